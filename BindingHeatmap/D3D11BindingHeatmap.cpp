@@ -0,0 +1,548 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/ResourceSize.h"
+#include "D3D11BindingHeatmap.h"
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+struct ResourceEntry
+{
+    ID3D11Resource *resource;   // 参照は持たない。破棄されたら OnDestroy() で消す
+    D3D11_RESOURCE_DIMENSION dimension;
+    std::string name;
+    size_t bytes;
+    size_t create_frame;
+    size_t last_used_frame;
+    size_t use_count;
+    size_t slot;                // g_bits のビット位置。破棄されたら他のリソースが使い回す
+
+    ResourceEntry()
+        : resource(NULL), dimension(D3D11_RESOURCE_DIMENSION_UNKNOWN), bytes(0)
+        , create_frame(0), last_used_frame(0), use_count(0), slot(0)
+    {}
+};
+
+typedef std::unordered_map<UINT64, ResourceEntry> ResourceTable; // key は D3D11GetObjectID()
+
+// 記録するリソースに付ける hook。id を振ってもらい、破棄の通知を受けるためだけのもの
+class BindingHeatmapBufferHook : public D3D11BufferHook {};
+class BindingHeatmapTexture1DHook : public D3D11Texture1DHook {};
+class BindingHeatmapTexture2DHook : public D3D11Texture2DHook {};
+class BindingHeatmapTexture3DHook : public D3D11Texture3DHook {};
+
+namespace {
+
+Mutex g_mutex;
+IDXGISwapChain *g_swapchain = NULL;
+ID3D11Device *g_device = NULL;
+ID3D11DeviceContext *g_context = NULL;
+ResourceTable g_resources;
+std::vector<UINT64> g_bits;         // このフレームに束縛されたリソースのビット列。ResourceEntry::slot で引く
+std::vector<UINT64> g_slot_ids;     // slot を使っているリソースの id。空いていれば 0
+std::vector<size_t> g_free_slots;
+size_t g_bound = 0;
+size_t g_destroyed_unused = 0;
+
+} // namespace
+
+
+void GetDebugName(ID3D11Resource *res, std::string &out)
+{
+    char name[256];
+    UINT size = sizeof(name)-1;
+    if(SUCCEEDED(res->GetPrivateData(WKPDID_D3DDebugObjectName, &size, name))) {
+        name[size] = '\0';
+        out = name;
+    }
+}
+
+size_t EstimateSize(ID3D11Resource *res, D3D11_RESOURCE_DIMENSION dim)
+{
+    switch(dim) {
+    case D3D11_RESOURCE_DIMENSION_BUFFER:
+        { D3D11_BUFFER_DESC desc; static_cast<ID3D11Buffer*>(res)->GetDesc(&desc); return EstimateResourceSize(desc); }
+    case D3D11_RESOURCE_DIMENSION_TEXTURE1D:
+        { D3D11_TEXTURE1D_DESC desc; static_cast<ID3D11Texture1D*>(res)->GetDesc(&desc); return EstimateResourceSize(desc); }
+    case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+        { D3D11_TEXTURE2D_DESC desc; static_cast<ID3D11Texture2D*>(res)->GetDesc(&desc); return EstimateResourceSize(desc); }
+    case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+        { D3D11_TEXTURE3D_DESC desc; static_cast<ID3D11Texture3D*>(res)->GetDesc(&desc); return EstimateResourceSize(desc); }
+    }
+    return 0;
+}
+
+// hook して記録を始め、id を返します
+UINT64 WatchResource(ID3D11Resource *res)
+{
+    // pool を持つ layer などは、記録済みのリソースを作成結果として返すことがある
+    UINT64 id = D3D11GetObjectID(res);
+    if(id!=0 && g_resources.find(id)!=g_resources.end()) { return id; }
+
+    D3D11_RESOURCE_DIMENSION dim;
+    res->GetType(&dim);
+    switch(dim) {
+    case D3D11_RESOURCE_DIMENSION_BUFFER:    D3D11SetHook<BindingHeatmapBufferHook>(static_cast<ID3D11Buffer*>(res)); break;
+    case D3D11_RESOURCE_DIMENSION_TEXTURE1D: D3D11SetHook<BindingHeatmapTexture1DHook>(static_cast<ID3D11Texture1D*>(res)); break;
+    case D3D11_RESOURCE_DIMENSION_TEXTURE2D: D3D11SetHook<BindingHeatmapTexture2DHook>(static_cast<ID3D11Texture2D*>(res)); break;
+    case D3D11_RESOURCE_DIMENSION_TEXTURE3D: D3D11SetHook<BindingHeatmapTexture3DHook>(static_cast<ID3D11Texture3D*>(res)); break;
+    default: return 0;
+    }
+
+    D3D11ObjectInfo info;
+    if(!D3D11GetObjectInfo(res, info)) { return 0; }
+    // slot は破棄されたリソースのものを使い回すので、g_bits は生存中のリソースの数までしか伸びない
+    size_t slot;
+    if(!g_free_slots.empty()) {
+        slot = g_free_slots.back();
+        g_free_slots.pop_back();
+        g_slot_ids[slot] = info.id;
+    }
+    else {
+        slot = g_slot_ids.size();
+        g_slot_ids.push_back(info.id);
+        if(slot/64>=g_bits.size()) { g_bits.resize(slot/64+1, 0); }
+    }
+
+    ResourceEntry &e = g_resources[info.id];
+    e.slot = slot;
+    e.resource = res;
+    e.dimension = dim;
+    e.bytes = EstimateSize(res, dim);
+    e.create_frame = info.create_frame;
+    GetDebugName(res, e.name);
+    return info.id;
+}
+
+void UnwatchResource(const ResourceEntry &e)
+{
+    switch(e.dimension) {
+    case D3D11_RESOURCE_DIMENSION_BUFFER:    D3D11RemoveHook<BindingHeatmapBufferHook>(e.resource); break;
+    case D3D11_RESOURCE_DIMENSION_TEXTURE1D: D3D11RemoveHook<BindingHeatmapTexture1DHook>(e.resource); break;
+    case D3D11_RESOURCE_DIMENSION_TEXTURE2D: D3D11RemoveHook<BindingHeatmapTexture2DHook>(e.resource); break;
+    case D3D11_RESOURCE_DIMENSION_TEXTURE3D: D3D11RemoveHook<BindingHeatmapTexture3DHook>(e.resource); break;
+    }
+}
+
+void OnDestroy(const void *, const D3D11ObjectInfo &info)
+{
+    ScopedLock lock(g_mutex);
+    ResourceTable::iterator i = g_resources.find(info.id);
+    if(i!=g_resources.end()) {
+        if(i->second.use_count==0) { ++g_destroyed_unused; }
+        // フレーム中に束縛されていても、slot を使い回すリソースに付かないよう落としておく
+        size_t slot = i->second.slot;
+        g_bits[slot/64] &= ~(UINT64(1) << (slot%64));
+        g_slot_ids[slot] = 0;
+        g_free_slots.push_back(slot);
+        g_resources.erase(i);
+    }
+}
+
+void MarkResource(ID3D11Resource *res)
+{
+    if(res==NULL) { return; }
+
+    UINT64 id = D3D11GetObjectID(res);
+    ResourceTable::iterator i = id!=0 ? g_resources.find(id) : g_resources.end();
+    if(i==g_resources.end()) {
+        // 初期化前に作られたか、他の layer だけが hook しているリソース
+        id = WatchResource(res);
+        if(id==0) { return; }
+        i = g_resources.find(id);
+    }
+    size_t slot = i->second.slot;
+    g_bits[slot/64] |= UINT64(1) << (slot%64);
+}
+
+// GetResource() で増えた参照の Release() は他の layer の hook を通り、そちらの lock を取るので、
+// g_mutex を持たずに呼びます (OnDestroy() はそれらの lock を持ったまま g_mutex を取るため、逆順になるとデッドロックする)
+template<class View>
+void MarkView(View *view)
+{
+    if(view==NULL) { return; }
+    ID3D11Resource *res = NULL;
+    view->GetResource(&res);
+    if(res!=NULL) {
+        {
+            ScopedLock lock(g_mutex);
+            MarkResource(res);
+        }
+        res->Release();
+    }
+}
+
+template<class View>
+void MarkViews(UINT num, View *const *views)
+{
+    if(views==NULL) { return; }
+    for(UINT i=0; i<num; ++i) { MarkView(views[i]); }
+}
+
+void MarkBuffers(UINT num, ID3D11Buffer *const *buffers)
+{
+    if(buffers==NULL) { return; }
+    for(UINT i=0; i<num; ++i) { MarkResource(buffers[i]); }
+}
+
+// フレーム中に立ったビットをリソースごとの記録に反映し、ビット列を空にします
+void EndFrame(size_t frame)
+{
+    g_bound = 0;
+    for(size_t w=0; w<g_bits.size(); ++w) {
+        UINT64 bits = g_bits[w];
+        if(bits==0) { continue; }
+        g_bits[w] = 0;
+        for(UINT b=0; b<64; ++b) {
+            if((bits & (UINT64(1)<<b))==0) { continue; }
+            ResourceTable::iterator i = g_resources.find(g_slot_ids[w*64+b]);
+            if(i==g_resources.end()) { continue; }
+            ResourceEntry &e = i->second;
+            ++e.use_count;
+            e.last_used_frame = frame;
+            ++g_bound;
+            // 名前は後から付けられることがあるので、まだなければ取り直す
+            if(e.name.empty()) { GetDebugName(e.resource, e.name); }
+        }
+    }
+}
+
+bool IsIdle(const ResourceEntry &e, size_t frame)
+{
+    size_t last = e.use_count>0 ? e.last_used_frame : e.create_frame;
+    return frame-last >= D3D11BINDINGHEATMAP_IDLE_FRAMES;
+}
+
+
+class DeviceContextBindingHeatmap : public D3D11DeviceContextHook
+{
+typedef D3D11DeviceContextHook super;
+public:
+    virtual void STDMETHODCALLTYPE VSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        MarkViews(NumViews, ppShaderResourceViews);
+        super::VSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+    virtual void STDMETHODCALLTYPE HSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        MarkViews(NumViews, ppShaderResourceViews);
+        super::HSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+    virtual void STDMETHODCALLTYPE DSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        MarkViews(NumViews, ppShaderResourceViews);
+        super::DSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+    virtual void STDMETHODCALLTYPE GSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        MarkViews(NumViews, ppShaderResourceViews);
+        super::GSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+    virtual void STDMETHODCALLTYPE PSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        MarkViews(NumViews, ppShaderResourceViews);
+        super::PSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+    virtual void STDMETHODCALLTYPE CSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        MarkViews(NumViews, ppShaderResourceViews);
+        super::CSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+
+    virtual void STDMETHODCALLTYPE VSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        { ScopedLock lock(g_mutex); MarkBuffers(NumBuffers, ppConstantBuffers); }
+        super::VSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE HSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        { ScopedLock lock(g_mutex); MarkBuffers(NumBuffers, ppConstantBuffers); }
+        super::HSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE DSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        { ScopedLock lock(g_mutex); MarkBuffers(NumBuffers, ppConstantBuffers); }
+        super::DSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE GSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        { ScopedLock lock(g_mutex); MarkBuffers(NumBuffers, ppConstantBuffers); }
+        super::GSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE PSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        { ScopedLock lock(g_mutex); MarkBuffers(NumBuffers, ppConstantBuffers); }
+        super::PSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE CSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        { ScopedLock lock(g_mutex); MarkBuffers(NumBuffers, ppConstantBuffers); }
+        super::CSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+
+    virtual void STDMETHODCALLTYPE IASetVertexBuffers(
+        UINT StartSlot,
+        UINT NumBuffers,
+        ID3D11Buffer *const *ppVertexBuffers,
+        const UINT *pStrides,
+        const UINT *pOffsets)
+    {
+        { ScopedLock lock(g_mutex); MarkBuffers(NumBuffers, ppVertexBuffers); }
+        super::IASetVertexBuffers(StartSlot, NumBuffers, ppVertexBuffers, pStrides, pOffsets);
+    }
+
+    virtual void STDMETHODCALLTYPE IASetIndexBuffer(
+        ID3D11Buffer *pIndexBuffer,
+        DXGI_FORMAT Format,
+        UINT Offset)
+    {
+        { ScopedLock lock(g_mutex); MarkResource(pIndexBuffer); }
+        super::IASetIndexBuffer(pIndexBuffer, Format, Offset);
+    }
+
+    virtual void STDMETHODCALLTYPE OMSetRenderTargets(
+        UINT NumViews,
+        ID3D11RenderTargetView *const *ppRenderTargetViews,
+        ID3D11DepthStencilView *pDepthStencilView)
+    {
+        MarkViews(NumViews, ppRenderTargetViews);
+        MarkView(pDepthStencilView);
+        super::OMSetRenderTargets(NumViews, ppRenderTargetViews, pDepthStencilView);
+    }
+
+    virtual void STDMETHODCALLTYPE OMSetRenderTargetsAndUnorderedAccessViews(
+        UINT NumRTVs,
+        ID3D11RenderTargetView *const *ppRenderTargetViews,
+        ID3D11DepthStencilView *pDepthStencilView,
+        UINT UAVStartSlot,
+        UINT NumUAVs,
+        ID3D11UnorderedAccessView *const *ppUnorderedAccessViews,
+        const UINT *pUAVInitialCounts)
+    {
+        if(NumRTVs!=D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL) {
+            MarkViews(NumRTVs, ppRenderTargetViews);
+            MarkView(pDepthStencilView);
+        }
+        if(NumUAVs!=D3D11_KEEP_UNORDERED_ACCESS_VIEWS) {
+            MarkViews(NumUAVs, ppUnorderedAccessViews);
+        }
+        super::OMSetRenderTargetsAndUnorderedAccessViews(NumRTVs, ppRenderTargetViews, pDepthStencilView,
+            UAVStartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+    }
+
+    virtual void STDMETHODCALLTYPE CSSetUnorderedAccessViews(
+        UINT StartSlot,
+        UINT NumUAVs,
+        ID3D11UnorderedAccessView *const *ppUnorderedAccessViews,
+        const UINT *pUAVInitialCounts)
+    {
+        MarkViews(NumUAVs, ppUnorderedAccessViews);
+        super::CSSetUnorderedAccessViews(StartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+    }
+};
+
+class DeviceBindingHeatmap : public D3D11DeviceHook
+{
+typedef D3D11DeviceHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE CreateBuffer(
+        const D3D11_BUFFER_DESC *pDesc,
+        const D3D11_SUBRESOURCE_DATA *pInitialData,
+        ID3D11Buffer **ppBuffer)
+    {
+        HRESULT r = super::CreateBuffer(pDesc, pInitialData, ppBuffer);
+        if(r==S_OK && ppBuffer!=NULL) { ScopedLock lock(g_mutex); WatchResource(*ppBuffer); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateTexture1D(
+        const D3D11_TEXTURE1D_DESC *pDesc,
+        const D3D11_SUBRESOURCE_DATA *pInitialData,
+        ID3D11Texture1D **ppTexture1D)
+    {
+        HRESULT r = super::CreateTexture1D(pDesc, pInitialData, ppTexture1D);
+        if(r==S_OK && ppTexture1D!=NULL) { ScopedLock lock(g_mutex); WatchResource(*ppTexture1D); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateTexture2D(
+        const D3D11_TEXTURE2D_DESC *pDesc,
+        const D3D11_SUBRESOURCE_DATA *pInitialData,
+        ID3D11Texture2D **ppTexture2D)
+    {
+        HRESULT r = super::CreateTexture2D(pDesc, pInitialData, ppTexture2D);
+        if(r==S_OK && ppTexture2D!=NULL) { ScopedLock lock(g_mutex); WatchResource(*ppTexture2D); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateTexture3D(
+        const D3D11_TEXTURE3D_DESC *pDesc,
+        const D3D11_SUBRESOURCE_DATA *pInitialData,
+        ID3D11Texture3D **ppTexture3D)
+    {
+        HRESULT r = super::CreateTexture3D(pDesc, pInitialData, ppTexture3D);
+        if(r==S_OK && ppTexture3D!=NULL) { ScopedLock lock(g_mutex); WatchResource(*ppTexture3D); }
+        return r;
+    }
+};
+
+class SwapChainBindingHeatmap : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        {
+            ScopedLock lock(g_mutex);
+            EndFrame(D3D11GetFrame());
+        }
+        return super::Present(SyncInterval, Flags);
+    }
+};
+
+
+bool _D3D11BindingHeatmapInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice)
+{
+    if(g_device!=NULL) { return false; }
+
+    g_swapchain = pSwapChain;
+    g_device = pDevice;
+    pDevice->GetImmediateContext(&g_context);
+    D3D11AddObjectDestroyCallback(OnDestroy);
+    D3D11SetHook<SwapChainBindingHeatmap>(pSwapChain);
+    D3D11SetHook<DeviceBindingHeatmap>(pDevice);
+    D3D11SetHook<DeviceContextBindingHeatmap>(g_context);
+    return true;
+}
+
+void _D3D11BindingHeatmapFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    ScopedLock lock(g_mutex);
+    D3D11RemoveObjectDestroyCallback(OnDestroy);
+    for(ResourceTable::const_iterator i=g_resources.begin(); i!=g_resources.end(); ++i) {
+        UnwatchResource(i->second);
+    }
+    g_resources.clear();
+    g_bits.clear();
+    g_slot_ids.clear();
+    g_free_slots.clear();
+    g_bound = 0;
+    g_destroyed_unused = 0;
+
+    D3D11RemoveHook<SwapChainBindingHeatmap>(g_swapchain);
+    D3D11RemoveHook<DeviceBindingHeatmap>(g_device);
+    D3D11RemoveHook<DeviceContextBindingHeatmap>(g_context);
+    g_context->Release();
+    g_context = NULL;
+    g_swapchain = NULL;
+    g_device = NULL;
+}
+
+ID3D11Device* _D3D11BindingHeatmapGetDevice()
+{
+    ScopedLock lock(g_mutex);
+    return g_device;
+}
+
+size_t _D3D11BindingHeatmapGetResources(D3D11BindingHeatmapResource *out, size_t max_num)
+{
+    ScopedLock lock(g_mutex);
+    size_t n = 0;
+    for(ResourceTable::const_iterator i=g_resources.begin(); i!=g_resources.end() && n<max_num; ++i, ++n) {
+        const ResourceEntry &e = i->second;
+        D3D11BindingHeatmapResource &o = out[n];
+        o.resource = e.resource;
+        o.id = i->first;
+        strncpy_s(o.name, e.name.c_str(), _TRUNCATE);
+        o.dimension = e.dimension;
+        o.bytes = e.bytes;
+        o.create_frame = e.create_frame;
+        o.last_used_frame = e.last_used_frame;
+        o.use_count = e.use_count;
+    }
+    return g_resources.size();
+}
+
+void _D3D11BindingHeatmapGetStats(D3D11BindingHeatmapStats &out)
+{
+    ScopedLock lock(g_mutex);
+    memset(&out, 0, sizeof(out));
+    out.frame = D3D11GetFrame();
+    out.num_resources = g_resources.size();
+    out.bound = g_bound;
+    out.destroyed_unused = g_destroyed_unused;
+    for(ResourceTable::const_iterator i=g_resources.begin(); i!=g_resources.end(); ++i) {
+        const ResourceEntry &e = i->second;
+        out.total_bytes += e.bytes;
+        if(IsIdle(e, out.frame)) {
+            ++out.idle;
+            out.idle_bytes += e.bytes;
+        }
+    }
+}
+
+void _D3D11BindingHeatmapPrintStats()
+{
+    D3D11BindingHeatmapStats stats;
+    _D3D11BindingHeatmapGetStats(stats);
+
+    char buf[512];
+    sprintf_s(buf, "D3D11BindingHeatmapPrintStats(): Frame=%Iu Resources=%Iu (%.2fMB) Bound=%Iu Idle=%Iu (%.2fMB) DestroyedUnused=%Iu\n",
+        stats.frame, stats.num_resources, double(stats.total_bytes)/(1024.0*1024.0), stats.bound,
+        stats.idle, double(stats.idle_bytes)/(1024.0*1024.0), stats.destroyed_unused);
+    OutputDebugStringA(buf);
+}
+
+bool _D3D11BindingHeatmapSetEvictionPriority(UINT64 id, UINT priority)
+{
+    // 破棄と競合しないよう、ロックしたまま呼ぶ
+    ScopedLock lock(g_mutex);
+    ResourceTable::iterator i = g_resources.find(id);
+    if(i==g_resources.end()) { return false; }
+    i->second.resource->SetEvictionPriority(priority);
+    return true;
+}
+
+bool GreaterBytes(const ResourceEntry *a, const ResourceEntry *b)
+{
+    return a->bytes > b->bytes;
+}
+
+void _D3D11BindingHeatmapPrintIdleResources(size_t max_num)
+{
+    ScopedLock lock(g_mutex);
+    size_t frame = D3D11GetFrame();
+    std::vector<const ResourceEntry*> sorted;
+    for(ResourceTable::const_iterator i=g_resources.begin(); i!=g_resources.end(); ++i) {
+        if(IsIdle(i->second, frame)) { sorted.push_back(&i->second); }
+    }
+    std::sort(sorted.begin(), sorted.end(), GreaterBytes);
+
+    std::string str;
+    char buf[512];
+    sprintf_s(buf, "D3D11BindingHeatmapPrintIdleResources(): %Iu resources not bound for %d frames, Frame=%Iu\n",
+        sorted.size(), D3D11BINDINGHEATMAP_IDLE_FRAMES, frame);
+    str += buf;
+    for(size_t i=0; i<sorted.size() && i<max_num; ++i) {
+        const ResourceEntry &e = *sorted[i];
+        if(e.use_count==0) {
+            sprintf_s(buf, "  0x%p %s: %.2fKB, never bound (created frame %Iu)\n",
+                e.resource, e.name.c_str(), double(e.bytes)/1024.0, e.create_frame);
+        }
+        else {
+            sprintf_s(buf, "  0x%p %s: %.2fKB, last bound frame %Iu, bound in %Iu frames\n",
+                e.resource, e.name.c_str(), double(e.bytes)/1024.0, e.last_used_frame, e.use_count);
+        }
+        str += buf;
+    }
+    str += "\n";
+    OutputDebugStringA(str.c_str());
+}
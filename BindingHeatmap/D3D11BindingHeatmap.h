@@ -0,0 +1,88 @@
+﻿#ifndef _ist_D3D11BindingHeatmap_h_
+#define _ist_D3D11BindingHeatmap_h_
+#include <D3D11.h>
+
+// immediate context に束縛されたリソースをフレームごとに記録し、リソースごとに最後に使われたフレームと使われたフレーム数を集計します。
+// 作成されたまま一度も使われない、あるいは長い間使われていないリソースを見つけて、ストリーミングや常駐の判断に使うためのものです。
+//
+// - 対象は *SetShaderResources()/*SetConstantBuffers()/IASetVertexBuffers()/IASetIndexBuffer()/OMSetRenderTargets*()/
+//   CSSetUnorderedAccessViews() で束縛されたリソースです。view はその元のリソースとして数えます
+// - リソースは作成時 (device の CreateBuffer()/CreateTexture*()) か、初期化前に作られたものは最初に束縛されたときに hook し、
+//   D3D11GetObjectID() の id で識別します。束縛の記録は、リソースごとに振った番号 (破棄されたら使い回す) の位置で
+//   フレームごとのビット列に立てるだけです。確保を伴うのは、まだ記録していないリソース (初期化前に作られたものなど) が最初に束縛されたときだけです
+// - 集計は Present() で行い、フレームは D3D11GetFrame() の値です
+// - deferred context での束縛は記録しません
+//
+// 有効にするには、このファイルを include する前に D3D11BINDINGHEATMAP_ENABLE を define しておく必要があります。
+// D3D11BINDINGHEATMAP_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+// この数のフレームの間束縛されなかったリソースを、使われていないとみなします
+#ifndef D3D11BINDINGHEATMAP_IDLE_FRAMES
+#define D3D11BINDINGHEATMAP_IDLE_FRAMES 300
+#endif
+#ifndef D3D11BINDINGHEATMAP_MAX_NAME
+#define D3D11BINDINGHEATMAP_MAX_NAME 64
+#endif
+
+struct D3D11BindingHeatmapResource
+{
+    const void *resource;
+    UINT64 id;                  // D3D11GetObjectID()
+    char name[D3D11BINDINGHEATMAP_MAX_NAME]; // WKPDID_D3DDebugObjectName
+    D3D11_RESOURCE_DIMENSION dimension;
+    size_t bytes;               // EstimateResourceSize() の結果
+    size_t create_frame;        // hook したフレーム
+    size_t last_used_frame;     // 最後に束縛されたフレーム。use_count==0 なら意味を持たない
+    size_t use_count;           // 束縛されたフレーム数
+};
+
+struct D3D11BindingHeatmapStats
+{
+    size_t frame;
+    size_t num_resources;   // 記録しているリソースの数
+    size_t total_bytes;
+    size_t bound;           // 直前のフレームで束縛されたリソースの数
+    size_t idle;            // D3D11BINDINGHEATMAP_IDLE_FRAMES フレーム以上束縛されていないリソースの数
+    size_t idle_bytes;
+    size_t destroyed_unused; // 一度も束縛されずに破棄されたリソースの数
+};
+
+#ifdef D3D11BINDINGHEATMAP_ENABLE
+
+bool _D3D11BindingHeatmapInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice);
+void _D3D11BindingHeatmapFinalize();
+// 記録中の device を返します。初期化されていなければ NULL
+ID3D11Device* _D3D11BindingHeatmapGetDevice();
+// 記録しているリソースを、最大 max_num 個 out に格納します。戻り値はリソースの総数です
+size_t _D3D11BindingHeatmapGetResources(D3D11BindingHeatmapResource *out, size_t max_num);
+void _D3D11BindingHeatmapGetStats(D3D11BindingHeatmapStats &out);
+void _D3D11BindingHeatmapPrintStats();
+// D3D11BINDINGHEATMAP_IDLE_FRAMES フレーム以上束縛されていないリソースを、サイズの大きい順に上位 max_num 個表示します
+void _D3D11BindingHeatmapPrintIdleResources(size_t max_num=50);
+// 記録しているリソースの SetEvictionPriority() を呼びます。id のリソースが既に破棄されていれば false を返します
+bool _D3D11BindingHeatmapSetEvictionPriority(UINT64 id, UINT priority);
+
+#define D3D11BindingHeatmapInitialize(...)          _D3D11BindingHeatmapInitialize(__VA_ARGS__)
+#define D3D11BindingHeatmapFinalize()               _D3D11BindingHeatmapFinalize()
+#define D3D11BindingHeatmapGetDevice()              _D3D11BindingHeatmapGetDevice()
+#define D3D11BindingHeatmapGetResources(...)        _D3D11BindingHeatmapGetResources(__VA_ARGS__)
+#define D3D11BindingHeatmapGetStats(...)            _D3D11BindingHeatmapGetStats(__VA_ARGS__)
+#define D3D11BindingHeatmapPrintStats()             _D3D11BindingHeatmapPrintStats()
+#define D3D11BindingHeatmapPrintIdleResources(...)  _D3D11BindingHeatmapPrintIdleResources(__VA_ARGS__)
+#define D3D11BindingHeatmapSetEvictionPriority(...) _D3D11BindingHeatmapSetEvictionPriority(__VA_ARGS__)
+
+#else // D3D11BINDINGHEATMAP_ENABLE
+
+#define D3D11BindingHeatmapInitialize(...)
+#define D3D11BindingHeatmapFinalize()
+#define D3D11BindingHeatmapGetDevice()              NULL
+#define D3D11BindingHeatmapGetResources(...)        0
+#define D3D11BindingHeatmapGetStats(...)
+#define D3D11BindingHeatmapPrintStats()
+#define D3D11BindingHeatmapPrintIdleResources(...)
+#define D3D11BindingHeatmapSetEvictionPriority(...) false
+
+#endif // D3D11BINDINGHEATMAP_ENABLE
+
+#endif // _ist_D3D11BindingHeatmap_h_
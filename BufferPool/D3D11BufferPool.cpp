@@ -0,0 +1,284 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Hash.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/ResourceSize.h"
+#include "D3D11BufferPool.h"
+#include <string.h>
+#include <stdio.h>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+
+
+// pool が管理しているバッファ。pool 自身も参照を 1 つ保持しています
+struct PooledBuffer
+{
+    D3D11_BUFFER_DESC desc;
+    uint64_t hash;
+    size_t bytes;
+    bool free;
+};
+
+struct FreeBuffer
+{
+    ID3D11Buffer *buffer;
+    size_t frame; // 解放されたフレーム
+};
+
+typedef std::unordered_map<ID3D11Buffer*, PooledBuffer> PooledBuffers;
+typedef std::deque<FreeBuffer> FreeList; // 先頭ほど古い
+typedef std::unordered_map<uint64_t, FreeList> FreeLists; // key は desc のハッシュ
+
+namespace {
+
+Mutex g_mutex;
+PooledBuffers g_buffers;
+FreeLists g_free_lists;
+IDXGISwapChain *g_swapchain = NULL;
+ID3D11Device *g_device = NULL;
+int g_opt = 0;
+size_t g_frame = 0;
+
+size_t g_hits = 0;
+size_t g_misses = 0;
+size_t g_num_free = 0;
+size_t g_free_bytes = 0;
+
+} // namespace
+
+
+class BufferPoolHook : public D3D11BufferHook
+{
+typedef D3D11BufferHook super;
+public:
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        ScopedLock lock(g_mutex);
+        ULONG r = super::Release();
+        // pool の参照だけが残ったら空きリストへ
+        if(r==1) {
+            PooledBuffers::iterator i = g_buffers.find(this);
+            if(i!=g_buffers.end() && !i->second.free) {
+                PooledBuffer &pb = i->second;
+                pb.free = true;
+                FreeBuffer fb = { this, g_frame };
+                g_free_lists[pb.hash].push_back(fb);
+                ++g_num_free;
+                g_free_bytes += pb.bytes;
+            }
+        }
+        return r;
+    }
+};
+
+
+bool IsPoolable(const D3D11_BUFFER_DESC &desc, const D3D11_SUBRESOURCE_DATA *pInitialData)
+{
+    if(desc.Usage!=D3D11_USAGE_DEFAULT && desc.Usage!=D3D11_USAGE_DYNAMIC) { return false; }
+    // view はバッファを内部参照だけで保持するので、Release() の hook からは view の生存が分からない
+    if((desc.BindFlags & (D3D11_BIND_SHADER_RESOURCE|D3D11_BIND_UNORDERED_ACCESS))!=0) { return false; }
+    if((desc.MiscFlags & (D3D11_RESOURCE_MISC_SHARED|D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX|D3D11_RESOURCE_MISC_GDI_COMPATIBLE))!=0) { return false; }
+    if(pInitialData!=NULL && (g_opt & D3D11BP_POOL_INITIAL_DATA)==0) { return false; }
+    return true;
+}
+
+// pool から外して pool の参照を解放します。空きのバッファなら実際に破棄されます
+void ReleasePooledBuffer(ID3D11Buffer *buffer)
+{
+    PooledBuffers::iterator i = g_buffers.find(buffer);
+    if(i==g_buffers.end()) { return; }
+    if(i->second.free) {
+        --g_num_free;
+        g_free_bytes -= i->second.bytes;
+    }
+    g_buffers.erase(i);
+    D3D11RemoveHook<BufferPoolHook>(buffer);
+    buffer->Release();
+}
+
+// D3D11BUFFERPOOL_FRAME_LATENCY フレーム以上前に解放された、desc が一致する空きバッファを取り出します
+ID3D11Buffer* PopFreeBuffer(const D3D11_BUFFER_DESC &desc, uint64_t hash)
+{
+    FreeLists::iterator l = g_free_lists.find(hash);
+    if(l==g_free_lists.end() || l->second.empty()) { return NULL; }
+
+    FreeBuffer &fb = l->second.front();
+    if(fb.frame+D3D11BUFFERPOOL_FRAME_LATENCY > g_frame) { return NULL; }
+    PooledBuffer &pb = g_buffers[fb.buffer];
+    if(memcmp(&pb.desc, &desc, sizeof(desc))!=0) { return NULL; } // ハッシュの衝突
+
+    ID3D11Buffer *buffer = fb.buffer;
+    l->second.pop_front();
+    pb.free = false;
+    --g_num_free;
+    g_free_bytes -= pb.bytes;
+    return buffer;
+}
+
+bool UploadInitialData(ID3D11Buffer *buffer, const D3D11_BUFFER_DESC &desc, const D3D11_SUBRESOURCE_DATA *pInitialData)
+{
+    bool ret = true;
+    ID3D11DeviceContext *ctx = NULL;
+    g_device->GetImmediateContext(&ctx);
+    if(desc.Usage==D3D11_USAGE_DYNAMIC) {
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if(SUCCEEDED(ctx->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+            memcpy(mapped.pData, pInitialData->pSysMem, desc.ByteWidth);
+            ctx->Unmap(buffer, 0);
+        }
+        else {
+            ret = false;
+        }
+    }
+    else {
+        ctx->UpdateSubresource(buffer, 0, NULL, pInitialData->pSysMem, 0, 0);
+    }
+    ctx->Release();
+    return ret;
+}
+
+// 空きになってから D3D11BUFFERPOOL_MAX_AGE フレーム経ったバッファを解放します
+void ReleaseOldBuffers()
+{
+    for(FreeLists::iterator l=g_free_lists.begin(); l!=g_free_lists.end(); ) {
+        FreeList &fl = l->second;
+        while(!fl.empty() && fl.front().frame+D3D11BUFFERPOOL_MAX_AGE < g_frame) {
+            ID3D11Buffer *buffer = fl.front().buffer;
+            fl.pop_front();
+            ReleasePooledBuffer(buffer);
+        }
+        if(fl.empty()) { l = g_free_lists.erase(l); }
+        else { ++l; }
+    }
+}
+
+
+class DeviceBufferPool : public D3D11DeviceHook
+{
+typedef D3D11DeviceHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE CreateBuffer(
+        const D3D11_BUFFER_DESC *pDesc,
+        const D3D11_SUBRESOURCE_DATA *pInitialData,
+        ID3D11Buffer **ppBuffer)
+    {
+        if(pDesc==NULL || ppBuffer==NULL || !IsPoolable(*pDesc, pInitialData)) {
+            return super::CreateBuffer(pDesc, pInitialData, ppBuffer);
+        }
+
+        ScopedLock lock(g_mutex);
+        uint64_t hash = HashBytes(pDesc, sizeof(*pDesc));
+        ID3D11Buffer *pooled = PopFreeBuffer(*pDesc, hash);
+        if(pooled!=NULL) {
+            if(pInitialData==NULL || UploadInitialData(pooled, *pDesc, pInitialData)) {
+                ++g_hits;
+                pooled->AddRef();
+                *ppBuffer = pooled;
+                return S_OK;
+            }
+            ReleasePooledBuffer(pooled);
+        }
+
+        ++g_misses;
+        HRESULT r = super::CreateBuffer(pDesc, pInitialData, ppBuffer);
+        if(r==S_OK) {
+            ID3D11Buffer *buffer = *ppBuffer;
+            PooledBuffer &pb = g_buffers[buffer];
+            pb.desc = *pDesc;
+            pb.hash = hash;
+            pb.bytes = EstimateResourceSize(*pDesc);
+            pb.free = false;
+            buffer->AddRef();
+            D3D11SetHook<BufferPoolHook>(buffer);
+        }
+        return r;
+    }
+};
+
+class SwapChainBufferPool : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        {
+            ScopedLock lock(g_mutex);
+            ++g_frame;
+            ReleaseOldBuffers();
+        }
+        return super::Present(SyncInterval, Flags);
+    }
+};
+
+
+bool _D3D11BufferPoolInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, int opt)
+{
+    if(g_device!=NULL) { return false; }
+
+    g_swapchain = pSwapChain;
+    g_device = pDevice;
+    g_opt = opt;
+    D3D11SetHook<SwapChainBufferPool>(pSwapChain);
+    D3D11SetHook<DeviceBufferPool>(pDevice);
+    return true;
+}
+
+void _D3D11BufferPoolFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    ScopedLock lock(g_mutex);
+    D3D11RemoveHook<SwapChainBufferPool>(g_swapchain);
+    D3D11RemoveHook<DeviceBufferPool>(g_device);
+
+    // 使用中のバッファはアプリの参照が残っているので、pool の参照を外すだけになります
+    std::vector<ID3D11Buffer*> buffers;
+    buffers.reserve(g_buffers.size());
+    for(PooledBuffers::iterator i=g_buffers.begin(); i!=g_buffers.end(); ++i) {
+        buffers.push_back(i->first);
+    }
+    for(size_t i=0; i<buffers.size(); ++i) {
+        ReleasePooledBuffer(buffers[i]);
+    }
+    g_free_lists.clear();
+
+    g_swapchain = NULL;
+    g_device = NULL;
+    g_frame = 0;
+    g_hits = g_misses = 0;
+}
+
+void _D3D11BufferPoolTrim()
+{
+    ScopedLock lock(g_mutex);
+    for(FreeLists::iterator l=g_free_lists.begin(); l!=g_free_lists.end(); ++l) {
+        for(FreeList::iterator i=l->second.begin(); i!=l->second.end(); ++i) {
+            ReleasePooledBuffer(i->buffer);
+        }
+    }
+    g_free_lists.clear();
+}
+
+void _D3D11BufferPoolGetStats(D3D11BufferPoolStats &out)
+{
+    ScopedLock lock(g_mutex);
+    out.hits        = g_hits;
+    out.misses      = g_misses;
+    out.num_pooled  = g_buffers.size();
+    out.num_free    = g_num_free;
+    out.free_bytes  = g_free_bytes;
+}
+
+void _D3D11BufferPoolPrintStats()
+{
+    D3D11BufferPoolStats stats;
+    _D3D11BufferPoolGetStats(stats);
+
+    size_t total = stats.hits + stats.misses;
+    char buf[512];
+    sprintf_s(buf, "D3D11BufferPoolPrintStats(): Hits=%Iu Misses=%Iu HitRate=%.1f%% Pooled=%Iu Free=%Iu FreeSize=%Iu\n",
+        stats.hits, stats.misses, total>0 ? 100.0*stats.hits/total : 0.0, stats.num_pooled, stats.num_free, stats.free_bytes);
+    OutputDebugStringA(buf);
+}
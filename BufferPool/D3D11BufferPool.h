@@ -0,0 +1,73 @@
+﻿#ifndef _ist_D3D11BufferPool_h_
+#define _ist_D3D11BufferPool_h_
+#include <D3D11.h>
+
+// ID3D11Device::CreateBuffer() で作られたバッファを、アプリが最後の参照を Release() した後も pool に保持しておき、
+// 同じ D3D11_BUFFER_DESC の CreateBuffer() が来たら再利用します。アプリ側は変更なしで、毎フレーム同じ desc の
+// バッファを作って捨てるようなコードの生成コストをほぼ無くせます。
+// 解放されたバッファは D3D11BUFFERPOOL_FRAME_LATENCY 回 Present() されるまで再利用しません (GPU がまだ使っている可能性があるため)。
+// D3D11BUFFERPOOL_MAX_AGE フレームの間再利用されなかったバッファは本当に解放されます。
+//
+// 対象は D3D11_USAGE_DEFAULT / D3D11_USAGE_DYNAMIC で、MiscFlags に D3D11_RESOURCE_MISC_SHARED 系を含まないバッファです。
+// D3D11_BIND_SHADER_RESOURCE / D3D11_BIND_UNORDERED_ACCESS を含むバッファは対象外です
+// (バッファを解放しても view が生きている場合があり、pool からはそれを検出できないため)。
+// 初期データ付きの CreateBuffer() は、D3D11BP_POOL_INITIAL_DATA を指定した場合のみ対象になります。
+// 初期データは DEFAULT なら UpdateSubresource()、DYNAMIC なら Map(D3D11_MAP_WRITE_DISCARD) で immediate context から書き込むので、
+// 初期データ付きの CreateBuffer() を描画スレッドからしか呼ばないアプリでだけ指定してください。
+// なお、再利用されたバッファには以前の SetPrivateData() の内容 (デバッグ名など) が残ります。
+//
+// 有効にするには、このファイルを include する前に D3D11BUFFERPOOL_ENABLE を define しておく必要があります。
+// D3D11BUFFERPOOL_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+#ifndef D3D11BUFFERPOOL_FRAME_LATENCY
+#define D3D11BUFFERPOOL_FRAME_LATENCY 3
+#endif
+#ifndef D3D11BUFFERPOOL_MAX_AGE
+#define D3D11BUFFERPOOL_MAX_AGE 60
+#endif
+
+enum D3D11BP_OPTION {
+    D3D11BP_NONE = 0,
+
+    // 初期データ付きの CreateBuffer() も pool から返すか。
+    // 初期データの書き込みに immediate context を使うので、他のスレッドから CreateBuffer() が呼ばれると描画スレッドと競合します。
+    D3D11BP_POOL_INITIAL_DATA = 1,
+};
+
+struct D3D11BufferPoolStats
+{
+    size_t hits;            // pool から返した回数
+    size_t misses;          // 対象のバッファだが pool に無く、作成した回数
+    size_t num_pooled;      // pool が管理しているバッファの数 (使用中 + 空き)
+    size_t num_free;        // 空きのバッファの数
+    size_t free_bytes;      // 空きのバッファが保持しているメモリの推定値
+};
+
+#ifdef D3D11BUFFERPOOL_ENABLE
+
+// opt: D3D11BP_OPTION の bit の組み合わせ
+bool _D3D11BufferPoolInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, int opt=D3D11BP_NONE);
+void _D3D11BufferPoolFinalize();
+// 空きのバッファを全て解放します
+void _D3D11BufferPoolTrim();
+void _D3D11BufferPoolGetStats(D3D11BufferPoolStats &out);
+void _D3D11BufferPoolPrintStats();
+
+#define D3D11BufferPoolInitialize(...)  _D3D11BufferPoolInitialize(__VA_ARGS__)
+#define D3D11BufferPoolFinalize()       _D3D11BufferPoolFinalize()
+#define D3D11BufferPoolTrim()           _D3D11BufferPoolTrim()
+#define D3D11BufferPoolGetStats(...)    _D3D11BufferPoolGetStats(__VA_ARGS__)
+#define D3D11BufferPoolPrintStats()     _D3D11BufferPoolPrintStats()
+
+#else // D3D11BUFFERPOOL_ENABLE
+
+#define D3D11BufferPoolInitialize(...)
+#define D3D11BufferPoolFinalize()
+#define D3D11BufferPoolTrim()
+#define D3D11BufferPoolGetStats(...)
+#define D3D11BufferPoolPrintStats()
+
+#endif // D3D11BUFFERPOOL_ENABLE
+
+#endif // _ist_D3D11BufferPool_h_
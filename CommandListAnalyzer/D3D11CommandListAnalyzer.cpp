@@ -0,0 +1,937 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/Timer.h"
+#include "D3D11CommandListAnalyzer.h"
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+
+enum CallKind {
+    CALL_OTHER,
+    CALL_STATE,
+    CALL_DRAW,
+};
+
+struct ContextRecord
+{
+    UINT64 id;
+    D3D11CommandListContextStats total;
+    // 記録中の command list
+    LONGLONG first_call;    // 0 ならまだ呼び出しがない
+    size_t calls;
+    size_t state_changes;
+    size_t draws;
+};
+
+struct ListRecord
+{
+    ID3D11CommandList *list;
+    size_t executes;
+    double execute_time;
+};
+
+// 記録するスレッドで、同じ deferred context への呼び出しをロックせずに数えておく領域
+struct PendingCalls
+{
+    ID3D11DeviceContext *context;
+    LONG generation;
+    LONGLONG first_call;
+    size_t calls;
+    size_t state_changes;
+    size_t draws;
+};
+
+typedef std::map<ID3D11DeviceContext*, ContextRecord> ContextTable;
+typedef std::unordered_map<UINT64, ListRecord> ListTable; // key は D3D11GetObjectID()
+typedef std::map<DWORD, D3D11CommandListThreadStats> ThreadTable;
+
+// command list の破棄を知るためだけの hook
+class CommandListAnalyzerHook : public D3D11CommandListHook {};
+class SwapChainCommandListAnalyzer : public DXGISwapChainHook {};
+
+namespace {
+
+Mutex g_mutex;
+IDXGISwapChain *g_swapchain = NULL;
+ID3D11Device *g_device = NULL;
+ID3D11DeviceContext *g_context = NULL;
+ContextTable g_contexts;
+ListTable g_lists;
+ThreadTable g_threads;
+D3D11CommandListStats g_stats;
+size_t g_first_frame = 0;
+volatile LONG g_generation = 0;     // D3D11CommandListAnalyzerInitialize() のたびに進め、古い PendingCalls を捨てる
+volatile LONG g_restore_pending = 0; // RestoreContextState=TRUE で戻したステートがまだ使われていない
+
+__declspec(thread) PendingCalls t_pending;
+
+} // namespace
+
+
+// g_mutex をロックした状態で呼ぶ
+void FlushPending()
+{
+    PendingCalls &p = t_pending;
+    if(p.context!=NULL && p.generation==g_generation && p.calls>0) {
+        ContextTable::iterator i = g_contexts.find(p.context);
+        if(i!=g_contexts.end()) {
+            ContextRecord &rec = i->second;
+            if(rec.first_call==0 || p.first_call<rec.first_call) { rec.first_call = p.first_call; }
+            rec.calls += p.calls;
+            rec.state_changes += p.state_changes;
+            rec.draws += p.draws;
+
+            D3D11CommandListThreadStats &ts = g_threads[GetCurrentThreadId()];
+            ts.calls += p.calls;
+            ts.state_changes += p.state_changes;
+            ts.draws += p.draws;
+        }
+    }
+    p.context = NULL;
+    p.generation = g_generation;
+    p.first_call = 0;
+    p.calls = p.state_changes = p.draws = 0;
+}
+
+// g_mutex をロックした状態で呼ぶ
+void ResolveRestore(bool needless)
+{
+    if(g_restore_pending==0) { return; }
+    g_restore_pending = 0;
+    if(needless) { ++g_stats.needless_restores; }
+}
+
+inline void CountCall(ID3D11DeviceContext *ctx, CallKind kind)
+{
+    if(ctx==g_context) {
+        // immediate context では、戻したステートが使われたかだけを見る
+        if(kind==CALL_DRAW && g_restore_pending!=0) {
+            ScopedLock lock(g_mutex);
+            ResolveRestore(false);
+        }
+        return;
+    }
+
+    PendingCalls &p = t_pending;
+    if(p.context!=ctx || p.generation!=g_generation) {
+        ScopedLock lock(g_mutex);
+        FlushPending();
+        p.context = ctx;
+    }
+    if(p.calls==0) { p.first_call = GetPerformanceCounter(); }
+    ++p.calls;
+    if(kind==CALL_STATE) { ++p.state_changes; }
+    if(kind==CALL_DRAW)  { ++p.draws; }
+}
+
+void OnDestroy(const void *pTarget, const D3D11ObjectInfo &info)
+{
+    ScopedLock lock(g_mutex);
+    ListTable::iterator l = g_lists.find(info.id);
+    if(l!=g_lists.end()) {
+        if(l->second.executes>=2) { ++g_stats.reused_lists; }
+        g_lists.erase(l);
+        return;
+    }
+    ContextTable::iterator c = g_contexts.find((ID3D11DeviceContext*)pTarget);
+    if(c!=g_contexts.end() && c->second.id==info.id) {
+        g_contexts.erase(c);
+    }
+}
+
+
+class DeviceContextCommandListAnalyzer : public D3D11DeviceContextHook
+{
+typedef D3D11DeviceContextHook super;
+public:
+    virtual void STDMETHODCALLTYPE IASetInputLayout(
+        ID3D11InputLayout *pInputLayout)
+    {
+        CountCall(this, CALL_STATE);
+        super::IASetInputLayout(pInputLayout);
+    }
+
+    virtual void STDMETHODCALLTYPE IASetVertexBuffers(
+        UINT StartSlot,
+        UINT NumBuffers,
+        ID3D11Buffer *const *ppVertexBuffers,
+        const UINT *pStrides,
+        const UINT *pOffsets)
+    {
+        CountCall(this, CALL_STATE);
+        super::IASetVertexBuffers(StartSlot, NumBuffers, ppVertexBuffers, pStrides, pOffsets);
+    }
+
+    virtual void STDMETHODCALLTYPE IASetIndexBuffer(
+        ID3D11Buffer *pIndexBuffer,
+        DXGI_FORMAT Format,
+        UINT Offset)
+    {
+        CountCall(this, CALL_STATE);
+        super::IASetIndexBuffer(pIndexBuffer, Format, Offset);
+    }
+
+    virtual void STDMETHODCALLTYPE IASetPrimitiveTopology(
+        D3D11_PRIMITIVE_TOPOLOGY Topology)
+    {
+        CountCall(this, CALL_STATE);
+        super::IASetPrimitiveTopology(Topology);
+    }
+
+    virtual void STDMETHODCALLTYPE VSSetShader(
+        ID3D11VertexShader *pVertexShader,
+        ID3D11ClassInstance *const *ppClassInstances,
+        UINT NumClassInstances)
+    {
+        CountCall(this, CALL_STATE);
+        super::VSSetShader(pVertexShader, ppClassInstances, NumClassInstances);
+    }
+
+    virtual void STDMETHODCALLTYPE VSSetShaderResources(
+        UINT StartSlot,
+        UINT NumViews,
+        ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        CountCall(this, CALL_STATE);
+        super::VSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+
+    virtual void STDMETHODCALLTYPE VSSetConstantBuffers(
+        UINT StartSlot,
+        UINT NumBuffers,
+        ID3D11Buffer *const *ppConstantBuffers)
+    {
+        CountCall(this, CALL_STATE);
+        super::VSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+
+    virtual void STDMETHODCALLTYPE VSSetSamplers(
+        UINT StartSlot,
+        UINT NumSamplers,
+        ID3D11SamplerState *const *ppSamplers)
+    {
+        CountCall(this, CALL_STATE);
+        super::VSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+    }
+
+    virtual void STDMETHODCALLTYPE HSSetShader(
+        ID3D11HullShader *pHullShader,
+        ID3D11ClassInstance *const *ppClassInstances,
+        UINT NumClassInstances)
+    {
+        CountCall(this, CALL_STATE);
+        super::HSSetShader(pHullShader, ppClassInstances, NumClassInstances);
+    }
+
+    virtual void STDMETHODCALLTYPE HSSetShaderResources(
+        UINT StartSlot,
+        UINT NumViews,
+        ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        CountCall(this, CALL_STATE);
+        super::HSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+
+    virtual void STDMETHODCALLTYPE HSSetConstantBuffers(
+        UINT StartSlot,
+        UINT NumBuffers,
+        ID3D11Buffer *const *ppConstantBuffers)
+    {
+        CountCall(this, CALL_STATE);
+        super::HSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+
+    virtual void STDMETHODCALLTYPE HSSetSamplers(
+        UINT StartSlot,
+        UINT NumSamplers,
+        ID3D11SamplerState *const *ppSamplers)
+    {
+        CountCall(this, CALL_STATE);
+        super::HSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+    }
+
+    virtual void STDMETHODCALLTYPE DSSetShader(
+        ID3D11DomainShader *pDomainShader,
+        ID3D11ClassInstance *const *ppClassInstances,
+        UINT NumClassInstances)
+    {
+        CountCall(this, CALL_STATE);
+        super::DSSetShader(pDomainShader, ppClassInstances, NumClassInstances);
+    }
+
+    virtual void STDMETHODCALLTYPE DSSetShaderResources(
+        UINT StartSlot,
+        UINT NumViews,
+        ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        CountCall(this, CALL_STATE);
+        super::DSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+
+    virtual void STDMETHODCALLTYPE DSSetConstantBuffers(
+        UINT StartSlot,
+        UINT NumBuffers,
+        ID3D11Buffer *const *ppConstantBuffers)
+    {
+        CountCall(this, CALL_STATE);
+        super::DSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+
+    virtual void STDMETHODCALLTYPE DSSetSamplers(
+        UINT StartSlot,
+        UINT NumSamplers,
+        ID3D11SamplerState *const *ppSamplers)
+    {
+        CountCall(this, CALL_STATE);
+        super::DSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+    }
+
+    virtual void STDMETHODCALLTYPE GSSetShader(
+        ID3D11GeometryShader *pShader,
+        ID3D11ClassInstance *const *ppClassInstances,
+        UINT NumClassInstances)
+    {
+        CountCall(this, CALL_STATE);
+        super::GSSetShader(pShader, ppClassInstances, NumClassInstances);
+    }
+
+    virtual void STDMETHODCALLTYPE GSSetShaderResources(
+        UINT StartSlot,
+        UINT NumViews,
+        ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        CountCall(this, CALL_STATE);
+        super::GSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+
+    virtual void STDMETHODCALLTYPE GSSetConstantBuffers(
+        UINT StartSlot,
+        UINT NumBuffers,
+        ID3D11Buffer *const *ppConstantBuffers)
+    {
+        CountCall(this, CALL_STATE);
+        super::GSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+
+    virtual void STDMETHODCALLTYPE GSSetSamplers(
+        UINT StartSlot,
+        UINT NumSamplers,
+        ID3D11SamplerState *const *ppSamplers)
+    {
+        CountCall(this, CALL_STATE);
+        super::GSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+    }
+
+    virtual void STDMETHODCALLTYPE PSSetShader(
+        ID3D11PixelShader *pPixelShader,
+        ID3D11ClassInstance *const *ppClassInstances,
+        UINT NumClassInstances)
+    {
+        CountCall(this, CALL_STATE);
+        super::PSSetShader(pPixelShader, ppClassInstances, NumClassInstances);
+    }
+
+    virtual void STDMETHODCALLTYPE PSSetShaderResources(
+        UINT StartSlot,
+        UINT NumViews,
+        ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        CountCall(this, CALL_STATE);
+        super::PSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+
+    virtual void STDMETHODCALLTYPE PSSetConstantBuffers(
+        UINT StartSlot,
+        UINT NumBuffers,
+        ID3D11Buffer *const *ppConstantBuffers)
+    {
+        CountCall(this, CALL_STATE);
+        super::PSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+
+    virtual void STDMETHODCALLTYPE PSSetSamplers(
+        UINT StartSlot,
+        UINT NumSamplers,
+        ID3D11SamplerState *const *ppSamplers)
+    {
+        CountCall(this, CALL_STATE);
+        super::PSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+    }
+
+    virtual void STDMETHODCALLTYPE CSSetShader(
+        ID3D11ComputeShader *pComputeShader,
+        ID3D11ClassInstance *const *ppClassInstances,
+        UINT NumClassInstances)
+    {
+        CountCall(this, CALL_STATE);
+        super::CSSetShader(pComputeShader, ppClassInstances, NumClassInstances);
+    }
+
+    virtual void STDMETHODCALLTYPE CSSetShaderResources(
+        UINT StartSlot,
+        UINT NumViews,
+        ID3D11ShaderResourceView *const *ppShaderResourceViews)
+    {
+        CountCall(this, CALL_STATE);
+        super::CSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+    }
+
+    virtual void STDMETHODCALLTYPE CSSetConstantBuffers(
+        UINT StartSlot,
+        UINT NumBuffers,
+        ID3D11Buffer *const *ppConstantBuffers)
+    {
+        CountCall(this, CALL_STATE);
+        super::CSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+
+    virtual void STDMETHODCALLTYPE CSSetSamplers(
+        UINT StartSlot,
+        UINT NumSamplers,
+        ID3D11SamplerState *const *ppSamplers)
+    {
+        CountCall(this, CALL_STATE);
+        super::CSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+    }
+
+    virtual void STDMETHODCALLTYPE CSSetUnorderedAccessViews(
+        UINT StartSlot,
+        UINT NumUAVs,
+        ID3D11UnorderedAccessView *const *ppUnorderedAccessViews,
+        const UINT *pUAVInitialCounts)
+    {
+        CountCall(this, CALL_STATE);
+        super::CSSetUnorderedAccessViews(StartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+    }
+
+    virtual void STDMETHODCALLTYPE OMSetRenderTargets(
+        UINT NumViews,
+        ID3D11RenderTargetView *const *ppRenderTargetViews,
+        ID3D11DepthStencilView *pDepthStencilView)
+    {
+        CountCall(this, CALL_STATE);
+        super::OMSetRenderTargets(NumViews, ppRenderTargetViews, pDepthStencilView);
+    }
+
+    virtual void STDMETHODCALLTYPE OMSetRenderTargetsAndUnorderedAccessViews(
+        UINT NumRTVs,
+        ID3D11RenderTargetView *const *ppRenderTargetViews,
+        ID3D11DepthStencilView *pDepthStencilView,
+        UINT UAVStartSlot,
+        UINT NumUAVs,
+        ID3D11UnorderedAccessView *const *ppUnorderedAccessViews,
+        const UINT *pUAVInitialCounts)
+    {
+        CountCall(this, CALL_STATE);
+        super::OMSetRenderTargetsAndUnorderedAccessViews(NumRTVs, ppRenderTargetViews, pDepthStencilView, UAVStartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+    }
+
+    virtual void STDMETHODCALLTYPE OMSetBlendState(
+        ID3D11BlendState *pBlendState,
+        const FLOAT BlendFactor[ 4 ],
+        UINT SampleMask)
+    {
+        CountCall(this, CALL_STATE);
+        super::OMSetBlendState(pBlendState, BlendFactor, SampleMask);
+    }
+
+    virtual void STDMETHODCALLTYPE OMSetDepthStencilState(
+        ID3D11DepthStencilState *pDepthStencilState,
+        UINT StencilRef)
+    {
+        CountCall(this, CALL_STATE);
+        super::OMSetDepthStencilState(pDepthStencilState, StencilRef);
+    }
+
+    virtual void STDMETHODCALLTYPE SOSetTargets(
+        UINT NumBuffers,
+        ID3D11Buffer *const *ppSOTargets,
+        const UINT *pOffsets)
+    {
+        CountCall(this, CALL_STATE);
+        super::SOSetTargets(NumBuffers, ppSOTargets, pOffsets);
+    }
+
+    virtual void STDMETHODCALLTYPE RSSetState(
+        ID3D11RasterizerState *pRasterizerState)
+    {
+        CountCall(this, CALL_STATE);
+        super::RSSetState(pRasterizerState);
+    }
+
+    virtual void STDMETHODCALLTYPE RSSetViewports(
+        UINT NumViewports,
+        const D3D11_VIEWPORT *pViewports)
+    {
+        CountCall(this, CALL_STATE);
+        super::RSSetViewports(NumViewports, pViewports);
+    }
+
+    virtual void STDMETHODCALLTYPE RSSetScissorRects(
+        UINT NumRects,
+        const D3D11_RECT *pRects)
+    {
+        CountCall(this, CALL_STATE);
+        super::RSSetScissorRects(NumRects, pRects);
+    }
+
+    virtual void STDMETHODCALLTYPE SetPredication(
+        ID3D11Predicate *pPredicate,
+        BOOL PredicateValue)
+    {
+        CountCall(this, CALL_STATE);
+        super::SetPredication(pPredicate, PredicateValue);
+    }
+
+    virtual void STDMETHODCALLTYPE Draw(
+        UINT VertexCount,
+        UINT StartVertexLocation)
+    {
+        CountCall(this, CALL_DRAW);
+        super::Draw(VertexCount, StartVertexLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawIndexed(
+        UINT IndexCount,
+        UINT StartIndexLocation,
+        INT BaseVertexLocation)
+    {
+        CountCall(this, CALL_DRAW);
+        super::DrawIndexed(IndexCount, StartIndexLocation, BaseVertexLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawInstanced(
+        UINT VertexCountPerInstance,
+        UINT InstanceCount,
+        UINT StartVertexLocation,
+        UINT StartInstanceLocation)
+    {
+        CountCall(this, CALL_DRAW);
+        super::DrawInstanced(VertexCountPerInstance, InstanceCount, StartVertexLocation, StartInstanceLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawIndexedInstanced(
+        UINT IndexCountPerInstance,
+        UINT InstanceCount,
+        UINT StartIndexLocation,
+        INT BaseVertexLocation,
+        UINT StartInstanceLocation)
+    {
+        CountCall(this, CALL_DRAW);
+        super::DrawIndexedInstanced(IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation, StartInstanceLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawAuto(void)
+    {
+        CountCall(this, CALL_DRAW);
+        super::DrawAuto();
+    }
+
+    virtual void STDMETHODCALLTYPE DrawInstancedIndirect(
+        ID3D11Buffer *pBufferForArgs,
+        UINT AlignedByteOffsetForArgs)
+    {
+        CountCall(this, CALL_DRAW);
+        super::DrawInstancedIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawIndexedInstancedIndirect(
+        ID3D11Buffer *pBufferForArgs,
+        UINT AlignedByteOffsetForArgs)
+    {
+        CountCall(this, CALL_DRAW);
+        super::DrawIndexedInstancedIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+    }
+
+    virtual void STDMETHODCALLTYPE Dispatch(
+        UINT ThreadGroupCountX,
+        UINT ThreadGroupCountY,
+        UINT ThreadGroupCountZ)
+    {
+        CountCall(this, CALL_DRAW);
+        super::Dispatch(ThreadGroupCountX, ThreadGroupCountY, ThreadGroupCountZ);
+    }
+
+    virtual void STDMETHODCALLTYPE DispatchIndirect(
+        ID3D11Buffer *pBufferForArgs,
+        UINT AlignedByteOffsetForArgs)
+    {
+        CountCall(this, CALL_DRAW);
+        super::DispatchIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE Map(
+        ID3D11Resource *pResource,
+        UINT Subresource,
+        D3D11_MAP MapType,
+        UINT MapFlags,
+        D3D11_MAPPED_SUBRESOURCE *pMappedResource)
+    {
+        CountCall(this, CALL_OTHER);
+        return super::Map(pResource, Subresource, MapType, MapFlags, pMappedResource);
+    }
+
+    virtual void STDMETHODCALLTYPE Unmap(
+        ID3D11Resource *pResource,
+        UINT Subresource)
+    {
+        CountCall(this, CALL_OTHER);
+        super::Unmap(pResource, Subresource);
+    }
+
+    virtual void STDMETHODCALLTYPE UpdateSubresource(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        const D3D11_BOX *pDstBox,
+        const void *pSrcData,
+        UINT SrcRowPitch,
+        UINT SrcDepthPitch)
+    {
+        CountCall(this, CALL_OTHER);
+        super::UpdateSubresource(pDstResource, DstSubresource, pDstBox, pSrcData, SrcRowPitch, SrcDepthPitch);
+    }
+
+    virtual void STDMETHODCALLTYPE CopyResource(
+        ID3D11Resource *pDstResource,
+        ID3D11Resource *pSrcResource)
+    {
+        CountCall(this, CALL_OTHER);
+        super::CopyResource(pDstResource, pSrcResource);
+    }
+
+    virtual void STDMETHODCALLTYPE CopySubresourceRegion(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        UINT DstX,
+        UINT DstY,
+        UINT DstZ,
+        ID3D11Resource *pSrcResource,
+        UINT SrcSubresource,
+        const D3D11_BOX *pSrcBox)
+    {
+        CountCall(this, CALL_OTHER);
+        super::CopySubresourceRegion(pDstResource, DstSubresource, DstX, DstY, DstZ, pSrcResource, SrcSubresource, pSrcBox);
+    }
+
+    virtual void STDMETHODCALLTYPE CopyStructureCount(
+        ID3D11Buffer *pDstBuffer,
+        UINT DstAlignedByteOffset,
+        ID3D11UnorderedAccessView *pSrcView)
+    {
+        CountCall(this, CALL_OTHER);
+        super::CopyStructureCount(pDstBuffer, DstAlignedByteOffset, pSrcView);
+    }
+
+    virtual void STDMETHODCALLTYPE ResolveSubresource(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        ID3D11Resource *pSrcResource,
+        UINT SrcSubresource,
+        DXGI_FORMAT Format)
+    {
+        CountCall(this, CALL_OTHER);
+        super::ResolveSubresource(pDstResource, DstSubresource, pSrcResource, SrcSubresource, Format);
+    }
+
+    virtual void STDMETHODCALLTYPE ClearRenderTargetView(
+        ID3D11RenderTargetView *pRenderTargetView,
+        const FLOAT ColorRGBA[ 4 ])
+    {
+        CountCall(this, CALL_OTHER);
+        super::ClearRenderTargetView(pRenderTargetView, ColorRGBA);
+    }
+
+    virtual void STDMETHODCALLTYPE ClearDepthStencilView(
+        ID3D11DepthStencilView *pDepthStencilView,
+        UINT ClearFlags,
+        FLOAT Depth,
+        UINT8 Stencil)
+    {
+        CountCall(this, CALL_OTHER);
+        super::ClearDepthStencilView(pDepthStencilView, ClearFlags, Depth, Stencil);
+    }
+
+    virtual void STDMETHODCALLTYPE ClearUnorderedAccessViewUint(
+        ID3D11UnorderedAccessView *pUnorderedAccessView,
+        const UINT Values[ 4 ])
+    {
+        CountCall(this, CALL_OTHER);
+        super::ClearUnorderedAccessViewUint(pUnorderedAccessView, Values);
+    }
+
+    virtual void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat(
+        ID3D11UnorderedAccessView *pUnorderedAccessView,
+        const FLOAT Values[ 4 ])
+    {
+        CountCall(this, CALL_OTHER);
+        super::ClearUnorderedAccessViewFloat(pUnorderedAccessView, Values);
+    }
+
+    virtual void STDMETHODCALLTYPE GenerateMips(
+        ID3D11ShaderResourceView *pShaderResourceView)
+    {
+        CountCall(this, CALL_OTHER);
+        super::GenerateMips(pShaderResourceView);
+    }
+
+    virtual void STDMETHODCALLTYPE SetResourceMinLOD(
+        ID3D11Resource *pResource,
+        FLOAT MinLOD)
+    {
+        CountCall(this, CALL_OTHER);
+        super::SetResourceMinLOD(pResource, MinLOD);
+    }
+
+    virtual void STDMETHODCALLTYPE Begin(
+        ID3D11Asynchronous *pAsync)
+    {
+        CountCall(this, CALL_OTHER);
+        super::Begin(pAsync);
+    }
+
+    virtual void STDMETHODCALLTYPE End(
+        ID3D11Asynchronous *pAsync)
+    {
+        CountCall(this, CALL_OTHER);
+        super::End(pAsync);
+    }
+    virtual void STDMETHODCALLTYPE ClearState(void)
+    {
+        if(this==g_context) {
+            if(g_restore_pending!=0) {
+                ScopedLock lock(g_mutex);
+                ResolveRestore(true);
+            }
+        }
+        else {
+            CountCall(this, CALL_STATE);
+        }
+        super::ClearState();
+    }
+
+    virtual void STDMETHODCALLTYPE ExecuteCommandList(
+        ID3D11CommandList *pCommandList,
+        BOOL RestoreContextState)
+    {
+        if(this!=g_context) {
+            CountCall(this, CALL_OTHER);
+            super::ExecuteCommandList(pCommandList, RestoreContextState);
+            return;
+        }
+
+        LONGLONG begin = GetPerformanceCounter();
+        super::ExecuteCommandList(pCommandList, RestoreContextState);
+        double elapsed = PerformanceCounterToMS(GetPerformanceCounter()-begin);
+
+        ScopedLock lock(g_mutex);
+        // command list は immediate context のステートを引き継がないので、直前に戻したステートは使われていない
+        ResolveRestore(true);
+        ++g_stats.executes;
+        g_stats.execute_time += elapsed;
+        if(RestoreContextState) {
+            ++g_stats.restore_executes;
+            g_restore_pending = 1;
+        }
+        ListTable::iterator i = g_lists.find(D3D11GetObjectID(pCommandList));
+        if(i!=g_lists.end()) {
+            ++i->second.executes;
+            i->second.execute_time += elapsed;
+        }
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE FinishCommandList(
+        BOOL RestoreDeferredContextState,
+        ID3D11CommandList **ppCommandList)
+    {
+        HRESULT r = super::FinishCommandList(RestoreDeferredContextState, ppCommandList);
+        LONGLONG end = GetPerformanceCounter();
+
+        ScopedLock lock(g_mutex);
+        FlushPending();
+        ContextTable::iterator i = g_contexts.find(this);
+        if(i==g_contexts.end()) { return r; }
+
+        ContextRecord &rec = i->second;
+        if(r==S_OK && ppCommandList!=NULL && *ppCommandList!=NULL) {
+            double record_time = rec.first_call!=0 ? PerformanceCounterToMS(end-rec.first_call) : 0.0;
+
+            D3D11CommandListContextStats &cs = rec.total;
+            ++cs.lists;
+            cs.calls += rec.calls;
+            cs.state_changes += rec.state_changes;
+            cs.draws += rec.draws;
+            cs.record_time += record_time;
+
+            D3D11CommandListThreadStats &ts = g_threads[GetCurrentThreadId()];
+            ++ts.lists;
+            ts.record_time += record_time;
+
+            ++g_stats.lists;
+            if(rec.calls<D3D11COMMANDLISTANALYZER_SMALL_LIST) { ++g_stats.small_lists; }
+            if(RestoreDeferredContextState) { ++g_stats.restore_finishes; }
+            g_stats.calls += rec.calls;
+            g_stats.state_changes += rec.state_changes;
+            g_stats.draws += rec.draws;
+            g_stats.record_time += record_time;
+
+            D3D11SetHook<CommandListAnalyzerHook>(*ppCommandList);
+            ListRecord lr = {*ppCommandList, 0, 0.0};
+            g_lists[D3D11GetObjectID(*ppCommandList)] = lr;
+        }
+        rec.first_call = 0;
+        rec.calls = rec.state_changes = rec.draws = 0;
+        return r;
+    }
+};
+
+
+class DeviceCommandListAnalyzer : public D3D11DeviceHook
+{
+typedef D3D11DeviceHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE CreateDeferredContext(
+        UINT ContextFlags,
+        ID3D11DeviceContext **ppDeferredContext)
+    {
+        HRESULT r = super::CreateDeferredContext(ContextFlags, ppDeferredContext);
+        if(r==S_OK && ppDeferredContext!=NULL) {
+            ScopedLock lock(g_mutex);
+            ID3D11DeviceContext *ctx = *ppDeferredContext;
+            if(g_contexts.find(ctx)==g_contexts.end()) {
+                D3D11SetHook<DeviceContextCommandListAnalyzer>(ctx);
+                ContextRecord &rec = g_contexts[ctx];
+                memset(&rec, 0, sizeof(rec));
+                rec.id = D3D11GetObjectID(ctx);
+                rec.total.context = ctx;
+                rec.total.id = rec.id;
+                ++g_stats.deferred_contexts;
+            }
+        }
+        return r;
+    }
+};
+
+
+bool _D3D11CommandListAnalyzerInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice)
+{
+    if(g_device!=NULL) { return false; }
+
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_restore_pending = 0;
+    InterlockedIncrement(&g_generation);
+    g_first_frame = D3D11GetFrame();
+
+    g_swapchain = pSwapChain;
+    g_device = pDevice;
+    pDevice->GetImmediateContext(&g_context);
+    D3D11AddObjectDestroyCallback(OnDestroy);
+    D3D11SetHook<SwapChainCommandListAnalyzer>(pSwapChain); // D3D11GetFrame() を進めるため
+    D3D11SetHook<DeviceCommandListAnalyzer>(pDevice);
+    D3D11SetHook<DeviceContextCommandListAnalyzer>(g_context);
+    return true;
+}
+
+void _D3D11CommandListAnalyzerFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    ScopedLock lock(g_mutex);
+    D3D11RemoveObjectDestroyCallback(OnDestroy);
+    for(ListTable::const_iterator i=g_lists.begin(); i!=g_lists.end(); ++i) {
+        D3D11RemoveHook<CommandListAnalyzerHook>(i->second.list);
+    }
+    for(ContextTable::const_iterator i=g_contexts.begin(); i!=g_contexts.end(); ++i) {
+        D3D11RemoveHook<DeviceContextCommandListAnalyzer>(i->first);
+    }
+    g_lists.clear();
+    g_contexts.clear();
+    g_threads.clear();
+    InterlockedIncrement(&g_generation);
+
+    D3D11RemoveHook<SwapChainCommandListAnalyzer>(g_swapchain);
+    D3D11RemoveHook<DeviceCommandListAnalyzer>(g_device);
+    D3D11RemoveHook<DeviceContextCommandListAnalyzer>(g_context);
+    g_context->Release();
+    g_context = NULL;
+    g_swapchain = NULL;
+    g_device = NULL;
+}
+
+void _D3D11CommandListAnalyzerGetStats(D3D11CommandListStats &out)
+{
+    ScopedLock lock(g_mutex);
+    out = g_stats;
+    out.frames = D3D11GetFrame()-g_first_frame;
+}
+
+size_t _D3D11CommandListAnalyzerGetThreadStats(D3D11CommandListThreadStats *out, size_t max_num)
+{
+    ScopedLock lock(g_mutex);
+    size_t n = 0;
+    for(ThreadTable::const_iterator i=g_threads.begin(); i!=g_threads.end() && n<max_num; ++i, ++n) {
+        out[n] = i->second;
+        out[n].thread = i->first;
+    }
+    return g_threads.size();
+}
+
+size_t _D3D11CommandListAnalyzerGetContextStats(D3D11CommandListContextStats *out, size_t max_num)
+{
+    ScopedLock lock(g_mutex);
+    size_t n = 0;
+    for(ContextTable::const_iterator i=g_contexts.begin(); i!=g_contexts.end() && n<max_num; ++i, ++n) {
+        out[n] = i->second.total;
+    }
+    return g_contexts.size();
+}
+
+void _D3D11CommandListAnalyzerPrintStats()
+{
+    D3D11CommandListStats stats;
+    _D3D11CommandListAnalyzerGetStats(stats);
+
+    double lists = double(std::max<size_t>(stats.lists, 1));
+    double frames = double(std::max<size_t>(stats.frames, 1));
+    char buf[1024];
+    sprintf_s(buf,
+        "D3D11CommandListAnalyzerPrintStats(): Frames=%Iu DeferredContexts=%Iu\n"
+        "  Lists=%Iu (%.2f/frame, Small=%Iu Reused=%Iu) Calls/List=%.1f StateChanges/List=%.1f Draws/List=%.1f\n"
+        "  Record=%.3fms (%.3fms/frame) Executes=%Iu Execute=%.3fms (%.3fms/frame)\n"
+        "  RestoreFinishes=%Iu RestoreExecutes=%Iu NeedlessRestores=%Iu\n",
+        stats.frames, stats.deferred_contexts,
+        stats.lists, double(stats.lists)/frames, stats.small_lists, stats.reused_lists,
+        double(stats.calls)/lists, double(stats.state_changes)/lists, double(stats.draws)/lists,
+        stats.record_time, stats.record_time/frames, stats.executes, stats.execute_time, stats.execute_time/frames,
+        stats.restore_finishes, stats.restore_executes, stats.needless_restores);
+    OutputDebugStringA(buf);
+}
+
+void _D3D11CommandListAnalyzerPrintThreadStats()
+{
+    std::vector<D3D11CommandListThreadStats> threads(_D3D11CommandListAnalyzerGetThreadStats(NULL, 0));
+    if(!threads.empty()) {
+        threads.resize(std::min<size_t>(threads.size(), _D3D11CommandListAnalyzerGetThreadStats(&threads[0], threads.size())));
+    }
+    std::vector<D3D11CommandListContextStats> contexts(_D3D11CommandListAnalyzerGetContextStats(NULL, 0));
+    if(!contexts.empty()) {
+        contexts.resize(std::min<size_t>(contexts.size(), _D3D11CommandListAnalyzerGetContextStats(&contexts[0], contexts.size())));
+    }
+
+    char buf[512];
+    OutputDebugStringA("D3D11CommandListAnalyzerPrintThreadStats():\n");
+    for(size_t i=0; i<threads.size(); ++i) {
+        const D3D11CommandListThreadStats &s = threads[i];
+        sprintf_s(buf, "  Thread %u: Lists=%Iu Calls=%Iu StateChanges=%Iu Draws=%Iu Record=%.3fms\n",
+            s.thread, s.lists, s.calls, s.state_changes, s.draws, s.record_time);
+        OutputDebugStringA(buf);
+    }
+    for(size_t i=0; i<contexts.size(); ++i) {
+        const D3D11CommandListContextStats &s = contexts[i];
+        sprintf_s(buf, "  Context 0x%p (#%I64u): Lists=%Iu Calls=%Iu StateChanges=%Iu Draws=%Iu Record=%.3fms\n",
+            s.context, s.id, s.lists, s.calls, s.state_changes, s.draws, s.record_time);
+        OutputDebugStringA(buf);
+    }
+}
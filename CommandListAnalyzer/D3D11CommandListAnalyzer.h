@@ -0,0 +1,100 @@
+﻿#ifndef _ist_D3D11CommandListAnalyzer_h_
+#define _ist_D3D11CommandListAnalyzer_h_
+#include <D3D11.h>
+
+// deferred context ごとに記録された呼び出しを数え、command list の大きさと記録/実行にかかった時間を集計します。
+// 描画をどうスレッドに分割するか、command list をどこまでまとめるかを決めるためのものです。
+//
+// - deferred context での呼び出しを、呼び出し (Draw*/Dispatch*/Set*/Map/Copy*/Clear* など)、
+//   そのうちのステート変更 (*Set*)、描画 (Draw*/Dispatch*) に分けて数えます
+// - 記録時間は、command list の最初の呼び出しから FinishCommandList() を抜けるまでの時間で、FinishCommandList() を呼んだスレッドに計上します
+// - immediate context の ExecuteCommandList() にかかった時間を、command list ごとに集計します
+// - 呼び出しは記録するスレッドのスレッドローカルな領域で数え、別の deferred context に切り替わったときと
+//   FinishCommandList() のときだけロックして反映します
+// - D3D11CommandListAnalyzerInitialize() 以降に CreateDeferredContext() で作られた deferred context が対象です
+//
+// ExecuteCommandList() を RestoreContextState=TRUE で呼んだ後、immediate context で Draw*/Dispatch* する前に
+// ExecuteCommandList() か ClearState() が呼ばれた場合、戻したステートは使われていないので不要だったとみなします。
+// (途中で呼ばれた Set* で上書きされたかまでは見ないので、必要と判定されたものにも不要なものは含まれえます)
+//
+// 有効にするには、このファイルを include する前に D3D11COMMANDLISTANALYZER_ENABLE を define しておく必要があります。
+// D3D11COMMANDLISTANALYZER_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+// 呼び出しがこの数未満の command list を、小さい (他とまとめる候補) とみなします
+#ifndef D3D11COMMANDLISTANALYZER_SMALL_LIST
+#define D3D11COMMANDLISTANALYZER_SMALL_LIST 32
+#endif
+
+struct D3D11CommandListStats
+{
+    size_t frames;              // D3D11CommandListAnalyzerInitialize() からのフレーム数
+    size_t deferred_contexts;   // 対象にした deferred context の数
+    size_t lists;               // FinishCommandList() で作られた command list の数
+    size_t small_lists;         // 呼び出しが D3D11COMMANDLISTANALYZER_SMALL_LIST 未満だったもの
+    size_t calls;
+    size_t state_changes;
+    size_t draws;
+    double record_time;         // 記録時間の合計 (ミリ秒)
+    size_t executes;            // immediate context での ExecuteCommandList() の回数
+    double execute_time;        // ExecuteCommandList() 内で費やした時間の合計 (ミリ秒)
+    size_t reused_lists;        // 破棄されるまでに 2 回以上実行された command list の数
+    size_t restore_finishes;    // RestoreDeferredContextState=TRUE の FinishCommandList()
+    size_t restore_executes;    // RestoreContextState=TRUE の ExecuteCommandList()
+    size_t needless_restores;   // そのうち、戻したステートが使われなかったもの
+};
+
+struct D3D11CommandListThreadStats
+{
+    DWORD thread;
+    size_t lists;
+    size_t calls;
+    size_t state_changes;
+    size_t draws;
+    double record_time;
+};
+
+struct D3D11CommandListContextStats
+{
+    const void *context;
+    UINT64 id;                  // D3D11GetObjectID()
+    size_t lists;
+    size_t calls;
+    size_t state_changes;
+    size_t draws;
+    double record_time;
+};
+
+#ifdef D3D11COMMANDLISTANALYZER_ENABLE
+
+bool _D3D11CommandListAnalyzerInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice);
+void _D3D11CommandListAnalyzerFinalize();
+void _D3D11CommandListAnalyzerGetStats(D3D11CommandListStats &out);
+// スレッドごと、deferred context ごとの集計を最大 max_num 個 out に格納します。戻り値は総数です
+size_t _D3D11CommandListAnalyzerGetThreadStats(D3D11CommandListThreadStats *out, size_t max_num);
+size_t _D3D11CommandListAnalyzerGetContextStats(D3D11CommandListContextStats *out, size_t max_num);
+void _D3D11CommandListAnalyzerPrintStats();
+// スレッドごと、deferred context ごとの集計を表示します
+void _D3D11CommandListAnalyzerPrintThreadStats();
+
+#define D3D11CommandListAnalyzerInitialize(...)         _D3D11CommandListAnalyzerInitialize(__VA_ARGS__)
+#define D3D11CommandListAnalyzerFinalize()              _D3D11CommandListAnalyzerFinalize()
+#define D3D11CommandListAnalyzerGetStats(...)           _D3D11CommandListAnalyzerGetStats(__VA_ARGS__)
+#define D3D11CommandListAnalyzerGetThreadStats(...)     _D3D11CommandListAnalyzerGetThreadStats(__VA_ARGS__)
+#define D3D11CommandListAnalyzerGetContextStats(...)    _D3D11CommandListAnalyzerGetContextStats(__VA_ARGS__)
+#define D3D11CommandListAnalyzerPrintStats()            _D3D11CommandListAnalyzerPrintStats()
+#define D3D11CommandListAnalyzerPrintThreadStats()      _D3D11CommandListAnalyzerPrintThreadStats()
+
+#else // D3D11COMMANDLISTANALYZER_ENABLE
+
+#define D3D11CommandListAnalyzerInitialize(...)
+#define D3D11CommandListAnalyzerFinalize()
+#define D3D11CommandListAnalyzerGetStats(...)
+#define D3D11CommandListAnalyzerGetThreadStats(...)     0
+#define D3D11CommandListAnalyzerGetContextStats(...)    0
+#define D3D11CommandListAnalyzerPrintStats()
+#define D3D11CommandListAnalyzerPrintThreadStats()
+
+#endif // D3D11COMMANDLISTANALYZER_ENABLE
+
+#endif // _ist_D3D11CommandListAnalyzer_h_
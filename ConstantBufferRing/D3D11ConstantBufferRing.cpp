@@ -0,0 +1,611 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/Module.h"
+#include "../Utilities/ConstantBufferRing.h"
+#include "D3D11ConstantBufferRing.h"
+#include <d3d11_1.h>
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+
+enum SHADER_STAGE {
+    STAGE_VS,
+    STAGE_HS,
+    STAGE_DS,
+    STAGE_GS,
+    STAGE_PS,
+    STAGE_CS,
+    STAGE_MAX,
+};
+
+// ring buffer の Map/Unmap とバインドを、hook を通さずに本来の vtable で行う
+class RingContext : public IConstantBufferRingContext
+{
+public:
+    virtual char* mapRing();
+    virtual void unmapRing();
+    virtual void writeBuffer(void *buffer, const char *data, unsigned size);
+    virtual void bindRing(int stage, unsigned slot, uint64_t offset, unsigned num_constants);
+    virtual void bindBuffer(int stage, unsigned slot, void *buffer);
+};
+
+typedef std::map<ID3D11DeviceContext*, UINT64> DeferredContexts; // value は D3D11GetObjectID()
+
+namespace {
+
+Mutex g_mutex;
+IDXGISwapChain *g_swapchain = NULL;
+ID3D11Device *g_device = NULL;
+ID3D11DeviceContext *g_context = NULL;
+ID3D11DeviceContext1 *g_context1 = NULL;
+ID3D11Buffer *g_ring = NULL;
+size_t g_max_buffer_size = 0;
+RingContext g_ring_context;
+ConstantBufferRing *g_cbring = NULL;
+DeferredContexts g_deferred_contexts;
+std::vector<ID3D11Buffer*> g_pending_excludes; // deferred context で使われた。次の ExecuteCommandList() で外す
+
+} // namespace
+
+
+bool IsRedirectable(const D3D11_BUFFER_DESC &desc)
+{
+    return desc.BindFlags==D3D11_BIND_CONSTANT_BUFFER && desc.Usage==D3D11_USAGE_DYNAMIC &&
+        desc.CPUAccessFlags==D3D11_CPU_ACCESS_WRITE && desc.MiscFlags==0 && desc.ByteWidth<=g_max_buffer_size;
+}
+
+// obj の vtable を、このスコープの間だけ hook を通さない本来のものに戻します
+class BaseVTableScope
+{
+public:
+    explicit BaseVTableScope(IUnknown *obj) : m_obj(obj), m_vtable(get_vtable(obj))
+    {
+        set_vtable(m_obj, D3D11GetBaseVTable(m_obj));
+    }
+    ~BaseVTableScope() { set_vtable(m_obj, m_vtable); }
+private:
+    IUnknown *m_obj;
+    void **m_vtable;
+};
+
+char* RingContext::mapRing()
+{
+    BaseVTableScope base(g_context);
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if(FAILED(g_context->Map(g_ring, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped))) { return NULL; }
+    return (char*)mapped.pData;
+}
+
+void RingContext::unmapRing()
+{
+    BaseVTableScope base(g_context);
+    g_context->Unmap(g_ring, 0);
+}
+
+void RingContext::writeBuffer(void *buffer, const char *data, unsigned size)
+{
+    BaseVTableScope base(g_context);
+    ID3D11Buffer *b = (ID3D11Buffer*)buffer;
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if(FAILED(g_context->Map(b, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) { return; }
+    memcpy(mapped.pData, data, size);
+    g_context->Unmap(b, 0);
+}
+
+// ID3D11DeviceContext1 のメンバ関数は HookInterface の vtable に無いので、本来の vtable に一時的に戻して呼びます
+void RingContext::bindRing(int stage, unsigned slot, uint64_t offset, unsigned num_constants)
+{
+    void **vtable = get_vtable(g_context1);
+    bool swap = (void*)g_context1==(void*)g_context;
+    if(swap) { set_vtable(g_context1, D3D11GetBaseVTable(g_context)); }
+
+    UINT first = UINT(offset/16);
+    UINT num = num_constants;
+    switch(stage) {
+    case STAGE_VS: g_context1->VSSetConstantBuffers1(slot, 1, &g_ring, &first, &num); break;
+    case STAGE_HS: g_context1->HSSetConstantBuffers1(slot, 1, &g_ring, &first, &num); break;
+    case STAGE_DS: g_context1->DSSetConstantBuffers1(slot, 1, &g_ring, &first, &num); break;
+    case STAGE_GS: g_context1->GSSetConstantBuffers1(slot, 1, &g_ring, &first, &num); break;
+    case STAGE_PS: g_context1->PSSetConstantBuffers1(slot, 1, &g_ring, &first, &num); break;
+    case STAGE_CS: g_context1->CSSetConstantBuffers1(slot, 1, &g_ring, &first, &num); break;
+    }
+
+    if(swap) { set_vtable(g_context1, vtable); }
+}
+
+void RingContext::bindBuffer(int stage, unsigned slot, void *buffer)
+{
+    BaseVTableScope base(g_context);
+    ID3D11Buffer *b = (ID3D11Buffer*)buffer;
+    switch(stage) {
+    case STAGE_VS: g_context->VSSetConstantBuffers(slot, 1, &b); break;
+    case STAGE_HS: g_context->HSSetConstantBuffers(slot, 1, &b); break;
+    case STAGE_DS: g_context->DSSetConstantBuffers(slot, 1, &b); break;
+    case STAGE_GS: g_context->GSSetConstantBuffers(slot, 1, &b); break;
+    case STAGE_PS: g_context->PSSetConstantBuffers(slot, 1, &b); break;
+    case STAGE_CS: g_context->CSSetConstantBuffers(slot, 1, &b); break;
+    }
+}
+
+
+// 本来のバッファの内容が必要な使い方をされたので、置き換え対象から外します。immediate context からのみ呼びます
+void ExcludeBuffer(ID3D11Resource *pResource, const char *reason)
+{
+    if(pResource==NULL) { return; }
+    ScopedLock lock(g_mutex);
+    void *buffer = static_cast<ID3D11Buffer*>(pResource);
+    if(!g_cbring->isTracked(buffer)) { return; }
+    g_cbring->exclude(buffer);
+
+    char buf[256];
+    sprintf_s(buf, "D3D11ConstantBufferRing: %s. the buffer is excluded from redirection.\n", reason);
+    OutputDebugStringA(buf);
+}
+
+// deferred context から呼ばれるので、immediate context を使う ExcludeBuffer() は後で行います
+void QueueExclude(ID3D11Resource *pResource)
+{
+    if(pResource==NULL) { return; }
+    ScopedLock lock(g_mutex);
+    ID3D11Buffer *buffer = static_cast<ID3D11Buffer*>(pResource);
+    if(g_cbring->isTracked(buffer) &&
+        std::find(g_pending_excludes.begin(), g_pending_excludes.end(), buffer)==g_pending_excludes.end())
+    {
+        g_pending_excludes.push_back(buffer);
+    }
+}
+
+void FlushPendingExcludes()
+{
+    ScopedLock lock(g_mutex);
+    for(size_t i=0; i<g_pending_excludes.size(); ++i) {
+        ExcludeBuffer(g_pending_excludes[i], "used on a deferred context");
+    }
+    g_pending_excludes.clear();
+}
+
+void OnDestroy(const void *pTarget, const D3D11ObjectInfo &info)
+{
+    ScopedLock lock(g_mutex);
+    DeferredContexts::iterator i = g_deferred_contexts.find((ID3D11DeviceContext*)pTarget);
+    if(i!=g_deferred_contexts.end() && i->second==info.id) {
+        g_deferred_contexts.erase(i);
+    }
+}
+
+
+class ConstantBufferRingHook : public D3D11BufferHook
+{
+typedef D3D11BufferHook super;
+public:
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        ScopedLock lock(g_mutex);
+        ULONG r = super::Release();
+        if(r==0) {
+            ID3D11Buffer *buffer = static_cast<ID3D11Buffer*>(this);
+            g_cbring->removeBuffer(buffer);
+            g_pending_excludes.erase(std::remove(g_pending_excludes.begin(), g_pending_excludes.end(), buffer), g_pending_excludes.end());
+        }
+        return r;
+    }
+};
+
+
+// deferred context での置き換え対象のバッファの使用を検出します。
+// command list は本来のバッファを参照するので、実行される前に置き換え対象から外して内容を書き戻します
+class DeferredContextConstantBufferRing : public D3D11DeviceContextHook
+{
+typedef D3D11DeviceContextHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Map(
+        ID3D11Resource *pResource,
+        UINT Subresource,
+        D3D11_MAP MapType,
+        UINT MapFlags,
+        D3D11_MAPPED_SUBRESOURCE *pMappedResource)
+    {
+        QueueExclude(pResource);
+        return super::Map(pResource, Subresource, MapType, MapFlags, pMappedResource);
+    }
+
+    virtual void STDMETHODCALLTYPE CopySubresourceRegion(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        UINT DstX,
+        UINT DstY,
+        UINT DstZ,
+        ID3D11Resource *pSrcResource,
+        UINT SrcSubresource,
+        const D3D11_BOX *pSrcBox)
+    {
+        QueueExclude(pSrcResource);
+        super::CopySubresourceRegion(pDstResource, DstSubresource, DstX, DstY, DstZ, pSrcResource, SrcSubresource, pSrcBox);
+    }
+
+    virtual void STDMETHODCALLTYPE CopyResource(
+        ID3D11Resource *pDstResource,
+        ID3D11Resource *pSrcResource)
+    {
+        QueueExclude(pSrcResource);
+        super::CopyResource(pDstResource, pSrcResource);
+    }
+
+    virtual void STDMETHODCALLTYPE VSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        queueExcludes(NumBuffers, ppConstantBuffers);
+        super::VSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE HSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        queueExcludes(NumBuffers, ppConstantBuffers);
+        super::HSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE DSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        queueExcludes(NumBuffers, ppConstantBuffers);
+        super::DSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE GSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        queueExcludes(NumBuffers, ppConstantBuffers);
+        super::GSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE PSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        queueExcludes(NumBuffers, ppConstantBuffers);
+        super::PSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE CSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        queueExcludes(NumBuffers, ppConstantBuffers);
+        super::CSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+    }
+
+private:
+    void queueExcludes(UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        if(ppConstantBuffers==NULL) { return; }
+        for(UINT i=0; i<NumBuffers; ++i) {
+            QueueExclude(ppConstantBuffers[i]);
+        }
+    }
+};
+
+
+class DeviceConstantBufferRing : public D3D11DeviceHook
+{
+typedef D3D11DeviceHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE CreateBuffer(
+        const D3D11_BUFFER_DESC *pDesc,
+        const D3D11_SUBRESOURCE_DATA *pInitialData,
+        ID3D11Buffer **ppBuffer)
+    {
+        HRESULT r = super::CreateBuffer(pDesc, pInitialData, ppBuffer);
+        if(r==S_OK && ppBuffer!=NULL && IsRedirectable(*pDesc)) {
+            ScopedLock lock(g_mutex);
+            ID3D11Buffer *buffer = *ppBuffer;
+            if(!g_cbring->isTracked(buffer)) {
+                g_cbring->addBuffer(buffer, pDesc->ByteWidth);
+                D3D11SetHook<ConstantBufferRingHook>(buffer);
+            }
+        }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateDeferredContext(
+        UINT ContextFlags,
+        ID3D11DeviceContext **ppDeferredContext)
+    {
+        HRESULT r = super::CreateDeferredContext(ContextFlags, ppDeferredContext);
+        if(r==S_OK && ppDeferredContext!=NULL) {
+            ScopedLock lock(g_mutex);
+            ID3D11DeviceContext *ctx = *ppDeferredContext;
+            if(g_deferred_contexts.find(ctx)==g_deferred_contexts.end()) {
+                D3D11SetHook<DeferredContextConstantBufferRing>(ctx);
+                g_deferred_contexts[ctx] = D3D11GetObjectID(ctx);
+            }
+        }
+        return r;
+    }
+};
+
+
+class DeviceContextConstantBufferRing : public D3D11DeviceContextHook
+{
+typedef D3D11DeviceContextHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Map(
+        ID3D11Resource *pResource,
+        UINT Subresource,
+        D3D11_MAP MapType,
+        UINT MapFlags,
+        D3D11_MAPPED_SUBRESOURCE *pMappedResource)
+    {
+        if(pMappedResource==NULL) {
+            return super::Map(pResource, Subresource, MapType, MapFlags, pMappedResource);
+        }
+        ScopedLock lock(g_mutex);
+        CBRING_MAP_TYPE type = MapType==D3D11_MAP_WRITE_DISCARD ? CBRING_MAP_WRITE_DISCARD :
+            MapType==D3D11_MAP_WRITE_NO_OVERWRITE ? CBRING_MAP_WRITE_NO_OVERWRITE : CBRING_MAP_OTHER;
+        char *data = NULL;
+        unsigned pitch = 0;
+        if(g_cbring->map(pResource, type, data, pitch)==CBRING_REDIRECTED) {
+            pMappedResource->pData = data;
+            pMappedResource->RowPitch = pMappedResource->DepthPitch = pitch;
+            return S_OK;
+        }
+        return super::Map(pResource, Subresource, MapType, MapFlags, pMappedResource);
+    }
+
+    virtual void STDMETHODCALLTYPE Unmap(
+        ID3D11Resource *pResource,
+        UINT Subresource)
+    {
+        ScopedLock lock(g_mutex);
+        if(!g_cbring->unmap(pResource)) {
+            super::Unmap(pResource, Subresource);
+        }
+    }
+
+    // 本来のバッファには ring buffer に書いた内容が無いので、コピー元になったら置き換え対象から外す
+    virtual void STDMETHODCALLTYPE CopySubresourceRegion(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        UINT DstX,
+        UINT DstY,
+        UINT DstZ,
+        ID3D11Resource *pSrcResource,
+        UINT SrcSubresource,
+        const D3D11_BOX *pSrcBox)
+    {
+        ExcludeBuffer(pSrcResource, "used as a copy source");
+        super::CopySubresourceRegion(pDstResource, DstSubresource, DstX, DstY, DstZ, pSrcResource, SrcSubresource, pSrcBox);
+    }
+
+    virtual void STDMETHODCALLTYPE CopyResource(
+        ID3D11Resource *pDstResource,
+        ID3D11Resource *pSrcResource)
+    {
+        ExcludeBuffer(pSrcResource, "used as a copy source");
+        super::CopyResource(pDstResource, pSrcResource);
+    }
+
+    virtual void STDMETHODCALLTYPE VSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        setConstantBuffers(STAGE_VS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE HSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        setConstantBuffers(STAGE_HS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE DSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        setConstantBuffers(STAGE_DS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE GSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        setConstantBuffers(STAGE_GS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE PSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        setConstantBuffers(STAGE_PS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE CSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        setConstantBuffers(STAGE_CS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+
+    virtual void STDMETHODCALLTYPE VSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer **ppConstantBuffers)
+    {
+        super::VSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+        replaceRing(STAGE_VS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE HSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer **ppConstantBuffers)
+    {
+        super::HSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+        replaceRing(STAGE_HS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE DSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer **ppConstantBuffers)
+    {
+        super::DSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+        replaceRing(STAGE_DS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE GSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer **ppConstantBuffers)
+    {
+        super::GSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+        replaceRing(STAGE_GS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE PSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer **ppConstantBuffers)
+    {
+        super::PSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+        replaceRing(STAGE_PS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+    virtual void STDMETHODCALLTYPE CSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer **ppConstantBuffers)
+    {
+        super::CSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+        replaceRing(STAGE_CS, StartSlot, NumBuffers, ppConstantBuffers);
+    }
+
+    virtual void STDMETHODCALLTYPE ClearState(void)
+    {
+        super::ClearState();
+        ScopedLock lock(g_mutex);
+        g_cbring->clearBindings();
+    }
+
+    virtual void STDMETHODCALLTYPE ExecuteCommandList(ID3D11CommandList *pCommandList, BOOL RestoreContextState)
+    {
+        FlushPendingExcludes();
+        super::ExecuteCommandList(pCommandList, RestoreContextState);
+        if(!RestoreContextState) {
+            ScopedLock lock(g_mutex);
+            g_cbring->clearBindings();
+        }
+    }
+
+private:
+    void superSetConstantBuffers(int stage, UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        switch(stage) {
+        case STAGE_VS: super::VSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); break;
+        case STAGE_HS: super::HSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); break;
+        case STAGE_DS: super::DSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); break;
+        case STAGE_GS: super::GSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); break;
+        case STAGE_PS: super::PSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); break;
+        case STAGE_CS: super::CSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); break;
+        }
+    }
+
+    void setConstantBuffers(int stage, UINT StartSlot, UINT NumBuffers, ID3D11Buffer *const *ppConstantBuffers)
+    {
+        // まず本来のバッファをそのままバインドし、ring buffer に置き換え中のものだけ上書きする
+        superSetConstantBuffers(stage, StartSlot, NumBuffers, ppConstantBuffers);
+        ScopedLock lock(g_mutex);
+        g_cbring->setConstantBuffers(stage, StartSlot, NumBuffers, (void*const*)ppConstantBuffers);
+    }
+
+    // Get*ConstantBuffers() で ring buffer が返ってきたスロットは、アプリがバインドしたバッファに差し替える
+    void replaceRing(int stage, UINT StartSlot, UINT NumBuffers, ID3D11Buffer **ppConstantBuffers)
+    {
+        if(ppConstantBuffers==NULL) { return; }
+        ScopedLock lock(g_mutex);
+        for(UINT i=0; i<NumBuffers && StartSlot+i<D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT; ++i) {
+            ID3D11Buffer *bound = (ID3D11Buffer*)g_cbring->getBoundBuffer(stage, StartSlot+i);
+            if(ppConstantBuffers[i]==g_ring && bound!=NULL) {
+                g_ring->Release();
+                bound->AddRef();
+                ppConstantBuffers[i] = bound;
+            }
+        }
+    }
+};
+
+
+class SwapChainConstantBufferRing : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        {
+            ScopedLock lock(g_mutex);
+            g_cbring->endFrame();
+        }
+        return super::Present(SyncInterval, Flags);
+    }
+};
+
+
+bool _D3D11ConstantBufferRingInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, size_t ring_size, size_t max_buffer_size)
+{
+    if(g_device!=NULL) { return false; }
+
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options;
+    memset(&options, 0, sizeof(options));
+    if(FAILED(pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+        !options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer)
+    {
+        OutputDebugStringA("D3D11ConstantBufferRingInitialize(): constant buffer offsetting is not supported.\n");
+        return false;
+    }
+
+    ID3D11DeviceContext *ctx = NULL;
+    pDevice->GetImmediateContext(&ctx);
+    if(FAILED(ctx->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&g_context1))) {
+        ctx->Release();
+        return false;
+    }
+
+    // *SetConstantBuffers1() の offset は 256 byte 単位
+    D3D11_BUFFER_DESC desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.ByteWidth = UINT((ring_size+255) & ~size_t(255));
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    if(FAILED(pDevice->CreateBuffer(&desc, NULL, &g_ring))) {
+        g_context1->Release();
+        g_context1 = NULL;
+        ctx->Release();
+        return false;
+    }
+
+    g_swapchain = pSwapChain;
+    g_device = pDevice;
+    g_context = ctx;
+    g_max_buffer_size = std::min<size_t>(max_buffer_size, D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT*16);
+    g_cbring = new ConstantBufferRing(&g_ring_context, desc.ByteWidth, D3D11CONSTANTBUFFERRING_FRAME_LATENCY);
+    D3D11AddObjectDestroyCallback(OnDestroy);
+    D3D11SetHook<SwapChainConstantBufferRing>(pSwapChain);
+    D3D11SetHook<DeviceConstantBufferRing>(pDevice);
+    D3D11SetHook<DeviceContextConstantBufferRing>(ctx);
+    return true;
+}
+
+void _D3D11ConstantBufferRingFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    ScopedLock lock(g_mutex);
+    D3D11RemoveHook<SwapChainConstantBufferRing>(g_swapchain);
+    D3D11RemoveHook<DeviceConstantBufferRing>(g_device);
+    D3D11RemoveHook<DeviceContextConstantBufferRing>(g_context);
+    D3D11RemoveObjectDestroyCallback(OnDestroy);
+    for(DeferredContexts::const_iterator i=g_deferred_contexts.begin(); i!=g_deferred_contexts.end(); ++i) {
+        D3D11RemoveHook<DeferredContextConstantBufferRing>(i->first);
+    }
+    g_deferred_contexts.clear();
+    g_pending_excludes.clear();
+
+    // 最新の内容を本来のバッファに書き戻し、ring buffer に置き換えていたスロットも戻す
+    g_cbring->restore();
+    std::vector<void*> buffers;
+    g_cbring->getTrackedBuffers(buffers);
+    for(size_t i=0; i<buffers.size(); ++i) {
+        D3D11RemoveHook<ConstantBufferRingHook>((ID3D11Buffer*)buffers[i]);
+    }
+    delete g_cbring;
+    g_cbring = NULL;
+
+    g_ring->Release();
+    g_ring = NULL;
+    g_context1->Release();
+    g_context1 = NULL;
+    g_context->Release();
+    g_context = NULL;
+    g_swapchain = NULL;
+    g_device = NULL;
+}
+
+void _D3D11ConstantBufferRingGetStats(D3D11ConstantBufferRingStats &out)
+{
+    ScopedLock lock(g_mutex);
+    memset(&out, 0, sizeof(out));
+    if(g_cbring==NULL) { return; }
+    out.num_tracked         = g_cbring->getNumTracked();
+    out.num_excluded        = g_cbring->getNumExcluded();
+    out.redirected          = g_cbring->getRedirected();
+    out.fallbacks           = g_cbring->getFallbacks();
+    out.rebinds             = g_cbring->getRebinds();
+    out.ring_size           = size_t(g_cbring->getRingSize());
+    out.frame_bytes         = g_cbring->getFrameBytes();
+    out.peak_frame_bytes    = g_cbring->getPeakFrameBytes();
+}
+
+void _D3D11ConstantBufferRingPrintStats()
+{
+    D3D11ConstantBufferRingStats stats;
+    _D3D11ConstantBufferRingGetStats(stats);
+
+    char buf[512];
+    sprintf_s(buf, "D3D11ConstantBufferRingPrintStats(): Tracked=%Iu Excluded=%Iu Redirected=%Iu Fallbacks=%Iu Rebinds=%Iu RingSize=%Iu FrameSize=%Iu PeakFrameSize=%Iu\n",
+        stats.num_tracked, stats.num_excluded, stats.redirected, stats.fallbacks, stats.rebinds, stats.ring_size, stats.frame_bytes, stats.peak_frame_bytes);
+    OutputDebugStringA(buf);
+}
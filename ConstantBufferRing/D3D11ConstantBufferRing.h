@@ -0,0 +1,78 @@
+﻿#ifndef _ist_D3D11ConstantBufferRing_h_
+#define _ist_D3D11ConstantBufferRing_h_
+#include <D3D11.h>
+
+// 小さな dynamic constant buffer への Map(D3D11_MAP_WRITE_DISCARD) を、1 本の大きな ring buffer からの切り出しに置き換えます。
+// ring buffer は D3D11_MAP_WRITE_NO_OVERWRITE で Map し、*SetConstantBuffers1() の offset 指定でアプリの constant buffer の代わりにバインドします。
+// これにより、Map(D3D11_MAP_WRITE_DISCARD) ごとにドライバが行うバッファのリネームを省きます。
+// ring buffer の領域は D3D11CONSTANTBUFFERRING_FRAME_LATENCY フレーム経ってから再利用します (Present() でフレームを区切ります)。
+// アプリには Map() でバッファごとの CPU 側のコピーを返し、Unmap() でそれを ring buffer に書き写します。
+// 切り出しと置き換え中のバッファの管理は Utilities/ConstantBufferRing.h の ConstantBufferRing が行います。
+//
+// D3D11.1 の ID3D11DeviceContext1 と、D3D11_FEATURE_DATA_D3D11_OPTIONS の ConstantBufferOffsetting / MapNoOverwriteOnDynamicConstantBuffer が
+// 使える環境でのみ有効になります。それ以外の環境では初期化に失敗し、何もしません。
+//
+// 置き換え中は本来のバッファの内容が古いままなので、本来のバッファの内容が必要になる以下の使い方を検出したら、
+// 最新の内容を書き戻してそのバッファを以後置き換え対象から外します (D3D11ConstantBufferRingStats::num_excluded)。
+// - immediate context での CopyResource() / CopySubresourceRegion() のコピー元
+// - deferred context での *SetConstantBuffers() / Map() / コピー元。次の ExecuteCommandList() の前に外します
+//
+// 制約:
+// - deferred context は、初期化後に CreateDeferredContext() で作られたものだけを検出できます
+// - アプリが自分で *SetConstantBuffers1() を呼ぶ場合には対応していません。ID3D11DeviceContext1 の呼び出しは hook できないため、
+//   置き換え対象のバッファを *SetConstantBuffers1() でバインドすると古い内容が見え、
+//   *SetConstantBuffers1() で上書きしたスロットも、以前バインドされていたバッファの Unmap() で ring buffer に戻されてしまいます
+// - 同じ理由で、CopySubresourceRegion1() のコピー元になった場合も検出できません
+// - ring buffer に空きが無い場合は、本来のバッファをそのまま Map します (D3D11ConstantBufferRingStats::fallbacks)。
+//   D3D11_MAP_WRITE_NO_OVERWRITE の場合は、前回の内容を書き戻してから Map します
+//
+// 有効にするには、このファイルを include する前に D3D11CONSTANTBUFFERRING_ENABLE を define しておく必要があります。
+// D3D11CONSTANTBUFFERRING_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+#ifndef D3D11CONSTANTBUFFERRING_FRAME_LATENCY
+#define D3D11CONSTANTBUFFERRING_FRAME_LATENCY 3
+#endif
+#ifndef D3D11CONSTANTBUFFERRING_DEFAULT_SIZE
+#define D3D11CONSTANTBUFFERRING_DEFAULT_SIZE (4*1024*1024)
+#endif
+// これ以下のサイズの constant buffer を置き換え対象にします
+#ifndef D3D11CONSTANTBUFFERRING_DEFAULT_MAX_BUFFER_SIZE
+#define D3D11CONSTANTBUFFERRING_DEFAULT_MAX_BUFFER_SIZE 4096
+#endif
+
+struct D3D11ConstantBufferRingStats
+{
+    size_t num_tracked;     // 置き換え対象の constant buffer の数
+    size_t num_excluded;    // 置き換え対象から外した constant buffer の数
+    size_t redirected;      // ring buffer に置き換えた Map() の回数
+    size_t fallbacks;       // ring buffer に空きが無く、本来のバッファを Map() した回数
+    size_t rebinds;         // 置き換えによって発生した *SetConstantBuffers1() の回数
+    size_t ring_size;
+    size_t frame_bytes;     // 直前のフレームで ring buffer から切り出したバイト数
+    size_t peak_frame_bytes;
+};
+
+#ifdef D3D11CONSTANTBUFFERRING_ENABLE
+
+bool _D3D11ConstantBufferRingInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice,
+    size_t ring_size=D3D11CONSTANTBUFFERRING_DEFAULT_SIZE, size_t max_buffer_size=D3D11CONSTANTBUFFERRING_DEFAULT_MAX_BUFFER_SIZE);
+void _D3D11ConstantBufferRingFinalize();
+void _D3D11ConstantBufferRingGetStats(D3D11ConstantBufferRingStats &out);
+void _D3D11ConstantBufferRingPrintStats();
+
+#define D3D11ConstantBufferRingInitialize(...)  _D3D11ConstantBufferRingInitialize(__VA_ARGS__)
+#define D3D11ConstantBufferRingFinalize()       _D3D11ConstantBufferRingFinalize()
+#define D3D11ConstantBufferRingGetStats(...)    _D3D11ConstantBufferRingGetStats(__VA_ARGS__)
+#define D3D11ConstantBufferRingPrintStats()     _D3D11ConstantBufferRingPrintStats()
+
+#else // D3D11CONSTANTBUFFERRING_ENABLE
+
+#define D3D11ConstantBufferRingInitialize(...)
+#define D3D11ConstantBufferRingFinalize()
+#define D3D11ConstantBufferRingGetStats(...)
+#define D3D11ConstantBufferRingPrintStats()
+
+#endif // D3D11CONSTANTBUFFERRING_ENABLE
+
+#endif // _ist_D3D11ConstantBufferRing_h_
@@ -1,5 +1,5 @@
 ﻿#include <vector>
-#include <map>
+#include <unordered_map>
 #include <algorithm>
 #include "D3D11HookInterface.h"
 #include "Utilities/Module.h"
@@ -11,9 +11,15 @@ class VTableStack
 private:
     std::vector<void**> m_vtables;
     int m_depth;
+    UINT64 m_id;
+    size_t m_create_frame;
 
 public:
-    VTableStack() : m_depth(-1) {}
+    VTableStack() : m_depth(-1), m_id(0), m_create_frame(0) {}
+
+    void setID(UINT64 id, size_t frame) { m_id=id; m_create_frame=frame; }
+    UINT64 getID() const                { return m_id; }
+    size_t getCreateFrame() const       { return m_create_frame; }
 
     size_t getStackSize() const { return m_vtables.size(); }
 
@@ -36,14 +42,20 @@ public:
         m_vtables.resize(1);
     }
 
-    int getDepth() const { return m_depth; }
+    void** getBase() const  { return m_vtables.front(); }
+    int getDepth() const    { return m_depth; }
     void** up()     { return --m_depth >= 0 ? m_vtables[m_depth] : NULL; }
     void** down()   { return ++m_depth >= 0 ? m_vtables[m_depth] : NULL; }
 };
 
 namespace {
-    typedef std::map<IUnknown*, VTableStack> VTables;
+    // unordered_map の要素への参照は、他の要素の追加/削除では無効にならない
+    typedef std::unordered_map<IUnknown*, VTableStack> VTables;
+    typedef std::vector<D3D11ObjectDestroyCallback> DestroyCallbacks;
     VTables g_vtables;
+    DestroyCallbacks g_destroy_callbacks;
+    UINT64 g_last_id = 0;
+    size_t g_frame = 0;
 
     void D3D11SetHookInternal(IUnknown *pTarget, void **vtable)
     {
@@ -52,6 +64,7 @@ namespace {
         // vtable を stack に追加
         if(vs.getStackSize()==0) {
             vs.pushVTable(get_vtable(pTarget));
+            vs.setID(++g_last_id, g_frame);
         }
         vs.pushVTable(vtable);
 
@@ -71,6 +84,12 @@ namespace {
         }
     }
 
+    void** D3D11GetBaseVTableInternal(IUnknown *pTarget)
+    {
+        VTables::iterator i = g_vtables.find(pTarget);
+        return i!=g_vtables.end() ? i->second.getBase() : get_vtable(pTarget);
+    }
+
     void D3D11RemoveAllHooksInternal(IUnknown *pTarget)
     {
         VTables::iterator i = g_vtables.find(pTarget);
@@ -80,6 +99,17 @@ namespace {
             g_vtables.erase(pTarget);
         }
     }
+
+    void D3D11HandleDestroy(const void *pTarget, const VTableStack &vs)
+    {
+        D3D11ObjectInfo info;
+        info.id = vs.getID();
+        info.create_frame = vs.getCreateFrame();
+        info.destroy_frame = g_frame;
+        for(size_t i=0; i<g_destroy_callbacks.size(); ++i) {
+            g_destroy_callbacks[i](pTarget, info);
+        }
+    }
 } // namespace 
 
 void D3D11SetHookDirect(IUnknown *pTarget, void **vtable)                                           { D3D11SetHookInternal(pTarget, vtable); }
@@ -121,6 +151,37 @@ void D3D11SetHookInstanciated(ID3D11ComputeShader *pTarget, ID3D11ComputeShader
 void D3D11RemoveHookDirect(IUnknown *pTarget, void **vtable)                                        { D3D11RemoveHookInternal(pTarget, vtable); }
 void D3D11RemoveHookInstanciated(IUnknown *pTarget, IUnknown *pHook)                                { D3D11RemoveHookInternal(pTarget, get_vtable(pHook)); }
 void D3D11RemoveAllHooks(IUnknown *pTarget)                                                         { D3D11RemoveAllHooksInternal(pTarget); }
+void** D3D11GetBaseVTable(IUnknown *pTarget)                                                        { return D3D11GetBaseVTableInternal(pTarget); }
+
+UINT64 D3D11GetObjectID(IUnknown *pTarget)
+{
+    VTables::const_iterator i = g_vtables.find(pTarget);
+    return i!=g_vtables.end() ? i->second.getID() : 0;
+}
+
+bool D3D11GetObjectInfo(IUnknown *pTarget, D3D11ObjectInfo &out)
+{
+    VTables::const_iterator i = g_vtables.find(pTarget);
+    if(i==g_vtables.end()) { return false; }
+    out.id = i->second.getID();
+    out.create_frame = i->second.getCreateFrame();
+    out.destroy_frame = 0;
+    return true;
+}
+
+size_t D3D11GetFrame() { return g_frame; }
+
+void D3D11AddObjectDestroyCallback(D3D11ObjectDestroyCallback callback)
+{
+    if(std::find(g_destroy_callbacks.begin(), g_destroy_callbacks.end(), callback)==g_destroy_callbacks.end()) {
+        g_destroy_callbacks.push_back(callback);
+    }
+}
+
+void D3D11RemoveObjectDestroyCallback(D3D11ObjectDestroyCallback callback)
+{
+    g_destroy_callbacks.erase(std::remove(g_destroy_callbacks.begin(), g_destroy_callbacks.end(), callback), g_destroy_callbacks.end());
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //                      template implementation
@@ -154,7 +215,10 @@ ULONG STDMETHODCALLTYPE TUnknownHook<T>::Release( void )
     int depth = vs.getDepth(); // ↓の Relase() で vs が開放されてる可能性があるので、ここで取得する必要がある
     ULONG r = Release();
     if(r==0) {
-        if(depth==0) { g_vtables.erase(this); }
+        if(depth==0) {
+            D3D11HandleDestroy(this, vs);
+            g_vtables.erase(this);
+        }
     }
     else {
         set_vtable(this, vs.down());
@@ -326,8 +390,10 @@ HRESULT STDMETHODCALLTYPE DXGISwapChainHook::Present( UINT SyncInterval, UINT Fl
 {
     VTableStack &vs = g_vtables[this];
     set_vtable(this, vs.up());
+    bool base = vs.getDepth()==0; // 多重 hook でも、本来の Present() を呼ぶ 1 回だけ数える
     HRESULT r = Present(SyncInterval, Flags);
     set_vtable(this, vs.down());
+    if(base) { ++g_frame; }
     return r;
 }
 
@@ -1274,6 +1274,30 @@ void D3D11RemoveHookDirect(IUnknown *pTarget, void **vtable);
 void D3D11RemoveHookInstanciated(IUnknown *pTarget, IUnknown *pHook);
 template<class HookType> inline void D3D11RemoveHook(IUnknown *pTarget) { HookType v; D3D11RemoveHookInstanciated(pTarget, &v); }
 void D3D11RemoveAllHooks(IUnknown *pTarget);
+// hook する前の本来の vtable を返します。hook されていなければ現在の vtable を返します。
+// HookInterface が持たない派生 interface (ID3D11DeviceContext1 など) のメンバ関数を呼ぶ際、一時的にこれに差し替えて使います
+void** D3D11GetBaseVTable(IUnknown *pTarget);
+
+// hook されているオブジェクトの情報。
+// アドレスは Release() 後に別のオブジェクトに再利用されるので、寿命をまたぐ記録には id を使います
+struct D3D11ObjectInfo
+{
+    UINT64 id;              // 最初に hook したときに振る、1 から始まる通し番号。再利用されません
+    size_t create_frame;    // 最初に hook したときの D3D11GetFrame()
+    size_t destroy_frame;   // 破棄されたときの D3D11GetFrame()。生きている間は 0
+};
+// 破棄されたオブジェクトの通知を受け取る関数。pTarget は既に解放されているので、アドレスとしてのみ使えます
+typedef void (*D3D11ObjectDestroyCallback)(const void *pTarget, const D3D11ObjectInfo &info);
+
+// pTarget の id を返します。hook されていなければ 0 を返します。
+// hook を全て外すと (D3D11RemoveHook()/D3D11RemoveAllHooks()) 破棄を検知できなくなるので、id も捨てます
+UINT64 D3D11GetObjectID(IUnknown *pTarget);
+bool D3D11GetObjectInfo(IUnknown *pTarget, D3D11ObjectInfo &out);
+// hook されている swap chain の Present() が呼ばれた回数
+size_t D3D11GetFrame();
+// hook されているオブジェクトの参照カウントが 0 になったときに呼ばれます
+void D3D11AddObjectDestroyCallback(D3D11ObjectDestroyCallback callback);
+void D3D11RemoveObjectDestroyCallback(D3D11ObjectDestroyCallback callback);
 
 
 template<class HookType> inline void D3D11SetHook(IDXGISwapChain *pTarget)              { HookType v; D3D11SetHookInstanciated(pTarget, &v); }
@@ -0,0 +1,819 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/Timer.h"
+#include "D3D11EventTrace.h"
+#include "D3D11EventTraceFile.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+
+
+#define D3D11ET_METHODS(X) \
+    X(ID3D11DeviceContext, Draw) \
+    X(ID3D11DeviceContext, DrawIndexed) \
+    X(ID3D11DeviceContext, DrawInstanced) \
+    X(ID3D11DeviceContext, DrawIndexedInstanced) \
+    X(ID3D11DeviceContext, DrawAuto) \
+    X(ID3D11DeviceContext, DrawInstancedIndirect) \
+    X(ID3D11DeviceContext, DrawIndexedInstancedIndirect) \
+    X(ID3D11DeviceContext, Dispatch) \
+    X(ID3D11DeviceContext, DispatchIndirect) \
+    X(ID3D11DeviceContext, Map) \
+    X(ID3D11DeviceContext, Unmap) \
+    X(ID3D11DeviceContext, UpdateSubresource) \
+    X(ID3D11DeviceContext, CopyResource) \
+    X(ID3D11DeviceContext, CopySubresourceRegion) \
+    X(ID3D11DeviceContext, ResolveSubresource) \
+    X(ID3D11DeviceContext, ClearRenderTargetView) \
+    X(ID3D11DeviceContext, ClearDepthStencilView) \
+    X(ID3D11DeviceContext, ClearUnorderedAccessViewUint) \
+    X(ID3D11DeviceContext, ClearUnorderedAccessViewFloat) \
+    X(ID3D11DeviceContext, GenerateMips) \
+    X(ID3D11DeviceContext, OMSetRenderTargets) \
+    X(ID3D11DeviceContext, Begin) \
+    X(ID3D11DeviceContext, End) \
+    X(ID3D11DeviceContext, GetData) \
+    X(ID3D11DeviceContext, Flush) \
+    X(ID3D11DeviceContext, ExecuteCommandList) \
+    X(ID3D11DeviceContext, FinishCommandList) \
+    X(ID3D11DeviceContext, ClearState) \
+    X(ID3D11Device, CreateBuffer) \
+    X(ID3D11Device, CreateTexture1D) \
+    X(ID3D11Device, CreateTexture2D) \
+    X(ID3D11Device, CreateTexture3D) \
+    X(ID3D11Device, CreateShaderResourceView) \
+    X(ID3D11Device, CreateUnorderedAccessView) \
+    X(ID3D11Device, CreateRenderTargetView) \
+    X(ID3D11Device, CreateDepthStencilView) \
+    X(ID3D11Device, CreateInputLayout) \
+    X(ID3D11Device, CreateVertexShader) \
+    X(ID3D11Device, CreatePixelShader) \
+    X(ID3D11Device, CreateComputeShader) \
+    X(ID3D11Device, CreateBlendState) \
+    X(ID3D11Device, CreateDepthStencilState) \
+    X(ID3D11Device, CreateRasterizerState) \
+    X(ID3D11Device, CreateSamplerState) \
+    X(ID3D11Device, CreateQuery) \
+    X(ID3D11Device, CreateDeferredContext) \
+    X(IDXGISwapChain, Present) \
+    X(IDXGISwapChain, ResizeBuffers)
+
+enum TraceMethod {
+#define D3D11ET_ENUM(I, M) TM_##M,
+    D3D11ET_METHODS(D3D11ET_ENUM)
+#undef D3D11ET_ENUM
+    TM_Count,
+};
+
+const char *g_method_names[] = {
+#define D3D11ET_NAME(I, M) #I "::" #M,
+    D3D11ET_METHODS(D3D11ET_NAME)
+#undef D3D11ET_NAME
+};
+
+
+// head は書き込み側 (記録するスレッド) だけが、tail は回収側だけが進めます。
+// 互いに相手の値は読むだけなので、ロックなしで受け渡せます
+struct ThreadBuffer
+{
+    volatile LONG head;
+    char pad0[60];      // head と tail を別のキャッシュラインに置く
+    volatile LONG tail;
+    volatile LONG dropped;
+    volatile LONG thread;
+    char pad1[52];
+    EventTraceEvent events[D3D11EVENTTRACE_BUFFER_SIZE];
+};
+
+typedef std::map<DWORD, std::string> ThreadNames;
+typedef std::set<ID3D11DeviceContext*> ContextSet;
+
+namespace {
+
+Mutex g_mutex;
+IDXGISwapChain *g_swapchain = NULL;
+ID3D11Device *g_device = NULL;
+ID3D11DeviceContext *g_context = NULL;
+ContextSet g_deferred_contexts;
+EventTraceWriter g_writer;
+HANDLE g_drain_thread = NULL;
+HANDLE g_stop_event = NULL;
+ThreadNames g_thread_names;
+std::map<uint16_t, std::string> g_user_names;
+uint64_t g_events = 0;
+
+ThreadBuffer *g_buffers = NULL; // 記録中のスレッドが残っていても安全なように、解放しない
+volatile LONG g_num_buffers = 0;
+volatile LONG g_generation = 0;
+volatile LONG g_active = 0;
+volatile LONG g_dropped_threads = 0;
+
+__declspec(thread) ThreadBuffer *t_buffer = NULL;
+__declspec(thread) LONG t_generation = 0;
+
+} // namespace
+
+
+// 最初の記録時に、まだ使われていないバッファを割り当てます。
+// D3D11EventTraceInitialize() し直した後は g_generation が変わるので、割り当て直します
+ThreadBuffer* GetThreadBuffer()
+{
+    LONG generation = g_generation;
+    if(t_generation!=generation) {
+        t_generation = generation;
+        LONG i = InterlockedIncrement(&g_num_buffers)-1;
+        if(i<D3D11EVENTTRACE_MAX_THREADS) {
+            t_buffer = &g_buffers[i];
+            t_buffer->thread = (LONG)GetCurrentThreadId();
+        }
+        else {
+            t_buffer = NULL;
+        }
+    }
+    return t_buffer;
+}
+
+void DrainBuffers()
+{
+    LONG n = std::min<LONG>(g_num_buffers, D3D11EVENTTRACE_MAX_THREADS);
+    for(LONG i=0; i<n; ++i) {
+        ThreadBuffer &b = g_buffers[i];
+        LONG head = b.head;
+        MemoryBarrier();
+        LONG tail = b.tail;
+        ULONG num = ULONG(head-tail);
+        if(num==0) { continue; }
+
+        ULONG begin = ULONG(tail) & (D3D11EVENTTRACE_BUFFER_SIZE-1);
+        ULONG first = std::min<ULONG>(num, D3D11EVENTTRACE_BUFFER_SIZE-begin);
+        g_writer.writeEvents(&b.events[begin], first);
+        if(num>first) {
+            g_writer.writeEvents(&b.events[0], num-first);
+        }
+        g_events += num;
+
+        // 書き出し終わるまで、書き込み側に上書きさせない
+        MemoryBarrier();
+        b.tail = head;
+    }
+}
+
+DWORD WINAPI DrainThread(LPVOID)
+{
+    while(WaitForSingleObject(g_stop_event, D3D11EVENTTRACE_DRAIN_INTERVAL)==WAIT_TIMEOUT) {
+        DrainBuffers();
+    }
+    DrainBuffers();
+    return 0;
+}
+
+
+class ScopedTrace
+{
+public:
+    ScopedTrace(uint16_t method, const void *object, uint32_t arg0=0, uint32_t arg1=0)
+        : m_method(method), m_object(object)
+    {
+        _D3D11EventTraceEmit(m_method, ETP_BEGIN, m_object, arg0, arg1);
+    }
+
+    ~ScopedTrace()
+    {
+        _D3D11EventTraceEmit(m_method, ETP_END, m_object);
+    }
+
+    // Create*() で作成したオブジェクトなど、終了時のイベントに残すオブジェクトを変えます
+    void setObject(const void *object) { m_object = object; }
+
+private:
+    uint16_t m_method;
+    const void *m_object;
+};
+
+
+class DeviceContextEventTrace : public D3D11DeviceContextHook
+{
+typedef D3D11DeviceContextHook super;
+public:
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        ID3D11DeviceContext *self = this;
+        ULONG r = super::Release();
+        if(r==0) {
+            ScopedLock lock(g_mutex);
+            g_deferred_contexts.erase(self);
+        }
+        return r;
+    }
+
+    virtual void STDMETHODCALLTYPE Draw(
+        UINT VertexCount,
+        UINT StartVertexLocation)
+    {
+        ScopedTrace trace(TM_Draw, this, VertexCount);
+        super::Draw(VertexCount, StartVertexLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawIndexed(
+        UINT IndexCount,
+        UINT StartIndexLocation,
+        INT BaseVertexLocation)
+    {
+        ScopedTrace trace(TM_DrawIndexed, this, IndexCount);
+        super::DrawIndexed(IndexCount, StartIndexLocation, BaseVertexLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawInstanced(
+        UINT VertexCountPerInstance,
+        UINT InstanceCount,
+        UINT StartVertexLocation,
+        UINT StartInstanceLocation)
+    {
+        ScopedTrace trace(TM_DrawInstanced, this, VertexCountPerInstance, InstanceCount);
+        super::DrawInstanced(VertexCountPerInstance, InstanceCount, StartVertexLocation, StartInstanceLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawIndexedInstanced(
+        UINT IndexCountPerInstance,
+        UINT InstanceCount,
+        UINT StartIndexLocation,
+        INT BaseVertexLocation,
+        UINT StartInstanceLocation)
+    {
+        ScopedTrace trace(TM_DrawIndexedInstanced, this, IndexCountPerInstance, InstanceCount);
+        super::DrawIndexedInstanced(IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation, StartInstanceLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawAuto(void)
+    {
+        ScopedTrace trace(TM_DrawAuto, this);
+        super::DrawAuto();
+    }
+
+    virtual void STDMETHODCALLTYPE DrawInstancedIndirect(
+        ID3D11Buffer *pBufferForArgs,
+        UINT AlignedByteOffsetForArgs)
+    {
+        ScopedTrace trace(TM_DrawInstancedIndirect, this, AlignedByteOffsetForArgs);
+        super::DrawInstancedIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawIndexedInstancedIndirect(
+        ID3D11Buffer *pBufferForArgs,
+        UINT AlignedByteOffsetForArgs)
+    {
+        ScopedTrace trace(TM_DrawIndexedInstancedIndirect, this, AlignedByteOffsetForArgs);
+        super::DrawIndexedInstancedIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+    }
+
+    virtual void STDMETHODCALLTYPE Dispatch(
+        UINT ThreadGroupCountX,
+        UINT ThreadGroupCountY,
+        UINT ThreadGroupCountZ)
+    {
+        ScopedTrace trace(TM_Dispatch, this, ThreadGroupCountX*ThreadGroupCountY*ThreadGroupCountZ);
+        super::Dispatch(ThreadGroupCountX, ThreadGroupCountY, ThreadGroupCountZ);
+    }
+
+    virtual void STDMETHODCALLTYPE DispatchIndirect(
+        ID3D11Buffer *pBufferForArgs,
+        UINT AlignedByteOffsetForArgs)
+    {
+        ScopedTrace trace(TM_DispatchIndirect, this, AlignedByteOffsetForArgs);
+        super::DispatchIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE Map(
+        ID3D11Resource *pResource,
+        UINT Subresource,
+        D3D11_MAP MapType,
+        UINT MapFlags,
+        D3D11_MAPPED_SUBRESOURCE *pMappedResource)
+    {
+        ScopedTrace trace(TM_Map, pResource, Subresource, MapType);
+        return super::Map(pResource, Subresource, MapType, MapFlags, pMappedResource);
+    }
+
+    virtual void STDMETHODCALLTYPE Unmap(
+        ID3D11Resource *pResource,
+        UINT Subresource)
+    {
+        ScopedTrace trace(TM_Unmap, pResource, Subresource);
+        super::Unmap(pResource, Subresource);
+    }
+
+    virtual void STDMETHODCALLTYPE UpdateSubresource(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        const D3D11_BOX *pDstBox,
+        const void *pSrcData,
+        UINT SrcRowPitch,
+        UINT SrcDepthPitch)
+    {
+        ScopedTrace trace(TM_UpdateSubresource, pDstResource, DstSubresource, pDstBox!=NULL ? pDstBox->right-pDstBox->left : 0);
+        super::UpdateSubresource(pDstResource, DstSubresource, pDstBox, pSrcData, SrcRowPitch, SrcDepthPitch);
+    }
+
+    virtual void STDMETHODCALLTYPE CopyResource(
+        ID3D11Resource *pDstResource,
+        ID3D11Resource *pSrcResource)
+    {
+        ScopedTrace trace(TM_CopyResource, pDstResource);
+        super::CopyResource(pDstResource, pSrcResource);
+    }
+
+    virtual void STDMETHODCALLTYPE CopySubresourceRegion(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        UINT DstX,
+        UINT DstY,
+        UINT DstZ,
+        ID3D11Resource *pSrcResource,
+        UINT SrcSubresource,
+        const D3D11_BOX *pSrcBox)
+    {
+        ScopedTrace trace(TM_CopySubresourceRegion, pDstResource, DstSubresource, SrcSubresource);
+        super::CopySubresourceRegion(pDstResource, DstSubresource, DstX, DstY, DstZ, pSrcResource, SrcSubresource, pSrcBox);
+    }
+
+    virtual void STDMETHODCALLTYPE ResolveSubresource(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        ID3D11Resource *pSrcResource,
+        UINT SrcSubresource,
+        DXGI_FORMAT Format)
+    {
+        ScopedTrace trace(TM_ResolveSubresource, pDstResource, DstSubresource, Format);
+        super::ResolveSubresource(pDstResource, DstSubresource, pSrcResource, SrcSubresource, Format);
+    }
+
+    virtual void STDMETHODCALLTYPE ClearRenderTargetView(
+        ID3D11RenderTargetView *pRenderTargetView,
+        const FLOAT ColorRGBA[ 4 ])
+    {
+        ScopedTrace trace(TM_ClearRenderTargetView, pRenderTargetView);
+        super::ClearRenderTargetView(pRenderTargetView, ColorRGBA);
+    }
+
+    virtual void STDMETHODCALLTYPE ClearDepthStencilView(
+        ID3D11DepthStencilView *pDepthStencilView,
+        UINT ClearFlags,
+        FLOAT Depth,
+        UINT8 Stencil)
+    {
+        ScopedTrace trace(TM_ClearDepthStencilView, pDepthStencilView, ClearFlags);
+        super::ClearDepthStencilView(pDepthStencilView, ClearFlags, Depth, Stencil);
+    }
+
+    virtual void STDMETHODCALLTYPE ClearUnorderedAccessViewUint(
+        ID3D11UnorderedAccessView *pUnorderedAccessView,
+        const UINT Values[ 4 ])
+    {
+        ScopedTrace trace(TM_ClearUnorderedAccessViewUint, pUnorderedAccessView);
+        super::ClearUnorderedAccessViewUint(pUnorderedAccessView, Values);
+    }
+
+    virtual void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat(
+        ID3D11UnorderedAccessView *pUnorderedAccessView,
+        const FLOAT Values[ 4 ])
+    {
+        ScopedTrace trace(TM_ClearUnorderedAccessViewFloat, pUnorderedAccessView);
+        super::ClearUnorderedAccessViewFloat(pUnorderedAccessView, Values);
+    }
+
+    virtual void STDMETHODCALLTYPE GenerateMips(
+        ID3D11ShaderResourceView *pShaderResourceView)
+    {
+        ScopedTrace trace(TM_GenerateMips, pShaderResourceView);
+        super::GenerateMips(pShaderResourceView);
+    }
+
+    virtual void STDMETHODCALLTYPE OMSetRenderTargets(
+        UINT NumViews,
+        ID3D11RenderTargetView *const *ppRenderTargetViews,
+        ID3D11DepthStencilView *pDepthStencilView)
+    {
+        ScopedTrace trace(TM_OMSetRenderTargets, NumViews>0 && ppRenderTargetViews!=NULL ? ppRenderTargetViews[0] : NULL, NumViews);
+        super::OMSetRenderTargets(NumViews, ppRenderTargetViews, pDepthStencilView);
+    }
+
+    virtual void STDMETHODCALLTYPE Begin(
+        ID3D11Asynchronous *pAsync)
+    {
+        ScopedTrace trace(TM_Begin, pAsync);
+        super::Begin(pAsync);
+    }
+
+    virtual void STDMETHODCALLTYPE End(
+        ID3D11Asynchronous *pAsync)
+    {
+        ScopedTrace trace(TM_End, pAsync);
+        super::End(pAsync);
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE GetData(
+        ID3D11Asynchronous *pAsync,
+        void *pData,
+        UINT DataSize,
+        UINT GetDataFlags)
+    {
+        ScopedTrace trace(TM_GetData, pAsync, GetDataFlags);
+        return super::GetData(pAsync, pData, DataSize, GetDataFlags);
+    }
+
+    virtual void STDMETHODCALLTYPE Flush(void)
+    {
+        ScopedTrace trace(TM_Flush, this);
+        super::Flush();
+    }
+
+    virtual void STDMETHODCALLTYPE ExecuteCommandList(
+        ID3D11CommandList *pCommandList,
+        BOOL RestoreContextState)
+    {
+        ScopedTrace trace(TM_ExecuteCommandList, pCommandList, RestoreContextState);
+        super::ExecuteCommandList(pCommandList, RestoreContextState);
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE FinishCommandList(
+        BOOL RestoreDeferredContextState,
+        ID3D11CommandList **ppCommandList)
+    {
+        ScopedTrace trace(TM_FinishCommandList, this, RestoreDeferredContextState);
+        HRESULT r = super::FinishCommandList(RestoreDeferredContextState, ppCommandList);
+        if(r==S_OK) { trace.setObject(*ppCommandList); }
+        return r;
+    }
+
+    virtual void STDMETHODCALLTYPE ClearState(void)
+    {
+        ScopedTrace trace(TM_ClearState, this);
+        super::ClearState();
+    }
+};
+
+
+class DeviceEventTrace : public D3D11DeviceHook
+{
+typedef D3D11DeviceHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE CreateBuffer(
+        const D3D11_BUFFER_DESC *pDesc,
+        const D3D11_SUBRESOURCE_DATA *pInitialData,
+        ID3D11Buffer **ppBuffer)
+    {
+        ScopedTrace trace(TM_CreateBuffer, this, pDesc!=NULL ? pDesc->ByteWidth : 0, pDesc!=NULL ? pDesc->BindFlags : 0);
+        HRESULT r = super::CreateBuffer(pDesc, pInitialData, ppBuffer);
+        if(r==S_OK && ppBuffer!=NULL) { trace.setObject(*ppBuffer); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateTexture1D(
+        const D3D11_TEXTURE1D_DESC *pDesc,
+        const D3D11_SUBRESOURCE_DATA *pInitialData,
+        ID3D11Texture1D **ppTexture1D)
+    {
+        ScopedTrace trace(TM_CreateTexture1D, this, pDesc!=NULL ? pDesc->Width : 0, pDesc!=NULL ? pDesc->Format : 0);
+        HRESULT r = super::CreateTexture1D(pDesc, pInitialData, ppTexture1D);
+        if(r==S_OK && ppTexture1D!=NULL) { trace.setObject(*ppTexture1D); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateTexture2D(
+        const D3D11_TEXTURE2D_DESC *pDesc,
+        const D3D11_SUBRESOURCE_DATA *pInitialData,
+        ID3D11Texture2D **ppTexture2D)
+    {
+        ScopedTrace trace(TM_CreateTexture2D, this, pDesc!=NULL ? pDesc->Width : 0, pDesc!=NULL ? pDesc->Height : 0);
+        HRESULT r = super::CreateTexture2D(pDesc, pInitialData, ppTexture2D);
+        if(r==S_OK && ppTexture2D!=NULL) { trace.setObject(*ppTexture2D); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateTexture3D(
+        const D3D11_TEXTURE3D_DESC *pDesc,
+        const D3D11_SUBRESOURCE_DATA *pInitialData,
+        ID3D11Texture3D **ppTexture3D)
+    {
+        ScopedTrace trace(TM_CreateTexture3D, this, pDesc!=NULL ? pDesc->Width : 0, pDesc!=NULL ? pDesc->Height : 0);
+        HRESULT r = super::CreateTexture3D(pDesc, pInitialData, ppTexture3D);
+        if(r==S_OK && ppTexture3D!=NULL) { trace.setObject(*ppTexture3D); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateShaderResourceView(
+        ID3D11Resource *pResource,
+        const D3D11_SHADER_RESOURCE_VIEW_DESC *pDesc,
+        ID3D11ShaderResourceView **ppSRView)
+    {
+        ScopedTrace trace(TM_CreateShaderResourceView, pResource);
+        HRESULT r = super::CreateShaderResourceView(pResource, pDesc, ppSRView);
+        if(r==S_OK && ppSRView!=NULL) { trace.setObject(*ppSRView); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateUnorderedAccessView(
+        ID3D11Resource *pResource,
+        const D3D11_UNORDERED_ACCESS_VIEW_DESC *pDesc,
+        ID3D11UnorderedAccessView **ppUAView)
+    {
+        ScopedTrace trace(TM_CreateUnorderedAccessView, pResource);
+        HRESULT r = super::CreateUnorderedAccessView(pResource, pDesc, ppUAView);
+        if(r==S_OK && ppUAView!=NULL) { trace.setObject(*ppUAView); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateRenderTargetView(
+        ID3D11Resource *pResource,
+        const D3D11_RENDER_TARGET_VIEW_DESC *pDesc,
+        ID3D11RenderTargetView **ppRTView)
+    {
+        ScopedTrace trace(TM_CreateRenderTargetView, pResource);
+        HRESULT r = super::CreateRenderTargetView(pResource, pDesc, ppRTView);
+        if(r==S_OK && ppRTView!=NULL) { trace.setObject(*ppRTView); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateDepthStencilView(
+        ID3D11Resource *pResource,
+        const D3D11_DEPTH_STENCIL_VIEW_DESC *pDesc,
+        ID3D11DepthStencilView **ppDepthStencilView)
+    {
+        ScopedTrace trace(TM_CreateDepthStencilView, pResource);
+        HRESULT r = super::CreateDepthStencilView(pResource, pDesc, ppDepthStencilView);
+        if(r==S_OK && ppDepthStencilView!=NULL) { trace.setObject(*ppDepthStencilView); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateInputLayout(
+        const D3D11_INPUT_ELEMENT_DESC *pInputElementDescs,
+        UINT NumElements,
+        const void *pShaderBytecodeWithInputSignature,
+        SIZE_T BytecodeLength,
+        ID3D11InputLayout **ppInputLayout)
+    {
+        ScopedTrace trace(TM_CreateInputLayout, this, NumElements);
+        HRESULT r = super::CreateInputLayout(pInputElementDescs, NumElements, pShaderBytecodeWithInputSignature, BytecodeLength, ppInputLayout);
+        if(r==S_OK && ppInputLayout!=NULL) { trace.setObject(*ppInputLayout); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateVertexShader(
+        const void *pShaderBytecode,
+        SIZE_T BytecodeLength,
+        ID3D11ClassLinkage *pClassLinkage,
+        ID3D11VertexShader **ppVertexShader)
+    {
+        ScopedTrace trace(TM_CreateVertexShader, this, (uint32_t)BytecodeLength);
+        HRESULT r = super::CreateVertexShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppVertexShader);
+        if(r==S_OK && ppVertexShader!=NULL) { trace.setObject(*ppVertexShader); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreatePixelShader(
+        const void *pShaderBytecode,
+        SIZE_T BytecodeLength,
+        ID3D11ClassLinkage *pClassLinkage,
+        ID3D11PixelShader **ppPixelShader)
+    {
+        ScopedTrace trace(TM_CreatePixelShader, this, (uint32_t)BytecodeLength);
+        HRESULT r = super::CreatePixelShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppPixelShader);
+        if(r==S_OK && ppPixelShader!=NULL) { trace.setObject(*ppPixelShader); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateComputeShader(
+        const void *pShaderBytecode,
+        SIZE_T BytecodeLength,
+        ID3D11ClassLinkage *pClassLinkage,
+        ID3D11ComputeShader **ppComputeShader)
+    {
+        ScopedTrace trace(TM_CreateComputeShader, this, (uint32_t)BytecodeLength);
+        HRESULT r = super::CreateComputeShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppComputeShader);
+        if(r==S_OK && ppComputeShader!=NULL) { trace.setObject(*ppComputeShader); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateBlendState(
+        const D3D11_BLEND_DESC *pBlendStateDesc,
+        ID3D11BlendState **ppBlendState)
+    {
+        ScopedTrace trace(TM_CreateBlendState, this);
+        HRESULT r = super::CreateBlendState(pBlendStateDesc, ppBlendState);
+        if(r==S_OK && ppBlendState!=NULL) { trace.setObject(*ppBlendState); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateDepthStencilState(
+        const D3D11_DEPTH_STENCIL_DESC *pDepthStencilDesc,
+        ID3D11DepthStencilState **ppDepthStencilState)
+    {
+        ScopedTrace trace(TM_CreateDepthStencilState, this);
+        HRESULT r = super::CreateDepthStencilState(pDepthStencilDesc, ppDepthStencilState);
+        if(r==S_OK && ppDepthStencilState!=NULL) { trace.setObject(*ppDepthStencilState); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateRasterizerState(
+        const D3D11_RASTERIZER_DESC *pRasterizerDesc,
+        ID3D11RasterizerState **ppRasterizerState)
+    {
+        ScopedTrace trace(TM_CreateRasterizerState, this);
+        HRESULT r = super::CreateRasterizerState(pRasterizerDesc, ppRasterizerState);
+        if(r==S_OK && ppRasterizerState!=NULL) { trace.setObject(*ppRasterizerState); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateSamplerState(
+        const D3D11_SAMPLER_DESC *pSamplerDesc,
+        ID3D11SamplerState **ppSamplerState)
+    {
+        ScopedTrace trace(TM_CreateSamplerState, this);
+        HRESULT r = super::CreateSamplerState(pSamplerDesc, ppSamplerState);
+        if(r==S_OK && ppSamplerState!=NULL) { trace.setObject(*ppSamplerState); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateQuery(
+        const D3D11_QUERY_DESC *pQueryDesc,
+        ID3D11Query **ppQuery)
+    {
+        ScopedTrace trace(TM_CreateQuery, this, pQueryDesc!=NULL ? pQueryDesc->Query : 0);
+        HRESULT r = super::CreateQuery(pQueryDesc, ppQuery);
+        if(r==S_OK && ppQuery!=NULL) { trace.setObject(*ppQuery); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateDeferredContext(
+        UINT ContextFlags,
+        ID3D11DeviceContext **ppDeferredContext)
+    {
+        ScopedTrace trace(TM_CreateDeferredContext, this);
+        HRESULT r = super::CreateDeferredContext(ContextFlags, ppDeferredContext);
+        if(r==S_OK && ppDeferredContext!=NULL) {
+            trace.setObject(*ppDeferredContext);
+            ScopedLock lock(g_mutex);
+            if(g_deferred_contexts.insert(*ppDeferredContext).second) {
+                D3D11SetHook<DeviceContextEventTrace>(*ppDeferredContext);
+            }
+        }
+        return r;
+    }
+};
+
+
+class SwapChainEventTrace : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        ScopedTrace trace(TM_Present, this, SyncInterval, Flags);
+        return super::Present(SyncInterval, Flags);
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE ResizeBuffers(
+        UINT BufferCount,
+        UINT Width,
+        UINT Height,
+        DXGI_FORMAT NewFormat,
+        UINT SwapChainFlags)
+    {
+        ScopedTrace trace(TM_ResizeBuffers, this, Width, Height);
+        return super::ResizeBuffers(BufferCount, Width, Height, NewFormat, SwapChainFlags);
+    }
+};
+
+
+bool _D3D11EventTraceInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, const char *path)
+{
+    if(g_device!=NULL) { return false; }
+
+    LARGE_INTEGER freq;
+    ::QueryPerformanceFrequency(&freq);
+    if(!g_writer.open(path, freq.QuadPart)) {
+        return false;
+    }
+
+    if(g_buffers==NULL) {
+        g_buffers = new ThreadBuffer[D3D11EVENTTRACE_MAX_THREADS];
+    }
+    for(size_t i=0; i<D3D11EVENTTRACE_MAX_THREADS; ++i) {
+        ThreadBuffer &b = g_buffers[i];
+        b.head = b.tail = b.dropped = b.thread = 0;
+    }
+    g_num_buffers = 0;
+    g_dropped_threads = 0;
+    g_events = 0;
+    InterlockedIncrement(&g_generation);
+
+    g_stop_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    g_drain_thread = CreateThread(NULL, 0, DrainThread, NULL, 0, NULL);
+
+    g_swapchain = pSwapChain;
+    g_device = pDevice;
+    pDevice->GetImmediateContext(&g_context);
+    D3D11SetHook<SwapChainEventTrace>(pSwapChain);
+    D3D11SetHook<DeviceEventTrace>(pDevice);
+    D3D11SetHook<DeviceContextEventTrace>(g_context);
+    InterlockedExchange(&g_active, 1);
+    return true;
+}
+
+void _D3D11EventTraceFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    InterlockedExchange(&g_active, 0);
+    SetEvent(g_stop_event);
+    WaitForSingleObject(g_drain_thread, INFINITE);
+    CloseHandle(g_drain_thread);
+    CloseHandle(g_stop_event);
+    g_drain_thread = g_stop_event = NULL;
+
+    ScopedLock lock(g_mutex);
+    for(uint16_t i=0; i<TM_Count; ++i) {
+        g_writer.writeName(i, g_method_names[i]);
+    }
+    for(std::map<uint16_t, std::string>::const_iterator i=g_user_names.begin(); i!=g_user_names.end(); ++i) {
+        g_writer.writeName(i->first, i->second);
+    }
+    LONG n = std::min<LONG>(g_num_buffers, D3D11EVENTTRACE_MAX_THREADS);
+    for(LONG i=0; i<n; ++i) {
+        const ThreadBuffer &b = g_buffers[i];
+        ThreadNames::const_iterator name = g_thread_names.find((DWORD)b.thread);
+        g_writer.writeThread((uint32_t)b.thread, name!=g_thread_names.end() ? name->second : std::string(), (uint64_t)b.dropped);
+    }
+    g_writer.close();
+
+    for(ContextSet::iterator i=g_deferred_contexts.begin(); i!=g_deferred_contexts.end(); ++i) {
+        D3D11RemoveHook<DeviceContextEventTrace>(*i);
+    }
+    g_deferred_contexts.clear();
+    D3D11RemoveHook<SwapChainEventTrace>(g_swapchain);
+    D3D11RemoveHook<DeviceEventTrace>(g_device);
+    D3D11RemoveHook<DeviceContextEventTrace>(g_context);
+    g_context->Release();
+    g_context = NULL;
+    g_swapchain = NULL;
+    g_device = NULL;
+}
+
+void _D3D11EventTraceEmit(uint16_t method, char phase, const void *object, uint32_t arg0, uint32_t arg1)
+{
+    if(g_active==0) { return; }
+
+    ThreadBuffer *b = GetThreadBuffer();
+    if(b==NULL) {
+        InterlockedIncrement(&g_dropped_threads);
+        return;
+    }
+
+    LONG head = b->head;
+    if(ULONG(head-b->tail) >= D3D11EVENTTRACE_BUFFER_SIZE) {
+        b->dropped = b->dropped+1; // 書き込み側しか更新しない
+        return;
+    }
+
+    EventTraceEvent &e = b->events[ULONG(head) & (D3D11EVENTTRACE_BUFFER_SIZE-1)];
+    e.time = (uint64_t)GetPerformanceCounter();
+    e.object = (uint64_t)(size_t)object;
+    e.thread = (uint32_t)b->thread;
+    e.method = method;
+    e.phase = (uint8_t)phase;
+    e.pad = 0;
+    e.args[0] = arg0;
+    e.args[1] = arg1;
+
+    // イベントを書き終えてから回収側に見せる
+    MemoryBarrier();
+    b->head = head+1;
+}
+
+void _D3D11EventTraceRegisterName(uint16_t method, const char *name)
+{
+    ScopedLock lock(g_mutex);
+    g_user_names[method] = name!=NULL ? name : "";
+}
+
+void _D3D11EventTraceSetThreadName(const char *name)
+{
+    ScopedLock lock(g_mutex);
+    g_thread_names[GetCurrentThreadId()] = name!=NULL ? name : "";
+}
+
+void _D3D11EventTraceGetStats(D3D11EventTraceStats &out)
+{
+    ScopedLock lock(g_mutex);
+    LONG n = g_buffers!=NULL ? std::min<LONG>(g_num_buffers, D3D11EVENTTRACE_MAX_THREADS) : 0;
+    out.events = g_events;
+    out.dropped = 0;
+    for(LONG i=0; i<n; ++i) {
+        out.dropped += (uint64_t)g_buffers[i].dropped;
+    }
+    out.dropped_threads = (uint64_t)g_dropped_threads;
+    out.num_threads = (size_t)n;
+}
@@ -0,0 +1,75 @@
+﻿#ifndef _ist_D3D11EventTrace_h_
+#define _ist_D3D11EventTrace_h_
+#include <D3D11.h>
+#include <stdint.h>
+
+// hook した D3D11 の呼び出しを、スレッドごとの固定長イベントとして記録します。
+// 結果は Tools/EventTraceTool で Chrome の trace event 形式に変換し、chrome://tracing や Perfetto UI でタイムラインとして見られます。
+//
+// - イベントはスレッドごとのリングバッファ (single producer / single consumer) に書き込みます。
+//   記録はロックも確保もしない wait-free な処理で、バッファが一杯ならそのイベントは捨てて数だけ数えます
+// - バッファは D3D11EventTraceInitialize() でまとめて確保し、各スレッドは最初の記録時にその 1 つを割り当てられます。
+//   D3D11EVENTTRACE_MAX_THREADS を超えたスレッドのイベントは捨てます
+// - 回収用のスレッドが D3D11EVENTTRACE_DRAIN_INTERVAL ミリ秒ごとにバッファを回収し、ファイルに書き出します
+// - device (Create*)、immediate context と deferred context (描画、Map/Unmap、コピーなど)、swap chain (Present) を記録します
+//
+// 他の layer も D3D11EventTraceEmit() で独自のイベントを記録できます。
+// method id は D3D11ET_USER_METHOD 以上を使い、D3D11EventTraceRegisterName() で名前を登録しておきます。
+// 確保したバッファは、記録中のスレッドが残っていても安全なように、プロセス終了まで解放しません。
+//
+// 有効にするには、このファイルを include する前に D3D11EVENTTRACE_ENABLE を define しておく必要があります。
+// D3D11EVENTTRACE_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+// スレッドごとのバッファのイベント数 (2 の累乗)
+#ifndef D3D11EVENTTRACE_BUFFER_SIZE
+#define D3D11EVENTTRACE_BUFFER_SIZE 16384
+#endif
+#ifndef D3D11EVENTTRACE_MAX_THREADS
+#define D3D11EVENTTRACE_MAX_THREADS 32
+#endif
+#ifndef D3D11EVENTTRACE_DRAIN_INTERVAL
+#define D3D11EVENTTRACE_DRAIN_INTERVAL 10
+#endif
+
+// これ未満の method id は D3D11EventTrace 自身が使います
+#define D3D11ET_USER_METHOD 0x1000
+
+struct D3D11EventTraceStats
+{
+    uint64_t events;            // ファイルに書き出したイベント数
+    uint64_t dropped;           // バッファが一杯で捨てたイベント数
+    uint64_t dropped_threads;   // バッファを割り当てられなかったスレッドのイベント数
+    size_t num_threads;
+};
+
+#ifdef D3D11EVENTTRACE_ENABLE
+
+bool _D3D11EventTraceInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, const char *path);
+void _D3D11EventTraceFinalize();
+// phase は EventTracePhase ('B', 'E', 'i')
+void _D3D11EventTraceEmit(uint16_t method, char phase, const void *object, uint32_t arg0=0, uint32_t arg1=0);
+void _D3D11EventTraceRegisterName(uint16_t method, const char *name);
+// 呼び出したスレッドの名前を設定します
+void _D3D11EventTraceSetThreadName(const char *name);
+void _D3D11EventTraceGetStats(D3D11EventTraceStats &out);
+
+#define D3D11EventTraceInitialize(...)      _D3D11EventTraceInitialize(__VA_ARGS__)
+#define D3D11EventTraceFinalize()           _D3D11EventTraceFinalize()
+#define D3D11EventTraceEmit(...)            _D3D11EventTraceEmit(__VA_ARGS__)
+#define D3D11EventTraceRegisterName(...)    _D3D11EventTraceRegisterName(__VA_ARGS__)
+#define D3D11EventTraceSetThreadName(...)   _D3D11EventTraceSetThreadName(__VA_ARGS__)
+#define D3D11EventTraceGetStats(...)        _D3D11EventTraceGetStats(__VA_ARGS__)
+
+#else // D3D11EVENTTRACE_ENABLE
+
+#define D3D11EventTraceInitialize(...)
+#define D3D11EventTraceFinalize()
+#define D3D11EventTraceEmit(...)
+#define D3D11EventTraceRegisterName(...)
+#define D3D11EventTraceSetThreadName(...)
+#define D3D11EventTraceGetStats(...)
+
+#endif // D3D11EVENTTRACE_ENABLE
+
+#endif // _ist_D3D11EventTrace_h_
@@ -0,0 +1,208 @@
+﻿#define _CRT_SECURE_NO_WARNINGS
+#include "D3D11EventTraceFile.h"
+#include <algorithm>
+
+namespace {
+
+const uint32_t c_magic   = 0x54453344; // "D3ET"
+const uint32_t c_version = 1;
+
+enum RecordTag {
+    RT_EVENTS = 1,
+    RT_NAME   = 2,
+    RT_THREAD = 3,
+};
+
+inline void WriteU32(FILE *f, uint32_t v) { fwrite(&v, sizeof(v), 1, f); }
+inline void WriteU64(FILE *f, uint64_t v) { fwrite(&v, sizeof(v), 1, f); }
+inline void WriteString(FILE *f, const std::string &v)
+{
+    WriteU32(f, static_cast<uint32_t>(v.size()));
+    fwrite(v.c_str(), 1, v.size(), f);
+}
+
+inline bool ReadU32(FILE *f, uint32_t &v) { return fread(&v, sizeof(v), 1, f)==1; }
+inline bool ReadU64(FILE *f, uint64_t &v) { return fread(&v, sizeof(v), 1, f)==1; }
+inline bool ReadString(FILE *f, std::string &v)
+{
+    uint32_t len;
+    if(!ReadU32(f, len)) { return false; }
+    v.resize(len);
+    return len==0 || fread(&v[0], 1, len, f)==len;
+}
+
+void WriteJSONString(FILE *f, const std::string &v)
+{
+    fputc('"', f);
+    for(size_t i=0; i<v.size(); ++i) {
+        unsigned char c = v[i];
+        switch(c) {
+        case '"':  fputs("\\\"", f); break;
+        case '\\': fputs("\\\\", f); break;
+        case '\n': fputs("\\n", f); break;
+        case '\r': fputs("\\r", f); break;
+        case '\t': fputs("\\t", f); break;
+        default:
+            if(c<0x20) { fprintf(f, "\\u%04x", c); }
+            else       { fputc(c, f); }
+            break;
+        }
+    }
+    fputc('"', f);
+}
+
+bool LessTime(const EventTraceEvent *a, const EventTraceEvent *b)
+{
+    return a->time < b->time;
+}
+
+} // namespace
+
+
+EventTraceWriter::EventTraceWriter()
+    : m_file(NULL)
+{
+}
+
+EventTraceWriter::~EventTraceWriter()
+{
+    close();
+}
+
+bool EventTraceWriter::open(const char *path, uint64_t frequency)
+{
+    close();
+    m_file = fopen(path, "wb");
+    if(m_file==NULL) { return false; }
+
+    setvbuf(m_file, NULL, _IOFBF, 1024*1024);
+    WriteU32(m_file, c_magic);
+    WriteU32(m_file, c_version);
+    WriteU64(m_file, frequency);
+    return true;
+}
+
+void EventTraceWriter::close()
+{
+    if(m_file!=NULL) {
+        fclose(m_file);
+        m_file = NULL;
+    }
+}
+
+void EventTraceWriter::writeEvents(const EventTraceEvent *events, size_t num)
+{
+    if(m_file==NULL || num==0) { return; }
+
+    WriteU32(m_file, RT_EVENTS);
+    WriteU32(m_file, static_cast<uint32_t>(num));
+    fwrite(events, sizeof(EventTraceEvent), num, m_file);
+}
+
+void EventTraceWriter::writeName(uint32_t method, const std::string &name)
+{
+    if(m_file==NULL) { return; }
+
+    WriteU32(m_file, RT_NAME);
+    WriteU32(m_file, method);
+    WriteString(m_file, name);
+}
+
+void EventTraceWriter::writeThread(uint32_t thread, const std::string &name, uint64_t dropped)
+{
+    if(m_file==NULL) { return; }
+
+    WriteU32(m_file, RT_THREAD);
+    WriteU32(m_file, thread);
+    WriteString(m_file, name);
+    WriteU64(m_file, dropped);
+}
+
+
+bool ReadEventTrace(const char *path, EventTrace &out)
+{
+    FILE *f = fopen(path, "rb");
+    if(f==NULL) { return false; }
+
+    bool ok = true;
+    uint32_t magic=0, version=0;
+    if(!ReadU32(f, magic) || !ReadU32(f, version) || magic!=c_magic || version!=c_version || !ReadU64(f, out.frequency)) {
+        ok = false;
+    }
+
+    uint32_t tag;
+    while(ok && ReadU32(f, tag)) {
+        if(tag==RT_EVENTS) {
+            uint32_t num;
+            ok = ReadU32(f, num);
+            if(ok) {
+                size_t pos = out.events.size();
+                out.events.resize(pos+num);
+                ok = num==0 || fread(&out.events[pos], sizeof(EventTraceEvent), num, f)==num;
+            }
+        }
+        else if(tag==RT_NAME) {
+            uint32_t method;
+            std::string name;
+            ok = ReadU32(f, method) && ReadString(f, name);
+            if(ok) { out.names[method] = name; }
+        }
+        else if(tag==RT_THREAD) {
+            uint32_t thread;
+            EventTraceThread t;
+            ok = ReadU32(f, thread) && ReadString(f, t.name) && ReadU64(f, t.dropped);
+            if(ok) { out.threads[thread] = t; }
+        }
+        else {
+            ok = false;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+bool ExportChromeTrace(const EventTrace &trace, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if(f==NULL) { return false; }
+    setvbuf(f, NULL, _IOFBF, 1024*1024);
+
+    // スレッドごとには時刻順に並んでいるが、スレッド間では回収した順になっている
+    std::vector<const EventTraceEvent*> sorted;
+    sorted.reserve(trace.events.size());
+    for(size_t i=0; i<trace.events.size(); ++i) {
+        sorted.push_back(&trace.events[i]);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), LessTime);
+
+    uint64_t base = sorted.empty() ? 0 : sorted.front()->time;
+    double to_us = 1000000.0/double(trace.frequency);
+    bool first = true;
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    for(EventTrace::Threads::const_iterator i=trace.threads.begin(); i!=trace.threads.end(); ++i) {
+        if(i->second.name.empty()) { continue; }
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", i->first);
+        WriteJSONString(f, i->second.name);
+        fputs("}}", f);
+        first = false;
+    }
+    char name[32];
+    for(size_t i=0; i<sorted.size(); ++i) {
+        const EventTraceEvent &e = *sorted[i];
+        EventTrace::Names::const_iterator n = trace.names.find(e.method);
+        if(n==trace.names.end()) { sprintf(name, "method %u", e.method); }
+
+        fprintf(f, "%s{\"name\":", first ? "" : ",\n");
+        WriteJSONString(f, n!=trace.names.end() ? n->second : std::string(name));
+        fprintf(f, ",\"cat\":\"d3d11\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u%s,\"args\":{\"object\":\"0x%llx\",\"arg0\":%u,\"arg1\":%u}}",
+            e.phase, double(e.time-base)*to_us, e.thread, e.phase==ETP_INSTANT ? ",\"s\":\"t\"" : "",
+            (unsigned long long)e.object, e.args[0], e.args[1]);
+        first = false;
+    }
+    fputs("\n]}\n", f);
+
+    bool ok = ferror(f)==0;
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,86 @@
+﻿#ifndef _ist_D3D11EventTraceFile_h_
+#define _ist_D3D11EventTraceFile_h_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+// イベントトレースのファイル出力/読み込みと、Chrome の trace event 形式 (JSON) への変換を提供します。
+// D3D11 / Windows に依存しないので、トレースを変換するツール (Tools/EventTraceTool.cpp) からも使えます。
+//
+// ファイルは以下のレコードの列です。
+//  events: EventTraceEvent の配列をそのまま詰めたもの。スレッドごとのバッファを回収するたびに出力します
+//  name  : method id の名前。終了時にまとめて出力します
+//  thread: スレッドの名前と、バッファが溢れて捨てたイベントの数。終了時にまとめて出力します
+//
+// Chrome の形式は chrome://tracing や Perfetto UI (ui.perfetto.dev) でそのまま開けます。
+
+
+enum EventTracePhase {
+    ETP_BEGIN   = 'B',
+    ETP_END     = 'E',
+    ETP_INSTANT = 'i',
+};
+
+// 固定長 32 byte。ファイルにもこのまま書き出します
+struct EventTraceEvent
+{
+    uint64_t time;      // QueryPerformanceCounter() の値
+    uint64_t object;    // 対象のオブジェクト
+    uint32_t thread;
+    uint16_t method;
+    uint8_t phase;      // EventTracePhase
+    uint8_t pad;
+    uint32_t args[2];
+};
+
+struct EventTraceThread
+{
+    std::string name;
+    uint64_t dropped;
+
+    EventTraceThread() : dropped(0) {}
+};
+
+struct EventTrace
+{
+    typedef std::map<uint32_t, std::string> Names;
+    typedef std::map<uint32_t, EventTraceThread> Threads;
+
+    uint64_t frequency; // QueryPerformanceFrequency() の値
+    std::vector<EventTraceEvent> events;
+    Names names;
+    Threads threads;
+
+    EventTrace() : frequency(1) {}
+};
+
+
+class EventTraceWriter
+{
+public:
+    EventTraceWriter();
+    ~EventTraceWriter();
+
+    bool open(const char *path, uint64_t frequency);
+    void close();
+
+    void writeEvents(const EventTraceEvent *events, size_t num);
+    void writeName(uint32_t method, const std::string &name);
+    void writeThread(uint32_t thread, const std::string &name, uint64_t dropped);
+
+private:
+    EventTraceWriter(const EventTraceWriter&);
+    EventTraceWriter& operator=(const EventTraceWriter&);
+
+    FILE *m_file;
+};
+
+bool ReadEventTrace(const char *path, EventTrace &out);
+
+/// Chrome の trace event 形式で出力します。イベントは時刻順に並べ替え、時刻は最初のイベントからのマイクロ秒になります
+bool ExportChromeTrace(const EventTrace &trace, const char *path);
+
+#endif // _ist_D3D11EventTraceFile_h_
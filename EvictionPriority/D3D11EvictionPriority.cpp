@@ -0,0 +1,185 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Lock.h"
+#include "D3D11EvictionPriority.h"
+// binding heatmap の記録を使うので、その API の宣言が必要
+#ifndef D3D11BINDINGHEATMAP_ENABLE
+#define D3D11BINDINGHEATMAP_ENABLE
+#endif
+#include "../BindingHeatmap/D3D11BindingHeatmap.h"
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+
+typedef std::unordered_map<UINT64, UINT> PriorityTable; // key は D3D11GetObjectID()
+
+namespace {
+
+Mutex g_mutex;
+IDXGISwapChain *g_swapchain = NULL;
+ID3D11Device *g_device = NULL;
+LRUEvictionPolicy g_default_policy;
+IEvictionPolicy *g_policy = NULL;
+EvictionTraceWriter g_trace;
+UINT64 g_budget = 0;
+PriorityTable g_priorities;     // 変えたリソースの priority。入っていなければ DXGI_RESOURCE_PRIORITY_NORMAL
+D3D11EvictionPriorityStats g_stats;
+
+// 毎回確保し直さないよう使い回す
+std::vector<D3D11BindingHeatmapResource> g_heatmap;
+std::vector<EvictionResource> g_resources;
+std::vector<EvictionChange> g_changes;
+
+} // namespace
+
+
+UINT64 GetDedicatedVideoMemory(ID3D11Device *device)
+{
+    UINT64 r = 0;
+    IDXGIDevice *dxgi_device = NULL;
+    if(SUCCEEDED(device->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgi_device))) {
+        IDXGIAdapter *adapter = NULL;
+        if(SUCCEEDED(dxgi_device->GetAdapter(&adapter))) {
+            DXGI_ADAPTER_DESC desc;
+            if(SUCCEEDED(adapter->GetDesc(&desc))) { r = desc.DedicatedVideoMemory; }
+            adapter->Release();
+        }
+        dxgi_device->Release();
+    }
+    return r;
+}
+
+void UpdatePriorities(size_t frame)
+{
+    size_t n = _D3D11BindingHeatmapGetResources(NULL, 0);
+    g_heatmap.resize(n);
+    if(n>0) {
+        // 間に増えた分は次の見直しで
+        n = std::min<size_t>(n, _D3D11BindingHeatmapGetResources(&g_heatmap[0], n));
+    }
+
+    EvictionState state;
+    state.frame = frame;
+    state.budget = g_budget;
+    state.usage = 0;
+    g_resources.resize(n);
+    PriorityTable priorities;
+    for(size_t i=0; i<n; ++i) {
+        const D3D11BindingHeatmapResource &h = g_heatmap[i];
+        EvictionResource &r = g_resources[i];
+        r.id = h.id;
+        r.bytes = h.bytes;
+        r.create_frame = h.create_frame;
+        r.last_used_frame = h.last_used_frame;
+        r.use_count = h.use_count;
+        PriorityTable::const_iterator p = g_priorities.find(h.id);
+        r.priority = p!=g_priorities.end() ? p->second : EVICTION_PRIORITY_NORMAL;
+        if(r.priority!=EVICTION_PRIORITY_NORMAL) { priorities[r.id] = r.priority; }
+        state.usage += h.bytes;
+    }
+    g_priorities.swap(priorities); // 破棄されたリソースはここで落ちる
+    g_trace.write(state, g_resources);
+
+    g_changes.clear();
+    size_t wanted = PlanEvictionPriorities(g_resources, state, *g_policy, D3D11EVICTIONPRIORITY_MAX_CHANGES, g_changes);
+    for(size_t i=0; i<g_changes.size(); ++i) {
+        const EvictionChange &c = g_changes[i];
+        if(!_D3D11BindingHeatmapSetEvictionPriority(c.id, c.priority)) { continue; }
+
+        PriorityTable::const_iterator p = g_priorities.find(c.id);
+        UINT prev = p!=g_priorities.end() ? p->second : EVICTION_PRIORITY_NORMAL;
+        if(c.priority<prev) { ++g_stats.demotions; }
+        else                { ++g_stats.promotions; }
+        ++g_stats.changes;
+        if(c.priority==EVICTION_PRIORITY_NORMAL) { g_priorities.erase(c.id); }
+        else                                     { g_priorities[c.id] = c.priority; }
+    }
+    ++g_stats.updates;
+    g_stats.deferred += wanted-g_changes.size();
+    g_stats.budget = state.budget;
+    g_stats.usage = state.usage;
+}
+
+
+class SwapChainEvictionPriority : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        {
+            ScopedLock lock(g_mutex);
+            size_t frame = D3D11GetFrame();
+            if(frame % D3D11EVICTIONPRIORITY_INTERVAL == 0) { UpdatePriorities(frame); }
+        }
+        return super::Present(SyncInterval, Flags);
+    }
+};
+
+
+bool _D3D11EvictionPriorityInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice,
+    IEvictionPolicy *policy, UINT64 budget, const char *trace_path)
+{
+    if(g_device!=NULL) { return false; }
+    // binding heatmap が記録していなければ、見直しの材料が無い
+    if(_D3D11BindingHeatmapGetDevice()!=pDevice) {
+        OutputDebugStringA("D3D11EvictionPriorityInitialize(): binding heatmap is not initialized for this device.\n");
+        return false;
+    }
+    if(trace_path!=NULL && !g_trace.open(trace_path)) { return false; }
+
+    g_swapchain = pSwapChain;
+    g_device = pDevice;
+    g_policy = policy!=NULL ? policy : &g_default_policy;
+    g_budget = budget!=0 ? budget : GetDedicatedVideoMemory(pDevice);
+    memset(&g_stats, 0, sizeof(g_stats));
+    D3D11SetHook<SwapChainEvictionPriority>(pSwapChain);
+    return true;
+}
+
+void _D3D11EvictionPriorityFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    ScopedLock lock(g_mutex);
+    for(PriorityTable::const_iterator i=g_priorities.begin(); i!=g_priorities.end(); ++i) {
+        _D3D11BindingHeatmapSetEvictionPriority(i->first, EVICTION_PRIORITY_NORMAL);
+    }
+    g_priorities.clear();
+    g_heatmap.clear();
+    g_resources.clear();
+    g_changes.clear();
+    g_trace.close();
+
+    D3D11RemoveHook<SwapChainEvictionPriority>(g_swapchain);
+    g_policy = NULL;
+    g_swapchain = NULL;
+    g_device = NULL;
+}
+
+void _D3D11EvictionPrioritySetBudget(UINT64 budget)
+{
+    ScopedLock lock(g_mutex);
+    g_budget = budget!=0 ? budget : (g_device!=NULL ? GetDedicatedVideoMemory(g_device) : 0);
+}
+
+void _D3D11EvictionPriorityGetStats(D3D11EvictionPriorityStats &out)
+{
+    ScopedLock lock(g_mutex);
+    out = g_stats;
+}
+
+void _D3D11EvictionPriorityPrintStats()
+{
+    D3D11EvictionPriorityStats stats;
+    _D3D11EvictionPriorityGetStats(stats);
+
+    char buf[512];
+    sprintf_s(buf, "D3D11EvictionPriorityPrintStats(): Updates=%Iu Changes=%Iu (Demotions=%Iu Promotions=%Iu) Deferred=%Iu Usage=%.2fMB Budget=%.2fMB\n",
+        stats.updates, stats.changes, stats.demotions, stats.promotions, stats.deferred,
+        double(stats.usage)/(1024.0*1024.0), double(stats.budget)/(1024.0*1024.0));
+    OutputDebugStringA(buf);
+}
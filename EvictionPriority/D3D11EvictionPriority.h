@@ -0,0 +1,65 @@
+﻿#ifndef _ist_D3D11EvictionPriority_h_
+#define _ist_D3D11EvictionPriority_h_
+#include <D3D11.h>
+#include "../Utilities/EvictionPolicy.h"
+
+// D3D11BindingHeatmap が記録したリソースごとの最後に束縛されたフレームとサイズから、
+// D3D11EVICTIONPRIORITY_INTERVAL フレームごとに SetEvictionPriority() をまとめて呼び直します。
+// ビデオメモリが足りなくなったとき、長く使われていないリソースから追い出されるようにするためのものです。
+//
+// - 方針は IEvictionPolicy で差し替えられます。指定しなければ LRUEvictionPolicy を使います
+// - 1 回に変える priority は D3D11EVICTIONPRIORITY_MAX_CHANGES 個までで、サイズの大きいものを優先します
+// - budget を 0 にすると、アダプタの DedicatedVideoMemory を使います
+// - trace_path を指定すると、見直しごとの使用状況を書き出します。Tools/EvictionSimTool で方針を比較できます
+// - Finalize() で、変えた priority を DXGI_RESOURCE_PRIORITY_NORMAL に戻します
+//
+// 先に同じ device で D3D11BindingHeatmapInitialize() しておく必要があります。していなければ初期化に失敗します。
+// 有効にするには、このファイルを include する前に D3D11EVICTIONPRIORITY_ENABLE を define しておく必要があります。
+// D3D11EVICTIONPRIORITY_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+#ifndef D3D11EVICTIONPRIORITY_INTERVAL
+#define D3D11EVICTIONPRIORITY_INTERVAL 30
+#endif
+#ifndef D3D11EVICTIONPRIORITY_MAX_CHANGES
+#define D3D11EVICTIONPRIORITY_MAX_CHANGES 64
+#endif
+
+struct D3D11EvictionPriorityStats
+{
+    size_t updates;     // 見直した回数
+    size_t changes;     // SetEvictionPriority() を呼んだ回数
+    size_t demotions;
+    size_t promotions;
+    size_t deferred;    // D3D11EVICTIONPRIORITY_MAX_CHANGES を超えて次に回した数の合計
+    UINT64 budget;
+    UINT64 usage;       // 直前の見直し時の、記録しているリソースの合計サイズ
+};
+
+#ifdef D3D11EVICTIONPRIORITY_ENABLE
+
+// policy の所有権は呼び出し側にあり、D3D11EvictionPriorityFinalize() まで破棄してはいけません
+bool _D3D11EvictionPriorityInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice,
+    IEvictionPolicy *policy=NULL, UINT64 budget=0, const char *trace_path=NULL);
+void _D3D11EvictionPriorityFinalize();
+void _D3D11EvictionPrioritySetBudget(UINT64 budget);
+void _D3D11EvictionPriorityGetStats(D3D11EvictionPriorityStats &out);
+void _D3D11EvictionPriorityPrintStats();
+
+#define D3D11EvictionPriorityInitialize(...)    _D3D11EvictionPriorityInitialize(__VA_ARGS__)
+#define D3D11EvictionPriorityFinalize()         _D3D11EvictionPriorityFinalize()
+#define D3D11EvictionPrioritySetBudget(...)     _D3D11EvictionPrioritySetBudget(__VA_ARGS__)
+#define D3D11EvictionPriorityGetStats(...)      _D3D11EvictionPriorityGetStats(__VA_ARGS__)
+#define D3D11EvictionPriorityPrintStats()       _D3D11EvictionPriorityPrintStats()
+
+#else // D3D11EVICTIONPRIORITY_ENABLE
+
+#define D3D11EvictionPriorityInitialize(...)
+#define D3D11EvictionPriorityFinalize()
+#define D3D11EvictionPrioritySetBudget(...)
+#define D3D11EvictionPriorityGetStats(...)
+#define D3D11EvictionPriorityPrintStats()
+
+#endif // D3D11EVICTIONPRIORITY_ENABLE
+
+#endif // _ist_D3D11EvictionPriority_h_
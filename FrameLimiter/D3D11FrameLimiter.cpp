@@ -0,0 +1,123 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/Timer.h"
+#include "../Utilities/FramePacer.h"
+#include "D3D11FrameLimiter.h"
+#include <string.h>
+#include <stdio.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+
+
+// QueryPerformanceCounter() と Sleep() による IFrameClock
+class PerformanceCounterClock : public IFrameClock
+{
+public:
+    PerformanceCounterClock() : m_base(GetPerformanceCounter()) {}
+    virtual double now()            { return PerformanceCounterToMS(GetPerformanceCounter()-m_base); }
+    virtual void sleep(double ms)   { ::Sleep(DWORD(ms)); }
+    virtual void spin()             { YieldProcessor(); }
+
+private:
+    LONGLONG m_base;
+};
+
+namespace {
+
+Mutex g_mutex;
+IDXGISwapChain *g_swapchain = NULL;
+PerformanceCounterClock *g_clock = NULL;
+FramePacer *g_pacer = NULL;
+
+} // namespace
+
+
+class SwapChainFrameLimiter : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        if((Flags & DXGI_PRESENT_TEST)!=0) {
+            return super::Present(SyncInterval, Flags);
+        }
+
+        ScopedLock lock(g_mutex);
+        g_pacer->beforePresent();
+        HRESULT r = super::Present(SyncInterval, Flags);
+        g_pacer->afterPresent();
+        return r;
+    }
+};
+
+
+bool _D3D11FrameLimiterInitialize(IDXGISwapChain *pSwapChain, int mode, double target_frame_time)
+{
+    if(g_swapchain!=NULL) { return false; }
+
+    // Sleep() の精度を 1ms にする
+    timeBeginPeriod(1);
+    g_swapchain = pSwapChain;
+    g_clock = new PerformanceCounterClock();
+    g_pacer = new FramePacer(g_clock);
+    g_pacer->setMode(FRAME_PACER_MODE(mode));
+    g_pacer->setTargetFrameTime(target_frame_time);
+    D3D11SetHook<SwapChainFrameLimiter>(pSwapChain);
+    return true;
+}
+
+void _D3D11FrameLimiterFinalize()
+{
+    if(g_swapchain==NULL) { return; }
+
+    ScopedLock lock(g_mutex);
+    D3D11RemoveHook<SwapChainFrameLimiter>(g_swapchain);
+    delete g_pacer;
+    g_pacer = NULL;
+    delete g_clock;
+    g_clock = NULL;
+    g_swapchain = NULL;
+    timeEndPeriod(1);
+}
+
+void _D3D11FrameLimiterSetMode(int mode)
+{
+    ScopedLock lock(g_mutex);
+    if(g_pacer==NULL) { return; }
+    g_pacer->setMode(FRAME_PACER_MODE(mode));
+}
+
+void _D3D11FrameLimiterSetTargetFrameTime(double ms)
+{
+    ScopedLock lock(g_mutex);
+    if(g_pacer==NULL) { return; }
+    g_pacer->setTargetFrameTime(ms);
+}
+
+void _D3D11FrameLimiterGetStats(D3D11FrameLimiterStats &out)
+{
+    ScopedLock lock(g_mutex);
+    memset(&out, 0, sizeof(out));
+    if(g_pacer==NULL) { return; }
+    out.mode                = g_pacer->getMode();
+    out.target_frame_time   = g_pacer->getTargetFrameTime();
+    out.predicted_cost      = g_pacer->getPredictedCost();
+    out.last_cost           = g_pacer->getLastCost();
+    out.present_wait        = g_pacer->getLastPresentWait();
+    out.start_wait          = g_pacer->getLastStartWait();
+    out.missed_deadlines    = g_pacer->getMissedDeadlines();
+}
+
+void _D3D11FrameLimiterPrintStats()
+{
+    D3D11FrameLimiterStats stats;
+    _D3D11FrameLimiterGetStats(stats);
+
+    static const char *s_mode_names[] = { "PassThrough", "FixedRate", "LowLatency" };
+    char buf[512];
+    sprintf_s(buf, "D3D11FrameLimiterPrintStats(): Mode=%s Target=%.3fms PredictedCost=%.3fms LastCost=%.3fms PresentWait=%.3fms StartWait=%.3fms Missed=%Iu\n",
+        s_mode_names[stats.mode], stats.target_frame_time, stats.predicted_cost, stats.last_cost, stats.present_wait, stats.start_wait, stats.missed_deadlines);
+    OutputDebugStringA(buf);
+}
@@ -0,0 +1,62 @@
+﻿#ifndef _ist_D3D11FrameLimiter_h_
+#define _ist_D3D11FrameLimiter_h_
+#include <D3D11.h>
+
+// IDXGISwapChain::Present() の前後で待機して、フレームレートと入力遅延を調整します。
+// 待機は残り時間が長い間は Sleep()、短くなったら spin で行います (Utilities/FramePacer.h の FramePacer)。
+// - D3D11FL_FIXED_RATE: Present() を目標のフレーム時間ごとに呼ばせます
+// - D3D11FL_LOW_LATENCY: 加えて Present() の後、直近のフレームの描画コマンド発行にかかった時間から逆算して、
+//   次のフレームの開始 (= 入力の読み取り) をできるだけ遅らせます
+// - D3D11FL_PASS_THROUGH: 何もしません
+// SyncInterval はそのまま渡すので、細かく制御したい場合はアプリ側で SyncInterval==0 にしてください。
+//
+// 有効にするには、このファイルを include する前に D3D11FRAMELIMITER_ENABLE を define しておく必要があります。
+// D3D11FRAMELIMITER_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+enum D3D11FL_MODE {
+    D3D11FL_PASS_THROUGH,
+    D3D11FL_FIXED_RATE,
+    D3D11FL_LOW_LATENCY,
+};
+
+struct D3D11FrameLimiterStats
+{
+    int mode;
+    double target_frame_time;   // ミリ秒
+    double predicted_cost;      // 直近のフレームの描画コマンド発行にかかった時間の最大値 (ミリ秒)
+    double last_cost;
+    double present_wait;        // 直前のフレームで Present() 前に待った時間 (ミリ秒)
+    double start_wait;          // 直前のフレームで Present() 後に待った時間 (ミリ秒)
+    size_t missed_deadlines;
+};
+
+#ifdef D3D11FRAMELIMITER_ENABLE
+
+// target_frame_time: ミリ秒
+bool _D3D11FrameLimiterInitialize(IDXGISwapChain *pSwapChain, int mode=D3D11FL_FIXED_RATE, double target_frame_time=1000.0/60.0);
+void _D3D11FrameLimiterFinalize();
+void _D3D11FrameLimiterSetMode(int mode);
+void _D3D11FrameLimiterSetTargetFrameTime(double ms);
+void _D3D11FrameLimiterGetStats(D3D11FrameLimiterStats &out);
+void _D3D11FrameLimiterPrintStats();
+
+#define D3D11FrameLimiterInitialize(...)        _D3D11FrameLimiterInitialize(__VA_ARGS__)
+#define D3D11FrameLimiterFinalize()             _D3D11FrameLimiterFinalize()
+#define D3D11FrameLimiterSetMode(...)           _D3D11FrameLimiterSetMode(__VA_ARGS__)
+#define D3D11FrameLimiterSetTargetFrameTime(...) _D3D11FrameLimiterSetTargetFrameTime(__VA_ARGS__)
+#define D3D11FrameLimiterGetStats(...)          _D3D11FrameLimiterGetStats(__VA_ARGS__)
+#define D3D11FrameLimiterPrintStats()           _D3D11FrameLimiterPrintStats()
+
+#else // D3D11FRAMELIMITER_ENABLE
+
+#define D3D11FrameLimiterInitialize(...)
+#define D3D11FrameLimiterFinalize()
+#define D3D11FrameLimiterSetMode(...)
+#define D3D11FrameLimiterSetTargetFrameTime(...)
+#define D3D11FrameLimiterGetStats(...)
+#define D3D11FrameLimiterPrintStats()
+
+#endif // D3D11FRAMELIMITER_ENABLE
+
+#endif // _ist_D3D11FrameLimiter_h_
@@ -0,0 +1,194 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Timer.h"
+#include "D3D11FrameTiming.h"
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+
+
+namespace {
+
+IDXGISwapChain *g_swapchain = NULL;
+LONGLONG g_base_time = 0;
+LONGLONG g_prev_begin = 0;
+DXGI_FRAME_STATISTICS g_prev_stats;
+bool g_prev_stats_valid = false;
+
+// Present() を呼ぶスレッドだけが書き込む ring buffer。
+// g_records[i % D3D11FRAMETIMING_HISTORY] を書き終えてから g_count を i+1 にします
+D3D11FrameTimingRecord g_records[D3D11FRAMETIMING_HISTORY];
+volatile LONG g_count = 0;
+
+} // namespace
+
+
+inline double ElapsedMS(LONGLONG t)
+{
+    return PerformanceCounterToMS(t-g_base_time);
+}
+
+// 落ちたフレーム数: 前回からの PresentRefreshCount の増分のうち、PresentCount の増分 * SyncInterval を超えた分
+UINT CountDroppedFrames(const DXGI_FRAME_STATISTICS &prev, const DXGI_FRAME_STATISTICS &cur, UINT sync_interval)
+{
+    if(sync_interval==0) { return 0; }
+    UINT presents = cur.PresentCount-prev.PresentCount;
+    UINT refreshes = cur.PresentRefreshCount-prev.PresentRefreshCount;
+    UINT expected = presents*sync_interval;
+    return refreshes>expected ? refreshes-expected : 0;
+}
+
+// 直近 max_num 個の記録を古い順にコピーし、コピーした数を返します。
+// コピー中に書き込み側に上書きされた分は捨てます
+size_t ReadRecords(D3D11FrameTimingRecord *out, size_t max_num)
+{
+    LONG count = g_count;
+    MemoryBarrier();
+    // 書き込み中の 1 つは避ける
+    size_t n = std::min<size_t>(std::min<size_t>(max_num, (size_t)count), D3D11FRAMETIMING_HISTORY-1);
+    size_t first = count-n;
+    for(size_t i=0; i<n; ++i) {
+        out[i] = g_records[(first+i) % D3D11FRAMETIMING_HISTORY];
+    }
+    MemoryBarrier();
+
+    // index i の記録は、g_count が i+D3D11FRAMETIMING_HISTORY になった時点で上書きされ始める
+    size_t count2 = (size_t)g_count;
+    size_t valid_first = count2>=D3D11FRAMETIMING_HISTORY ? count2-D3D11FRAMETIMING_HISTORY+1 : 0;
+    if(valid_first>first) {
+        size_t skip = std::min<size_t>(valid_first-first, n);
+        memmove(out, out+skip, sizeof(D3D11FrameTimingRecord)*(n-skip));
+        n -= skip;
+    }
+    return n;
+}
+
+
+class SwapChainFrameTiming : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::Present(SyncInterval, Flags);
+        LONGLONG end = GetPerformanceCounter();
+        if((Flags & DXGI_PRESENT_TEST)!=0) { return r; }
+
+        LONG index = g_count;
+        D3D11FrameTimingRecord &rec = g_records[index % D3D11FRAMETIMING_HISTORY];
+        memset(&rec, 0, sizeof(rec));
+        rec.frame = (size_t)index;
+        rec.present_begin = ElapsedMS(begin);
+        rec.present_end = ElapsedMS(end);
+        rec.frame_interval = g_prev_begin!=0 ? PerformanceCounterToMS(begin-g_prev_begin) : 0.0;
+        rec.present_time = PerformanceCounterToMS(end-begin);
+        rec.sync_interval = SyncInterval;
+        super::GetLastPresentCount(&rec.last_present_count);
+
+        DXGI_FRAME_STATISTICS stats;
+        if(SUCCEEDED(super::GetFrameStatistics(&stats))) {
+            rec.stats_valid = true;
+            rec.present_count = stats.PresentCount;
+            rec.present_refresh_count = stats.PresentRefreshCount;
+            rec.sync_refresh_count = stats.SyncRefreshCount;
+            rec.sync_qpc_time = stats.SyncQPCTime.QuadPart;
+            rec.queued = rec.last_present_count>stats.PresentCount ? rec.last_present_count-stats.PresentCount : 0;
+            if(g_prev_stats_valid) {
+                rec.dropped = CountDroppedFrames(g_prev_stats, stats, SyncInterval);
+            }
+            g_prev_stats = stats;
+            g_prev_stats_valid = true;
+        }
+        else {
+            g_prev_stats_valid = false;
+        }
+        g_prev_begin = begin;
+
+        MemoryBarrier();
+        g_count = index+1;
+        return r;
+    }
+};
+
+
+bool _D3D11FrameTimingInitialize(IDXGISwapChain *pSwapChain)
+{
+    if(g_swapchain!=NULL) { return false; }
+
+    g_swapchain = pSwapChain;
+    g_base_time = GetPerformanceCounter();
+    g_prev_begin = 0;
+    g_prev_stats_valid = false;
+    g_count = 0;
+    D3D11SetHook<SwapChainFrameTiming>(pSwapChain);
+    return true;
+}
+
+void _D3D11FrameTimingFinalize()
+{
+    if(g_swapchain==NULL) { return; }
+
+    D3D11RemoveHook<SwapChainFrameTiming>(g_swapchain);
+    g_swapchain = NULL;
+}
+
+bool _D3D11FrameTimingGetLastFrame(D3D11FrameTimingRecord &out)
+{
+    return ReadRecords(&out, 1)==1;
+}
+
+size_t _D3D11FrameTimingGetHistory(D3D11FrameTimingRecord *out, size_t max_num)
+{
+    return ReadRecords(out, max_num);
+}
+
+void _D3D11FrameTimingGetSummary(D3D11FrameTimingSummary &out, size_t num_frames)
+{
+    memset(&out, 0, sizeof(out));
+
+    D3D11FrameTimingRecord records[D3D11FRAMETIMING_HISTORY];
+    size_t n = ReadRecords(records, num_frames);
+    if(n==0) { return; }
+
+    // 最初のフレームは frame_interval が無い
+    double intervals[D3D11FRAMETIMING_HISTORY];
+    size_t num_intervals = 0;
+    double present_total = 0.0;
+    for(size_t i=0; i<n; ++i) {
+        const D3D11FrameTimingRecord &rec = records[i];
+        if(rec.frame!=0) { intervals[num_intervals++] = rec.frame_interval; }
+        present_total += rec.present_time;
+        out.present_time_max = std::max<double>(out.present_time_max, rec.present_time);
+        out.dropped += rec.dropped;
+    }
+    out.num_frames = n;
+    out.present_time_avg = present_total/n;
+    out.queued = records[n-1].queued;
+
+    if(num_intervals>0) {
+        std::sort(intervals, intervals+num_intervals);
+        double total = 0.0;
+        for(size_t i=0; i<num_intervals; ++i) { total += intervals[i]; }
+        out.frame_time_avg = total/num_intervals;
+        out.frame_time_min = intervals[0];
+        out.frame_time_max = intervals[num_intervals-1];
+        out.frame_time_p50 = intervals[(num_intervals-1)*50/100];
+        out.frame_time_p90 = intervals[(num_intervals-1)*90/100];
+        out.frame_time_p95 = intervals[(num_intervals-1)*95/100];
+        out.frame_time_p99 = intervals[(num_intervals-1)*99/100];
+    }
+}
+
+void _D3D11FrameTimingPrintSummary(size_t num_frames)
+{
+    D3D11FrameTimingSummary s;
+    _D3D11FrameTimingGetSummary(s, num_frames);
+
+    char buf[512];
+    sprintf_s(buf, "D3D11FrameTimingPrintSummary(): %Iu frames, FrameTime: Avg=%.3fms Min=%.3fms Max=%.3fms P50=%.3fms P90=%.3fms P95=%.3fms P99=%.3fms, Present: Avg=%.3fms Max=%.3fms, Dropped=%Iu Queued=%u\n",
+        s.num_frames, s.frame_time_avg, s.frame_time_min, s.frame_time_max, s.frame_time_p50, s.frame_time_p90, s.frame_time_p95, s.frame_time_p99,
+        s.present_time_avg, s.present_time_max, s.dropped, s.queued);
+    OutputDebugStringA(buf);
+}
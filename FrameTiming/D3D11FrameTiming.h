@@ -0,0 +1,87 @@
+﻿#ifndef _ist_D3D11FrameTiming_h_
+#define _ist_D3D11FrameTiming_h_
+#include <D3D11.h>
+
+// IDXGISwapChain::Present() の前後の時刻を記録し、フレームごとの記録を直近 D3D11FRAMETIMING_HISTORY フレーム分保持します。
+// - Present() の呼び出し間隔 (フレーム時間) と、Present() 内でブロックされた時間
+// - Present() 直後の GetFrameStatistics() / GetLastPresentCount() の結果。ここから溜まっているフレーム数と、落ちたフレーム数を求めます
+//   落ちたフレーム数は、前回からの PresentRefreshCount の増分が PresentCount の増分 * SyncInterval を超えた分です (SyncInterval==0 の場合は数えません)。
+//   フルスクリーンでないなど、GetFrameStatistics() が失敗する環境では D3D11FrameTimingRecord::stats_valid が false になります
+//
+// 記録は Present() を呼ぶスレッドだけが書き込む ring buffer で、読み出し側はロックを取りません。
+// D3D11FrameTimingGetLastFrame() は 1 フレーム分のコピーだけ、D3D11FrameTimingGetSummary() は指定フレーム数のソートだけのコストなので、
+// 毎フレーム呼んでオーバーレイなどに表示する用途に使えます。
+//
+// 有効にするには、このファイルを include する前に D3D11FRAMETIMING_ENABLE を define しておく必要があります。
+// D3D11FRAMETIMING_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+#ifndef D3D11FRAMETIMING_HISTORY
+#define D3D11FRAMETIMING_HISTORY 256
+#endif
+
+struct D3D11FrameTimingRecord
+{
+    size_t frame;
+    double present_begin;       // Present() に入った時刻 (初期化時からのミリ秒)
+    double present_end;         // Present() から戻った時刻
+    double frame_interval;      // 前のフレームの present_begin からの時間 (ミリ秒)
+    double present_time;        // present_end - present_begin
+    UINT sync_interval;
+    UINT last_present_count;    // GetLastPresentCount()
+    bool stats_valid;           // 以下は GetFrameStatistics() が成功した場合のみ有効
+    UINT present_count;
+    UINT present_refresh_count;
+    UINT sync_refresh_count;
+    LONGLONG sync_qpc_time;
+    UINT queued;                // last_present_count - present_count。まだ画面に出ていない Present() の数
+    UINT dropped;
+};
+
+struct D3D11FrameTimingSummary
+{
+    size_t num_frames;          // 集計したフレーム数
+    double frame_time_avg;      // frame_interval の統計 (ミリ秒)
+    double frame_time_min;
+    double frame_time_max;
+    double frame_time_p50;
+    double frame_time_p90;
+    double frame_time_p95;
+    double frame_time_p99;
+    double present_time_avg;    // Present() 内でブロックされた時間 (ミリ秒)
+    double present_time_max;
+    size_t dropped;
+    UINT queued;                // 最新のフレームの queued
+};
+
+#ifdef D3D11FRAMETIMING_ENABLE
+
+bool _D3D11FrameTimingInitialize(IDXGISwapChain *pSwapChain);
+void _D3D11FrameTimingFinalize();
+// 最新のフレームの記録を取得します。まだ 1 フレームも無い場合 false を返します
+bool _D3D11FrameTimingGetLastFrame(D3D11FrameTimingRecord &out);
+// 直近最大 max_num フレームの記録を古い順に out に格納し、格納した数を返します
+size_t _D3D11FrameTimingGetHistory(D3D11FrameTimingRecord *out, size_t max_num);
+// 直近 num_frames フレームの統計を求めます
+void _D3D11FrameTimingGetSummary(D3D11FrameTimingSummary &out, size_t num_frames=D3D11FRAMETIMING_HISTORY);
+void _D3D11FrameTimingPrintSummary(size_t num_frames=D3D11FRAMETIMING_HISTORY);
+
+#define D3D11FrameTimingInitialize(...)     _D3D11FrameTimingInitialize(__VA_ARGS__)
+#define D3D11FrameTimingFinalize()          _D3D11FrameTimingFinalize()
+#define D3D11FrameTimingGetLastFrame(...)   _D3D11FrameTimingGetLastFrame(__VA_ARGS__)
+#define D3D11FrameTimingGetHistory(...)     _D3D11FrameTimingGetHistory(__VA_ARGS__)
+#define D3D11FrameTimingGetSummary(...)     _D3D11FrameTimingGetSummary(__VA_ARGS__)
+#define D3D11FrameTimingPrintSummary(...)   _D3D11FrameTimingPrintSummary(__VA_ARGS__)
+
+#else // D3D11FRAMETIMING_ENABLE
+
+#define D3D11FrameTimingInitialize(...)
+#define D3D11FrameTimingFinalize()
+#define D3D11FrameTimingGetLastFrame(...)   false
+#define D3D11FrameTimingGetHistory(...)     0
+#define D3D11FrameTimingGetSummary(...)
+#define D3D11FrameTimingPrintSummary(...)
+
+#endif // D3D11FRAMETIMING_ENABLE
+
+#endif // _ist_D3D11FrameTiming_h_
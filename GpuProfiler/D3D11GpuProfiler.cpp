@@ -0,0 +1,295 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/GpuProfiler.h"
+#include "D3D11GpuProfiler.h"
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+
+
+// ID3D11Query で IGpuQueryContext を実装します
+class QueryContext : public IGpuQueryContext
+{
+public:
+    virtual GpuQuery createTimestamp();
+    virtual GpuQuery createDisjoint();
+    virtual void releaseQuery(GpuQuery q);
+    virtual void begin(GpuQuery q);
+    virtual void end(GpuQuery q);
+    virtual bool getTimestamp(GpuQuery q, uint64_t &out);
+    virtual bool getDisjoint(GpuQuery q, uint64_t &out_frequency, bool &out_disjoint);
+};
+
+namespace {
+
+Mutex g_mutex;
+IDXGISwapChain *g_swapchain = NULL;
+ID3D11Device *g_device = NULL;
+ID3D11DeviceContext *g_context = NULL;
+int g_opt = 0;
+QueryContext g_query_context;
+GpuProfiler *g_profiler = NULL;
+ID3D11RenderTargetView *g_rtvs[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+ID3D11DepthStencilView *g_dsv = NULL;
+
+} // namespace
+
+
+ID3D11Query* CreateQuery(D3D11_QUERY type)
+{
+    D3D11_QUERY_DESC desc = { type, 0 };
+    ID3D11Query *q = NULL;
+    g_device->CreateQuery(&desc, &q);
+    return q;
+}
+
+GpuQuery QueryContext::createTimestamp()        { return CreateQuery(D3D11_QUERY_TIMESTAMP); }
+GpuQuery QueryContext::createDisjoint()         { return CreateQuery(D3D11_QUERY_TIMESTAMP_DISJOINT); }
+void QueryContext::releaseQuery(GpuQuery q)     { ((ID3D11Query*)q)->Release(); }
+void QueryContext::begin(GpuQuery q)            { g_context->Begin((ID3D11Query*)q); }
+void QueryContext::end(GpuQuery q)              { g_context->End((ID3D11Query*)q); }
+
+bool QueryContext::getTimestamp(GpuQuery q, uint64_t &out)
+{
+    UINT64 v;
+    if(g_context->GetData((ID3D11Query*)q, &v, sizeof(v), D3D11_ASYNC_GETDATA_DONOTFLUSH)!=S_OK) { return false; }
+    out = v;
+    return true;
+}
+
+bool QueryContext::getDisjoint(GpuQuery q, uint64_t &out_frequency, bool &out_disjoint)
+{
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT v;
+    if(g_context->GetData((ID3D11Query*)q, &v, sizeof(v), D3D11_ASYNC_GETDATA_DONOTFLUSH)!=S_OK) { return false; }
+    out_frequency = v.Frequency;
+    out_disjoint = v.Disjoint!=FALSE;
+    return true;
+}
+
+void GetPassName(ID3D11RenderTargetView *rtv, ID3D11DepthStencilView *dsv, char *out, size_t out_size)
+{
+    ID3D11View *view = rtv!=NULL ? (ID3D11View*)rtv : (ID3D11View*)dsv;
+    if(view==NULL) {
+        strncpy_s(out, out_size, "(no render target)", _TRUNCATE);
+        return;
+    }
+
+    ID3D11Resource *res = NULL;
+    view->GetResource(&res);
+    char name[D3D11GPUPROFILER_MAX_NAME];
+    UINT size = sizeof(name)-1;
+    if(SUCCEEDED(res->GetPrivateData(WKPDID_D3DDebugObjectName, &size, name))) {
+        name[size] = '\0';
+        strncpy_s(out, out_size, name, _TRUNCATE);
+    }
+    else {
+        sprintf_s(out, out_size, "%s 0x%p", rtv!=NULL ? "RT" : "DS", res);
+    }
+    res->Release();
+}
+
+// レンダーターゲットが変わっていれば、自動のパスを区切ります
+void OnSetRenderTargets(UINT num, ID3D11RenderTargetView *const *rtvs, ID3D11DepthStencilView *dsv)
+{
+    ID3D11RenderTargetView *new_rtvs[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+    num = std::min<UINT>(num, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT);
+    for(UINT i=0; rtvs!=NULL && i<num; ++i) { new_rtvs[i] = rtvs[i]; }
+    if(memcmp(new_rtvs, g_rtvs, sizeof(g_rtvs))==0 && dsv==g_dsv) { return; }
+    memcpy(g_rtvs, new_rtvs, sizeof(g_rtvs));
+    g_dsv = dsv;
+
+    ID3D11RenderTargetView *first = NULL;
+    for(UINT i=0; i<num && first==NULL; ++i) { first = new_rtvs[i]; }
+    char name[D3D11GPUPROFILER_MAX_NAME];
+    GetPassName(first, dsv, name, sizeof(name));
+    g_profiler->beginPass(name);
+}
+
+// フレームの最初のパスは、レンダーターゲットが前のフレームと同じでも区切る
+void ResetRenderTargets()
+{
+    memset(g_rtvs, 0, sizeof(g_rtvs));
+    g_dsv = NULL;
+}
+
+
+class DeviceContextGpuProfiler : public D3D11DeviceContextHook
+{
+typedef D3D11DeviceContextHook super;
+public:
+    virtual void STDMETHODCALLTYPE OMSetRenderTargets(
+        UINT NumViews,
+        ID3D11RenderTargetView *const *ppRenderTargetViews,
+        ID3D11DepthStencilView *pDepthStencilView)
+    {
+        {
+            ScopedLock lock(g_mutex);
+            OnSetRenderTargets(NumViews, ppRenderTargetViews, pDepthStencilView);
+        }
+        super::OMSetRenderTargets(NumViews, ppRenderTargetViews, pDepthStencilView);
+    }
+
+    virtual void STDMETHODCALLTYPE OMSetRenderTargetsAndUnorderedAccessViews(
+        UINT NumRTVs,
+        ID3D11RenderTargetView *const *ppRenderTargetViews,
+        ID3D11DepthStencilView *pDepthStencilView,
+        UINT UAVStartSlot,
+        UINT NumUAVs,
+        ID3D11UnorderedAccessView *const *ppUnorderedAccessViews,
+        const UINT *pUAVInitialCounts)
+    {
+        if(NumRTVs!=D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL) {
+            ScopedLock lock(g_mutex);
+            OnSetRenderTargets(NumRTVs, ppRenderTargetViews, pDepthStencilView);
+        }
+        super::OMSetRenderTargetsAndUnorderedAccessViews(NumRTVs, ppRenderTargetViews, pDepthStencilView, UAVStartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+    }
+};
+
+class SwapChainGpuProfiler : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        if((Flags & DXGI_PRESENT_TEST)!=0) {
+            return super::Present(SyncInterval, Flags);
+        }
+
+        {
+            ScopedLock lock(g_mutex);
+            g_profiler->beforePresent();
+        }
+        HRESULT r = super::Present(SyncInterval, Flags);
+        {
+            ScopedLock lock(g_mutex);
+            g_profiler->afterPresent();
+            ResetRenderTargets();
+        }
+        return r;
+    }
+};
+
+
+bool _D3D11GpuProfilerInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, int opt)
+{
+    if(g_device!=NULL) { return false; }
+
+    ScopedLock lock(g_mutex);
+    g_swapchain = pSwapChain;
+    g_device = pDevice;
+    g_opt = opt;
+    pDevice->GetImmediateContext(&g_context);
+    g_profiler = new GpuProfiler(&g_query_context,
+        D3D11GPUPROFILER_FRAME_LATENCY, D3D11GPUPROFILER_INITIAL_QUERIES, D3D11GPUPROFILER_MAX_QUERIES);
+    ResetRenderTargets();
+
+    D3D11SetHook<SwapChainGpuProfiler>(pSwapChain);
+    if((opt & D3D11GP_AUTO_PASSES)!=0) {
+        D3D11SetHook<DeviceContextGpuProfiler>(g_context);
+    }
+    g_profiler->start();
+    return true;
+}
+
+void _D3D11GpuProfilerFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    ScopedLock lock(g_mutex);
+    D3D11RemoveHook<SwapChainGpuProfiler>(g_swapchain);
+    if((g_opt & D3D11GP_AUTO_PASSES)!=0) {
+        D3D11RemoveHook<DeviceContextGpuProfiler>(g_context);
+    }
+
+    delete g_profiler;
+    g_profiler = NULL;
+    g_context->Release();
+    g_context = NULL;
+    g_swapchain = NULL;
+    g_device = NULL;
+}
+
+void _D3D11GpuProfilerBeginRegion(const char *name)
+{
+    ScopedLock lock(g_mutex);
+    if(g_device==NULL) { return; }
+    g_profiler->beginRegion(name);
+}
+
+void _D3D11GpuProfilerEndRegion()
+{
+    ScopedLock lock(g_mutex);
+    if(g_device==NULL) { return; }
+    g_profiler->endRegion();
+}
+
+size_t _D3D11GpuProfilerGetLastFrame(D3D11GpuProfilerResult *out, size_t max_num)
+{
+    ScopedLock lock(g_mutex);
+    if(g_device==NULL) { return 0; }
+    const std::vector<GpuProfilerResult> &results = g_profiler->getLastResults();
+    size_t n = std::min<size_t>(max_num, results.size());
+    for(size_t i=0; i<n; ++i) {
+        const GpuProfilerResult &r = results[i];
+        strncpy_s(out[i].name, r.name.c_str(), _TRUNCATE);
+        out[i].time = r.time;
+        out[i].depth = r.depth;
+        out[i].user_region = r.user_region;
+    }
+    return results.size();
+}
+
+void _D3D11GpuProfilerGetStats(D3D11GpuProfilerStats &out)
+{
+    ScopedLock lock(g_mutex);
+    memset(&out, 0, sizeof(out));
+    if(g_device==NULL) { return; }
+    out.frame           = g_profiler->getLastFrame();
+    out.frame_time      = g_profiler->getLastFrameTime();
+    out.num_queries     = g_profiler->getNumQueries();
+    out.skipped_frames  = g_profiler->getSkippedFrames();
+    out.disjoint_frames = g_profiler->getDisjointFrames();
+    out.dropped_regions = g_profiler->getDroppedRegions();
+}
+
+void _D3D11GpuProfilerPrintLastFrame()
+{
+    ScopedLock lock(g_mutex);
+    if(g_device==NULL) { return; }
+    std::string str;
+    char buf[512];
+    sprintf_s(buf, "D3D11GpuProfilerPrintLastFrame(): Frame=%Iu GPU=%.3fms Queries=%Iu Skipped=%Iu Disjoint=%Iu Dropped=%Iu\n",
+        g_profiler->getLastFrame(), g_profiler->getLastFrameTime(), g_profiler->getNumQueries(),
+        g_profiler->getSkippedFrames(), g_profiler->getDisjointFrames(), g_profiler->getDroppedRegions());
+    str += buf;
+    const std::vector<GpuProfilerResult> &results = g_profiler->getLastResults();
+    for(size_t i=0; i<results.size(); ++i) {
+        const GpuProfilerResult &r = results[i];
+        sprintf_s(buf, "  %*s%s: %.3fms\n", r.depth*2, "", r.name.c_str(), r.time);
+        str += buf;
+    }
+    str += "\n";
+    OutputDebugStringA(str.c_str());
+}
+
+void _D3D11GpuProfilerPrintAverages()
+{
+    ScopedLock lock(g_mutex);
+    if(g_device==NULL) { return; }
+    const GpuProfiler::RegionStatsTable &stats = g_profiler->getRegionStats();
+    std::string str;
+    char buf[512];
+    sprintf_s(buf, "D3D11GpuProfilerPrintAverages(): %Iu regions\n", stats.size());
+    str += buf;
+    for(GpuProfiler::RegionStatsTable::const_iterator i=stats.begin(); i!=stats.end(); ++i) {
+        const GpuProfilerRegionStats &rs = i->second;
+        sprintf_s(buf, "  %s: Avg=%.3fms Max=%.3fms Count=%Iu\n", i->first.c_str(), rs.total/rs.count, rs.max, rs.count);
+        str += buf;
+    }
+    str += "\n";
+    OutputDebugStringA(str.c_str());
+}
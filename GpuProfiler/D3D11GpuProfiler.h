@@ -0,0 +1,94 @@
+﻿#ifndef _ist_D3D11GpuProfiler_h_
+#define _ist_D3D11GpuProfiler_h_
+#include <D3D11.h>
+
+// D3D11_QUERY_TIMESTAMP / D3D11_QUERY_TIMESTAMP_DISJOINT で、パスごとの GPU 時間を計測します。
+// - D3D11GP_AUTO_PASSES を指定すると、immediate context の OMSetRenderTargets*() でレンダーターゲットが変わるたびに
+//   新しいパスとして区切ります。パス名はレンダーターゲット (なければ深度バッファ) のリソースの WKPDID_D3DDebugObjectName です
+// - D3D11GpuProfilerBeginRegion() / D3D11GpuProfilerEndRegion() で任意の区間を計測できます (入れ子可)
+//
+// query はあらかじめ確保したプールから使い回します。結果は D3D11GPUPROFILER_FRAME_LATENCY フレームの間に
+// GetData(D3D11_ASYNC_GETDATA_DONOTFLUSH) で待たずに回収し、まだ出ていなければ次の Present() でまた試します。
+// 回収が追いつかない場合、そのフレームは計測しません (D3D11GpuProfilerStats::skipped_frames)。
+// 結果が出るのは数フレーム遅れなので、D3D11GpuProfilerGetLastFrame() が返すのは回収できた最新のフレームの結果です。
+// query のプールと回収は Utilities/GpuProfiler.h の GpuProfiler が行います。
+//
+// 有効にするには、このファイルを include する前に D3D11GPUPROFILER_ENABLE を define しておく必要があります。
+// D3D11GPUPROFILER_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+#ifndef D3D11GPUPROFILER_FRAME_LATENCY
+#define D3D11GPUPROFILER_FRAME_LATENCY 4
+#endif
+// 最初に確保しておく timestamp query の数
+#ifndef D3D11GPUPROFILER_INITIAL_QUERIES
+#define D3D11GPUPROFILER_INITIAL_QUERIES 256
+#endif
+// timestamp query の数の上限。これを超える区間は計測しません
+#ifndef D3D11GPUPROFILER_MAX_QUERIES
+#define D3D11GPUPROFILER_MAX_QUERIES 2048
+#endif
+#ifndef D3D11GPUPROFILER_MAX_NAME
+#define D3D11GPUPROFILER_MAX_NAME 64
+#endif
+
+enum D3D11GP_OPTION {
+    D3D11GP_NONE = 0,
+    // レンダーターゲットの切り替えで自動的にパスを区切る
+    D3D11GP_AUTO_PASSES = 1,
+};
+
+struct D3D11GpuProfilerResult
+{
+    char name[D3D11GPUPROFILER_MAX_NAME];
+    double time;        // GPU 時間 (ミリ秒)
+    int depth;          // D3D11GpuProfilerBeginRegion() の入れ子の深さ。自動のパスは 0
+    bool user_region;   // D3D11GpuProfilerBeginRegion() による区間なら true
+};
+
+struct D3D11GpuProfilerStats
+{
+    size_t frame;               // 結果が出ている最新のフレーム
+    double frame_time;          // そのフレームの GPU 時間 (ミリ秒)
+    size_t num_queries;         // 確保済みの timestamp query の数
+    size_t skipped_frames;      // 回収が追いつかず計測しなかったフレーム数
+    size_t disjoint_frames;     // TIMESTAMP_DISJOINT で結果が無効だったフレーム数
+    size_t dropped_regions;     // query が足りず計測しなかった区間の数
+};
+
+#ifdef D3D11GPUPROFILER_ENABLE
+
+bool _D3D11GpuProfilerInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, int opt=D3D11GP_AUTO_PASSES);
+void _D3D11GpuProfilerFinalize();
+void _D3D11GpuProfilerBeginRegion(const char *name);
+void _D3D11GpuProfilerEndRegion();
+// 結果が出ている最新のフレームの区間を、発行順に最大 max_num 個 out に格納します。戻り値は区間の総数です
+size_t _D3D11GpuProfilerGetLastFrame(D3D11GpuProfilerResult *out, size_t max_num);
+void _D3D11GpuProfilerGetStats(D3D11GpuProfilerStats &out);
+void _D3D11GpuProfilerPrintLastFrame();
+// 名前ごとの平均/最大の GPU 時間を表示します
+void _D3D11GpuProfilerPrintAverages();
+
+#define D3D11GpuProfilerInitialize(...)     _D3D11GpuProfilerInitialize(__VA_ARGS__)
+#define D3D11GpuProfilerFinalize()          _D3D11GpuProfilerFinalize()
+#define D3D11GpuProfilerBeginRegion(...)    _D3D11GpuProfilerBeginRegion(__VA_ARGS__)
+#define D3D11GpuProfilerEndRegion()         _D3D11GpuProfilerEndRegion()
+#define D3D11GpuProfilerGetLastFrame(...)   _D3D11GpuProfilerGetLastFrame(__VA_ARGS__)
+#define D3D11GpuProfilerGetStats(...)       _D3D11GpuProfilerGetStats(__VA_ARGS__)
+#define D3D11GpuProfilerPrintLastFrame()    _D3D11GpuProfilerPrintLastFrame()
+#define D3D11GpuProfilerPrintAverages()     _D3D11GpuProfilerPrintAverages()
+
+#else // D3D11GPUPROFILER_ENABLE
+
+#define D3D11GpuProfilerInitialize(...)
+#define D3D11GpuProfilerFinalize()
+#define D3D11GpuProfilerBeginRegion(...)
+#define D3D11GpuProfilerEndRegion()
+#define D3D11GpuProfilerGetLastFrame(...)   0
+#define D3D11GpuProfilerGetStats(...)
+#define D3D11GpuProfilerPrintLastFrame()
+#define D3D11GpuProfilerPrintAverages()
+
+#endif // D3D11GPUPROFILER_ENABLE
+
+#endif // _ist_D3D11GpuProfiler_h_
@@ -0,0 +1,267 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Hash.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/Timer.h"
+#include "../Utilities/ResourceSize.h"
+#include "D3D11InputLayoutCache.h"
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string>
+#include <unordered_map>
+
+
+struct InputLayoutKey
+{
+    std::string elements;   // MakeElementsKey() の結果
+    std::string signature;  // 入力シグネチャ (見つからなければバイトコード全体) の中身。ハッシュが衝突しても取り違えないよう中身で比べる
+    uint64_t hash;          // 両方を合わせたハッシュ
+
+    bool operator==(const InputLayoutKey &v) const
+    {
+        return hash==v.hash && elements==v.elements && signature==v.signature;
+    }
+};
+
+struct CachedInputLayout
+{
+    InputLayoutKey key;
+    ID3D11InputLayout *layout;
+    LONGLONG create_time; // ドライバでの作成にかかった時間
+};
+
+typedef std::unordered_map<uint64_t, CachedInputLayout> CachedInputLayouts; // key は InputLayoutKey::hash
+typedef std::unordered_map<ID3D11InputLayout*, uint64_t> InputLayoutKeys;
+
+namespace {
+
+Mutex g_mutex;
+CachedInputLayouts g_layouts;
+InputLayoutKeys g_keys;
+ID3D11Device *g_device = NULL;
+
+size_t g_hits = 0;
+size_t g_misses = 0;
+LONGLONG g_create_time = 0;
+LONGLONG g_saved_time = 0;
+
+} // namespace
+
+
+inline void AppendUINT(std::string &out, UINT v)
+{
+    out.append((const char*)&v, sizeof(v));
+}
+
+// 要素の配列を、意味が同じなら同じになるバイト列に変換します。
+// - セマンティクス名は大文字小文字を区別しないので大文字にする
+// - D3D11_APPEND_ALIGNED_ELEMENT は実際のオフセットにする
+//   (サイズの分からないフォーマットの要素があったら、そのスロットは次に明示的なオフセットが来るまでそのまま)
+// - per-vertex 要素の InstanceDataStepRate は使われないので 0 にする
+std::string MakeElementsKey(const D3D11_INPUT_ELEMENT_DESC *pInputElementDescs, UINT NumElements)
+{
+    UINT slot_end[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT] = {0};
+    bool slot_unknown[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT] = {false}; // slot_end が分からなくなったスロット
+    std::string key;
+    for(UINT i=0; i<NumElements; ++i) {
+        const D3D11_INPUT_ELEMENT_DESC &e = pInputElementDescs[i];
+        for(const char *c=e.SemanticName; c!=NULL && *c!='\0'; ++c) {
+            key += (char)toupper((unsigned char)*c);
+        }
+        key += '\0';
+
+        UINT size = GetFormatBitsPerPixel(e.Format)/8;
+        UINT offset = e.AlignedByteOffset;
+        if(e.InputSlot<D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT) {
+            if(offset==D3D11_APPEND_ALIGNED_ELEMENT && !slot_unknown[e.InputSlot]) {
+                offset = slot_end[e.InputSlot];
+            }
+            if(size==0) {
+                slot_unknown[e.InputSlot] = true;
+            }
+            else if(offset!=D3D11_APPEND_ALIGNED_ELEMENT) {
+                slot_end[e.InputSlot] = offset+size;
+                slot_unknown[e.InputSlot] = false;
+            }
+        }
+        AppendUINT(key, e.SemanticIndex);
+        AppendUINT(key, e.Format);
+        AppendUINT(key, e.InputSlot);
+        AppendUINT(key, offset);
+        AppendUINT(key, e.InputSlotClass);
+        AppendUINT(key, e.InputSlotClass==D3D11_INPUT_PER_VERTEX_DATA ? 0 : e.InstanceDataStepRate);
+    }
+    return key;
+}
+
+// DXBC コンテナから入力シグネチャの chunk (ISGN / ISG1) を探します
+bool FindInputSignature(const void *bytecode, size_t length, const unsigned char *&out_data, size_t &out_size)
+{
+    // header: "DXBC", checksum[16], version, total size, chunk 数, chunk の offset の配列
+    const unsigned char *p = (const unsigned char*)bytecode;
+    if(length<32 || memcmp(p, "DXBC", 4)!=0) { return false; }
+    uint32_t num_chunks;
+    memcpy(&num_chunks, p+28, sizeof(num_chunks));
+    if(num_chunks>(length-32)/4) { return false; }
+
+    for(uint32_t i=0; i<num_chunks; ++i) {
+        // chunk: fourcc, size, data
+        uint32_t offset, size;
+        memcpy(&offset, p+32+i*4, sizeof(offset));
+        if(offset>length || length-offset<8) { continue; }
+        memcpy(&size, p+offset+4, sizeof(size));
+        if(length-offset-8<size) { continue; }
+        if(memcmp(p+offset, "ISGN", 4)==0 || memcmp(p+offset, "ISG1", 4)==0) {
+            out_data = p+offset+8;
+            out_size = size;
+            return true;
+        }
+    }
+    return false;
+}
+
+InputLayoutKey MakeInputLayoutKey(const D3D11_INPUT_ELEMENT_DESC *pInputElementDescs, UINT NumElements,
+    const void *pShaderBytecodeWithInputSignature, SIZE_T BytecodeLength)
+{
+    InputLayoutKey key;
+    key.elements = MakeElementsKey(pInputElementDescs, NumElements);
+
+    // 入力シグネチャが見つからなければバイトコード全体で代用 (先頭の 1 byte で区別しておく)
+    const unsigned char *signature = NULL;
+    size_t signature_size = 0;
+    if(FindInputSignature(pShaderBytecodeWithInputSignature, BytecodeLength, signature, signature_size)) {
+        key.signature = 'S';
+    }
+    else {
+        signature = (const unsigned char*)pShaderBytecodeWithInputSignature;
+        signature_size = BytecodeLength;
+        key.signature = 'B';
+    }
+    key.signature.append((const char*)signature, signature_size);
+    key.hash = HashCombine(HashBytes(key.elements.c_str(), key.elements.size()),
+        HashBytesFast(key.signature.c_str(), key.signature.size()));
+    return key;
+}
+
+
+// キャッシュ中の input layout に仕掛ける hook。解放されたらキャッシュから取り除きます
+class InputLayoutCacheHook : public D3D11InputLayoutHook
+{
+typedef D3D11InputLayoutHook super;
+public:
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        // 別スレッドの CreateInputLayout() がこの input layout を返そうとしている可能性があるので、ロックしたまま解放する
+        ScopedLock lock(g_mutex);
+        ULONG r = super::Release();
+        if(r==0) {
+            InputLayoutKeys::iterator i = g_keys.find(this);
+            if(i!=g_keys.end()) {
+                g_layouts.erase(i->second);
+                g_keys.erase(i);
+            }
+        }
+        return r;
+    }
+};
+
+
+class DeviceInputLayoutCache : public D3D11DeviceHook
+{
+typedef D3D11DeviceHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE CreateInputLayout(
+        const D3D11_INPUT_ELEMENT_DESC *pInputElementDescs,
+        UINT NumElements,
+        const void *pShaderBytecodeWithInputSignature,
+        SIZE_T BytecodeLength,
+        ID3D11InputLayout **ppInputLayout)
+    {
+        if(pInputElementDescs==NULL || pShaderBytecodeWithInputSignature==NULL || ppInputLayout==NULL) {
+            return super::CreateInputLayout(pInputElementDescs, NumElements, pShaderBytecodeWithInputSignature, BytecodeLength, ppInputLayout);
+        }
+
+        InputLayoutKey key = MakeInputLayoutKey(pInputElementDescs, NumElements, pShaderBytecodeWithInputSignature, BytecodeLength);
+        {
+            ScopedLock lock(g_mutex);
+            CachedInputLayouts::iterator i = g_layouts.find(key.hash);
+            if(i!=g_layouts.end() && i->second.key==key) {
+                ID3D11InputLayout *layout = i->second.layout;
+                layout->AddRef();
+                *ppInputLayout = layout;
+                ++g_hits;
+                g_saved_time += i->second.create_time;
+                return S_OK;
+            }
+        }
+
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::CreateInputLayout(pInputElementDescs, NumElements, pShaderBytecodeWithInputSignature, BytecodeLength, ppInputLayout);
+        LONGLONG elapsed = GetPerformanceCounter()-begin;
+        if(r==S_OK) {
+            ScopedLock lock(g_mutex);
+            ++g_misses;
+            g_create_time += elapsed;
+
+            ID3D11InputLayout *layout = *ppInputLayout;
+            if(g_keys.find(layout)==g_keys.end() && g_layouts.find(key.hash)==g_layouts.end()) {
+                CachedInputLayout &cl = g_layouts[key.hash];
+                cl.key = key;
+                cl.layout = layout;
+                cl.create_time = elapsed;
+                g_keys[layout] = key.hash;
+                D3D11SetHook<InputLayoutCacheHook>(layout);
+            }
+        }
+        return r;
+    }
+};
+
+
+bool _D3D11InputLayoutCacheInitialize(ID3D11Device *pDevice)
+{
+    if(g_device!=NULL) { return false; }
+
+    g_device = pDevice;
+    D3D11SetHook<DeviceInputLayoutCache>(pDevice);
+    return true;
+}
+
+void _D3D11InputLayoutCacheFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    ScopedLock lock(g_mutex);
+    D3D11RemoveHook<DeviceInputLayoutCache>(g_device);
+    for(CachedInputLayouts::iterator i=g_layouts.begin(); i!=g_layouts.end(); ++i) {
+        D3D11RemoveHook<InputLayoutCacheHook>(i->second.layout);
+    }
+    g_layouts.clear();
+    g_keys.clear();
+    g_device = NULL;
+
+    g_hits = g_misses = 0;
+    g_create_time = g_saved_time = 0;
+}
+
+void _D3D11InputLayoutCacheGetStats(D3D11InputLayoutCacheStats &out)
+{
+    ScopedLock lock(g_mutex);
+    out.num_cached  = g_layouts.size();
+    out.hits        = g_hits;
+    out.misses      = g_misses;
+    out.create_time = PerformanceCounterToMS(g_create_time);
+    out.saved_time  = PerformanceCounterToMS(g_saved_time);
+}
+
+void _D3D11InputLayoutCachePrintStats()
+{
+    D3D11InputLayoutCacheStats stats;
+    _D3D11InputLayoutCacheGetStats(stats);
+
+    size_t total = stats.hits + stats.misses;
+    char buf[512];
+    sprintf_s(buf, "D3D11InputLayoutCachePrintStats(): Cached=%Iu Hits=%Iu Misses=%Iu HitRate=%.1f%% CreateTime=%.3fms SavedTime=%.3fms\n",
+        stats.num_cached, stats.hits, stats.misses, total>0 ? 100.0*stats.hits/total : 0.0, stats.create_time, stats.saved_time);
+    OutputDebugStringA(buf);
+}
@@ -0,0 +1,47 @@
+﻿#ifndef _ist_D3D11InputLayoutCache_h_
+#define _ist_D3D11InputLayoutCache_h_
+#include <D3D11.h>
+
+// ID3D11Device::CreateInputLayout() で、同じ要素と入力シグネチャから作られた生存中の input layout があれば、
+// ドライバを呼ばずにそれを AddRef() して返します。
+// 要素の配列は正規化してから比較します (セマンティクス名の大文字小文字、D3D11_APPEND_ALIGNED_ELEMENT の解決、
+// per-vertex 要素の InstanceDataStepRate)。シェーダはバイトコード全体ではなく入力シグネチャ (ISGN chunk) で比較するので、
+// 別のシェーダでも入力シグネチャが同じなら同じ input layout が返ります。
+// キャッシュは参照を保持しないので、アプリ側の参照が無くなった input layout は通常通り解放され、キャッシュからも取り除かれます。
+// D3D11InputLayoutCachePrintStats() でヒット数と、ドライバでの作成時間を節約できた量を表示できます。
+//
+// 有効にするには、このファイルを include する前に D3D11INPUTLAYOUTCACHE_ENABLE を define しておく必要があります。
+// D3D11INPUTLAYOUTCACHE_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+struct D3D11InputLayoutCacheStats
+{
+    size_t num_cached;      // キャッシュ中の input layout の数
+    size_t hits;
+    size_t misses;
+    double create_time;     // ドライバでの作成にかかった時間の合計 (ミリ秒)
+    double saved_time;      // ヒットした input layout の作成時間の合計 (ミリ秒)
+};
+
+#ifdef D3D11INPUTLAYOUTCACHE_ENABLE
+
+bool _D3D11InputLayoutCacheInitialize(ID3D11Device *pDevice);
+void _D3D11InputLayoutCacheFinalize();
+void _D3D11InputLayoutCacheGetStats(D3D11InputLayoutCacheStats &out);
+void _D3D11InputLayoutCachePrintStats();
+
+#define D3D11InputLayoutCacheInitialize(...)    _D3D11InputLayoutCacheInitialize(__VA_ARGS__)
+#define D3D11InputLayoutCacheFinalize()         _D3D11InputLayoutCacheFinalize()
+#define D3D11InputLayoutCacheGetStats(...)      _D3D11InputLayoutCacheGetStats(__VA_ARGS__)
+#define D3D11InputLayoutCachePrintStats()       _D3D11InputLayoutCachePrintStats()
+
+#else // D3D11INPUTLAYOUTCACHE_ENABLE
+
+#define D3D11InputLayoutCacheInitialize(...)
+#define D3D11InputLayoutCacheFinalize()
+#define D3D11InputLayoutCacheGetStats(...)
+#define D3D11InputLayoutCachePrintStats()
+
+#endif // D3D11INPUTLAYOUTCACHE_ENABLE
+
+#endif // _ist_D3D11InputLayoutCache_h_
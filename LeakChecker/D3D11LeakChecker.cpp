@@ -1,7 +1,9 @@
 ﻿#include "../D3D11HookInterface.h"
 #include "../Utilities/Callstack.h"
 #include "../Utilities/Module.h"
+#include "../Utilities/ResourceSize.h"
 #include "D3D11LeakChecker.h"
+#include "D3D11LeakReport.h"
 #include <algorithm>
 #include <map>
 #include <vector>
@@ -11,17 +13,17 @@ namespace {
 
 struct CallStack
 {
-    void *stack[D3D11LEAKCHECKER_MAX_CALLSTACK_SIZE];
+    void *stack[D3D11LEAKCHECKER_MAX_CALLSTACK_SIZE]; // size 以降は未初期化
     size_t size;
     size_t frame;
+    uint64_t hash;
 
-    CallStack() : size(0), frame(0)
-    {
-        std::fill_n(stack, _countof(stack), (void*)NULL);
-    }
+    CallStack() : size(0), frame(0), hash(0)
+    {}
 
     void getCurrentCallstack();
-    std::string genKeyString() const;
+    void collectAddresses(std::vector<void*> &out) const;
+    std::string toSymbolNames(const char *indent) const;
 };
 
 struct ReferenceInfo
@@ -38,29 +40,63 @@ struct Entry
     void *address;
     void **vtable;
     size_t ref_count;
+    size_t bytes; // GPU メモリ使用量の推定値。リソース以外は 0
+    int kind;     // D3D11LC_OBJECT_KIND
     CallStack trace_create;
     std::string name;
 #ifdef D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
-    typedef std::map<std::string, ReferenceInfo> ReferenceTable;
+    typedef std::map<uint64_t, ReferenceInfo> ReferenceTable; // key は CallStack::hash
     ReferenceTable trace_addref;
     ReferenceTable trace_release;
 #endif // D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
 
-    Entry() : address(NULL), vtable(NULL), ref_count(1)
+    Entry() : address(NULL), vtable(NULL), ref_count(1), bytes(0), kind(D3D11LC_KIND_OTHER)
     {
         name = "unnamed";
     }
 
     void handleAddRef(ULONG rc);
     void handleRelease(ULONG rc);
+    void collectAddresses(std::vector<void*> &out) const;
     void printLeakInfo();
 };
 
 typedef std::map<IUnknown*, Entry> Entries;
 
+// 生成場所 + 種類ごとの生成/破棄の統計
+struct CallsiteStats
+{
+    CallStack sample; // 表示用
+    int kind;
+    size_t num_created;
+    size_t num_destroyed;
+    size_t live_bytes;
+    size_t total_bytes;
+    size_t first_frame;
+    size_t last_frame;
+    size_t history[D3D11LEAKCHECKER_CREATION_HISTORY]; // フレームごとの生成数のリングバッファ。history[head] が last_frame
+    size_t head;
+
+    CallsiteStats() : kind(D3D11LC_KIND_OTHER), num_created(0), num_destroyed(0), live_bytes(0), total_bytes(0),
+        first_frame(0), last_frame(0), head(0)
+    {
+        std::fill(history, history+_countof(history), 0);
+    }
+
+    void handleCreate(const Entry &e);
+    void handleDestroy(const Entry &e);
+    size_t getCreated(size_t frame, size_t age) const;
+    size_t getRecentCreated(size_t frame) const;
+    void getStats(uint64_t callsite, size_t frame, D3D11LCCallsiteStats &out) const;
+};
+
+typedef std::pair<uint64_t, int> CallsiteKey; // 生成時のコールスタックの hash, D3D11LC_OBJECT_KIND
+typedef std::map<CallsiteKey, CallsiteStats> CallsiteTable;
+
 namespace {
 
 Entries g_entries;
+CallsiteTable g_callsites;
 size_t g_frame = 0;
 bool g_opt_initialize_symbols = false;
 bool g_initialized = false;
@@ -70,15 +106,39 @@ bool g_initialized = false;
 
 
 
+// leak checker 内部のフレームは取得時に D3D11LEAKCHECKER_CALLSTACK_SKIP 個捨て、
+// D3D11 runtime やドライバ、スレッド開始部分のフレームはモジュールのアドレス範囲で取り除くので、
+// 保存されるのは必要なフレームだけです
 void CallStack::getCurrentCallstack()
 {
     frame = g_frame;
-    size = GetCallstack(stack, _countof(stack), 0);
+#ifdef D3D11LEAKCHECKER_USE_FRAME_POINTER
+    size = GetCallstackFP(stack, _countof(stack), D3D11LEAKCHECKER_CALLSTACK_SKIP, &hash);
+#else
+    size = GetCallstack(stack, _countof(stack), D3D11LEAKCHECKER_CALLSTACK_SKIP, &hash);
+#endif
+    size = FilterCallstack(stack, static_cast<int>(size), &hash);
+}
+
+void CallStack::collectAddresses(std::vector<void*> &out) const
+{
+    out.insert(out.end(), stack, stack+size);
+}
+
+std::string CallStack::toSymbolNames(const char *indent) const
+{
+    return CallstackToSymbolNames(const_cast<void**>(stack), static_cast<int>(size), 0, 0, indent);
 }
 
-std::string CallStack::genKeyString() const
+// 重複を除いたアドレスをまとめてシンボルキャッシュに解決させておきます。
+// 以降の AddressToSymbolName() はキャッシュを引くだけになります。
+void ResolveSymbols(std::vector<void*> &addresses)
 {
-    return std::string((char*)stack, sizeof(void*)*size);
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+    if(!addresses.empty()) {
+        ResolveAddresses(&addresses[0], addresses.size());
+    }
 }
 
 void Entry::handleAddRef(ULONG rc)
@@ -87,8 +147,7 @@ void Entry::handleAddRef(ULONG rc)
 #ifdef D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
     CallStack stack;
     stack.getCurrentCallstack();
-    std::string key = stack.genKeyString();
-    ReferenceInfo &ri = trace_addref[key];
+    ReferenceInfo &ri = trace_addref[stack.hash];
     if(ri.count++ == 0) {
         ri.stack = stack;
     }
@@ -101,51 +160,151 @@ void Entry::handleRelease(ULONG rc)
 #ifdef D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
     CallStack stack;
     stack.getCurrentCallstack();
-    std::string key = stack.genKeyString();
-    ReferenceInfo &ri = trace_release[key];
+    ReferenceInfo &ri = trace_release[stack.hash];
     if(ri.count++ == 0) {
         ri.stack = stack;
     }
 #endif // D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
 }
 
-void Entry::printLeakInfo()
+void CallsiteStats::handleCreate(const Entry &e)
 {
-    // コールスタックの必要な部分だけ抽出
-    // コンパイルオプションで変動するのでこの指定の仕方はよくないかも…
-    int c_head=0, c_tail=0;
-#ifdef _WIN64
-#ifdef _DEBUG
-    c_head = 2; c_tail = 4;
-#else
-    c_head = 0; c_tail = 3;
-#endif
-#else
-#ifdef _DEBUG
-    c_head = 2; c_tail = 5;
-#else
-    c_tail = 0; c_tail = 4;
-#endif
-#endif
+    size_t frame = e.trace_create.frame;
+    if(num_created==0) {
+        sample = e.trace_create;
+        kind = e.kind;
+        first_frame = last_frame = frame;
+    }
+    else if(frame!=last_frame) {
+        // 前回の生成から進んだフレーム分のスロットを 0 にしてから進める
+        size_t advance = std::min<size_t>(frame-last_frame, _countof(history));
+        for(size_t i=1; i<=advance; ++i) {
+            history[(head+i) % _countof(history)] = 0;
+        }
+        head = (head+advance) % _countof(history);
+        last_frame = frame;
+    }
+    ++history[head];
+    ++num_created;
+    live_bytes += e.bytes;
+    total_bytes += e.bytes;
+}
+
+void CallsiteStats::handleDestroy(const Entry &e)
+{
+    ++num_destroyed;
+    live_bytes -= e.bytes;
+}
+
+// frame から age フレーム前の生成数
+size_t CallsiteStats::getCreated(size_t frame, size_t age) const
+{
+    size_t elapsed = frame-last_frame;
+    if(age<elapsed || age-elapsed>=_countof(history)) { return 0; }
+    size_t n = _countof(history);
+    return history[(head + n - (age-elapsed)) % n];
+}
+
+size_t CallsiteStats::getRecentCreated(size_t frame) const
+{
+    size_t total = 0;
+    for(size_t i=0; i<_countof(history); ++i) {
+        total += getCreated(frame, i);
+    }
+    return total;
+}
+
+void CallsiteStats::getStats(uint64_t callsite, size_t frame, D3D11LCCallsiteStats &out) const
+{
+    out.callsite = callsite;
+    out.kind = kind;
+    out.num_created = num_created;
+    out.num_destroyed = num_destroyed;
+    out.num_live = num_created-num_destroyed;
+    out.live_bytes = live_bytes;
+    out.total_bytes = total_bytes;
+    out.first_frame = first_frame;
+    out.last_frame = last_frame;
+    for(size_t i=0; i<_countof(out.created_per_frame); ++i) {
+        out.created_per_frame[i] = getCreated(frame, i);
+    }
+}
 
+// 直近フレームの生成数が多い順
+struct GreaterRecentCreated
+{
+    size_t frame;
+    GreaterRecentCreated(size_t f) : frame(f) {}
+    bool operator()(const CallsiteTable::value_type *a, const CallsiteTable::value_type *b) const
+    {
+        return a->second.getRecentCreated(frame) > b->second.getRecentCreated(frame);
+    }
+};
+
+void SortCallsites(std::vector<const CallsiteTable::value_type*> &out)
+{
+    out.clear();
+    out.reserve(g_callsites.size());
+    for(CallsiteTable::const_iterator i=g_callsites.begin(); i!=g_callsites.end(); ++i) {
+        out.push_back(&*i);
+    }
+    std::stable_sort(out.begin(), out.end(), GreaterRecentCreated(g_frame));
+}
+
+const char* GetObjectKindName(int kind)
+{
+    static const char *s_names[] = {
+        "Buffer",
+        "Texture1D",
+        "Texture2D",
+        "Texture3D",
+        "ShaderResourceView",
+        "UnorderedAccessView",
+        "RenderTargetView",
+        "DepthStencilView",
+        "InputLayout",
+        "Shader",
+        "State",
+        "Query",
+        "Other",
+    };
+    return kind>=0 && kind<(int)_countof(s_names) ? s_names[kind] : "Unknown";
+}
+
+
+void Entry::collectAddresses(std::vector<void*> &out) const
+{
+    trace_create.collectAddresses(out);
+#ifdef D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
+    for(ReferenceTable::const_iterator i=trace_addref.begin(); i!=trace_addref.end(); ++i) {
+        i->second.stack.collectAddresses(out);
+    }
+    for(ReferenceTable::const_iterator i=trace_release.begin(); i!=trace_release.end(); ++i) {
+        i->second.stack.collectAddresses(out);
+    }
+#endif // D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
+}
+
+void Entry::printLeakInfo()
+{
     std::string str;
     char buf[512];
-    sprintf_s(buf, "Addr=0x%p Name=\"%s\" Ref=%d Frame=%d\n", address, name.c_str(), ref_count, trace_create.frame);
+    sprintf_s(buf, "Addr=0x%p Name=\"%s\" Ref=%d Frame=%d Size=%Iu\n", address, name.c_str(), ref_count, trace_create.frame, bytes);
     str += buf;
-    str += CallstackToSymbolNames(trace_create.stack, static_cast<int>(trace_create.size), c_head, c_tail, "    ");
+    str += trace_create.toSymbolNames("    ");
 
 #ifdef D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
     for(ReferenceTable::iterator i=trace_addref.begin(); i!=trace_addref.end(); ++i) {
         ReferenceInfo &ri = i->second;
         sprintf_s(buf, "  AddRef() %d times\n", ri.count);
         str += buf;
-        str += CallstackToSymbolNames(ri.stack.stack, static_cast<int>(ri.stack.size), c_head+1, c_tail, "    ");
+        str += ri.stack.toSymbolNames("    ");
     }
     for(ReferenceTable::iterator i=trace_release.begin(); i!=trace_release.end(); ++i) {
         ReferenceInfo &ri = i->second;
         sprintf_s(buf, "  Release() %d times\n", ri.count);
         str += buf;
-        str += CallstackToSymbolNames(ri.stack.stack, static_cast<int>(ri.stack.size), c_head+1, c_tail, "    ");
+        str += ri.stack.toSymbolNames("    ");
     }
 #endif // D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
     str += "\n";
@@ -153,6 +312,77 @@ void Entry::printLeakInfo()
 }
 
 
+// 生成場所/名前/フレーム単位での GPU メモリ使用量の集計
+struct MemoryUsage
+{
+    size_t count;
+    size_t bytes;
+    const Entry *sample; // 表示用の代表
+
+    MemoryUsage() : count(0), bytes(0), sample(NULL)
+    {}
+
+    void add(const Entry &e)
+    {
+        ++count;
+        bytes += e.bytes;
+        if(sample==NULL) { sample = &e; }
+    }
+};
+
+template<class T>
+bool GreaterBytes(const T *a, const T *b) { return a->bytes > b->bytes; }
+
+template<class Table>
+void SortByBytes(Table &table, std::vector<MemoryUsage*> &out)
+{
+    out.clear();
+    for(typename Table::iterator i=table.begin(); i!=table.end(); ++i) {
+        out.push_back(&i->second);
+    }
+    std::stable_sort(out.begin(), out.end(), GreaterBytes<MemoryUsage>);
+}
+
+
+// レポート出力用のコールスタック表。同じコールスタックには同じ id を振り、1 度だけ出力します。
+// 出現したアドレスも記録しておき、シンボル解決は最後にまとめて重複なしで行います。
+class ReportStackTable
+{
+public:
+    ReportStackTable(LeakReportWriter &writer) : m_writer(writer)
+    {
+    }
+
+    uint32_t getID(const CallStack &cs)
+    {
+        std::string key((const char*)cs.stack, sizeof(void*)*cs.size);
+
+        std::pair<IDTable::iterator, bool> r = m_ids.insert(std::make_pair(key, static_cast<uint32_t>(m_ids.size())));
+        if(r.second) {
+            m_writer.writeStack(r.first->second, cs.stack, cs.size);
+            m_addresses.insert(m_addresses.end(), cs.stack, cs.stack+cs.size);
+        }
+        return r.first->second;
+    }
+
+    void writeSymbols()
+    {
+        ResolveSymbols(m_addresses);
+        for(size_t i=0; i<m_addresses.size(); ++i) {
+            std::string name = AddressToSymbolName(m_addresses[i]);
+            if(!name.empty() && name[name.size()-1]=='\n') { name.resize(name.size()-1); }
+            m_writer.writeSymbol((uint64_t)(size_t)m_addresses[i], name);
+        }
+    }
+
+private:
+    typedef std::map<std::string, uint32_t> IDTable;
+    LeakReportWriter &m_writer;
+    IDTable m_ids;
+    std::vector<void*> m_addresses;
+};
+
+
 template<class T>
 class TLeakChecker : public T
 {
@@ -173,7 +403,12 @@ public:
         ULONG r = super::Release();
         Entries::iterator i = g_entries.find(this);
         if(i!=g_entries.end()) {
-            if(r==0) { g_entries.erase(i); }
+            if(r==0) {
+                Entry &e = i->second;
+                CallsiteTable::iterator cs = g_callsites.find(CallsiteKey(e.trace_create.hash, e.kind));
+                if(cs!=g_callsites.end()) { cs->second.handleDestroy(e); }
+                g_entries.erase(i);
+            }
             else { i->second.handleRelease(r); }
         }
         return r;
@@ -200,8 +435,35 @@ template<class T> struct GetLeakCheckedType { typedef TLeakChecker<typename D3D1
 template<> struct GetLeakCheckedType<ID3D11Device> { typedef DeviceLeakChecker result_type; };
 template<> struct GetLeakCheckedType<IDXGISwapChain> { typedef SwapChainLeakChecker result_type; };
 
+template<class T> struct GetObjectKind { static const int value = D3D11LC_KIND_OTHER; };
+#define DEFINE_OBJECT_KIND(T, Kind) template<> struct GetObjectKind<T> { static const int value = Kind; };
+DEFINE_OBJECT_KIND(ID3D11Buffer,                D3D11LC_KIND_BUFFER)
+DEFINE_OBJECT_KIND(ID3D11Texture1D,             D3D11LC_KIND_TEXTURE1D)
+DEFINE_OBJECT_KIND(ID3D11Texture2D,             D3D11LC_KIND_TEXTURE2D)
+DEFINE_OBJECT_KIND(ID3D11Texture3D,             D3D11LC_KIND_TEXTURE3D)
+DEFINE_OBJECT_KIND(ID3D11ShaderResourceView,    D3D11LC_KIND_SRV)
+DEFINE_OBJECT_KIND(ID3D11UnorderedAccessView,   D3D11LC_KIND_UAV)
+DEFINE_OBJECT_KIND(ID3D11RenderTargetView,      D3D11LC_KIND_RTV)
+DEFINE_OBJECT_KIND(ID3D11DepthStencilView,      D3D11LC_KIND_DSV)
+DEFINE_OBJECT_KIND(ID3D11InputLayout,           D3D11LC_KIND_INPUT_LAYOUT)
+DEFINE_OBJECT_KIND(ID3D11VertexShader,          D3D11LC_KIND_SHADER)
+DEFINE_OBJECT_KIND(ID3D11GeometryShader,        D3D11LC_KIND_SHADER)
+DEFINE_OBJECT_KIND(ID3D11PixelShader,           D3D11LC_KIND_SHADER)
+DEFINE_OBJECT_KIND(ID3D11HullShader,            D3D11LC_KIND_SHADER)
+DEFINE_OBJECT_KIND(ID3D11DomainShader,          D3D11LC_KIND_SHADER)
+DEFINE_OBJECT_KIND(ID3D11ComputeShader,         D3D11LC_KIND_SHADER)
+DEFINE_OBJECT_KIND(ID3D11BlendState,            D3D11LC_KIND_STATE)
+DEFINE_OBJECT_KIND(ID3D11DepthStencilState,     D3D11LC_KIND_STATE)
+DEFINE_OBJECT_KIND(ID3D11RasterizerState,       D3D11LC_KIND_STATE)
+DEFINE_OBJECT_KIND(ID3D11SamplerState,          D3D11LC_KIND_STATE)
+DEFINE_OBJECT_KIND(ID3D11Query,                 D3D11LC_KIND_QUERY)
+DEFINE_OBJECT_KIND(ID3D11Predicate,             D3D11LC_KIND_QUERY)
+DEFINE_OBJECT_KIND(ID3D11Counter,               D3D11LC_KIND_QUERY)
+#undef DEFINE_OBJECT_KIND
+
+// bytes: リソースの GPU メモリ使用量の推定値 (EstimateResourceSize() の結果)
 template<class T>
-void WatchD3D11Object(T *v)
+void WatchD3D11Object(T *v, size_t bytes=0)
 {
     // CreateSamplerState() などは、同じパラメータで作成されたオブジェクトが既にある場合、2 回目以降は参照カウンタだけ上げて過去に作成したオブジェクトを返します。
     // このため、作成直後であっても既に登録されている可能性があります。
@@ -220,8 +482,10 @@ void WatchD3D11Object(T *v)
     Entry &ti = g_entries[v];
     ti.address = v;
     ti.vtable = get_vtable(&hook);
-    ti.trace_create.frame = g_frame;
-    ti.trace_create.size = GetCallstack(ti.trace_create.stack, D3D11LEAKCHECKER_MAX_CALLSTACK_SIZE, 0);
+    ti.bytes = bytes;
+    ti.kind = GetObjectKind<T>::value;
+    ti.trace_create.getCurrentCallstack();
+    g_callsites[CallsiteKey(ti.trace_create.hash, ti.kind)].handleCreate(ti);
 }
 
 
@@ -235,7 +499,7 @@ public:
         ID3D11Buffer **ppBuffer)
     {
         HRESULT r = super::CreateBuffer(pDesc, pInitialData, ppBuffer);
-        if(r==S_OK) { WatchD3D11Object(*ppBuffer); }
+        if(r==S_OK) { WatchD3D11Object(*ppBuffer, EstimateResourceSize(*pDesc)); }
         return r;
     }
 
@@ -245,7 +509,7 @@ public:
         ID3D11Texture1D **ppTexture1D)
     {
         HRESULT r = super::CreateTexture1D(pDesc, pInitialData, ppTexture1D);
-        if(r==S_OK) { WatchD3D11Object(*ppTexture1D); }
+        if(r==S_OK) { WatchD3D11Object(*ppTexture1D, EstimateResourceSize(*pDesc)); }
         return r;
     }
 
@@ -255,7 +519,7 @@ public:
         ID3D11Texture2D **ppTexture2D)
     {
         HRESULT r = super::CreateTexture2D(pDesc, pInitialData, ppTexture2D);
-        if(r==S_OK) { WatchD3D11Object(*ppTexture2D); }
+        if(r==S_OK) { WatchD3D11Object(*ppTexture2D, EstimateResourceSize(*pDesc)); }
         return r;
     }
 
@@ -265,7 +529,7 @@ public:
         ID3D11Texture3D **ppTexture3D)
     {
         HRESULT r = super::CreateTexture3D(pDesc, pInitialData, ppTexture3D);
-        if(r==S_OK) { WatchD3D11Object(*ppTexture3D); }
+        if(r==S_OK) { WatchD3D11Object(*ppTexture3D, EstimateResourceSize(*pDesc)); }
         return r;
     }
 
@@ -532,6 +796,7 @@ void _D3D11LeakCheckerFinalize()
         D3D11RemoveHookDirect(i->first, i->second.vtable);
     }
     g_entries.clear();
+    g_callsites.clear();
     g_frame = 0;
 
     if(g_opt_initialize_symbols) { FinalizeSymbol(); }
@@ -547,8 +812,164 @@ void _D3D11LeakCheckerPrintLeakInfo()
     }
     else {
         OutputDebugStringA("D3D11LeakCheckerPrintLeakInfo(): leak detected.\n");
+        // VRAM を多く消費しているものから順に表示
+        std::vector<Entry*> entries;
+        entries.reserve(g_entries.size());
         for(Entries::iterator i=g_entries.begin(); i!=g_entries.end(); ++i) {
-            i->second.printLeakInfo();
+            entries.push_back(&i->second);
+        }
+        std::stable_sort(entries.begin(), entries.end(), GreaterBytes<Entry>);
+
+        // 同じアドレスは何度も出現するので、先に全部集めて 1 回ずつシンボル解決しておく
+        std::vector<void*> addresses;
+        for(size_t i=0; i<entries.size(); ++i) {
+            entries[i]->collectAddresses(addresses);
         }
+        ResolveSymbols(addresses);
+
+        for(size_t i=0; i<entries.size(); ++i) {
+            entries[i]->printLeakInfo();
+        }
+    }
+}
+
+bool _D3D11LeakCheckerExportLeakInfo(const char *path, int format)
+{
+    if(!g_initialized) { return false; }
+
+    LeakReportWriter writer;
+    if(!writer.open(path, format==D3D11LC_REPORT_BINARY ? LRF_BINARY : LRF_JSON)) {
+        return false;
+    }
+
+    // entry はその場で書き出し、シンボル解決は最後に 1 回だけ
+    ReportStackTable stacks(writer);
+    LeakReportEntry re;
+    for(Entries::iterator i=g_entries.begin(); i!=g_entries.end(); ++i) {
+        const Entry &e = i->second;
+        re.address   = (uint64_t)(size_t)e.address;
+        re.bytes     = e.bytes;
+        re.ref_count = static_cast<uint32_t>(e.ref_count);
+        re.frame     = static_cast<uint32_t>(e.trace_create.frame);
+        re.stack     = stacks.getID(e.trace_create);
+        re.name      = e.name;
+        re.refs.clear();
+#ifdef D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
+        for(Entry::ReferenceTable::const_iterator r=e.trace_addref.begin(); r!=e.trace_addref.end(); ++r) {
+            LeakReportReference ref;
+            ref.type  = LRR_ADDREF;
+            ref.count = static_cast<uint32_t>(r->second.count);
+            ref.stack = stacks.getID(r->second.stack);
+            re.refs.push_back(ref);
+        }
+        for(Entry::ReferenceTable::const_iterator r=e.trace_release.begin(); r!=e.trace_release.end(); ++r) {
+            LeakReportReference ref;
+            ref.type  = LRR_RELEASE;
+            ref.count = static_cast<uint32_t>(r->second.count);
+            ref.stack = stacks.getID(r->second.stack);
+            re.refs.push_back(ref);
+        }
+#endif // D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
+        writer.writeEntry(re);
+    }
+    stacks.writeSymbols();
+    return true;
+}
+
+void _D3D11LeakCheckerPrintMemoryUsage()
+{
+    if(!g_initialized) { return; }
+
+    typedef std::map<uint64_t, MemoryUsage> CallsiteUsageTable;
+    typedef std::map<std::string, MemoryUsage> NameUsageTable;
+    typedef std::map<size_t, MemoryUsage> FrameUsageTable;
+    CallsiteUsageTable by_callsite;
+    NameUsageTable by_name;
+    FrameUsageTable by_frame;
+    MemoryUsage total;
+
+    for(Entries::iterator i=g_entries.begin(); i!=g_entries.end(); ++i) {
+        const Entry &e = i->second;
+        if(e.bytes==0) { continue; }
+        total.add(e);
+        by_callsite[e.trace_create.hash].add(e);
+        by_name[e.name].add(e);
+        by_frame[e.trace_create.frame].add(e);
+    }
+
+    std::string str;
+    char buf[512];
+    sprintf_s(buf, "D3D11LeakCheckerPrintMemoryUsage(): %Iu bytes in %Iu resources\n", total.bytes, total.count);
+    str += buf;
+
+    std::vector<MemoryUsage*> sorted;
+    str += "by callsite:\n";
+    SortByBytes(by_callsite, sorted);
+    std::vector<void*> addresses;
+    for(size_t i=0; i<sorted.size(); ++i) {
+        sorted[i]->sample->trace_create.collectAddresses(addresses);
+    }
+    ResolveSymbols(addresses);
+    for(size_t i=0; i<sorted.size(); ++i) {
+        sprintf_s(buf, "  %Iu bytes in %Iu resources\n", sorted[i]->bytes, sorted[i]->count);
+        str += buf;
+        str += sorted[i]->sample->trace_create.toSymbolNames("    ");
+    }
+    str += "by name:\n";
+    SortByBytes(by_name, sorted);
+    for(size_t i=0; i<sorted.size(); ++i) {
+        sprintf_s(buf, "  %Iu bytes in %Iu resources: \"%s\"\n", sorted[i]->bytes, sorted[i]->count, sorted[i]->sample->name.c_str());
+        str += buf;
     }
+    str += "by frame:\n";
+    SortByBytes(by_frame, sorted);
+    for(size_t i=0; i<sorted.size(); ++i) {
+        sprintf_s(buf, "  %Iu bytes in %Iu resources: Frame=%Iu\n", sorted[i]->bytes, sorted[i]->count, sorted[i]->sample->trace_create.frame);
+        str += buf;
+    }
+    str += "\n";
+    OutputDebugStringA(str.c_str());
+}
+
+size_t _D3D11LeakCheckerGetCallsiteStats(D3D11LCCallsiteStats *out, size_t max_num)
+{
+    if(!g_initialized) { return 0; }
+
+    std::vector<const CallsiteTable::value_type*> sorted;
+    SortCallsites(sorted);
+    size_t n = std::min<size_t>(max_num, sorted.size());
+    for(size_t i=0; i<n; ++i) {
+        sorted[i]->second.getStats(sorted[i]->first.first, g_frame, out[i]);
+    }
+    return sorted.size();
+}
+
+void _D3D11LeakCheckerPrintCallsiteStats(size_t max_num)
+{
+    if(!g_initialized) { return; }
+
+    std::vector<const CallsiteTable::value_type*> sorted;
+    SortCallsites(sorted);
+    if(sorted.size()>max_num) { sorted.resize(max_num); }
+
+    std::vector<void*> addresses;
+    for(size_t i=0; i<sorted.size(); ++i) {
+        sorted[i]->second.sample.collectAddresses(addresses);
+    }
+    ResolveSymbols(addresses);
+
+    std::string str;
+    char buf[512];
+    sprintf_s(buf, "D3D11LeakCheckerPrintCallsiteStats(): %Iu callsites, Frame=%Iu\n", g_callsites.size(), g_frame);
+    str += buf;
+    for(size_t i=0; i<sorted.size(); ++i) {
+        const CallsiteStats &cs = sorted[i]->second;
+        sprintf_s(buf, "  %s: %Iu created in last %d frames, Created=%Iu Destroyed=%Iu Live=%Iu LiveSize=%Iu TotalSize=%Iu Frame=%Iu-%Iu\n",
+            GetObjectKindName(cs.kind), cs.getRecentCreated(g_frame), D3D11LEAKCHECKER_CREATION_HISTORY,
+            cs.num_created, cs.num_destroyed, cs.num_created-cs.num_destroyed, cs.live_bytes, cs.total_bytes, cs.first_frame, cs.last_frame);
+        str += buf;
+        str += cs.sample.toSymbolNames("    ");
+    }
+    str += "\n";
+    OutputDebugStringA(str.c_str());
 }
@@ -4,6 +4,12 @@
 
 // DirectX11 のリソースのリークチェック機能を提供します。
 // D3D11LeakCheckerPrintLeakInfo() を呼んだ時点で解放されてないリソースを、作成された場所のコールスタックと共に表示します。
+// バッファ/テクスチャは desc から推定した GPU メモリ使用量も記録し、使用量の多い順に表示します。
+// D3D11LeakCheckerExportLeakInfo() は同じ情報を JSON lines か binary 形式でファイルに書き出します。
+// 大量のリークがあっても高速で、Tools/LeakReportTool で複数回の実行結果をマージ/比較できます。
+// D3D11LeakCheckerPrintMemoryUsage() で、生存中のリソースの使用量を生成場所/名前/フレーム別に集計して表示できます。
+// D3D11LeakCheckerGetCallsiteStats() / D3D11LeakCheckerPrintCallsiteStats() で、生成場所 + オブジェクトの種類ごとの
+// 生成/破棄数と直近フレームの生成数を取得できます。毎フレーム大量に作って捨てている箇所を探すのに使います。
 // 
 // 有効にするには、このファイルを include する前に D3D11LEAKCHECKER_ENABLE を define しておく必要があります。
 // D3D11LEAKCHECKER_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
@@ -17,9 +23,31 @@
 //  とりあえず PIX、Intel GPA、Dxtory は併用可能なのを確認済みです。)
 
 
+#ifndef D3D11LEAKCHECKER_MAX_CALLSTACK_SIZE
 #define D3D11LEAKCHECKER_MAX_CALLSTACK_SIZE 32
+#endif
 #define D3D11LEAKCHECKER_ENABLE_ADDREF_TRACE
 
+// コールスタック取得時に先頭から捨てるフレーム数 (leak checker 内部の関数の分)。
+// インライン展開の具合で変わるので、合わない場合はプロジェクト設定で define して調整してください。
+// D3D11 runtime やドライバ内のフレームは取得時にモジュール単位で取り除かれます (ModuleIndex::addCallstackFilter() で追加可能)。
+#ifndef D3D11LEAKCHECKER_CALLSTACK_SKIP
+#ifdef _DEBUG
+#define D3D11LEAKCHECKER_CALLSTACK_SKIP 3
+#else
+#define D3D11LEAKCHECKER_CALLSTACK_SKIP 1
+#endif
+#endif
+
+// 生成場所ごとの統計で、フレーム別の生成数を何フレーム分記録するか
+#ifndef D3D11LEAKCHECKER_CREATION_HISTORY
+#define D3D11LEAKCHECKER_CREATION_HISTORY 16
+#endif
+
+// define すると CaptureStackBackTrace() の代わりに frame pointer をたどってコールスタックを取得します。
+// AddRef()/Release() の trace がかなり軽くなりますが、x86 で /Oy- (frame pointer 省略なし) のビルドでのみ有効です。
+//#define D3D11LEAKCHECKER_USE_FRAME_POINTER
+
 
 enum D3D11LC_OPTION {
     D3D11LC_NONE = 0,
@@ -29,22 +57,75 @@ enum D3D11LC_OPTION {
     D3D11LC_INIT_SYMBOLS = 1,
 };
 
+enum D3D11LC_REPORT_FORMAT {
+    D3D11LC_REPORT_JSON = 0,    // 1 行 1 レコードの JSON (JSON lines)
+    D3D11LC_REPORT_BINARY = 1,  // Tools/LeakReportTool で読める binary 形式
+};
+
+enum D3D11LC_OBJECT_KIND {
+    D3D11LC_KIND_BUFFER,
+    D3D11LC_KIND_TEXTURE1D,
+    D3D11LC_KIND_TEXTURE2D,
+    D3D11LC_KIND_TEXTURE3D,
+    D3D11LC_KIND_SRV,
+    D3D11LC_KIND_UAV,
+    D3D11LC_KIND_RTV,
+    D3D11LC_KIND_DSV,
+    D3D11LC_KIND_INPUT_LAYOUT,
+    D3D11LC_KIND_SHADER,
+    D3D11LC_KIND_STATE,
+    D3D11LC_KIND_QUERY,     // query/predicate/counter
+    D3D11LC_KIND_OTHER,
+    D3D11LC_KIND_MAX,
+};
+
+// 生成場所 (生成時のコールスタック) + オブジェクトの種類ごとの統計
+struct D3D11LCCallsiteStats
+{
+    UINT64 callsite;        // 生成時のコールスタックの hash
+    int kind;               // D3D11LC_OBJECT_KIND
+    size_t num_created;
+    size_t num_destroyed;
+    size_t num_live;
+    size_t live_bytes;      // 生存中のリソースの GPU メモリ使用量の推定値
+    size_t total_bytes;     // これまでに生成したリソースの推定値の合計
+    size_t first_frame;     // 最初/最後に生成されたフレーム
+    size_t last_frame;
+    size_t created_per_frame[D3D11LEAKCHECKER_CREATION_HISTORY]; // [0] が現在のフレーム、[1] が 1 つ前のフレーム…の生成数
+};
+
 #ifdef D3D11LEAKCHECKER_ENABLE
 
 // opt: D3D11LC_OPTION の bit の組み合わせ
 bool _D3D11LeakCheckerInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, int opt=D3D11LC_INIT_SYMBOLS);
 void _D3D11LeakCheckerFinalize();
 void _D3D11LeakCheckerPrintLeakInfo();
+// format: D3D11LC_REPORT_FORMAT
+bool _D3D11LeakCheckerExportLeakInfo(const char *path, int format=D3D11LC_REPORT_JSON);
+void _D3D11LeakCheckerPrintMemoryUsage();
+// 直近 D3D11LEAKCHECKER_CREATION_HISTORY フレームの生成数が多い順に、最大 max_num 個を out に格納します。
+// 戻り値は生成場所の総数
+size_t _D3D11LeakCheckerGetCallsiteStats(D3D11LCCallsiteStats *out, size_t max_num);
+// 同じ順で、上位 max_num 個を生成場所のコールスタックと共に表示します
+void _D3D11LeakCheckerPrintCallsiteStats(size_t max_num=20);
 
 #define D3D11LeakCheckerInitialize(...) _D3D11LeakCheckerInitialize(__VA_ARGS__)
 #define D3D11LeakCheckerFinalize()      _D3D11LeakCheckerFinalize()
 #define D3D11LeakCheckerPrintLeakInfo() _D3D11LeakCheckerPrintLeakInfo()
+#define D3D11LeakCheckerExportLeakInfo(...) _D3D11LeakCheckerExportLeakInfo(__VA_ARGS__)
+#define D3D11LeakCheckerPrintMemoryUsage() _D3D11LeakCheckerPrintMemoryUsage()
+#define D3D11LeakCheckerGetCallsiteStats(...) _D3D11LeakCheckerGetCallsiteStats(__VA_ARGS__)
+#define D3D11LeakCheckerPrintCallsiteStats(...) _D3D11LeakCheckerPrintCallsiteStats(__VA_ARGS__)
 
 #else // D3D11LEAKCHECKER_ENABLE
 
 #define D3D11LeakCheckerInitialize(...) 
 #define D3D11LeakCheckerFinalize() 
 #define D3D11LeakCheckerPrintLeakInfo() 
+#define D3D11LeakCheckerExportLeakInfo(...) 
+#define D3D11LeakCheckerPrintMemoryUsage() 
+#define D3D11LeakCheckerGetCallsiteStats(...) 0
+#define D3D11LeakCheckerPrintCallsiteStats(...) 
 
 #endif // D3D11LEAKCHECKER_ENABLE
 
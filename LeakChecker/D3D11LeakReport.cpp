@@ -0,0 +1,216 @@
+﻿#define _CRT_SECURE_NO_WARNINGS
+#include "D3D11LeakReport.h"
+
+namespace {
+
+const uint32_t c_magic   = 0x524C3344; // "D3LR"
+const uint32_t c_version = 1;
+
+enum RecordTag {
+    RT_STACK  = 1,
+    RT_ENTRY  = 2,
+    RT_SYMBOL = 3,
+};
+
+inline void WriteU32(FILE *f, uint32_t v) { fwrite(&v, sizeof(v), 1, f); }
+inline void WriteU64(FILE *f, uint64_t v) { fwrite(&v, sizeof(v), 1, f); }
+inline void WriteString(FILE *f, const std::string &v)
+{
+    WriteU32(f, static_cast<uint32_t>(v.size()));
+    fwrite(v.c_str(), 1, v.size(), f);
+}
+
+inline bool ReadU32(FILE *f, uint32_t &v) { return fread(&v, sizeof(v), 1, f)==1; }
+inline bool ReadU64(FILE *f, uint64_t &v) { return fread(&v, sizeof(v), 1, f)==1; }
+// ファイルの残りに num 個 size byte の要素が収まるか。壊れた長さで巨大な確保をしないよう、確保の前に確かめる
+inline bool Fits(FILE *f, long file_size, uint32_t num, size_t size)
+{
+    long pos = ftell(f);
+    return pos>=0 && pos<=file_size && uint64_t(num)*size <= uint64_t(file_size-pos);
+}
+inline bool ReadString(FILE *f, long file_size, std::string &v)
+{
+    uint32_t len;
+    if(!ReadU32(f, len) || !Fits(f, file_size, len, 1)) { return false; }
+    v.resize(len);
+    return len==0 || fread(&v[0], 1, len, f)==len;
+}
+
+void WriteJSONString(FILE *f, const std::string &v)
+{
+    fputc('"', f);
+    for(size_t i=0; i<v.size(); ++i) {
+        unsigned char c = v[i];
+        switch(c) {
+        case '"':  fputs("\\\"", f); break;
+        case '\\': fputs("\\\\", f); break;
+        case '\n': fputs("\\n", f); break;
+        case '\r': fputs("\\r", f); break;
+        case '\t': fputs("\\t", f); break;
+        default:
+            if(c<0x20) { fprintf(f, "\\u%04x", c); }
+            else       { fputc(c, f); }
+            break;
+        }
+    }
+    fputc('"', f);
+}
+
+} // namespace
+
+
+LeakReportWriter::LeakReportWriter()
+    : m_file(NULL), m_format(LRF_JSON)
+{
+}
+
+LeakReportWriter::~LeakReportWriter()
+{
+    close();
+}
+
+bool LeakReportWriter::open(const char *path, LeakReportFormat format)
+{
+    close();
+    m_format = format;
+    m_file = fopen(path, m_format==LRF_BINARY ? "wb" : "w");
+    if(m_file==NULL) { return false; }
+
+    // 細かい書き込みが大量に来るので、バッファは大きめにとっておく
+    setvbuf(m_file, NULL, _IOFBF, 1024*1024);
+    if(m_format==LRF_BINARY) {
+        WriteU32(m_file, c_magic);
+        WriteU32(m_file, c_version);
+    }
+    return true;
+}
+
+void LeakReportWriter::close()
+{
+    if(m_file!=NULL) {
+        fclose(m_file);
+        m_file = NULL;
+    }
+}
+
+void LeakReportWriter::writeStack(uint32_t id, void *const *frames, size_t num_frames)
+{
+    if(m_file==NULL) { return; }
+
+    if(m_format==LRF_BINARY) {
+        WriteU32(m_file, RT_STACK);
+        WriteU32(m_file, id);
+        WriteU32(m_file, static_cast<uint32_t>(num_frames));
+        for(size_t i=0; i<num_frames; ++i) {
+            WriteU64(m_file, (uint64_t)(size_t)frames[i]);
+        }
+    }
+    else {
+        fprintf(m_file, "{\"type\":\"stack\",\"id\":%u,\"frames\":[", id);
+        for(size_t i=0; i<num_frames; ++i) {
+            fprintf(m_file, i==0 ? "\"0x%llx\"" : ",\"0x%llx\"", (unsigned long long)(size_t)frames[i]);
+        }
+        fputs("]}\n", m_file);
+    }
+}
+
+void LeakReportWriter::writeEntry(const LeakReportEntry &e)
+{
+    if(m_file==NULL) { return; }
+
+    if(m_format==LRF_BINARY) {
+        WriteU32(m_file, RT_ENTRY);
+        WriteU64(m_file, e.address);
+        WriteU64(m_file, e.bytes);
+        WriteU32(m_file, e.ref_count);
+        WriteU32(m_file, e.frame);
+        WriteU32(m_file, e.stack);
+        WriteString(m_file, e.name);
+        WriteU32(m_file, static_cast<uint32_t>(e.refs.size()));
+        for(size_t i=0; i<e.refs.size(); ++i) {
+            WriteU32(m_file, e.refs[i].type);
+            WriteU32(m_file, e.refs[i].count);
+            WriteU32(m_file, e.refs[i].stack);
+        }
+    }
+    else {
+        fprintf(m_file, "{\"type\":\"entry\",\"address\":\"0x%llx\",\"name\":", (unsigned long long)e.address);
+        WriteJSONString(m_file, e.name);
+        fprintf(m_file, ",\"ref\":%u,\"frame\":%u,\"bytes\":%llu,\"stack\":%u,\"refs\":[",
+            e.ref_count, e.frame, (unsigned long long)e.bytes, e.stack);
+        for(size_t i=0; i<e.refs.size(); ++i) {
+            const LeakReportReference &r = e.refs[i];
+            fprintf(m_file, "%s{\"type\":\"%s\",\"count\":%u,\"stack\":%u}",
+                i==0 ? "" : ",", r.type==LRR_ADDREF ? "AddRef" : "Release", r.count, r.stack);
+        }
+        fputs("]}\n", m_file);
+    }
+}
+
+void LeakReportWriter::writeSymbol(uint64_t address, const std::string &name)
+{
+    if(m_file==NULL) { return; }
+
+    if(m_format==LRF_BINARY) {
+        WriteU32(m_file, RT_SYMBOL);
+        WriteU64(m_file, address);
+        WriteString(m_file, name);
+    }
+    else {
+        fprintf(m_file, "{\"type\":\"symbol\",\"address\":\"0x%llx\",\"name\":", (unsigned long long)address);
+        WriteJSONString(m_file, name);
+        fputs("}\n", m_file);
+    }
+}
+
+
+bool ReadLeakReport(const char *path, LeakReport &out)
+{
+    FILE *f = fopen(path, "rb");
+    if(f==NULL) { return false; }
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    bool ok = file_size>=0;
+    uint32_t magic=0, version=0;
+    if(!ReadU32(f, magic) || !ReadU32(f, version) || magic!=c_magic || version!=c_version) {
+        ok = false;
+    }
+
+    uint32_t tag;
+    while(ok && ReadU32(f, tag)) {
+        if(tag==RT_STACK) {
+            uint32_t id, num;
+            ok = ReadU32(f, id) && ReadU32(f, num) && Fits(f, file_size, num, sizeof(uint64_t));
+            std::vector<uint64_t> &frames = out.stacks[id];
+            frames.resize(ok ? num : 0);
+            for(uint32_t i=0; ok && i<num; ++i) {
+                ok = ReadU64(f, frames[i]);
+            }
+        }
+        else if(tag==RT_ENTRY) {
+            out.entries.push_back(LeakReportEntry());
+            LeakReportEntry &e = out.entries.back();
+            uint32_t num_refs = 0;
+            ok = ReadU64(f, e.address) && ReadU64(f, e.bytes) && ReadU32(f, e.ref_count) &&
+                 ReadU32(f, e.frame) && ReadU32(f, e.stack) && ReadString(f, file_size, e.name) &&
+                 ReadU32(f, num_refs) && Fits(f, file_size, num_refs, sizeof(uint32_t)*3);
+            e.refs.resize(ok ? num_refs : 0);
+            for(uint32_t i=0; ok && i<num_refs; ++i) {
+                ok = ReadU32(f, e.refs[i].type) && ReadU32(f, e.refs[i].count) && ReadU32(f, e.refs[i].stack);
+            }
+        }
+        else if(tag==RT_SYMBOL) {
+            uint64_t address;
+            std::string name;
+            ok = ReadU64(f, address) && ReadString(f, file_size, name);
+            if(ok) { out.symbols[address] = name; }
+        }
+        else {
+            ok = false;
+        }
+    }
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,89 @@
+﻿#ifndef _ist_D3D11LeakReport_h_
+#define _ist_D3D11LeakReport_h_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+// リークレポートのファイル出力/読み込みを提供します。
+// D3D11 / Windows に依存しないので、レポートを解析するツール (Tools/LeakReportTool.cpp) からも使えます。
+//
+// レポートは以下のレコードの列です。
+//  stack : コールスタック。id を振って 1 度だけ出力し、entry からは id で参照します
+//  entry : リークしているオブジェクト 1 つ分の情報
+//  symbol: アドレスのシンボル名。全 entry を出力した後、重複を除いたアドレスについてまとめて出力します
+//
+// JSON 形式は 1 行 1 レコード (JSON lines)、binary 形式はそれをそのまま詰めたものです。
+// ReadLeakReport() が読めるのは binary 形式のみです。
+
+
+enum LeakReportFormat {
+    LRF_JSON,
+    LRF_BINARY,
+};
+
+enum LeakReportReferenceType {
+    LRR_ADDREF,
+    LRR_RELEASE,
+};
+
+struct LeakReportReference
+{
+    uint32_t type;  // LeakReportReferenceType
+    uint32_t count;
+    uint32_t stack;
+
+    LeakReportReference() : type(0), count(0), stack(0) {}
+};
+
+struct LeakReportEntry
+{
+    uint64_t address;
+    uint64_t bytes;
+    uint32_t ref_count;
+    uint32_t frame;
+    uint32_t stack;
+    std::string name;
+    std::vector<LeakReportReference> refs;
+
+    LeakReportEntry() : address(0), bytes(0), ref_count(0), frame(0), stack(0) {}
+};
+
+struct LeakReport
+{
+    typedef std::map<uint32_t, std::vector<uint64_t> > Stacks;
+    typedef std::map<uint64_t, std::string> Symbols;
+
+    Stacks stacks;
+    std::vector<LeakReportEntry> entries;
+    Symbols symbols;
+};
+
+
+class LeakReportWriter
+{
+public:
+    LeakReportWriter();
+    ~LeakReportWriter();
+
+    bool open(const char *path, LeakReportFormat format);
+    void close();
+
+    void writeStack(uint32_t id, void *const *frames, size_t num_frames);
+    void writeEntry(const LeakReportEntry &entry);
+    void writeSymbol(uint64_t address, const std::string &name);
+
+private:
+    LeakReportWriter(const LeakReportWriter&);
+    LeakReportWriter& operator=(const LeakReportWriter&);
+
+    FILE *m_file;
+    LeakReportFormat m_format;
+};
+
+/// binary 形式のレポートを読み込みます
+bool ReadLeakReport(const char *path, LeakReport &out);
+
+#endif // _ist_D3D11LeakReport_h_
@@ -0,0 +1,573 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Callstack.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/Timer.h"
+#include "../Utilities/ResourceSize.h"
+#include "D3D11MapProfiler.h"
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+struct ResourceStats
+{
+    std::string name;       // WKPDID_D3DDebugObjectName
+    D3D11_RESOURCE_DIMENSION dimension;
+    size_t map_count[5];
+    size_t map_bytes[5];
+    LONGLONG map_time;
+    size_t stalls;
+    size_t update_count;
+    size_t update_bytes;
+    size_t frame;           // frame_bytes を数えているフレーム
+    size_t frame_bytes;     // そのフレームの転送量
+    size_t peak_frame_bytes;
+    size_t last_gpu_write;  // 最後に GPU 側で書き込まれたフレーム (+1。0 なら書き込まれていない)
+    size_t last_gpu_read;   // 最後に GPU 側で読まれた (コピー元になった) フレーム (+1。0 なら読まれていない)
+
+    ResourceStats()
+        : dimension(D3D11_RESOURCE_DIMENSION_UNKNOWN), map_time(0), stalls(0), update_count(0), update_bytes(0)
+        , frame(0), frame_bytes(0), peak_frame_bytes(0), last_gpu_write(0), last_gpu_read(0)
+    {
+        memset(map_count, 0, sizeof(map_count));
+        memset(map_bytes, 0, sizeof(map_bytes));
+    }
+
+    size_t getTotalBytes() const
+    {
+        size_t r = update_bytes;
+        for(size_t i=0; i<_countof(map_bytes); ++i) { r += map_bytes[i]; }
+        return r;
+    }
+};
+
+struct UploadCallsite
+{
+    void *stack[D3D11MAPPROFILER_MAX_CALLSTACK_SIZE];
+    int size;
+    size_t count;
+    size_t bytes;
+    size_t stalls;
+    LONGLONG time;
+
+    UploadCallsite() : size(0), count(0), bytes(0), stalls(0), time(0) {}
+};
+
+typedef std::unordered_map<ID3D11Resource*, ResourceStats> ResourceTable;
+typedef std::unordered_map<uint64_t, UploadCallsite> CallsiteTable; // key はコールスタックのハッシュ
+
+namespace {
+
+Mutex g_mutex;
+ResourceTable g_resources;
+CallsiteTable g_callsites;
+IDXGISwapChain *g_swapchain = NULL;
+ID3D11Device *g_device = NULL;
+ID3D11DeviceContext *g_context = NULL;
+int g_opt = 0;
+size_t g_frame = 0;
+
+D3D11MapProfilerFrameStats g_current;
+D3D11MapProfilerFrameStats g_last;
+
+} // namespace
+
+
+void ClearFrameStats(D3D11MapProfilerFrameStats &stats, size_t frame)
+{
+    memset(&stats, 0, sizeof(stats));
+    stats.frame = frame;
+}
+
+void GetDebugName(ID3D11Resource *res, std::string &out)
+{
+    char name[256];
+    UINT size = sizeof(name)-1;
+    if(SUCCEEDED(res->GetPrivateData(WKPDID_D3DDebugObjectName, &size, name))) {
+        name[size] = '\0';
+        out = name;
+    }
+}
+
+ResourceStats& GetResourceStats(ID3D11Resource *res)
+{
+    ResourceTable::iterator i = g_resources.find(res);
+    if(i!=g_resources.end()) {
+        ResourceStats &rs = i->second;
+        if(rs.frame!=g_frame) {
+            rs.frame = g_frame;
+            rs.frame_bytes = 0;
+            // 名前は後から付けられることがあるので、フレームが変わるたびに取り直す
+            if(rs.name.empty()) { GetDebugName(res, rs.name); }
+        }
+        return rs;
+    }
+    ResourceStats &rs = g_resources[res];
+    res->GetType(&rs.dimension);
+    rs.frame = g_frame;
+    GetDebugName(res, rs.name);
+    return rs;
+}
+
+// box==NULL ならサブリソース全体の、そうでなければ box の範囲のバイト数を返します
+size_t GetSubresourceBytes(ID3D11Resource *res, UINT subresource, const D3D11_BOX *box=NULL)
+{
+    D3D11_RESOURCE_DIMENSION dim;
+    res->GetType(&dim);
+
+    DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+    UINT width=1, height=1, depth=1, mip_levels=1;
+    switch(dim) {
+    case D3D11_RESOURCE_DIMENSION_BUFFER:
+        {
+            D3D11_BUFFER_DESC desc;
+            static_cast<ID3D11Buffer*>(res)->GetDesc(&desc);
+            if(box!=NULL) { return box->right>box->left ? box->right-box->left : 0; }
+            return desc.ByteWidth;
+        }
+    case D3D11_RESOURCE_DIMENSION_TEXTURE1D:
+        {
+            D3D11_TEXTURE1D_DESC desc;
+            static_cast<ID3D11Texture1D*>(res)->GetDesc(&desc);
+            format = desc.Format; width = desc.Width;
+            mip_levels = GetMipLevelCount(desc.MipLevels, width);
+        }
+        break;
+    case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+        {
+            D3D11_TEXTURE2D_DESC desc;
+            static_cast<ID3D11Texture2D*>(res)->GetDesc(&desc);
+            format = desc.Format; width = desc.Width; height = desc.Height;
+            mip_levels = GetMipLevelCount(desc.MipLevels, width, height);
+        }
+        break;
+    case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+        {
+            D3D11_TEXTURE3D_DESC desc;
+            static_cast<ID3D11Texture3D*>(res)->GetDesc(&desc);
+            format = desc.Format; width = desc.Width; height = desc.Height; depth = desc.Depth;
+            mip_levels = GetMipLevelCount(desc.MipLevels, width, height, depth);
+        }
+        break;
+    default:
+        return 0;
+    }
+
+    UINT mip = subresource % mip_levels;
+    width  = std::max<UINT>(width>>mip, 1);
+    height = std::max<UINT>(height>>mip, 1);
+    depth  = std::max<UINT>(depth>>mip, 1);
+    if(box!=NULL) {
+        width  = box->right>box->left ? box->right-box->left : 0;
+        height = box->bottom>box->top ? box->bottom-box->top : 0;
+        depth  = box->back>box->front ? box->back-box->front : 0;
+    }
+
+    size_t bpp = GetFormatBitsPerPixel(format);
+    if(IsBlockCompressedFormat(format)) {
+        // 4x4 block 単位
+        width  = (width+3)/4;
+        height = (height+3)/4;
+        bpp *= 16;
+    }
+    return (size_t)width*height*depth*bpp/8;
+}
+
+void AddCallsite(size_t bytes, bool stall, LONGLONG time)
+{
+    void *stack[D3D11MAPPROFILER_MAX_CALLSTACK_SIZE];
+    uint64_t hash = 0;
+    int size = GetCallstack(stack, _countof(stack), 2, &hash); // GetCallstack() と AddCallsite() 自身は捨てる
+    size = FilterCallstack(stack, size, &hash);
+
+    UploadCallsite &cs = g_callsites[hash];
+    if(cs.count==0) {
+        memcpy(cs.stack, stack, sizeof(void*)*size);
+        cs.size = size;
+    }
+    ++cs.count;
+    cs.bytes += bytes;
+    cs.stalls += stall ? 1 : 0;
+    cs.time += time;
+}
+
+void ReportStall(ID3D11Resource *res, const ResourceStats &rs, D3D11_MAP type, double ms, bool gpu_used)
+{
+    char buf[512];
+    sprintf_s(buf, "D3D11MapProfiler: stall on Map(): Resource=0x%p \"%s\" MapType=%d Time=%.3fms%s Frame=%Iu\n",
+        res, rs.name.c_str(), (int)type, ms, gpu_used ? " (used by GPU in recent frames)" : "", g_frame);
+    OutputDebugStringA(buf);
+}
+
+void MarkGPUWrite(ID3D11Resource *res)
+{
+    if(res==NULL) { return; }
+    ScopedLock lock(g_mutex);
+    GetResourceStats(res).last_gpu_write = g_frame+1;
+}
+
+void MarkGPURead(ID3D11Resource *res)
+{
+    if(res==NULL) { return; }
+    ScopedLock lock(g_mutex);
+    GetResourceStats(res).last_gpu_read = g_frame+1;
+}
+
+// RTV/UAV としてバインドされた。全てのリソースを記録すると統計が埋もれるので、既に記録しているものだけ対象にします。
+// GetResource() の参照の Release() は他の layer の hook で lock を取ることがあるので、g_mutex の外で行います
+template<class View>
+void MarkBoundView(View *view)
+{
+    if(view==NULL) { return; }
+    ID3D11Resource *res = NULL;
+    view->GetResource(&res);
+    if(res==NULL) { return; }
+    {
+        ScopedLock lock(g_mutex);
+        ResourceTable::iterator i = g_resources.find(res);
+        if(i!=g_resources.end()) { i->second.last_gpu_write = g_frame+1; }
+    }
+    res->Release();
+}
+
+template<class View>
+void MarkBoundViews(UINT num, View *const *views)
+{
+    if(views==NULL) { return; }
+    for(UINT i=0; i<num; ++i) { MarkBoundView(views[i]); }
+}
+
+
+class DeviceContextMapProfiler : public D3D11DeviceContextHook
+{
+typedef D3D11DeviceContextHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Map(
+        ID3D11Resource *pResource,
+        UINT Subresource,
+        D3D11_MAP MapType,
+        UINT MapFlags,
+        D3D11_MAPPED_SUBRESOURCE *pMappedResource)
+    {
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::Map(pResource, Subresource, MapType, MapFlags, pMappedResource);
+        LONGLONG elapsed = GetPerformanceCounter()-begin;
+        if(pResource==NULL || MapType<D3D11_MAP_READ || MapType>D3D11_MAP_WRITE_NO_OVERWRITE) { return r; }
+
+        ScopedLock lock(g_mutex);
+        ResourceStats &rs = GetResourceStats(pResource);
+        if(r==DXGI_ERROR_WAS_STILL_DRAWING) {
+            ++g_current.still_drawing;
+            return r;
+        }
+        if(FAILED(r)) { return r; }
+
+        size_t bytes = GetSubresourceBytes(pResource, Subresource);
+        int ti = MapType-D3D11_MAP_READ;
+        double ms = PerformanceCounterToMS(elapsed);
+        // GPU の書き込みは読み書きどちらの Map も待たされ、GPU の読み込みは書き込む Map だけが待たされる
+        bool gpu_written = MapType!=D3D11_MAP_WRITE_DISCARD && MapType!=D3D11_MAP_WRITE_NO_OVERWRITE &&
+            rs.last_gpu_write!=0 && rs.last_gpu_write+D3D11MAPPROFILER_FRAME_LATENCY > g_frame;
+        bool gpu_read = (MapType==D3D11_MAP_WRITE || MapType==D3D11_MAP_READ_WRITE) &&
+            rs.last_gpu_read!=0 && rs.last_gpu_read+D3D11MAPPROFILER_FRAME_LATENCY > g_frame;
+        bool gpu_used = gpu_written || gpu_read;
+        bool stall = gpu_used || (MapType!=D3D11_MAP_WRITE_NO_OVERWRITE && ms>=D3D11MAPPROFILER_STALL_THRESHOLD);
+
+        ++g_current.map_count[ti];
+        g_current.map_bytes[ti] += bytes;
+        g_current.map_time += ms;
+        ++rs.map_count[ti];
+        rs.map_bytes[ti] += bytes;
+        rs.map_time += elapsed;
+        rs.frame_bytes += bytes;
+        rs.peak_frame_bytes = std::max<size_t>(rs.peak_frame_bytes, rs.frame_bytes);
+        if(stall) {
+            ++g_current.stalls;
+            g_current.stall_time += ms;
+            ++rs.stalls;
+            if((g_opt & D3D11MP_REPORT_STALLS)!=0) { ReportStall(pResource, rs, MapType, ms, gpu_used); }
+        }
+        if((g_opt & D3D11MP_TRACE_CALLSITES)!=0 && MapType!=D3D11_MAP_READ) {
+            AddCallsite(bytes, stall, elapsed);
+        }
+        return r;
+    }
+
+    virtual void STDMETHODCALLTYPE UpdateSubresource(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        const D3D11_BOX *pDstBox,
+        const void *pSrcData,
+        UINT SrcRowPitch,
+        UINT SrcDepthPitch)
+    {
+        LONGLONG begin = GetPerformanceCounter();
+        super::UpdateSubresource(pDstResource, DstSubresource, pDstBox, pSrcData, SrcRowPitch, SrcDepthPitch);
+        LONGLONG elapsed = GetPerformanceCounter()-begin;
+        if(pDstResource==NULL) { return; }
+
+        ScopedLock lock(g_mutex);
+        ResourceStats &rs = GetResourceStats(pDstResource);
+        size_t bytes = GetSubresourceBytes(pDstResource, DstSubresource, pDstBox);
+        rs.last_gpu_write = g_frame+1; // 書き込みは GPU 側のコピーで行われる
+        ++g_current.update_count;
+        g_current.update_bytes += bytes;
+        ++rs.update_count;
+        rs.update_bytes += bytes;
+        rs.frame_bytes += bytes;
+        rs.peak_frame_bytes = std::max<size_t>(rs.peak_frame_bytes, rs.frame_bytes);
+        if((g_opt & D3D11MP_TRACE_CALLSITES)!=0) {
+            AddCallsite(bytes, false, elapsed);
+        }
+    }
+
+    virtual void STDMETHODCALLTYPE CopySubresourceRegion(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        UINT DstX,
+        UINT DstY,
+        UINT DstZ,
+        ID3D11Resource *pSrcResource,
+        UINT SrcSubresource,
+        const D3D11_BOX *pSrcBox)
+    {
+        MarkGPUWrite(pDstResource);
+        MarkGPURead(pSrcResource);
+        super::CopySubresourceRegion(pDstResource, DstSubresource, DstX, DstY, DstZ, pSrcResource, SrcSubresource, pSrcBox);
+    }
+
+    virtual void STDMETHODCALLTYPE CopyResource(
+        ID3D11Resource *pDstResource,
+        ID3D11Resource *pSrcResource)
+    {
+        MarkGPUWrite(pDstResource);
+        MarkGPURead(pSrcResource);
+        super::CopyResource(pDstResource, pSrcResource);
+    }
+
+    virtual void STDMETHODCALLTYPE ResolveSubresource(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        ID3D11Resource *pSrcResource,
+        UINT SrcSubresource,
+        DXGI_FORMAT Format)
+    {
+        MarkGPUWrite(pDstResource);
+        MarkGPURead(pSrcResource);
+        super::ResolveSubresource(pDstResource, DstSubresource, pSrcResource, SrcSubresource, Format);
+    }
+
+    virtual void STDMETHODCALLTYPE CopyStructureCount(
+        ID3D11Buffer *pDstBuffer,
+        UINT DstAlignedByteOffset,
+        ID3D11UnorderedAccessView *pSrcView)
+    {
+        MarkGPUWrite(pDstBuffer);
+        super::CopyStructureCount(pDstBuffer, DstAlignedByteOffset, pSrcView);
+    }
+
+    virtual void STDMETHODCALLTYPE OMSetRenderTargets(
+        UINT NumViews,
+        ID3D11RenderTargetView *const *ppRenderTargetViews,
+        ID3D11DepthStencilView *pDepthStencilView)
+    {
+        MarkBoundViews(NumViews, ppRenderTargetViews);
+        MarkBoundView(pDepthStencilView);
+        super::OMSetRenderTargets(NumViews, ppRenderTargetViews, pDepthStencilView);
+    }
+
+    virtual void STDMETHODCALLTYPE OMSetRenderTargetsAndUnorderedAccessViews(
+        UINT NumRTVs,
+        ID3D11RenderTargetView *const *ppRenderTargetViews,
+        ID3D11DepthStencilView *pDepthStencilView,
+        UINT UAVStartSlot,
+        UINT NumUAVs,
+        ID3D11UnorderedAccessView *const *ppUnorderedAccessViews,
+        const UINT *pUAVInitialCounts)
+    {
+        if(NumRTVs!=D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL) {
+            MarkBoundViews(NumRTVs, ppRenderTargetViews);
+            MarkBoundView(pDepthStencilView);
+        }
+        if(NumUAVs!=D3D11_KEEP_UNORDERED_ACCESS_VIEWS) {
+            MarkBoundViews(NumUAVs, ppUnorderedAccessViews);
+        }
+        super::OMSetRenderTargetsAndUnorderedAccessViews(NumRTVs, ppRenderTargetViews, pDepthStencilView,
+            UAVStartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+    }
+
+    virtual void STDMETHODCALLTYPE CSSetUnorderedAccessViews(
+        UINT StartSlot,
+        UINT NumUAVs,
+        ID3D11UnorderedAccessView *const *ppUnorderedAccessViews,
+        const UINT *pUAVInitialCounts)
+    {
+        MarkBoundViews(NumUAVs, ppUnorderedAccessViews);
+        super::CSSetUnorderedAccessViews(StartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+    }
+};
+
+class SwapChainMapProfiler : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        {
+            ScopedLock lock(g_mutex);
+            g_last = g_current;
+            ++g_frame;
+            ClearFrameStats(g_current, g_frame);
+        }
+        return super::Present(SyncInterval, Flags);
+    }
+};
+
+
+bool _D3D11MapProfilerInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, int opt)
+{
+    if(g_device!=NULL) { return false; }
+
+    if((opt & D3D11MP_INIT_SYMBOLS)!=0) {
+        if(!InitializeSymbol()) {
+            return false;
+        }
+    }
+
+    g_swapchain = pSwapChain;
+    g_device = pDevice;
+    g_opt = opt;
+    g_frame = 0;
+    ClearFrameStats(g_current, 0);
+    ClearFrameStats(g_last, 0);
+    pDevice->GetImmediateContext(&g_context);
+    D3D11SetHook<SwapChainMapProfiler>(pSwapChain);
+    D3D11SetHook<DeviceContextMapProfiler>(g_context);
+    return true;
+}
+
+void _D3D11MapProfilerFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    {
+        ScopedLock lock(g_mutex);
+        D3D11RemoveHook<SwapChainMapProfiler>(g_swapchain);
+        D3D11RemoveHook<DeviceContextMapProfiler>(g_context);
+        g_context->Release();
+        g_resources.clear();
+        g_callsites.clear();
+        g_swapchain = NULL;
+        g_device = NULL;
+        g_context = NULL;
+    }
+    if((g_opt & D3D11MP_INIT_SYMBOLS)!=0) { FinalizeSymbol(); }
+    g_opt = 0;
+}
+
+void _D3D11MapProfilerGetFrameStats(D3D11MapProfilerFrameStats &out)
+{
+    ScopedLock lock(g_mutex);
+    out = g_last;
+}
+
+void _D3D11MapProfilerPrintFrameStats()
+{
+    D3D11MapProfilerFrameStats s;
+    _D3D11MapProfilerGetFrameStats(s);
+
+    char buf[1024];
+    sprintf_s(buf,
+        "D3D11MapProfilerPrintFrameStats(): Frame=%Iu\n"
+        "  Read=%Iu (%Iu bytes) Write=%Iu (%Iu bytes) ReadWrite=%Iu (%Iu bytes) WriteDiscard=%Iu (%Iu bytes) WriteNoOverwrite=%Iu (%Iu bytes)\n"
+        "  UpdateSubresource=%Iu (%Iu bytes) MapTime=%.3fms Stalls=%Iu StallTime=%.3fms StillDrawing=%Iu\n",
+        s.frame,
+        s.map_count[0], s.map_bytes[0], s.map_count[1], s.map_bytes[1], s.map_count[2], s.map_bytes[2],
+        s.map_count[3], s.map_bytes[3], s.map_count[4], s.map_bytes[4],
+        s.update_count, s.update_bytes, s.map_time, s.stalls, s.stall_time, s.still_drawing);
+    OutputDebugStringA(buf);
+}
+
+bool GreaterTotalBytes(const ResourceTable::value_type *a, const ResourceTable::value_type *b)
+{
+    return a->second.getTotalBytes() > b->second.getTotalBytes();
+}
+
+bool GreaterCallsiteBytes(const CallsiteTable::value_type *a, const CallsiteTable::value_type *b)
+{
+    return a->second.bytes > b->second.bytes;
+}
+
+void _D3D11MapProfilerPrintResourceStats(size_t max_num)
+{
+    ScopedLock lock(g_mutex);
+    std::vector<const ResourceTable::value_type*> sorted;
+    sorted.reserve(g_resources.size());
+    for(ResourceTable::const_iterator i=g_resources.begin(); i!=g_resources.end(); ++i) {
+        sorted.push_back(&*i);
+    }
+    std::sort(sorted.begin(), sorted.end(), GreaterTotalBytes);
+    if(sorted.size()>max_num) { sorted.resize(max_num); }
+
+    std::string str;
+    char buf[1024];
+    sprintf_s(buf, "D3D11MapProfilerPrintResourceStats(): %Iu resources, Frame=%Iu\n", g_resources.size(), g_frame);
+    str += buf;
+    for(size_t i=0; i<sorted.size(); ++i) {
+        const ResourceStats &rs = sorted[i]->second;
+        sprintf_s(buf, "  0x%p \"%s\": %Iu bytes, Read=%Iu Write=%Iu ReadWrite=%Iu WriteDiscard=%Iu WriteNoOverwrite=%Iu Update=%Iu PeakFrameSize=%Iu MapTime=%.3fms Stalls=%Iu\n",
+            sorted[i]->first, rs.name.c_str(), rs.getTotalBytes(),
+            rs.map_count[0], rs.map_count[1], rs.map_count[2], rs.map_count[3], rs.map_count[4], rs.update_count,
+            rs.peak_frame_bytes, PerformanceCounterToMS(rs.map_time), rs.stalls);
+        str += buf;
+    }
+    str += "\n";
+    OutputDebugStringA(str.c_str());
+}
+
+void _D3D11MapProfilerPrintCallsiteStats(size_t max_num)
+{
+    ScopedLock lock(g_mutex);
+    if((g_opt & D3D11MP_TRACE_CALLSITES)==0) {
+        OutputDebugStringA("D3D11MapProfilerPrintCallsiteStats(): D3D11MP_TRACE_CALLSITES is not specified.\n");
+        return;
+    }
+
+    std::vector<const CallsiteTable::value_type*> sorted;
+    sorted.reserve(g_callsites.size());
+    for(CallsiteTable::const_iterator i=g_callsites.begin(); i!=g_callsites.end(); ++i) {
+        sorted.push_back(&*i);
+    }
+    std::sort(sorted.begin(), sorted.end(), GreaterCallsiteBytes);
+    if(sorted.size()>max_num) { sorted.resize(max_num); }
+
+    std::vector<void*> addresses;
+    for(size_t i=0; i<sorted.size(); ++i) {
+        const UploadCallsite &cs = sorted[i]->second;
+        addresses.insert(addresses.end(), cs.stack, cs.stack+cs.size);
+    }
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+    if(!addresses.empty()) {
+        ResolveAddresses(&addresses[0], addresses.size());
+    }
+
+    std::string str;
+    char buf[512];
+    sprintf_s(buf, "D3D11MapProfilerPrintCallsiteStats(): %Iu callsites, Frame=%Iu\n", g_callsites.size(), g_frame);
+    str += buf;
+    for(size_t i=0; i<sorted.size(); ++i) {
+        const UploadCallsite &cs = sorted[i]->second;
+        sprintf_s(buf, "  %Iu bytes in %Iu calls, Time=%.3fms Stalls=%Iu\n",
+            cs.bytes, cs.count, PerformanceCounterToMS(cs.time), cs.stalls);
+        str += buf;
+        str += CallstackToSymbolNames(const_cast<void**>(cs.stack), cs.size, 0, 0, "    ");
+    }
+    str += "\n";
+    OutputDebugStringA(str.c_str());
+}
@@ -0,0 +1,90 @@
+﻿#ifndef _ist_D3D11MapProfiler_h_
+#define _ist_D3D11MapProfiler_h_
+#include <D3D11.h>
+
+// immediate context の Map() / UpdateSubresource() による CPU -> GPU / GPU -> CPU の転送量と、Map() 内で待たされた時間を記録します。
+// - フレームごと、D3D11_MAP の種類ごとの回数とバイト数、Map() にかかった時間
+// - リソースごとの累計 (D3D11MapProfilerPrintResourceStats())
+// - D3D11MP_TRACE_CALLSITES を指定した場合、書き込み (アップロード) を行った場所のコールスタックごとの累計 (D3D11MapProfilerPrintCallsiteStats())
+//
+// 以下を stall として数えます。
+// - 直近 D3D11MAPPROFILER_FRAME_LATENCY フレーム以内に GPU が書き込んだ (GPU がまだ使っている可能性が高い) リソースに対する、
+//   D3D11_MAP_READ / D3D11_MAP_READ_WRITE / D3D11_MAP_WRITE の Map()。
+//   Copy*/ResolveSubresource/UpdateSubresource の書き込み先と、RTV/DSV/UAV としてバインドされたリソースが対象です
+//   (バインドされたものは、既に Map() などで記録しているリソースだけを見ます)
+// - 直近 D3D11MAPPROFILER_FRAME_LATENCY フレーム以内に Copy*/ResolveSubresource のコピー元になったリソースに対する、
+//   D3D11_MAP_READ_WRITE / D3D11_MAP_WRITE の Map()
+// - D3D11_MAP_WRITE_NO_OVERWRITE 以外で、D3D11MAPPROFILER_STALL_THRESHOLD ミリ秒以上かかった Map()
+//
+// リソースはアドレスで集計しているので、解放後に同じアドレスに作られたリソースの統計は合算されます。
+// deferred context は対象外です。
+//
+// 有効にするには、このファイルを include する前に D3D11MAPPROFILER_ENABLE を define しておく必要があります。
+// D3D11MAPPROFILER_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+#ifndef D3D11MAPPROFILER_STALL_THRESHOLD
+#define D3D11MAPPROFILER_STALL_THRESHOLD 0.5
+#endif
+#ifndef D3D11MAPPROFILER_FRAME_LATENCY
+#define D3D11MAPPROFILER_FRAME_LATENCY 2
+#endif
+#ifndef D3D11MAPPROFILER_MAX_CALLSTACK_SIZE
+#define D3D11MAPPROFILER_MAX_CALLSTACK_SIZE 16
+#endif
+
+enum D3D11MP_OPTION {
+    D3D11MP_NONE = 0,
+
+    // symbol の初期化/終了処理を行うか (SymInitialize()/SymCleanup())
+    D3D11MP_INIT_SYMBOLS = 1,
+    // アップロードした場所のコールスタックごとに集計するか。Map()/UpdateSubresource() ごとにコールスタックを取得するので重くなります
+    D3D11MP_TRACE_CALLSITES = 2,
+    // stall を検出するたびにデバッグ出力するか
+    D3D11MP_REPORT_STALLS = 4,
+};
+
+struct D3D11MapProfilerFrameStats
+{
+    size_t frame;
+    size_t map_count[5];    // [MapType-1] (D3D11_MAP_READ ～ D3D11_MAP_WRITE_NO_OVERWRITE)
+    size_t map_bytes[5];
+    double map_time;        // Map() 内で費やした時間 (ミリ秒)
+    size_t still_drawing;   // D3D11_MAP_FLAG_DO_NOT_WAIT で DXGI_ERROR_WAS_STILL_DRAWING が返った回数
+    size_t stalls;
+    double stall_time;      // stall と判定した Map() の時間の合計 (ミリ秒)
+    size_t update_count;    // UpdateSubresource()
+    size_t update_bytes;
+};
+
+#ifdef D3D11MAPPROFILER_ENABLE
+
+// opt: D3D11MP_OPTION の bit の組み合わせ
+bool _D3D11MapProfilerInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, int opt=D3D11MP_NONE);
+void _D3D11MapProfilerFinalize();
+// 直前のフレームの統計を取得します
+void _D3D11MapProfilerGetFrameStats(D3D11MapProfilerFrameStats &out);
+void _D3D11MapProfilerPrintFrameStats();
+// 転送量の多い順に、上位 max_num 個を表示します
+void _D3D11MapProfilerPrintResourceStats(size_t max_num=20);
+void _D3D11MapProfilerPrintCallsiteStats(size_t max_num=20);
+
+#define D3D11MapProfilerInitialize(...)             _D3D11MapProfilerInitialize(__VA_ARGS__)
+#define D3D11MapProfilerFinalize()                  _D3D11MapProfilerFinalize()
+#define D3D11MapProfilerGetFrameStats(...)          _D3D11MapProfilerGetFrameStats(__VA_ARGS__)
+#define D3D11MapProfilerPrintFrameStats()           _D3D11MapProfilerPrintFrameStats()
+#define D3D11MapProfilerPrintResourceStats(...)     _D3D11MapProfilerPrintResourceStats(__VA_ARGS__)
+#define D3D11MapProfilerPrintCallsiteStats(...)     _D3D11MapProfilerPrintCallsiteStats(__VA_ARGS__)
+
+#else // D3D11MAPPROFILER_ENABLE
+
+#define D3D11MapProfilerInitialize(...)
+#define D3D11MapProfilerFinalize()
+#define D3D11MapProfilerGetFrameStats(...)
+#define D3D11MapProfilerPrintFrameStats()
+#define D3D11MapProfilerPrintResourceStats(...)
+#define D3D11MapProfilerPrintCallsiteStats(...)
+
+#endif // D3D11MAPPROFILER_ENABLE
+
+#endif // _ist_D3D11MapProfiler_h_
@@ -0,0 +1,297 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Callstack.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/Timer.h"
+#include "D3D11QueryMonitor.h"
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+struct QueryRecord
+{
+    size_t end_frame;       // 最後に End() したフレーム
+    size_t last_frame;      // 最後に使われたフレーム
+    size_t polls;           // End() 後の GetData() の回数
+    LONGLONG first_poll;    // End() 後の最初の GetData() の時刻
+    bool completed;         // End() 後に結果が出た
+    UINT data_size;         // 保持している結果のサイズ
+    char data[D3D11QUERYMONITOR_MAX_DATA_SIZE];
+
+    QueryRecord() : end_frame(0), last_frame(0), polls(0), first_poll(0), completed(false), data_size(0) {}
+};
+
+struct BusyWaitCallsite
+{
+    void *stack[D3D11QUERYMONITOR_MAX_CALLSTACK_SIZE];
+    int size;
+    size_t count;
+    size_t polls;
+    LONGLONG time;
+
+    BusyWaitCallsite() : size(0), count(0), polls(0), time(0) {}
+};
+
+typedef std::unordered_map<ID3D11Asynchronous*, QueryRecord> QueryTable;
+typedef std::unordered_map<uint64_t, BusyWaitCallsite> CallsiteTable; // key はコールスタックのハッシュ
+
+namespace {
+
+Mutex g_mutex;
+QueryTable g_queries;
+CallsiteTable g_callsites;
+IDXGISwapChain *g_swapchain = NULL;
+ID3D11Device *g_device = NULL;
+ID3D11DeviceContext *g_context = NULL;
+int g_opt = 0;
+size_t g_frame = 0;
+
+size_t g_get_data = 0;
+size_t g_not_ready = 0;
+size_t g_cache_hits = 0;
+size_t g_busy_waits = 0;
+size_t g_max_polls = 0;
+LONGLONG g_spin_time = 0;
+
+} // namespace
+
+
+void AddBusyWaitCallsite(size_t polls, LONGLONG time)
+{
+    void *stack[D3D11QUERYMONITOR_MAX_CALLSTACK_SIZE];
+    uint64_t hash = 0;
+    int size = GetCallstack(stack, _countof(stack), 2, &hash); // GetCallstack() と AddBusyWaitCallsite() 自身は捨てる
+    size = FilterCallstack(stack, size, &hash);
+
+    BusyWaitCallsite &cs = g_callsites[hash];
+    if(cs.count==0) {
+        memcpy(cs.stack, stack, sizeof(void*)*size);
+        cs.size = size;
+    }
+    ++cs.count;
+    cs.polls += polls;
+    cs.time += time;
+}
+
+// 新しく計測を始めたので、前回の結果を捨てる
+void ResetQuery(ID3D11Asynchronous *async)
+{
+    QueryRecord &q = g_queries[async];
+    q.last_frame = g_frame;
+    q.polls = 0;
+    q.completed = false;
+    q.data_size = 0;
+}
+
+// D3D11QUERYMONITOR_MAX_IDLE_FRAMES フレーム使われなかった記録を捨てます
+void RemoveIdleQueries()
+{
+    for(QueryTable::iterator i=g_queries.begin(); i!=g_queries.end(); ) {
+        if(i->second.last_frame+D3D11QUERYMONITOR_MAX_IDLE_FRAMES < g_frame) { i = g_queries.erase(i); }
+        else { ++i; }
+    }
+}
+
+
+class DeviceContextQueryMonitor : public D3D11DeviceContextHook
+{
+typedef D3D11DeviceContextHook super;
+public:
+    virtual void STDMETHODCALLTYPE Begin(
+        ID3D11Asynchronous *pAsync)
+    {
+        if(pAsync!=NULL) {
+            ScopedLock lock(g_mutex);
+            ResetQuery(pAsync);
+        }
+        super::Begin(pAsync);
+    }
+
+    virtual void STDMETHODCALLTYPE End(
+        ID3D11Asynchronous *pAsync)
+    {
+        if(pAsync!=NULL) {
+            ScopedLock lock(g_mutex);
+            ResetQuery(pAsync);
+            g_queries[pAsync].end_frame = g_frame;
+        }
+        super::End(pAsync);
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE GetData(
+        ID3D11Asynchronous *pAsync,
+        void *pData,
+        UINT DataSize,
+        UINT GetDataFlags)
+    {
+        if(pAsync==NULL) {
+            return super::GetData(pAsync, pData, DataSize, GetDataFlags);
+        }
+
+        ScopedLock lock(g_mutex);
+        ++g_get_data;
+        QueryRecord &q = g_queries[pAsync];
+        q.last_frame = g_frame;
+        if((g_opt & D3D11QM_CACHE_RESULTS)!=0 && q.completed && (pData==NULL || DataSize==q.data_size)) {
+            if(pData!=NULL) { memcpy(pData, q.data, DataSize); }
+            ++g_cache_hits;
+            return S_OK;
+        }
+
+        LONGLONG now = GetPerformanceCounter();
+        HRESULT r = super::GetData(pAsync, pData, DataSize, GetDataFlags);
+        if(q.completed) { return r; } // 結果が出た後の GetData()
+
+        if(q.polls++==0) { q.first_poll = now; }
+        g_max_polls = std::max<size_t>(g_max_polls, q.polls);
+        if(r==S_FALSE) {
+            ++g_not_ready;
+        }
+        else if(r==S_OK) {
+            q.completed = true;
+            if(q.polls>=D3D11QUERYMONITOR_BUSY_WAIT_POLLS && q.end_frame==g_frame) {
+                LONGLONG spin = GetPerformanceCounter()-q.first_poll;
+                ++g_busy_waits;
+                g_spin_time += spin;
+                if((g_opt & D3D11QM_TRACE_CALLSITES)!=0) { AddBusyWaitCallsite(q.polls, spin); }
+            }
+            if(pData!=NULL && DataSize<=sizeof(q.data)) {
+                memcpy(q.data, pData, DataSize);
+                q.data_size = DataSize;
+            }
+        }
+        return r;
+    }
+};
+
+class SwapChainQueryMonitor : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        {
+            ScopedLock lock(g_mutex);
+            ++g_frame;
+            if(g_frame % D3D11QUERYMONITOR_MAX_IDLE_FRAMES == 0) { RemoveIdleQueries(); }
+        }
+        return super::Present(SyncInterval, Flags);
+    }
+};
+
+
+bool _D3D11QueryMonitorInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, int opt)
+{
+    if(g_device!=NULL) { return false; }
+
+    if((opt & D3D11QM_INIT_SYMBOLS)!=0) {
+        if(!InitializeSymbol()) {
+            return false;
+        }
+    }
+
+    g_swapchain = pSwapChain;
+    g_device = pDevice;
+    g_opt = opt;
+    g_frame = 0;
+    pDevice->GetImmediateContext(&g_context);
+    D3D11SetHook<SwapChainQueryMonitor>(pSwapChain);
+    D3D11SetHook<DeviceContextQueryMonitor>(g_context);
+    return true;
+}
+
+void _D3D11QueryMonitorFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    {
+        ScopedLock lock(g_mutex);
+        D3D11RemoveHook<SwapChainQueryMonitor>(g_swapchain);
+        D3D11RemoveHook<DeviceContextQueryMonitor>(g_context);
+        g_context->Release();
+        g_context = NULL;
+        g_swapchain = NULL;
+        g_device = NULL;
+        g_queries.clear();
+        g_callsites.clear();
+
+        g_get_data = g_not_ready = g_cache_hits = g_busy_waits = g_max_polls = 0;
+        g_spin_time = 0;
+    }
+    if((g_opt & D3D11QM_INIT_SYMBOLS)!=0) { FinalizeSymbol(); }
+    g_opt = 0;
+}
+
+void _D3D11QueryMonitorGetStats(D3D11QueryMonitorStats &out)
+{
+    ScopedLock lock(g_mutex);
+    out.num_queries = g_queries.size();
+    out.get_data    = g_get_data;
+    out.not_ready   = g_not_ready;
+    out.cache_hits  = g_cache_hits;
+    out.busy_waits  = g_busy_waits;
+    out.max_polls   = g_max_polls;
+    out.spin_time   = PerformanceCounterToMS(g_spin_time);
+}
+
+void _D3D11QueryMonitorPrintStats()
+{
+    D3D11QueryMonitorStats stats;
+    _D3D11QueryMonitorGetStats(stats);
+
+    char buf[512];
+    sprintf_s(buf, "D3D11QueryMonitorPrintStats(): Queries=%Iu GetData=%Iu NotReady=%Iu CacheHits=%Iu BusyWaits=%Iu MaxPolls=%Iu SpinTime=%.3fms\n",
+        stats.num_queries, stats.get_data, stats.not_ready, stats.cache_hits, stats.busy_waits, stats.max_polls, stats.spin_time);
+    OutputDebugStringA(buf);
+}
+
+bool GreaterBusyWaits(const CallsiteTable::value_type *a, const CallsiteTable::value_type *b)
+{
+    return a->second.count > b->second.count;
+}
+
+void _D3D11QueryMonitorPrintCallsiteStats(size_t max_num)
+{
+    ScopedLock lock(g_mutex);
+    if((g_opt & D3D11QM_TRACE_CALLSITES)==0) {
+        OutputDebugStringA("D3D11QueryMonitorPrintCallsiteStats(): D3D11QM_TRACE_CALLSITES is not specified.\n");
+        return;
+    }
+
+    std::vector<const CallsiteTable::value_type*> sorted;
+    sorted.reserve(g_callsites.size());
+    for(CallsiteTable::const_iterator i=g_callsites.begin(); i!=g_callsites.end(); ++i) {
+        sorted.push_back(&*i);
+    }
+    std::sort(sorted.begin(), sorted.end(), GreaterBusyWaits);
+    if(sorted.size()>max_num) { sorted.resize(max_num); }
+
+    std::vector<void*> addresses;
+    for(size_t i=0; i<sorted.size(); ++i) {
+        const BusyWaitCallsite &cs = sorted[i]->second;
+        addresses.insert(addresses.end(), cs.stack, cs.stack+cs.size);
+    }
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+    if(!addresses.empty()) {
+        ResolveAddresses(&addresses[0], addresses.size());
+    }
+
+    std::string str;
+    char buf[512];
+    sprintf_s(buf, "D3D11QueryMonitorPrintCallsiteStats(): %Iu callsites, Frame=%Iu\n", g_callsites.size(), g_frame);
+    str += buf;
+    for(size_t i=0; i<sorted.size(); ++i) {
+        const BusyWaitCallsite &cs = sorted[i]->second;
+        sprintf_s(buf, "  %Iu busy waits, Polls=%Iu SpinTime=%.3fms\n", cs.count, cs.polls, PerformanceCounterToMS(cs.time));
+        str += buf;
+        str += CallstackToSymbolNames(const_cast<void**>(cs.stack), cs.size, 0, 0, "    ");
+    }
+    str += "\n";
+    OutputDebugStringA(str.c_str());
+}
@@ -0,0 +1,81 @@
+﻿#ifndef _ist_D3D11QueryMonitor_h_
+#define _ist_D3D11QueryMonitor_h_
+#include <D3D11.h>
+
+// immediate context の End() / GetData() を監視し、query の結果を待って GetData() を繰り返し呼んでいる箇所を検出します。
+// query ごとに End() したフレーム、End() 後の GetData() の回数、最初の GetData() から結果が出るまでの時間を記録し、
+// End() と同じフレーム内で D3D11QUERYMONITOR_BUSY_WAIT_POLLS 回以上 GetData() してから結果を得たものを busy wait とみなします。
+// D3D11QM_TRACE_CALLSITES を指定すると、busy wait した GetData() のコールスタックごとに集計します (D3D11QueryMonitorPrintCallsiteStats())。
+//
+// D3D11QM_CACHE_RESULTS を指定すると、結果が出た query のデータを保持しておき、次に Begin()/End() されるまでの GetData() には
+// runtime を呼ばずにそれを返します。
+//
+// query はアドレスで記録しているので、D3D11QUERYMONITOR_MAX_IDLE_FRAMES フレーム使われなかった記録は捨てます。
+// (新しい query は End() されるまで GetData() できないので、同じアドレスに作られた別の query に古い結果を返すことはありません)
+//
+// 有効にするには、このファイルを include する前に D3D11QUERYMONITOR_ENABLE を define しておく必要があります。
+// D3D11QUERYMONITOR_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+#ifndef D3D11QUERYMONITOR_BUSY_WAIT_POLLS
+#define D3D11QUERYMONITOR_BUSY_WAIT_POLLS 8
+#endif
+#ifndef D3D11QUERYMONITOR_MAX_IDLE_FRAMES
+#define D3D11QUERYMONITOR_MAX_IDLE_FRAMES 600
+#endif
+// 保持する結果の最大サイズ。D3D11_QUERY_DATA_PIPELINE_STATISTICS が収まる大きさ
+#ifndef D3D11QUERYMONITOR_MAX_DATA_SIZE
+#define D3D11QUERYMONITOR_MAX_DATA_SIZE 128
+#endif
+#ifndef D3D11QUERYMONITOR_MAX_CALLSTACK_SIZE
+#define D3D11QUERYMONITOR_MAX_CALLSTACK_SIZE 16
+#endif
+
+enum D3D11QM_OPTION {
+    D3D11QM_NONE = 0,
+
+    // symbol の初期化/終了処理を行うか (SymInitialize()/SymCleanup())
+    D3D11QM_INIT_SYMBOLS = 1,
+    // busy wait した GetData() のコールスタックごとに集計するか
+    D3D11QM_TRACE_CALLSITES = 2,
+    // 結果の出た query のデータを保持し、以後の GetData() にそれを返すか
+    D3D11QM_CACHE_RESULTS = 4,
+};
+
+struct D3D11QueryMonitorStats
+{
+    size_t num_queries;     // 記録している query の数
+    size_t get_data;        // GetData() の回数 (cache_hits を含む)
+    size_t not_ready;       // S_FALSE が返った回数
+    size_t cache_hits;      // 保持していた結果を返した回数
+    size_t busy_waits;
+    size_t max_polls;       // 1 回の End() に対する GetData() の回数の最大値
+    double spin_time;       // busy wait の、最初の GetData() から結果が出るまでの時間の合計 (ミリ秒)
+};
+
+#ifdef D3D11QUERYMONITOR_ENABLE
+
+bool _D3D11QueryMonitorInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, int opt=D3D11QM_NONE);
+void _D3D11QueryMonitorFinalize();
+void _D3D11QueryMonitorGetStats(D3D11QueryMonitorStats &out);
+void _D3D11QueryMonitorPrintStats();
+// busy wait の多い順に、上位 max_num 個を表示します
+void _D3D11QueryMonitorPrintCallsiteStats(size_t max_num=20);
+
+#define D3D11QueryMonitorInitialize(...)        _D3D11QueryMonitorInitialize(__VA_ARGS__)
+#define D3D11QueryMonitorFinalize()             _D3D11QueryMonitorFinalize()
+#define D3D11QueryMonitorGetStats(...)          _D3D11QueryMonitorGetStats(__VA_ARGS__)
+#define D3D11QueryMonitorPrintStats()           _D3D11QueryMonitorPrintStats()
+#define D3D11QueryMonitorPrintCallsiteStats(...) _D3D11QueryMonitorPrintCallsiteStats(__VA_ARGS__)
+
+#else // D3D11QUERYMONITOR_ENABLE
+
+#define D3D11QueryMonitorInitialize(...)
+#define D3D11QueryMonitorFinalize()
+#define D3D11QueryMonitorGetStats(...)
+#define D3D11QueryMonitorPrintStats()
+#define D3D11QueryMonitorPrintCallsiteStats(...)
+
+#endif // D3D11QUERYMONITOR_ENABLE
+
+#endif // _ist_D3D11QueryMonitor_h_
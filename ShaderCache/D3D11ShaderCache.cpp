@@ -0,0 +1,312 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Hash.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/Timer.h"
+#include "D3D11ShaderCache.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+
+
+enum SHADER_STAGE {
+    STAGE_VS,
+    STAGE_GS,
+    STAGE_PS,
+    STAGE_HS,
+    STAGE_DS,
+    STAGE_CS,
+};
+
+struct ShaderKey
+{
+    uint64_t hash;  // バイトコードのハッシュ
+    size_t length;
+    int stage;      // SHADER_STAGE
+    ID3D11ClassLinkage *linkage;
+
+    bool operator==(const ShaderKey &v) const
+    {
+        return hash==v.hash && length==v.length && stage==v.stage && linkage==v.linkage;
+    }
+    uint64_t combined() const
+    {
+        return HashCombine(HashCombine(HashCombine(hash, length), stage), (size_t)linkage);
+    }
+};
+
+struct CachedShader
+{
+    ShaderKey key;
+    IUnknown *shader;
+    LONGLONG create_time; // ドライバでの作成にかかった時間
+    std::string bytecode; // ハッシュが衝突したときに別のシェーダを返さないよう、ヒットしたら中身も比べる
+};
+
+typedef std::unordered_map<uint64_t, CachedShader> CachedShaders; // key は ShaderKey::combined()
+typedef std::unordered_map<IUnknown*, uint64_t> ShaderKeys;
+
+namespace {
+
+Mutex g_mutex;
+CachedShaders g_shaders;
+ShaderKeys g_keys;
+ID3D11Device *g_device = NULL;
+
+size_t g_hits = 0;
+size_t g_misses = 0;
+size_t g_bytes_hashed = 0;
+LONGLONG g_hash_time = 0;
+LONGLONG g_create_time = 0;
+LONGLONG g_saved_time = 0;
+
+} // namespace
+
+
+// キャッシュ中のシェーダに仕掛ける hook。解放されたらキャッシュから取り除きます
+template<class T>
+class TShaderCacheHook : public T
+{
+    typedef T super;
+public:
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        // 別スレッドの Create*Shader() がこのシェーダを返そうとしている可能性があるので、ロックしたまま解放する
+        ScopedLock lock(g_mutex);
+        ULONG r = super::Release();
+        if(r==0) {
+            ShaderKeys::iterator i = g_keys.find(this);
+            if(i!=g_keys.end()) {
+                g_shaders.erase(i->second);
+                g_keys.erase(i);
+            }
+        }
+        return r;
+    }
+};
+typedef TShaderCacheHook<D3D11VertexShaderHook>     VertexShaderCacheHook;
+typedef TShaderCacheHook<D3D11GeometryShaderHook>   GeometryShaderCacheHook;
+typedef TShaderCacheHook<D3D11PixelShaderHook>      PixelShaderCacheHook;
+typedef TShaderCacheHook<D3D11HullShaderHook>       HullShaderCacheHook;
+typedef TShaderCacheHook<D3D11DomainShaderHook>     DomainShaderCacheHook;
+typedef TShaderCacheHook<D3D11ComputeShaderHook>    ComputeShaderCacheHook;
+
+template<class T> struct GetShaderCacheHookType;
+template<> struct GetShaderCacheHookType<ID3D11VertexShader>    { typedef VertexShaderCacheHook result_type; };
+template<> struct GetShaderCacheHookType<ID3D11GeometryShader>  { typedef GeometryShaderCacheHook result_type; };
+template<> struct GetShaderCacheHookType<ID3D11PixelShader>     { typedef PixelShaderCacheHook result_type; };
+template<> struct GetShaderCacheHookType<ID3D11HullShader>      { typedef HullShaderCacheHook result_type; };
+template<> struct GetShaderCacheHookType<ID3D11DomainShader>    { typedef DomainShaderCacheHook result_type; };
+template<> struct GetShaderCacheHookType<ID3D11ComputeShader>   { typedef ComputeShaderCacheHook result_type; };
+
+
+ShaderKey MakeShaderKey(int stage, const void *pShaderBytecode, SIZE_T BytecodeLength, ID3D11ClassLinkage *pClassLinkage)
+{
+    LONGLONG begin = GetPerformanceCounter();
+    ShaderKey key;
+    key.hash = HashBytesFast(pShaderBytecode, BytecodeLength);
+    key.length = BytecodeLength;
+    key.stage = stage;
+    key.linkage = pClassLinkage;
+    LONGLONG elapsed = GetPerformanceCounter()-begin;
+
+    ScopedLock lock(g_mutex);
+    g_bytes_hashed += BytecodeLength;
+    g_hash_time += elapsed;
+    return key;
+}
+
+template<class Interface>
+bool FindShader(const ShaderKey &key, const void *pShaderBytecode, Interface **out)
+{
+    ScopedLock lock(g_mutex);
+    CachedShaders::iterator i = g_shaders.find(key.combined());
+    if(i==g_shaders.end() || !(i->second.key==key)) { return false; }
+    if(key.length>0 && memcmp(i->second.bytecode.data(), pShaderBytecode, key.length)!=0) { return false; }
+
+    Interface *v = static_cast<Interface*>(i->second.shader);
+    v->AddRef();
+    *out = v;
+    ++g_hits;
+    g_saved_time += i->second.create_time;
+    return true;
+}
+
+template<class Interface>
+void AddShader(const ShaderKey &key, const void *pShaderBytecode, Interface *v, LONGLONG elapsed)
+{
+    ScopedLock lock(g_mutex);
+    ++g_misses;
+    g_create_time += elapsed;
+
+    uint64_t combined = key.combined();
+    if(g_keys.find(v)!=g_keys.end() || g_shaders.find(combined)!=g_shaders.end()) { return; }
+    CachedShader &cs = g_shaders[combined];
+    cs.key = key;
+    cs.shader = v;
+    cs.create_time = elapsed;
+    cs.bytecode.assign((const char*)pShaderBytecode, key.length);
+    g_keys[v] = combined;
+    D3D11SetHook<typename GetShaderCacheHookType<Interface>::result_type>(v);
+}
+
+
+class DeviceShaderCache : public D3D11DeviceHook
+{
+typedef D3D11DeviceHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE CreateVertexShader(
+        const void *pShaderBytecode,
+        SIZE_T BytecodeLength,
+        ID3D11ClassLinkage *pClassLinkage,
+        ID3D11VertexShader **ppVertexShader)
+    {
+        if(pShaderBytecode==NULL || ppVertexShader==NULL) { return super::CreateVertexShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppVertexShader); }
+
+        ShaderKey key = MakeShaderKey(STAGE_VS, pShaderBytecode, BytecodeLength, pClassLinkage);
+        if(FindShader(key, pShaderBytecode, ppVertexShader)) { return S_OK; }
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::CreateVertexShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppVertexShader);
+        if(r==S_OK) { AddShader(key, pShaderBytecode, *ppVertexShader, GetPerformanceCounter()-begin); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateGeometryShader(
+        const void *pShaderBytecode,
+        SIZE_T BytecodeLength,
+        ID3D11ClassLinkage *pClassLinkage,
+        ID3D11GeometryShader **ppGeometryShader)
+    {
+        if(pShaderBytecode==NULL || ppGeometryShader==NULL) { return super::CreateGeometryShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppGeometryShader); }
+
+        ShaderKey key = MakeShaderKey(STAGE_GS, pShaderBytecode, BytecodeLength, pClassLinkage);
+        if(FindShader(key, pShaderBytecode, ppGeometryShader)) { return S_OK; }
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::CreateGeometryShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppGeometryShader);
+        if(r==S_OK) { AddShader(key, pShaderBytecode, *ppGeometryShader, GetPerformanceCounter()-begin); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreatePixelShader(
+        const void *pShaderBytecode,
+        SIZE_T BytecodeLength,
+        ID3D11ClassLinkage *pClassLinkage,
+        ID3D11PixelShader **ppPixelShader)
+    {
+        if(pShaderBytecode==NULL || ppPixelShader==NULL) { return super::CreatePixelShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppPixelShader); }
+
+        ShaderKey key = MakeShaderKey(STAGE_PS, pShaderBytecode, BytecodeLength, pClassLinkage);
+        if(FindShader(key, pShaderBytecode, ppPixelShader)) { return S_OK; }
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::CreatePixelShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppPixelShader);
+        if(r==S_OK) { AddShader(key, pShaderBytecode, *ppPixelShader, GetPerformanceCounter()-begin); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateHullShader(
+        const void *pShaderBytecode,
+        SIZE_T BytecodeLength,
+        ID3D11ClassLinkage *pClassLinkage,
+        ID3D11HullShader **ppHullShader)
+    {
+        if(pShaderBytecode==NULL || ppHullShader==NULL) { return super::CreateHullShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppHullShader); }
+
+        ShaderKey key = MakeShaderKey(STAGE_HS, pShaderBytecode, BytecodeLength, pClassLinkage);
+        if(FindShader(key, pShaderBytecode, ppHullShader)) { return S_OK; }
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::CreateHullShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppHullShader);
+        if(r==S_OK) { AddShader(key, pShaderBytecode, *ppHullShader, GetPerformanceCounter()-begin); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateDomainShader(
+        const void *pShaderBytecode,
+        SIZE_T BytecodeLength,
+        ID3D11ClassLinkage *pClassLinkage,
+        ID3D11DomainShader **ppDomainShader)
+    {
+        if(pShaderBytecode==NULL || ppDomainShader==NULL) { return super::CreateDomainShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppDomainShader); }
+
+        ShaderKey key = MakeShaderKey(STAGE_DS, pShaderBytecode, BytecodeLength, pClassLinkage);
+        if(FindShader(key, pShaderBytecode, ppDomainShader)) { return S_OK; }
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::CreateDomainShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppDomainShader);
+        if(r==S_OK) { AddShader(key, pShaderBytecode, *ppDomainShader, GetPerformanceCounter()-begin); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateComputeShader(
+        const void *pShaderBytecode,
+        SIZE_T BytecodeLength,
+        ID3D11ClassLinkage *pClassLinkage,
+        ID3D11ComputeShader **ppComputeShader)
+    {
+        if(pShaderBytecode==NULL || ppComputeShader==NULL) { return super::CreateComputeShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppComputeShader); }
+
+        ShaderKey key = MakeShaderKey(STAGE_CS, pShaderBytecode, BytecodeLength, pClassLinkage);
+        if(FindShader(key, pShaderBytecode, ppComputeShader)) { return S_OK; }
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::CreateComputeShader(pShaderBytecode, BytecodeLength, pClassLinkage, ppComputeShader);
+        if(r==S_OK) { AddShader(key, pShaderBytecode, *ppComputeShader, GetPerformanceCounter()-begin); }
+        return r;
+    }
+};
+
+
+bool _D3D11ShaderCacheInitialize(ID3D11Device *pDevice)
+{
+    if(g_device!=NULL) { return false; }
+
+    g_device = pDevice;
+    D3D11SetHook<DeviceShaderCache>(pDevice);
+    return true;
+}
+
+void _D3D11ShaderCacheFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    ScopedLock lock(g_mutex);
+    D3D11RemoveHook<DeviceShaderCache>(g_device);
+    for(CachedShaders::iterator i=g_shaders.begin(); i!=g_shaders.end(); ++i) {
+        IUnknown *shader = i->second.shader;
+        switch(i->second.key.stage) {
+        case STAGE_VS: D3D11RemoveHook<VertexShaderCacheHook>(shader); break;
+        case STAGE_GS: D3D11RemoveHook<GeometryShaderCacheHook>(shader); break;
+        case STAGE_PS: D3D11RemoveHook<PixelShaderCacheHook>(shader); break;
+        case STAGE_HS: D3D11RemoveHook<HullShaderCacheHook>(shader); break;
+        case STAGE_DS: D3D11RemoveHook<DomainShaderCacheHook>(shader); break;
+        case STAGE_CS: D3D11RemoveHook<ComputeShaderCacheHook>(shader); break;
+        }
+    }
+    g_shaders.clear();
+    g_keys.clear();
+    g_device = NULL;
+
+    g_hits = g_misses = 0;
+    g_bytes_hashed = 0;
+    g_hash_time = g_create_time = g_saved_time = 0;
+}
+
+void _D3D11ShaderCacheGetStats(D3D11ShaderCacheStats &out)
+{
+    ScopedLock lock(g_mutex);
+    out.num_cached      = g_shaders.size();
+    out.hits            = g_hits;
+    out.misses          = g_misses;
+    out.bytes_hashed    = g_bytes_hashed;
+    out.hash_time       = PerformanceCounterToMS(g_hash_time);
+    out.create_time     = PerformanceCounterToMS(g_create_time);
+    out.saved_time      = PerformanceCounterToMS(g_saved_time);
+}
+
+void _D3D11ShaderCachePrintStats()
+{
+    D3D11ShaderCacheStats stats;
+    _D3D11ShaderCacheGetStats(stats);
+
+    char buf[512];
+    sprintf_s(buf, "D3D11ShaderCachePrintStats(): Cached=%Iu Hits=%Iu Misses=%Iu BytesHashed=%Iu HashTime=%.3fms CreateTime=%.3fms SavedTime=%.3fms\n",
+        stats.num_cached, stats.hits, stats.misses, stats.bytes_hashed, stats.hash_time, stats.create_time, stats.saved_time);
+    OutputDebugStringA(buf);
+}
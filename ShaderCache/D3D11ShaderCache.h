@@ -0,0 +1,48 @@
+﻿#ifndef _ist_D3D11ShaderCache_h_
+#define _ist_D3D11ShaderCache_h_
+#include <D3D11.h>
+
+// ID3D11Device::CreateVertexShader() / CreatePixelShader() / CreateGeometryShader() / CreateHullShader() /
+// CreateDomainShader() / CreateComputeShader() で、同じバイトコードと ClassLinkage から作られた生存中のシェーダがあれば、
+// ドライバを呼ばずにそれを AddRef() して返します。キーはバイトコードのハッシュ (HashBytesFast()) とサイズです。
+// ハッシュの衝突で別のシェーダを返さないよう、キャッシュ中のシェーダのバイトコードも保持しておき、ヒットしたら中身を比べます。
+// キャッシュは参照を保持しないので、アプリ側の参照が無くなったシェーダは通常通り解放され、キャッシュからも取り除かれます。
+// D3D11ShaderCachePrintStats() でヒット数、ハッシュしたバイト数、ドライバでの作成時間を節約できた量を表示できます。
+//
+// 有効にするには、このファイルを include する前に D3D11SHADERCACHE_ENABLE を define しておく必要があります。
+// D3D11SHADERCACHE_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+struct D3D11ShaderCacheStats
+{
+    size_t num_cached;      // キャッシュ中のシェーダの数
+    size_t hits;
+    size_t misses;
+    size_t bytes_hashed;
+    double hash_time;       // ハッシュ計算にかかった時間の合計 (ミリ秒)
+    double create_time;     // ドライバでのシェーダ作成にかかった時間の合計 (ミリ秒)
+    double saved_time;      // ヒットしたシェーダの作成時間の合計 (ミリ秒)
+};
+
+#ifdef D3D11SHADERCACHE_ENABLE
+
+bool _D3D11ShaderCacheInitialize(ID3D11Device *pDevice);
+void _D3D11ShaderCacheFinalize();
+void _D3D11ShaderCacheGetStats(D3D11ShaderCacheStats &out);
+void _D3D11ShaderCachePrintStats();
+
+#define D3D11ShaderCacheInitialize(...) _D3D11ShaderCacheInitialize(__VA_ARGS__)
+#define D3D11ShaderCacheFinalize()      _D3D11ShaderCacheFinalize()
+#define D3D11ShaderCacheGetStats(...)   _D3D11ShaderCacheGetStats(__VA_ARGS__)
+#define D3D11ShaderCachePrintStats()    _D3D11ShaderCachePrintStats()
+
+#else // D3D11SHADERCACHE_ENABLE
+
+#define D3D11ShaderCacheInitialize(...)
+#define D3D11ShaderCacheFinalize()
+#define D3D11ShaderCacheGetStats(...)
+#define D3D11ShaderCachePrintStats()
+
+#endif // D3D11SHADERCACHE_ENABLE
+
+#endif // _ist_D3D11ShaderCache_h_
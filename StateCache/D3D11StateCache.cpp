@@ -0,0 +1,344 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Hash.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/Timer.h"
+#include "D3D11StateCache.h"
+#include <string.h>
+#include <stdio.h>
+#include <unordered_map>
+
+
+// desc の padding が未初期化だとハッシュと比較が狂うので、0 埋めしてからメンバをコピーしたものを key にします
+template<class Desc>
+inline void NormalizeDesc(Desc &dst, const Desc &src)
+{
+    dst = src;
+}
+
+inline void NormalizeDesc(D3D11_BLEND_DESC &dst, const D3D11_BLEND_DESC &src)
+{
+    memset(&dst, 0, sizeof(dst));
+    dst.AlphaToCoverageEnable   = src.AlphaToCoverageEnable;
+    dst.IndependentBlendEnable  = src.IndependentBlendEnable;
+    for(size_t i=0; i<_countof(dst.RenderTarget); ++i) {
+        const D3D11_RENDER_TARGET_BLEND_DESC &s = src.RenderTarget[i];
+        D3D11_RENDER_TARGET_BLEND_DESC &d = dst.RenderTarget[i];
+        d.BlendEnable           = s.BlendEnable;
+        d.SrcBlend              = s.SrcBlend;
+        d.DestBlend             = s.DestBlend;
+        d.BlendOp               = s.BlendOp;
+        d.SrcBlendAlpha         = s.SrcBlendAlpha;
+        d.DestBlendAlpha        = s.DestBlendAlpha;
+        d.BlendOpAlpha          = s.BlendOpAlpha;
+        d.RenderTargetWriteMask = s.RenderTargetWriteMask;
+    }
+}
+
+inline void NormalizeDesc(D3D11_DEPTH_STENCIL_DESC &dst, const D3D11_DEPTH_STENCIL_DESC &src)
+{
+    memset(&dst, 0, sizeof(dst));
+    dst.DepthEnable         = src.DepthEnable;
+    dst.DepthWriteMask      = src.DepthWriteMask;
+    dst.DepthFunc           = src.DepthFunc;
+    dst.StencilEnable       = src.StencilEnable;
+    dst.StencilReadMask     = src.StencilReadMask;
+    dst.StencilWriteMask    = src.StencilWriteMask;
+    dst.FrontFace           = src.FrontFace;
+    dst.BackFace            = src.BackFace;
+}
+
+template<class Desc>
+struct StateKey
+{
+    Desc desc;
+    uint64_t hash;
+
+    explicit StateKey(const Desc &v)
+    {
+        NormalizeDesc(desc, v);
+        hash = HashBytes(&desc, sizeof(desc));
+    }
+};
+
+// desc のハッシュ -> ステートオブジェクト の表。参照は保持しません。
+template<class Interface, class Desc>
+class StateTable
+{
+public:
+    Interface* find(const StateKey<Desc> &key) const
+    {
+        typename Items::const_iterator i = m_items.find(key.hash);
+        if(i!=m_items.end() && memcmp(&i->second.desc, &key.desc, sizeof(Desc))==0) {
+            return i->second.object;
+        }
+        return NULL;
+    }
+
+    // 既に登録されているオブジェクトか、ハッシュが衝突した場合は false を返します
+    bool insert(const StateKey<Desc> &key, Interface *object)
+    {
+        if(m_objects.find(object)!=m_objects.end() || m_items.find(key.hash)!=m_items.end()) {
+            return false;
+        }
+        Item &item = m_items[key.hash];
+        item.desc = key.desc;
+        item.object = object;
+        m_objects[object] = key.hash;
+        return true;
+    }
+
+    void erase(Interface *object)
+    {
+        typename Objects::iterator i = m_objects.find(object);
+        if(i!=m_objects.end()) {
+            m_items.erase(i->second);
+            m_objects.erase(i);
+        }
+    }
+
+    template<class HookType>
+    void removeHooks()
+    {
+        for(typename Objects::iterator i=m_objects.begin(); i!=m_objects.end(); ++i) {
+            D3D11RemoveHook<HookType>(i->first);
+        }
+        m_items.clear();
+        m_objects.clear();
+    }
+
+    size_t size() const { return m_items.size(); }
+
+private:
+    struct Item
+    {
+        Desc desc;
+        Interface *object;
+    };
+    typedef std::unordered_map<uint64_t, Item> Items;
+    typedef std::unordered_map<Interface*, uint64_t> Objects;
+
+    Items m_items;
+    Objects m_objects;
+};
+
+namespace {
+
+Mutex g_mutex;
+StateTable<ID3D11BlendState, D3D11_BLEND_DESC>                  g_blend_states;
+StateTable<ID3D11DepthStencilState, D3D11_DEPTH_STENCIL_DESC>   g_depth_stencil_states;
+StateTable<ID3D11RasterizerState, D3D11_RASTERIZER_DESC>        g_rasterizer_states;
+StateTable<ID3D11SamplerState, D3D11_SAMPLER_DESC>              g_sampler_states;
+
+IDXGISwapChain *g_swapchain = NULL;
+ID3D11Device *g_device = NULL;
+
+size_t g_hits = 0;
+size_t g_misses = 0;
+LONGLONG g_miss_time = 0;
+size_t g_frame_hits = 0;
+size_t g_frame_misses = 0;
+size_t g_last_frame_hits = 0;
+size_t g_last_frame_misses = 0;
+
+} // namespace
+
+StateTable<ID3D11BlendState, D3D11_BLEND_DESC>&                 GetStateTable(ID3D11BlendState*)        { return g_blend_states; }
+StateTable<ID3D11DepthStencilState, D3D11_DEPTH_STENCIL_DESC>&  GetStateTable(ID3D11DepthStencilState*) { return g_depth_stencil_states; }
+StateTable<ID3D11RasterizerState, D3D11_RASTERIZER_DESC>&       GetStateTable(ID3D11RasterizerState*)   { return g_rasterizer_states; }
+StateTable<ID3D11SamplerState, D3D11_SAMPLER_DESC>&             GetStateTable(ID3D11SamplerState*)      { return g_sampler_states; }
+
+
+// キャッシュ中のステートオブジェクトに仕掛ける hook。解放されたらキャッシュから取り除きます
+template<class T>
+class TStateCacheHook : public T
+{
+    typedef T super;
+public:
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        // 別スレッドの Create*State() がこのオブジェクトを返そうとしている可能性があるので、ロックしたまま解放する
+        ScopedLock lock(g_mutex);
+        ULONG r = super::Release();
+        if(r==0) { GetStateTable(this).erase(this); }
+        return r;
+    }
+};
+typedef TStateCacheHook<D3D11BlendStateHook>        BlendStateCacheHook;
+typedef TStateCacheHook<D3D11DepthStencilStateHook> DepthStencilStateCacheHook;
+typedef TStateCacheHook<D3D11RasterizerStateHook>   RasterizerStateCacheHook;
+typedef TStateCacheHook<D3D11SamplerStateHook>      SamplerStateCacheHook;
+
+template<class T> struct GetStateCacheHookType;
+template<> struct GetStateCacheHookType<ID3D11BlendState>           { typedef BlendStateCacheHook result_type; };
+template<> struct GetStateCacheHookType<ID3D11DepthStencilState>    { typedef DepthStencilStateCacheHook result_type; };
+template<> struct GetStateCacheHookType<ID3D11RasterizerState>      { typedef RasterizerStateCacheHook result_type; };
+template<> struct GetStateCacheHookType<ID3D11SamplerState>         { typedef SamplerStateCacheHook result_type; };
+
+
+template<class Interface, class Desc>
+bool FindState(StateTable<Interface, Desc> &table, const StateKey<Desc> &key, Interface **out)
+{
+    ScopedLock lock(g_mutex);
+    Interface *v = table.find(key);
+    if(v==NULL) { return false; }
+    v->AddRef();
+    *out = v;
+    ++g_hits;
+    ++g_frame_hits;
+    return true;
+}
+
+template<class Interface, class Desc>
+void AddState(StateTable<Interface, Desc> &table, const StateKey<Desc> &key, Interface *v, LONGLONG elapsed)
+{
+    ScopedLock lock(g_mutex);
+    ++g_misses;
+    ++g_frame_misses;
+    g_miss_time += elapsed;
+    if(table.insert(key, v)) {
+        D3D11SetHook<typename GetStateCacheHookType<Interface>::result_type>(v);
+    }
+}
+
+
+class DeviceStateCache : public D3D11DeviceHook
+{
+typedef D3D11DeviceHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE CreateBlendState(
+        const D3D11_BLEND_DESC *pBlendStateDesc,
+        ID3D11BlendState **ppBlendState)
+    {
+        if(pBlendStateDesc==NULL || ppBlendState==NULL) { return super::CreateBlendState(pBlendStateDesc, ppBlendState); }
+
+        StateKey<D3D11_BLEND_DESC> key(*pBlendStateDesc);
+        if(FindState(g_blend_states, key, ppBlendState)) { return S_OK; }
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::CreateBlendState(pBlendStateDesc, ppBlendState);
+        if(r==S_OK) { AddState(g_blend_states, key, *ppBlendState, GetPerformanceCounter()-begin); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateDepthStencilState(
+        const D3D11_DEPTH_STENCIL_DESC *pDepthStencilDesc,
+        ID3D11DepthStencilState **ppDepthStencilState)
+    {
+        if(pDepthStencilDesc==NULL || ppDepthStencilState==NULL) { return super::CreateDepthStencilState(pDepthStencilDesc, ppDepthStencilState); }
+
+        StateKey<D3D11_DEPTH_STENCIL_DESC> key(*pDepthStencilDesc);
+        if(FindState(g_depth_stencil_states, key, ppDepthStencilState)) { return S_OK; }
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::CreateDepthStencilState(pDepthStencilDesc, ppDepthStencilState);
+        if(r==S_OK) { AddState(g_depth_stencil_states, key, *ppDepthStencilState, GetPerformanceCounter()-begin); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateRasterizerState(
+        const D3D11_RASTERIZER_DESC *pRasterizerDesc,
+        ID3D11RasterizerState **ppRasterizerState)
+    {
+        if(pRasterizerDesc==NULL || ppRasterizerState==NULL) { return super::CreateRasterizerState(pRasterizerDesc, ppRasterizerState); }
+
+        StateKey<D3D11_RASTERIZER_DESC> key(*pRasterizerDesc);
+        if(FindState(g_rasterizer_states, key, ppRasterizerState)) { return S_OK; }
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::CreateRasterizerState(pRasterizerDesc, ppRasterizerState);
+        if(r==S_OK) { AddState(g_rasterizer_states, key, *ppRasterizerState, GetPerformanceCounter()-begin); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateSamplerState(
+        const D3D11_SAMPLER_DESC *pSamplerDesc,
+        ID3D11SamplerState **ppSamplerState)
+    {
+        if(pSamplerDesc==NULL || ppSamplerState==NULL) { return super::CreateSamplerState(pSamplerDesc, ppSamplerState); }
+
+        StateKey<D3D11_SAMPLER_DESC> key(*pSamplerDesc);
+        if(FindState(g_sampler_states, key, ppSamplerState)) { return S_OK; }
+        LONGLONG begin = GetPerformanceCounter();
+        HRESULT r = super::CreateSamplerState(pSamplerDesc, ppSamplerState);
+        if(r==S_OK) { AddState(g_sampler_states, key, *ppSamplerState, GetPerformanceCounter()-begin); }
+        return r;
+    }
+};
+
+class SwapChainStateCache : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        {
+            ScopedLock lock(g_mutex);
+            g_last_frame_hits = g_frame_hits;
+            g_last_frame_misses = g_frame_misses;
+            g_frame_hits = 0;
+            g_frame_misses = 0;
+        }
+        return super::Present(SyncInterval, Flags);
+    }
+};
+
+
+bool _D3D11StateCacheInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice)
+{
+    if(g_device!=NULL) { return false; }
+
+    g_swapchain = pSwapChain;
+    g_device = pDevice;
+    D3D11SetHook<SwapChainStateCache>(pSwapChain);
+    D3D11SetHook<DeviceStateCache>(pDevice);
+    return true;
+}
+
+void _D3D11StateCacheFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    ScopedLock lock(g_mutex);
+    D3D11RemoveHook<SwapChainStateCache>(g_swapchain);
+    D3D11RemoveHook<DeviceStateCache>(g_device);
+    g_blend_states.removeHooks<BlendStateCacheHook>();
+    g_depth_stencil_states.removeHooks<DepthStencilStateCacheHook>();
+    g_rasterizer_states.removeHooks<RasterizerStateCacheHook>();
+    g_sampler_states.removeHooks<SamplerStateCacheHook>();
+    g_swapchain = NULL;
+    g_device = NULL;
+
+    g_hits = g_misses = 0;
+    g_miss_time = 0;
+    g_frame_hits = g_frame_misses = 0;
+    g_last_frame_hits = g_last_frame_misses = 0;
+}
+
+void _D3D11StateCacheGetStats(D3D11StateCacheStats &out)
+{
+    ScopedLock lock(g_mutex);
+    double miss_time = PerformanceCounterToMS(g_miss_time);
+    double avg_miss_time = g_misses>0 ? miss_time/g_misses : 0.0;
+    out.num_cached  = g_blend_states.size() + g_depth_stencil_states.size() + g_rasterizer_states.size() + g_sampler_states.size();
+    out.hits        = g_hits;
+    out.misses      = g_misses;
+    out.miss_time   = miss_time;
+    out.saved_time  = avg_miss_time * g_hits;
+    out.last_frame_hits         = g_last_frame_hits;
+    out.last_frame_misses       = g_last_frame_misses;
+    out.last_frame_saved_time   = avg_miss_time * g_last_frame_hits;
+}
+
+void _D3D11StateCachePrintStats()
+{
+    D3D11StateCacheStats stats;
+    _D3D11StateCacheGetStats(stats);
+
+    size_t total = stats.hits + stats.misses;
+    char buf[512];
+    sprintf_s(buf,
+        "D3D11StateCachePrintStats(): Cached=%Iu Hits=%Iu Misses=%Iu HitRate=%.1f%% MissTime=%.3fms SavedTime=%.3fms\n"
+        "  last frame: Hits=%Iu Misses=%Iu SavedTime=%.3fms\n",
+        stats.num_cached, stats.hits, stats.misses, total>0 ? 100.0*stats.hits/total : 0.0, stats.miss_time, stats.saved_time,
+        stats.last_frame_hits, stats.last_frame_misses, stats.last_frame_saved_time);
+    OutputDebugStringA(buf);
+}
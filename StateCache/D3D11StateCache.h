@@ -0,0 +1,48 @@
+﻿#ifndef _ist_D3D11StateCache_h_
+#define _ist_D3D11StateCache_h_
+#include <D3D11.h>
+
+// ID3D11Device::CreateBlendState() / CreateDepthStencilState() / CreateRasterizerState() / CreateSamplerState() の結果をキャッシュします。
+// D3D11 runtime も同じ desc のステートオブジェクトは既存のものを返しますが、desc のハッシュ計算とロックと検索のコストがかかります。
+// このキャッシュは desc のハッシュで引き、ヒットした場合は AddRef() して返すだけで runtime を呼びません。
+// キャッシュは参照を保持しないので、アプリ側の参照が無くなったステートオブジェクトは通常通り解放され、キャッシュからも取り除かれます。
+// D3D11StateCachePrintStats() でヒット率と、runtime を呼ばずに済んだ時間の推定値を表示できます。
+//
+// 有効にするには、このファイルを include する前に D3D11STATECACHE_ENABLE を define しておく必要があります。
+// D3D11STATECACHE_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+struct D3D11StateCacheStats
+{
+    size_t num_cached;      // キャッシュ中のステートオブジェクトの数
+    size_t hits;
+    size_t misses;
+    double miss_time;       // runtime の Create*State() にかかった時間の合計 (ミリ秒)
+    double saved_time;      // ヒットにより節約できた時間の推定値 (ミリ秒)。ミス時の平均時間 * ヒット数
+    size_t last_frame_hits; // 直前のフレームの値
+    size_t last_frame_misses;
+    double last_frame_saved_time;
+};
+
+#ifdef D3D11STATECACHE_ENABLE
+
+bool _D3D11StateCacheInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice);
+void _D3D11StateCacheFinalize();
+void _D3D11StateCacheGetStats(D3D11StateCacheStats &out);
+void _D3D11StateCachePrintStats();
+
+#define D3D11StateCacheInitialize(...)  _D3D11StateCacheInitialize(__VA_ARGS__)
+#define D3D11StateCacheFinalize()       _D3D11StateCacheFinalize()
+#define D3D11StateCacheGetStats(...)    _D3D11StateCacheGetStats(__VA_ARGS__)
+#define D3D11StateCachePrintStats()     _D3D11StateCachePrintStats()
+
+#else // D3D11STATECACHE_ENABLE
+
+#define D3D11StateCacheInitialize(...)
+#define D3D11StateCacheFinalize()
+#define D3D11StateCacheGetStats(...)
+#define D3D11StateCachePrintStats()
+
+#endif // D3D11STATECACHE_ENABLE
+
+#endif // _ist_D3D11StateCache_h_
@@ -0,0 +1,361 @@
+﻿// Utilities/ConstantBufferRing.h のテストです。ring buffer の Map とバインドを記録する偽の context を使います。
+//   g++ -O2 -o ConstantBufferRingTest Tests/ConstantBufferRingTest.cpp Utilities/ConstantBufferRing.cpp
+
+#include "../Utilities/ConstantBufferRing.h"
+#include "Test.h"
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum { VS=0, PS=4 };
+const uint64_t c_ring_size = 4096;
+const uint64_t c_none = ~0ULL;
+
+// ring buffer と本来のバッファの内容、各スロットに何がバインドされているかを記録する
+class MockContext : public IConstantBufferRingContext
+{
+public:
+    struct Binding
+    {
+        void *buffer;       // 本来のバッファ。ring buffer なら NULL
+        uint64_t offset;    // ring buffer の場合の offset
+        bool while_mapped;  // ring buffer が Map 中にバインドされた
+    };
+
+    std::vector<char> ring;
+    std::map<void*, std::string> buffers; // writeBuffer() で書き戻された内容
+    bool mapped;
+    bool fail_map;
+    int num_maps;
+    int num_writes;
+    Binding slots[CBRING_STAGES][CBRING_SLOTS];
+
+    MockContext() : ring(size_t(c_ring_size)), mapped(false), fail_map(false), num_maps(0), num_writes(0)
+    {
+        memset(slots, 0, sizeof(slots));
+    }
+
+    virtual char* mapRing()
+    {
+        TEST_CHECK(!mapped);
+        if(fail_map) { return NULL; }
+        mapped = true;
+        ++num_maps;
+        return &ring[0];
+    }
+    virtual void unmapRing()
+    {
+        TEST_CHECK(mapped);
+        mapped = false;
+    }
+    virtual void writeBuffer(void *buffer, const char *data, unsigned size)
+    {
+        buffers[buffer].assign(data, size);
+        ++num_writes;
+    }
+    virtual void bindRing(int stage, unsigned slot, uint64_t offset, unsigned)
+    {
+        Binding &b = slots[stage][slot];
+        b.buffer = NULL;
+        b.offset = offset;
+        b.while_mapped = mapped;
+    }
+    virtual void bindBuffer(int stage, unsigned slot, void *buffer)
+    {
+        Binding &b = slots[stage][slot];
+        b.buffer = buffer;
+        b.offset = c_none;
+        b.while_mapped = false;
+    }
+
+    // アプリの *SetConstantBuffers()。本来のバッファをバインドしてから ConstantBufferRing に渡す
+    void set(ConstantBufferRing &ring, int stage, unsigned slot, void *buffer)
+    {
+        bindBuffer(stage, slot, buffer);
+        ring.setConstantBuffers(stage, slot, 1, &buffer);
+    }
+    bool boundToRing(int stage, unsigned slot) const { return slots[stage][slot].buffer==NULL && slots[stage][slot].offset!=c_none; }
+    char ringAt(uint64_t offset) const { return ring[size_t(offset)]; }
+    char bufferAt(void *buffer, size_t pos) { return buffers[buffer].size()>pos ? buffers[buffer][pos] : 0; }
+};
+
+int g_a, g_b, g_c;
+void *A = &g_a;
+void *B = &g_b;
+void *C = &g_c;
+
+CBRING_MAP_RESULT Map(ConstantBufferRing &ring, void *buffer, CBRING_MAP_TYPE type, char **out=NULL)
+{
+    char *data = NULL;
+    unsigned pitch = 0;
+    CBRING_MAP_RESULT r = ring.map(buffer, type, data, pitch);
+    if(out!=NULL) { *out = data; }
+    return r;
+}
+
+// Map して先頭に v を書き込み、Unmap する
+CBRING_MAP_RESULT Write(ConstantBufferRing &ring, void *buffer, CBRING_MAP_TYPE type, char v)
+{
+    char *data = NULL;
+    CBRING_MAP_RESULT r = Map(ring, buffer, type, &data);
+    if(r==CBRING_REDIRECTED) {
+        data[0] = v;
+        ring.unmap(buffer);
+    }
+    return r;
+}
+
+void TestRedirect()
+{
+    MockContext ctx;
+    ConstantBufferRing ring(&ctx, c_ring_size, 3);
+    ring.addBuffer(A, 64);
+    ctx.set(ring, VS, 0, A);
+    ctx.set(ring, PS, 2, A);
+    TEST_CHECK(!ctx.boundToRing(VS, 0));
+
+    // 書き込み先は CPU 側のコピーで、ring buffer は Unmap() の中でだけ Map する
+    char *data = NULL;
+    TEST_CHECK_EQUAL(Map(ring, A, CBRING_MAP_WRITE_DISCARD, &data), CBRING_REDIRECTED);
+    TEST_CHECK(data!=NULL);
+    TEST_CHECK(!ctx.mapped);
+    data[0] = 1;
+    data[255] = 2;
+    TEST_CHECK(ring.unmap(A));
+    TEST_CHECK(!ctx.mapped);
+    TEST_CHECK_EQUAL(ctx.ringAt(0), 1);
+    TEST_CHECK_EQUAL(ctx.ringAt(255), 2);
+    // Unmap() で、バインドされている全スロットが ring buffer に置き換わる
+    TEST_CHECK(ctx.boundToRing(VS, 0));
+    TEST_CHECK(ctx.boundToRing(PS, 2));
+    TEST_CHECK(!ctx.slots[VS][0].while_mapped);
+    TEST_CHECK_EQUAL(ctx.slots[VS][0].offset, 0ULL);
+
+    // 次の DISCARD は新しい領域 (256 byte 単位)
+    TEST_CHECK_EQUAL(Write(ring, A, CBRING_MAP_WRITE_DISCARD, 3), CBRING_REDIRECTED);
+    TEST_CHECK_EQUAL(ctx.slots[VS][0].offset, 256ULL);
+    TEST_CHECK_EQUAL(ctx.ringAt(256), 3);
+    TEST_CHECK_EQUAL(ctx.ringAt(0), 1);
+
+    // 置き換え対象でないバッファや他の Map はそのまま
+    TEST_CHECK_EQUAL(Map(ring, B, CBRING_MAP_WRITE_DISCARD), CBRING_PASS_THROUGH);
+    TEST_CHECK(!ring.unmap(B));
+    TEST_CHECK_EQUAL(Map(ring, A, CBRING_MAP_OTHER), CBRING_PASS_THROUGH);
+    TEST_CHECK(!ring.unmap(A));
+    TEST_CHECK_EQUAL(ring.getRedirected(), (size_t)2);
+    TEST_CHECK_EQUAL(ctx.num_maps, 2);
+    TEST_CHECK_EQUAL(ctx.num_writes, 0);
+}
+
+// 複数のバッファを同時に Map しても、それぞれ別の領域に置き換える
+void TestNestedMaps()
+{
+    MockContext ctx;
+    ConstantBufferRing ring(&ctx, c_ring_size, 3);
+    ring.addBuffer(A, 64);
+    ring.addBuffer(B, 64);
+    ctx.set(ring, VS, 0, A);
+    ctx.set(ring, VS, 1, B);
+
+    char *a = NULL, *b = NULL;
+    TEST_CHECK_EQUAL(Map(ring, A, CBRING_MAP_WRITE_DISCARD, &a), CBRING_REDIRECTED);
+    TEST_CHECK_EQUAL(Map(ring, B, CBRING_MAP_WRITE_DISCARD, &b), CBRING_REDIRECTED);
+    TEST_CHECK(a!=b);
+    a[0] = 1;
+    b[0] = 2;
+    TEST_CHECK(ring.unmap(B));
+    TEST_CHECK(ctx.boundToRing(VS, 1));
+    TEST_CHECK(!ctx.boundToRing(VS, 0)); // A はまだ Map 中
+    TEST_CHECK(ring.unmap(A));
+    TEST_CHECK(ctx.boundToRing(VS, 0));
+    TEST_CHECK_EQUAL(ctx.ringAt(ctx.slots[VS][0].offset), 1);
+    TEST_CHECK_EQUAL(ctx.ringAt(ctx.slots[VS][1].offset), 2);
+    TEST_CHECK_EQUAL(ring.getFallbacks(), (size_t)0);
+
+    // Map 中にバインドされたものは Unmap() までバインドしない
+    TEST_CHECK_EQUAL(Map(ring, A, CBRING_MAP_WRITE_DISCARD), CBRING_REDIRECTED);
+    ctx.set(ring, PS, 0, A);
+    TEST_CHECK(ctx.slots[PS][0].buffer==A);
+    ctx.set(ring, PS, 1, B);
+    TEST_CHECK(ctx.boundToRing(PS, 1));
+    ring.unmap(A);
+    TEST_CHECK(ctx.boundToRing(PS, 0));
+}
+
+void TestNoOverwrite()
+{
+    MockContext ctx;
+    ConstantBufferRing ring(&ctx, c_ring_size, 3);
+    ring.addBuffer(A, 64);
+    ctx.set(ring, VS, 0, A);
+
+    // 切り出す前の NO_OVERWRITE は本来のバッファで
+    TEST_CHECK_EQUAL(Map(ring, A, CBRING_MAP_WRITE_NO_OVERWRITE), CBRING_PASS_THROUGH);
+    TEST_CHECK(!ring.unmap(A));
+
+    char *data = NULL;
+    Map(ring, A, CBRING_MAP_WRITE_DISCARD, &data);
+    data[0] = 1;
+    ring.unmap(A);
+    // 前回の内容を残したまま、新しい領域に書き足せる
+    TEST_CHECK_EQUAL(Map(ring, A, CBRING_MAP_WRITE_NO_OVERWRITE, &data), CBRING_REDIRECTED);
+    TEST_CHECK_EQUAL(data[0], 1);
+    data[16] = 2;
+    ring.unmap(A);
+    TEST_CHECK_EQUAL(ctx.slots[VS][0].offset, 256ULL);
+    TEST_CHECK_EQUAL(ctx.ringAt(256), 1);
+    TEST_CHECK_EQUAL(ctx.ringAt(256+16), 2);
+
+    // フレームをまたいでも同じ
+    ring.endFrame();
+    TEST_CHECK_EQUAL(Map(ring, A, CBRING_MAP_WRITE_NO_OVERWRITE, &data), CBRING_REDIRECTED);
+    TEST_CHECK_EQUAL(data[16], 2);
+    ring.unmap(A);
+    TEST_CHECK_EQUAL(ctx.ringAt(512+16), 2);
+    TEST_CHECK_EQUAL(ring.getNumExcluded(), (size_t)0);
+}
+
+void TestFrameLatency()
+{
+    MockContext ctx;
+    ConstantBufferRing ring(&ctx, 1024, 2);
+    ring.addBuffer(A, 64);  // 256 byte
+    ctx.set(ring, VS, 0, A);
+
+    // 1 フレームで 4 回切り出すと満杯
+    for(int i=0; i<4; ++i) {
+        TEST_CHECK_EQUAL(Write(ring, A, CBRING_MAP_WRITE_DISCARD, char(i)), CBRING_REDIRECTED);
+    }
+    TEST_CHECK_EQUAL(Map(ring, A, CBRING_MAP_WRITE_DISCARD), CBRING_PASS_THROUGH);
+    TEST_CHECK(!ring.unmap(A));
+    TEST_CHECK(ctx.slots[VS][0].buffer==A);
+
+    // 2 フレーム経つまでは再利用しない
+    ring.endFrame();
+    TEST_CHECK_EQUAL(ring.getFrameBytes(), (size_t)1024);
+    TEST_CHECK_EQUAL(Map(ring, A, CBRING_MAP_WRITE_DISCARD), CBRING_PASS_THROUGH);
+    ring.endFrame();
+    ring.endFrame();
+    TEST_CHECK_EQUAL(Write(ring, A, CBRING_MAP_WRITE_DISCARD, 5), CBRING_REDIRECTED);
+    TEST_CHECK_EQUAL(ctx.slots[VS][0].offset, 0ULL);
+    TEST_CHECK_EQUAL(ring.getPeakFrameBytes(), (size_t)1024);
+    TEST_CHECK_EQUAL(ring.getFallbacks(), (size_t)2);
+
+    // 満杯のときの NO_OVERWRITE は、前回の内容を本来のバッファに書き戻してから本来のバッファで
+    for(int i=0; i<3; ++i) { Write(ring, A, CBRING_MAP_WRITE_DISCARD, char(6+i)); }
+    TEST_CHECK_EQUAL(Map(ring, A, CBRING_MAP_WRITE_NO_OVERWRITE), CBRING_PASS_THROUGH);
+    TEST_CHECK_EQUAL(ctx.num_writes, 1);
+    TEST_CHECK_EQUAL(ctx.bufferAt(A, 0), 8);
+    TEST_CHECK(ctx.slots[VS][0].buffer==A);
+    TEST_CHECK(!ring.unmap(A));
+
+    // ring buffer の Map に失敗したら、本来のバッファに書き込む
+    ring.endFrame();
+    ring.endFrame();
+    ring.endFrame();
+    ctx.fail_map = true;
+    TEST_CHECK_EQUAL(Write(ring, A, CBRING_MAP_WRITE_DISCARD, 9), CBRING_REDIRECTED);
+    TEST_CHECK_EQUAL(ctx.num_writes, 2);
+    TEST_CHECK_EQUAL(ctx.bufferAt(A, 0), 9);
+    TEST_CHECK(ctx.slots[VS][0].buffer==A);
+}
+
+void TestExclude()
+{
+    MockContext ctx;
+    ConstantBufferRing ring(&ctx, c_ring_size, 3);
+    ring.addBuffer(A, 64);
+    ring.addBuffer(B, 64);
+    ctx.set(ring, VS, 0, A);
+    ctx.set(ring, PS, 0, B);
+
+    // 最新の内容を書き戻し、バインドを本来のバッファに戻す
+    Write(ring, A, CBRING_MAP_WRITE_DISCARD, 1);
+    TEST_CHECK(ctx.boundToRing(VS, 0));
+    ring.exclude(A);
+    TEST_CHECK_EQUAL(ctx.bufferAt(A, 0), 1);
+    TEST_CHECK(ctx.slots[VS][0].buffer==A);
+    TEST_CHECK_EQUAL(ring.getNumExcluded(), (size_t)1);
+    TEST_CHECK_EQUAL(Map(ring, A, CBRING_MAP_WRITE_DISCARD), CBRING_PASS_THROUGH);
+    TEST_CHECK(!ring.unmap(A));
+    ring.exclude(A);
+    TEST_CHECK_EQUAL(ring.getNumExcluded(), (size_t)1);
+    TEST_CHECK_EQUAL(ctx.num_writes, 1);
+
+    // Map 中に外されたら、Unmap() で本来のバッファに書き込む
+    char *data = NULL;
+    Map(ring, B, CBRING_MAP_WRITE_DISCARD, &data);
+    ring.exclude(B);
+    TEST_CHECK_EQUAL(ctx.num_writes, 1);
+    data[0] = 2;
+    TEST_CHECK(ring.unmap(B));
+    TEST_CHECK(!ctx.mapped);
+    TEST_CHECK_EQUAL(ctx.bufferAt(B, 0), 2);
+    TEST_CHECK(ctx.slots[PS][0].buffer==B);
+
+    // 置き換えたことの無いバッファは書き戻さない
+    ring.addBuffer(C, 64);
+    ring.exclude(C);
+    TEST_CHECK_EQUAL(ctx.num_writes, 2);
+    ring.removeBuffer(A);
+    TEST_CHECK_EQUAL(ring.getNumExcluded(), (size_t)2);
+}
+
+void TestReleaseAndRestore()
+{
+    MockContext ctx;
+    ConstantBufferRing ring(&ctx, c_ring_size, 3);
+    ring.addBuffer(A, 64);
+    ring.addBuffer(B, 64);
+    ring.addBuffer(C, 64);
+    ctx.set(ring, VS, 0, A);
+    ctx.set(ring, VS, 1, B);
+    TEST_CHECK_EQUAL(ring.getNumTracked(), (size_t)3);
+
+    // Map したまま解放された
+    Map(ring, A, CBRING_MAP_WRITE_DISCARD);
+    ring.removeBuffer(A);
+    TEST_CHECK(!ring.unmap(A));
+    TEST_CHECK(ring.getBoundBuffer(VS, 0)==NULL);
+    TEST_CHECK_EQUAL(ring.getNumTracked(), (size_t)2);
+
+    Write(ring, B, CBRING_MAP_WRITE_DISCARD, 1);
+    TEST_CHECK(ctx.boundToRing(VS, 1));
+    TEST_CHECK(ring.getBoundBuffer(VS, 1)==B);
+
+    // 別のバッファで上書きされたスロットは追わない
+    ctx.set(ring, VS, 1, C);
+    Write(ring, B, CBRING_MAP_WRITE_DISCARD, 2);
+    TEST_CHECK(ctx.slots[VS][1].buffer==C);
+
+    // 置き換え中のバッファは内容を書き戻し、スロットを本来のバッファに戻す
+    Write(ring, C, CBRING_MAP_WRITE_DISCARD, 3);
+    TEST_CHECK(ctx.boundToRing(VS, 1));
+    ring.restore();
+    TEST_CHECK(!ctx.mapped);
+    TEST_CHECK(ctx.slots[VS][1].buffer==C);
+    TEST_CHECK_EQUAL(ctx.bufferAt(B, 0), 2);
+    TEST_CHECK_EQUAL(ctx.bufferAt(C, 0), 3);
+    TEST_CHECK(ring.getBoundBuffer(VS, 1)==NULL);
+
+    std::vector<void*> buffers;
+    ring.getTrackedBuffers(buffers);
+    TEST_CHECK_EQUAL(buffers.size(), (size_t)2);
+}
+
+} // namespace
+
+
+int main()
+{
+    TEST_RUN(TestRedirect);
+    TEST_RUN(TestNestedMaps);
+    TEST_RUN(TestNoOverwrite);
+    TEST_RUN(TestFrameLatency);
+    TEST_RUN(TestExclude);
+    TEST_RUN(TestReleaseAndRestore);
+    return TestResult("ConstantBufferRingTest");
+}
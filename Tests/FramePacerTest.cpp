@@ -0,0 +1,156 @@
+﻿// Utilities/FramePacer.h のテストです。時刻 0 から始まる偽の clock で待ち時間を確かめます。
+//   g++ -O2 -o FramePacerTest Tests/FramePacerTest.cpp Utilities/FramePacer.cpp
+
+#include "../Utilities/FramePacer.h"
+#include "Test.h"
+#include <math.h>
+
+namespace {
+
+// sleep() は指定より oversleep ミリ秒長く、spin() は 1 回 0.01 ミリ秒進む
+class FakeClock : public IFrameClock
+{
+public:
+    double t;
+    double oversleep;
+    size_t sleeps;
+    size_t spins;
+
+    FakeClock() : t(0.0), oversleep(0.0), sleeps(0), spins(0) {}
+    virtual double now() { return t; }
+    virtual void sleep(double ms) { t += ms+oversleep; ++sleeps; }
+    virtual void spin() { t += 0.01; ++spins; }
+    void work(double ms) { t += ms; }
+};
+
+bool Near(double a, double b) { return fabs(a-b) < 0.02; }
+
+// 1 フレーム: 描画に cost ミリ秒かけて Present()
+void Frame(FramePacer &pacer, FakeClock &clock, double cost)
+{
+    clock.work(cost);
+    pacer.beforePresent();
+    pacer.afterPresent();
+}
+
+void TestPassThrough()
+{
+    FakeClock clock;
+    FramePacer pacer(&clock);
+    pacer.setTargetFrameTime(10.0);
+
+    // 時刻 0 で始まったフレームのコストも記録される
+    pacer.afterPresent();
+    Frame(pacer, clock, 5.0);
+    TEST_CHECK(Near(pacer.getLastCost(), 5.0));
+    Frame(pacer, clock, 3.0);
+    TEST_CHECK(Near(clock.t, 8.0));
+    TEST_CHECK_EQUAL(pacer.getLastPresentWait(), 0.0);
+    TEST_CHECK(Near(pacer.getPredictedCost(), 5.0));
+    TEST_CHECK_EQUAL(clock.sleeps+clock.spins, (size_t)0);
+}
+
+void TestFixedRate()
+{
+    FakeClock clock;
+    FramePacer pacer(&clock);
+    pacer.setMode(FRAME_PACER_FIXED_RATE);
+    pacer.setTargetFrameTime(10.0);
+    pacer.setSpinThreshold(2.0);
+
+    // 時刻 0 の最初の Present() が予定の起点になる
+    Frame(pacer, clock, 0.0);
+    TEST_CHECK_EQUAL(clock.t, 0.0);
+    for(int i=1; i<=5; ++i) {
+        Frame(pacer, clock, 3.0);
+        TEST_CHECK(Near(clock.t, 10.0*i));
+        TEST_CHECK(clock.t >= 10.0*i);
+        TEST_CHECK(Near(pacer.getLastPresentWait(), 7.0));
+    }
+    TEST_CHECK_EQUAL(pacer.getMissedDeadlines(), (size_t)0);
+    TEST_CHECK(clock.sleeps>0 && clock.spins>0);
+
+    // sleep が長引いても spin で合わせる
+    clock.oversleep = 1.0;
+    Frame(pacer, clock, 1.0);
+    TEST_CHECK(Near(clock.t, 60.0));
+    TEST_CHECK(clock.t >= 60.0);
+}
+
+void TestMissedDeadline()
+{
+    FakeClock clock;
+    FramePacer pacer(&clock);
+    pacer.setMode(FRAME_PACER_FIXED_RATE);
+    pacer.setTargetFrameTime(10.0);
+
+    Frame(pacer, clock, 0.0);   // 予定は 10
+    Frame(pacer, clock, 12.0);  // 12 で遅れた。待たない
+    TEST_CHECK_EQUAL(pacer.getMissedDeadlines(), (size_t)1);
+    TEST_CHECK(Near(clock.t, 12.0));
+    Frame(pacer, clock, 3.0);   // 予定は 20 のまま
+    TEST_CHECK(Near(clock.t, 20.0));
+
+    // 1 フレーム以上遅れたら、その時刻から数え直す
+    Frame(pacer, clock, 25.0);  // 予定 30 に対して 45
+    TEST_CHECK_EQUAL(pacer.getMissedDeadlines(), (size_t)2);
+    TEST_CHECK(Near(clock.t, 45.0));
+    Frame(pacer, clock, 1.0);
+    TEST_CHECK(Near(clock.t, 55.0));
+
+    // 目標を変えたら予定も決め直す
+    pacer.setTargetFrameTime(20.0);
+    Frame(pacer, clock, 1.0);
+    TEST_CHECK(Near(clock.t, 56.0));
+    Frame(pacer, clock, 1.0);
+    TEST_CHECK(Near(clock.t, 76.0));
+    TEST_CHECK_EQUAL(pacer.getMissedDeadlines(), (size_t)2);
+}
+
+void TestLowLatency()
+{
+    FakeClock clock;
+    FramePacer pacer(&clock);
+    pacer.setMode(FRAME_PACER_LOW_LATENCY);
+    pacer.setTargetFrameTime(10.0);
+    pacer.setSafetyMargin(1.0);
+
+    // 1 フレーム目はコストが分からないので、すぐに次のフレームを始める
+    Frame(pacer, clock, 0.0);
+    TEST_CHECK_EQUAL(pacer.getLastStartWait(), 0.0);
+    TEST_CHECK_EQUAL(clock.t, 0.0);
+
+    // コスト 4 が分かったら、次の予定 (20) の 4+1 前 (15) まで開始を遅らせる
+    Frame(pacer, clock, 4.0);
+    TEST_CHECK(Near(clock.t, 15.0));
+    TEST_CHECK(Near(pacer.getLastPresentWait(), 6.0));
+    TEST_CHECK(Near(pacer.getLastStartWait(), 5.0));
+
+    // 予測通りなら Present() の前はほとんど待たない
+    Frame(pacer, clock, 4.0);
+    TEST_CHECK(Near(clock.t, 25.0));
+    TEST_CHECK(Near(pacer.getLastPresentWait(), 1.0));
+
+    TEST_CHECK_EQUAL(pacer.getMissedDeadlines(), (size_t)0);
+
+    // 予測より重いフレームは間に合わない。予測は直近 FRAME_PACER_HISTORY フレームの最大値になる
+    Frame(pacer, clock, 6.0);
+    TEST_CHECK_EQUAL(pacer.getMissedDeadlines(), (size_t)1);
+    TEST_CHECK(Near(pacer.getPredictedCost(), 6.0));
+    TEST_CHECK(Near(clock.t, 33.0));
+    for(int i=0; i<FRAME_PACER_HISTORY; ++i) { Frame(pacer, clock, 4.0); }
+    TEST_CHECK(Near(pacer.getPredictedCost(), 4.0));
+    TEST_CHECK_EQUAL(pacer.getMissedDeadlines(), (size_t)1);
+}
+
+} // namespace
+
+
+int main()
+{
+    TEST_RUN(TestPassThrough);
+    TEST_RUN(TestFixedRate);
+    TEST_RUN(TestMissedDeadline);
+    TEST_RUN(TestLowLatency);
+    return TestResult("FramePacerTest");
+}
@@ -0,0 +1,264 @@
+﻿// Utilities/GpuProfiler.h のテストです。GPU の進み具合と timestamp を偽装する context を使います。
+//   g++ -O2 -o GpuProfilerTest Tests/GpuProfilerTest.cpp Utilities/GpuProfiler.cpp
+
+#include "../Utilities/GpuProfiler.h"
+#include "Test.h"
+#include <math.h>
+#include <vector>
+
+namespace {
+
+// timestamp は End() した時点の gpu_clock。周波数は 1000 なので 1 tick = 1 ミリ秒。
+// End() から gpu_delay フレーム経つまで結果は出ない
+class MockContext : public IGpuQueryContext
+{
+public:
+    struct Query
+    {
+        bool disjoint_query;
+        bool ended;
+        bool released;
+        uint64_t value;
+        size_t end_frame;
+    };
+
+    std::vector<Query*> queries;
+    size_t frame;
+    size_t gpu_delay;
+    uint64_t gpu_clock;
+    bool disjoint;
+    size_t max_creates; // これを超えると作成に失敗する
+    size_t polls;       // 結果を取得しようとした回数
+
+    MockContext() : frame(0), gpu_delay(1), gpu_clock(0), disjoint(false), max_creates(~size_t(0)), polls(0) {}
+    ~MockContext()
+    {
+        for(size_t i=0; i<queries.size(); ++i) { delete queries[i]; }
+    }
+
+    GpuQuery create(bool disjoint_query)
+    {
+        if(queries.size()>=max_creates) { return NULL; }
+        Query *q = new Query();
+        q->disjoint_query = disjoint_query;
+        q->ended = q->released = false;
+        q->value = 0;
+        q->end_frame = 0;
+        queries.push_back(q);
+        return q;
+    }
+    virtual GpuQuery createTimestamp()  { return create(false); }
+    virtual GpuQuery createDisjoint()   { return create(true); }
+    virtual void releaseQuery(GpuQuery q)
+    {
+        Query *v = (Query*)q;
+        TEST_CHECK(!v->released);
+        v->released = true;
+    }
+    virtual void begin(GpuQuery q)
+    {
+        TEST_CHECK(((Query*)q)->disjoint_query);
+        ((Query*)q)->ended = false;
+    }
+    virtual void end(GpuQuery q)
+    {
+        Query *v = (Query*)q;
+        TEST_CHECK(!v->released);
+        v->ended = true;
+        v->value = gpu_clock;
+        v->end_frame = frame;
+    }
+    bool ready(Query *v)
+    {
+        ++polls;
+        return v->ended && frame>=v->end_frame+gpu_delay;
+    }
+    virtual bool getTimestamp(GpuQuery q, uint64_t &out)
+    {
+        Query *v = (Query*)q;
+        if(!ready(v)) { return false; }
+        out = v->value;
+        return true;
+    }
+    virtual bool getDisjoint(GpuQuery q, uint64_t &out_frequency, bool &out_disjoint)
+    {
+        Query *v = (Query*)q;
+        if(!ready(v)) { return false; }
+        out_frequency = 1000;
+        out_disjoint = disjoint;
+        return true;
+    }
+
+    size_t numLive() const
+    {
+        size_t n = 0;
+        for(size_t i=0; i<queries.size(); ++i) { if(!queries[i]->released) { ++n; } }
+        return n;
+    }
+};
+
+bool Near(double a, double b) { return fabs(a-b) < 1e-6; }
+
+void Present(GpuProfiler &profiler, MockContext &ctx)
+{
+    profiler.beforePresent();
+    ++ctx.frame;
+    profiler.afterPresent();
+}
+
+// パス 2 つ (3ms, 5ms) と、2 つ目のパスの中の入れ子の区間 (2ms) からなるフレーム
+void RenderFrame(GpuProfiler &profiler, MockContext &ctx)
+{
+    ctx.gpu_clock += 1;
+    profiler.beginPass("shadow");
+    ctx.gpu_clock += 3;
+    profiler.beginPass("main");
+    ctx.gpu_clock += 1;
+    profiler.beginRegion("particles");
+    ctx.gpu_clock += 2;
+    profiler.endRegion();
+    ctx.gpu_clock += 2;
+    Present(profiler, ctx);
+}
+
+void TestLatency()
+{
+    MockContext ctx;
+    ctx.gpu_delay = 2;
+    {
+        GpuProfiler profiler(&ctx, 4, 16, 64);
+        TEST_CHECK_EQUAL(profiler.getNumQueries(), (size_t)16);
+        profiler.start();
+
+        // 結果は gpu_delay フレーム後に回収される。それまでは待たずに次へ進む
+        RenderFrame(profiler, ctx);
+        TEST_CHECK(profiler.getLastResults().empty());
+        RenderFrame(profiler, ctx);
+        const std::vector<GpuProfilerResult> &r = profiler.getLastResults();
+        TEST_CHECK_EQUAL(r.size(), (size_t)3);
+        TEST_CHECK_EQUAL(profiler.getLastFrame(), (size_t)0);
+        TEST_CHECK(Near(profiler.getLastFrameTime(), 9.0));
+        if(r.size()==3) {
+            TEST_CHECK(r[0].name=="shadow" && Near(r[0].time, 3.0) && r[0].depth==0 && !r[0].user_region);
+            TEST_CHECK(r[1].name=="main" && Near(r[1].time, 5.0) && r[1].depth==0);
+            TEST_CHECK(r[2].name=="particles" && Near(r[2].time, 2.0) && r[2].depth==1 && r[2].user_region);
+        }
+
+        for(int i=0; i<10; ++i) { RenderFrame(profiler, ctx); }
+        TEST_CHECK_EQUAL(profiler.getLastFrame(), (size_t)10);
+        TEST_CHECK_EQUAL(profiler.getSkippedFrames(), (size_t)0);
+        // 回収した query はプールに戻るので、作り足さない
+        TEST_CHECK_EQUAL(profiler.getNumQueries(), (size_t)16);
+        const GpuProfilerRegionStats &rs = profiler.getRegionStats().find("main")->second;
+        TEST_CHECK_EQUAL(rs.count, (size_t)11);
+        TEST_CHECK(Near(rs.total/rs.count, 5.0));
+    }
+    // 全部解放されている (slot ごとの disjoint 4 + timestamp 16)
+    TEST_CHECK_EQUAL(ctx.queries.size(), (size_t)20);
+    TEST_CHECK_EQUAL(ctx.numLive(), (size_t)0);
+}
+
+void TestSkip()
+{
+    MockContext ctx;
+    ctx.gpu_delay = 3;
+    GpuProfiler profiler(&ctx, 2, 16, 64);
+    profiler.start();
+
+    // slot が 2 つしかないのに結果は 3 フレーム後なので、回収が追いつかないフレームは計測しない
+    for(int i=0; i<6; ++i) { RenderFrame(profiler, ctx); }
+    TEST_CHECK(profiler.getSkippedFrames()>0);
+    TEST_CHECK_EQUAL(profiler.getDroppedRegions(), (size_t)0);
+    TEST_CHECK(!profiler.getLastResults().empty());
+    size_t skipped = profiler.getSkippedFrames();
+
+    // 計測しないフレームでの区間は無視され、対応も崩れない
+    ctx.gpu_delay = 0;
+    RenderFrame(profiler, ctx);
+    RenderFrame(profiler, ctx);
+    RenderFrame(profiler, ctx);
+    TEST_CHECK_EQUAL(profiler.getSkippedFrames(), skipped);
+    TEST_CHECK_EQUAL(profiler.getLastResults().size(), (size_t)3);
+    TEST_CHECK_EQUAL(profiler.getLastFrame(), (size_t)8);
+}
+
+void TestDrop()
+{
+    MockContext ctx;
+    ctx.gpu_delay = 0;
+    // フレームの開始/終了に 2 つ使うので、区間に使えるのは 3 つ
+    GpuProfiler profiler(&ctx, 2, 2, 5);
+    profiler.start();
+
+    profiler.beginRegion("a");      // 3 つ目
+    ctx.gpu_clock += 2;
+    profiler.endRegion();           // 4 つ目
+    profiler.beginRegion("b");      // 5 つ目
+    profiler.endRegion();           // 閉じられない
+    profiler.beginRegion("c");      // 開けない
+    profiler.endRegion();           // c の分。何もしない
+    Present(profiler, ctx);
+    TEST_CHECK_EQUAL(profiler.getNumQueries(), (size_t)5);
+    TEST_CHECK_EQUAL(profiler.getDroppedRegions(), (size_t)2);
+    // 閉じられなかった区間は結果に含めない
+    const std::vector<GpuProfilerResult> &r = profiler.getLastResults();
+    TEST_CHECK_EQUAL(r.size(), (size_t)1);
+    if(r.size()==1) {
+        TEST_CHECK(r[0].name=="a" && Near(r[0].time, 2.0));
+    }
+
+    // 回収した query は次のフレームで使える。開けなかった区間があっても、入れ子の対応は崩れない
+    profiler.beginPass("p");        // 3 つ目
+    profiler.beginRegion("d");      // 4 つ目
+    profiler.beginRegion("e");      // 5 つ目
+    profiler.beginRegion("f");      // 開けない
+    profiler.endRegion();           // f の分
+    profiler.endRegion();           // e を閉じられない
+    profiler.endRegion();           // d を閉じられない
+    Present(profiler, ctx);         // p を閉じられない
+    TEST_CHECK_EQUAL(profiler.getNumQueries(), (size_t)5);
+    TEST_CHECK_EQUAL(profiler.getDroppedRegions(), (size_t)6);
+    TEST_CHECK(profiler.getLastResults().empty());
+    TEST_CHECK_EQUAL(profiler.getLastFrame(), (size_t)1);
+
+    // query を作れない環境でもフレームを計測しないだけで動き続ける
+    MockContext ctx2;
+    ctx2.max_creates = 3;
+    GpuProfiler profiler2(&ctx2, 2, 16, 64);
+    profiler2.start();
+    RenderFrame(profiler2, ctx2);
+    TEST_CHECK(profiler2.getSkippedFrames()>0);
+}
+
+void TestDisjoint()
+{
+    MockContext ctx;
+    ctx.gpu_delay = 1;
+    GpuProfiler profiler(&ctx, 3, 16, 64);
+    profiler.start();
+    RenderFrame(profiler, ctx);
+    RenderFrame(profiler, ctx);
+    TEST_CHECK_EQUAL(profiler.getLastFrame(), (size_t)1);
+
+    // TIMESTAMP_DISJOINT のフレームは結果を更新しない
+    ctx.disjoint = true;
+    RenderFrame(profiler, ctx);
+    TEST_CHECK_EQUAL(profiler.getDisjointFrames(), (size_t)1);
+    TEST_CHECK_EQUAL(profiler.getLastFrame(), (size_t)1);
+    ctx.disjoint = false;
+    RenderFrame(profiler, ctx);
+    TEST_CHECK_EQUAL(profiler.getLastFrame(), (size_t)3);
+    TEST_CHECK_EQUAL(profiler.getRegionStats().find("shadow")->second.count, (size_t)3);
+}
+
+} // namespace
+
+
+int main()
+{
+    TEST_RUN(TestLatency);
+    TEST_RUN(TestSkip);
+    TEST_RUN(TestDrop);
+    TEST_RUN(TestDisjoint);
+    return TestResult("GpuProfilerTest");
+}
@@ -0,0 +1,83 @@
+﻿// Utilities/Hash.h のテストです。Windows/D3D11 に依存しないので Linux などでもビルドできます。
+// SSE2 の経路とそうでない経路の両方を確かめるため、-U__SSE2__ を付けたものもビルドして同じ結果になることを確認してください。
+//   g++ -O2 -o HashTest Tests/HashTest.cpp
+//   g++ -O2 -U__SSE2__ -o HashTestScalar Tests/HashTest.cpp
+// 引数に 'print' を渡すと、経路間の比較用にハッシュ値を出力します。
+
+#include "../Utilities/Hash.h"
+#include "Test.h"
+#include <string.h>
+#include <vector>
+
+namespace {
+
+std::vector<unsigned char> MakeData(size_t size, unsigned seed)
+{
+    std::vector<unsigned char> data(size);
+    uint32_t x = seed*2654435761u + 1;
+    for(size_t i=0; i<size; ++i) {
+        x ^= x<<13; x ^= x>>17; x ^= x<<5;
+        data[i] = (unsigned char)x;
+    }
+    return data;
+}
+
+uint64_t Hash(const std::vector<unsigned char> &data)
+{
+    return HashBytesFast(data.empty() ? NULL : &data[0], data.size());
+}
+
+void TestStripeOrder()
+{
+    // 96 byte (3 ストライプ) のうち 2 つを入れ替えたもの
+    std::vector<unsigned char> a = MakeData(96, 1);
+    std::vector<unsigned char> b = a;
+    memcpy(&b[0], &a[32], 32);
+    memcpy(&b[32], &a[0], 32);
+    TEST_CHECK(Hash(a)!=Hash(b));
+
+    // レーン内の入れ替え (同じストライプの 8 byte 同士)
+    std::vector<unsigned char> c = a;
+    memcpy(&c[0], &a[8], 8);
+    memcpy(&c[8], &a[0], 8);
+    TEST_CHECK(Hash(a)!=Hash(c));
+
+    // 同じ内容のストライプが並んでいても、位置が違えば違う寄与になる
+    std::vector<unsigned char> d(64, 0), e(64, 0);
+    memset(&d[0], 0xab, 32);
+    memset(&e[32], 0xab, 32);
+    TEST_CHECK(Hash(d)!=Hash(e));
+}
+
+void TestSensitivity()
+{
+    std::vector<unsigned char> a = MakeData(1000, 2);
+    uint64_t h = Hash(a);
+    TEST_CHECK_EQUAL(h, Hash(a));
+    for(size_t i=0; i<a.size(); i+=37) {
+        std::vector<unsigned char> b = a;
+        b[i] ^= 1;
+        TEST_CHECK(Hash(b)!=h);
+    }
+
+    // 末尾の 0 埋めと長さ
+    std::vector<unsigned char> z1(32, 0), z2(33, 0);
+    TEST_CHECK(Hash(z1)!=Hash(z2));
+    TEST_CHECK(HashBytesFast(&a[0], a.size(), 1)!=HashBytesFast(&a[0], a.size(), 2));
+}
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+    if(argc>=2 && strcmp(argv[1], "print")==0) {
+        for(size_t size=0; size<=200; size+=13) {
+            printf("%u %016llx\n", (unsigned)size, (unsigned long long)Hash(MakeData(size, (unsigned)size)));
+        }
+        return 0;
+    }
+    TEST_RUN(TestStripeOrder);
+    TEST_RUN(TestSensitivity);
+    return TestResult("HashTest");
+}
@@ -0,0 +1,117 @@
+﻿// Utilities/ModuleRangeTable のテストです。Windows/D3D11 に依存しないので Linux などでもビルドできます。
+//   g++ -O2 -o ModuleRangeTableTest Tests/ModuleRangeTableTest.cpp
+
+#include "../Utilities/ModuleRangeTable.h"
+#include "Test.h"
+
+namespace {
+
+ModuleRange MakeRange(size_t begin, size_t end, const wchar_t *name)
+{
+    ModuleRange m;
+    m.begin = begin;
+    m.end = end;
+    m.name = name;
+    return m;
+}
+
+const void* Address(size_t v) { return (const void*)v; }
+
+bool FoundIs(const ModuleRange *m, const wchar_t *name)
+{
+    return m!=NULL && m->name==name;
+}
+
+void TestBoundaries()
+{
+    ModuleRangeTable table;
+    table.insert(MakeRange(0x3000, 0x4000, L"c.dll"));
+    table.insert(MakeRange(0x1000, 0x2000, L"a.dll"));
+    table.insert(MakeRange(0x2000, 0x3000, L"b.dll")); // a と c に隣接
+    TEST_CHECK_EQUAL(table.size(), size_t(3));
+
+    TEST_CHECK(table.find(Address(0x0fff))==NULL);
+    TEST_CHECK(FoundIs(table.find(Address(0x1000)), L"a.dll"));     // begin は含む
+    TEST_CHECK(FoundIs(table.find(Address(0x1fff)), L"a.dll"));
+    TEST_CHECK(FoundIs(table.find(Address(0x2000)), L"b.dll"));     // end は含まない
+    TEST_CHECK(FoundIs(table.find(Address(0x3fff)), L"c.dll"));
+    TEST_CHECK(table.find(Address(0x4000))==NULL);
+    TEST_CHECK(table.find(Address(0))==NULL);
+    TEST_CHECK(table.find(Address(~size_t(0)))==NULL);
+
+    // 隙間
+    table.remove(Address(0x2000));
+    TEST_CHECK_EQUAL(table.size(), size_t(2));
+    TEST_CHECK(table.find(Address(0x2000))==NULL);
+    TEST_CHECK(table.find(Address(0x2fff))==NULL);
+    TEST_CHECK(FoundIs(table.find(Address(0x3000)), L"c.dll"));
+
+    // base と一致しないアドレスでは取り除かない
+    table.remove(Address(0x3001));
+    TEST_CHECK_EQUAL(table.size(), size_t(2));
+}
+
+void TestOverlaps()
+{
+    ModuleRangeTable table;
+    table.insert(MakeRange(0x1000, 0x2000, L"a.dll"));
+    table.insert(MakeRange(0x2000, 0x3000, L"b.dll"));
+    table.insert(MakeRange(0x3000, 0x4000, L"c.dll"));
+
+    // 前後のモジュールの一部に重なるものは、重なった古いモジュールを置き換える
+    table.insert(MakeRange(0x1800, 0x2800, L"d.dll"));
+    TEST_CHECK_EQUAL(table.size(), size_t(2));
+    TEST_CHECK(table.find(Address(0x1000))==NULL);
+    TEST_CHECK(FoundIs(table.find(Address(0x1800)), L"d.dll"));
+    TEST_CHECK(FoundIs(table.find(Address(0x27ff)), L"d.dll"));
+    TEST_CHECK(table.find(Address(0x2800))==NULL);
+    TEST_CHECK(FoundIs(table.find(Address(0x3000)), L"c.dll"));
+
+    // 隣接するだけなら置き換えない
+    table.insert(MakeRange(0x2800, 0x3000, L"e.dll"));
+    TEST_CHECK_EQUAL(table.size(), size_t(3));
+    TEST_CHECK(FoundIs(table.find(Address(0x2800)), L"e.dll"));
+    TEST_CHECK(FoundIs(table.find(Address(0x27ff)), L"d.dll"));
+
+    // 複数のモジュールを覆うもの
+    table.insert(MakeRange(0x0800, 0x5000, L"f.dll"));
+    TEST_CHECK_EQUAL(table.size(), size_t(1));
+    TEST_CHECK(FoundIs(table.find(Address(0x0800)), L"f.dll"));
+    TEST_CHECK(FoundIs(table.find(Address(0x4fff)), L"f.dll"));
+
+    // 同じ範囲に読み込み直されたもの
+    table.insert(MakeRange(0x0800, 0x5000, L"g.dll"));
+    TEST_CHECK_EQUAL(table.size(), size_t(1));
+    TEST_CHECK(FoundIs(table.find(Address(0x0800)), L"g.dll"));
+
+    // 並びが保たれていること
+    table.insert(MakeRange(0x9000, 0xa000, L"h.dll"));
+    table.insert(MakeRange(0x6000, 0x7000, L"i.dll"));
+    for(size_t i=1; i<table.size(); ++i) {
+        TEST_CHECK(table[i-1].end <= table[i].begin);
+    }
+}
+
+void TestNames()
+{
+    ModuleRangeTable table;
+    table.insert(MakeRange(0x1000, 0x2000, L"D3D11.dll"));
+    table.insert(MakeRange(0x2000, 0x3000, L"nvwgf2umx.dll"));
+    TEST_CHECK(FoundIs(table.findByName(L"d3d11.DLL"), L"D3D11.dll"));
+    TEST_CHECK(table.findByName(L"d3d11")==NULL);
+    TEST_CHECK(table.findByName(L"d3d11.dll2")==NULL);
+    TEST_CHECK(ModuleNameStartsWith(L"nvwgf2umx.dll", L"NVWGF"));
+    TEST_CHECK(!ModuleNameStartsWith(L"nv", L"nvwgf"));
+    TEST_CHECK(ModuleNameEquals(L"", L""));
+}
+
+} // namespace
+
+
+int main()
+{
+    TEST_RUN(TestBoundaries);
+    TEST_RUN(TestOverlaps);
+    TEST_RUN(TestNames);
+    return TestResult("ModuleRangeTableTest");
+}
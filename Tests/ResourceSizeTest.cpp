@@ -0,0 +1,144 @@
+﻿// Utilities/ResourceSize のテストです。Windows/D3D11 に依存しないので Linux などでもビルドできます。
+//   g++ -O2 -o ResourceSizeTest Tests/ResourceSizeTest.cpp Utilities/ResourceSize.cpp
+
+#include "../Utilities/ResourceSize.h"
+#include "Test.h"
+#include <string.h>
+
+namespace {
+
+D3D11_TEXTURE2D_DESC MakeTexture2D(UINT width, UINT height, UINT mips, UINT array_size, DXGI_FORMAT format)
+{
+    D3D11_TEXTURE2D_DESC desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = mips;
+    desc.ArraySize = array_size;
+    desc.Format = format;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    return desc;
+}
+
+void TestFormat()
+{
+    TEST_CHECK_EQUAL(GetFormatBitsPerPixel(DXGI_FORMAT_R8G8B8A8_UNORM), 32u);
+    TEST_CHECK_EQUAL(GetFormatBitsPerPixel(DXGI_FORMAT_R32G32B32_FLOAT), 96u);
+    TEST_CHECK_EQUAL(GetFormatBitsPerPixel(DXGI_FORMAT_BC1_UNORM), 4u);
+    TEST_CHECK_EQUAL(GetFormatBitsPerPixel(DXGI_FORMAT_BC7_UNORM), 8u);
+    TEST_CHECK_EQUAL(GetFormatBitsPerPixel(DXGI_FORMAT_UNKNOWN), 0u);
+    TEST_CHECK(IsBlockCompressedFormat(DXGI_FORMAT_BC1_TYPELESS));
+    TEST_CHECK(IsBlockCompressedFormat(DXGI_FORMAT_BC5_SNORM));
+    TEST_CHECK(IsBlockCompressedFormat(DXGI_FORMAT_BC6H_UF16));
+    TEST_CHECK(!IsBlockCompressedFormat(DXGI_FORMAT_B5G6R5_UNORM)); // BC5 と BC6H の間にある
+    TEST_CHECK(!IsBlockCompressedFormat(DXGI_FORMAT_R8G8B8A8_UNORM));
+}
+
+void TestMips()
+{
+    TEST_CHECK_EQUAL(GetMipLevelCount(0, 256), 9u);
+    TEST_CHECK_EQUAL(GetMipLevelCount(0, 1), 1u);
+    TEST_CHECK_EQUAL(GetMipLevelCount(0, 5, 3), 3u);
+    TEST_CHECK_EQUAL(GetMipLevelCount(0, 4, 4, 16), 5u);
+    TEST_CHECK_EQUAL(GetMipLevelCount(4, 1024, 1024), 4u);
+
+    // 256x256 RGBA8 の full mip chain: 349524 byte を 64KB 境界に
+    D3D11_TEXTURE2D_DESC desc = MakeTexture2D(256, 256, 0, 1, DXGI_FORMAT_R8G8B8A8_UNORM);
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc), size_t(6*64*1024));
+
+    // 16x16x16 R8 の full mip chain: 4096+512+64+8+1 byte を 4KB 境界に
+    D3D11_TEXTURE3D_DESC desc3;
+    memset(&desc3, 0, sizeof(desc3));
+    desc3.Width = desc3.Height = desc3.Depth = 16;
+    desc3.Format = DXGI_FORMAT_R8_UNORM;
+    desc3.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc3), size_t(2*4096));
+}
+
+void TestBlockCompressed()
+{
+    // 4x4 block 1 つ
+    D3D11_TEXTURE2D_DESC desc = MakeTexture2D(4, 4, 1, 1, DXGI_FORMAT_BC3_UNORM);
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc), size_t(4096));
+
+    // 256x256 BC1 の full mip chain: 2x2 以下の mip も 1 block (8 byte) を使う
+    // 32768+8192+2048+512+128+32+8+8+8 = 43704 byte を 4KB 境界に
+    desc = MakeTexture2D(256, 256, 0, 1, DXGI_FORMAT_BC1_UNORM);
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc), size_t(11*4096));
+
+    // 4 の倍数でない大きさは block 単位に切り上げる: 1028x1024 BC7 は 257x256 block
+    desc = MakeTexture2D(1024, 1024, 1, 1, DXGI_FORMAT_BC7_UNORM);
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc), size_t(1024*1024));
+    desc = MakeTexture2D(1028, 1024, 1, 1, DXGI_FORMAT_BC7_UNORM);
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc), size_t(17*64*1024)); // 1052672 byte
+}
+
+void TestArray()
+{
+    // cube map: 1024x1024 RGBA8 が 6 枚
+    D3D11_TEXTURE2D_DESC desc = MakeTexture2D(1024, 1024, 1, 6, DXGI_FORMAT_R8G8B8A8_UNORM);
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc), size_t(6*4*1024*1024));
+
+    // 小さい array はまとめて 4KB 境界に
+    D3D11_TEXTURE1D_DESC desc1;
+    memset(&desc1, 0, sizeof(desc1));
+    desc1.Width = 100;
+    desc1.MipLevels = 1;
+    desc1.ArraySize = 3;
+    desc1.Format = DXGI_FORMAT_R32_FLOAT;
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc1), size_t(4096));
+
+    // ArraySize==0 は 1 として扱う
+    desc1.ArraySize = 0;
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc1), size_t(4096));
+}
+
+void TestMSAA()
+{
+    // 1920x1080 RGBA8 4x MSAA: 33177600 byte を 4MB 境界に
+    D3D11_TEXTURE2D_DESC desc = MakeTexture2D(1920, 1080, 1, 1, DXGI_FORMAT_R8G8B8A8_UNORM);
+    desc.SampleDesc.Count = 4;
+    desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc), size_t(8*4*1024*1024));
+
+    // 小さくても MSAA は 4MB
+    desc = MakeTexture2D(16, 16, 1, 1, DXGI_FORMAT_R8G8B8A8_UNORM);
+    desc.SampleDesc.Count = 2;
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc), size_t(4*1024*1024));
+
+    // MSAA でない render target は小さくても 64KB
+    desc.SampleDesc.Count = 1;
+    desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc), size_t(64*1024));
+}
+
+void TestBufferAndStaging()
+{
+    D3D11_BUFFER_DESC desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.ByteWidth = 100;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc), size_t(256));
+    desc.Usage = D3D11_USAGE_STAGING;
+    TEST_CHECK_EQUAL(EstimateResourceSize(desc), size_t(100));
+
+    D3D11_TEXTURE2D_DESC tex = MakeTexture2D(100, 100, 1, 1, DXGI_FORMAT_R8G8B8A8_UNORM);
+    tex.Usage = D3D11_USAGE_STAGING;
+    TEST_CHECK_EQUAL(EstimateResourceSize(tex), size_t(100*100*4));
+}
+
+} // namespace
+
+
+int main()
+{
+    TEST_RUN(TestFormat);
+    TEST_RUN(TestMips);
+    TEST_RUN(TestBlockCompressed);
+    TEST_RUN(TestArray);
+    TEST_RUN(TestMSAA);
+    TEST_RUN(TestBufferAndStaging);
+    return TestResult("ResourceSizeTest");
+}
@@ -0,0 +1,232 @@
+﻿// Utilities/SymbolCache.h のテストです。固定のモジュールとシンボルを返す偽の resolver を使います。
+//   g++ -O2 -o SymbolCacheTest Tests/SymbolCacheTest.cpp Utilities/SymbolCache.cpp
+
+#include "../Utilities/SymbolCache.h"
+#include "Test.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char *c_path = "SymbolCacheTest.tmp";
+
+// base から 0x1000 byte を 1 つのモジュールとし、0x10 byte ごとに別の関数があることにする
+class StubResolver : public ISymbolResolver
+{
+public:
+    SymbolModuleKey key;
+    size_t base;
+    int num_resolves;
+
+    StubResolver(size_t b, uint32_t timestamp=1, uint32_t checksum=2) : base(b), num_resolves(0)
+    {
+        key.name = "test.exe";
+        key.timestamp = timestamp;
+        key.checksum = checksum;
+    }
+
+    virtual bool findModule(void *address, SymbolModuleKey &out_key, size_t &out_base)
+    {
+        size_t a = (size_t)address;
+        if(a<base || a>=base+0x1000) { return false; }
+        out_key = key;
+        out_base = base;
+        return true;
+    }
+
+    virtual bool resolve(void *address, ResolvedSymbol &out)
+    {
+        ++num_resolves;
+        size_t a = (size_t)address;
+        if(a<base || a>=base+0x1000) { return false; }
+        char name[32];
+        sprintf(name, "func%x", unsigned((a-base)/0x10));
+        out.module = key.name;
+        out.function = name;
+        out.file = "test.cpp";
+        out.line = unsigned((a-base)/0x10);
+        out.offset = (a-base)%0x10;
+        return true;
+    }
+};
+
+void* Addr(size_t base, size_t rva) { return (void*)(base+rva); }
+
+void TestCacheHit()
+{
+    StubResolver resolver(0x10000);
+    SymbolCache cache(&resolver);
+
+    const SymbolInfo &a = cache.resolve(Addr(0x10000, 0x24));
+    TEST_CHECK_EQUAL(resolver.num_resolves, 1);
+    TEST_CHECK_EQUAL(std::string(a.function), std::string("func2"));
+    TEST_CHECK_EQUAL(std::string(a.file), std::string("test.cpp"));
+    TEST_CHECK_EQUAL(a.line, 2u);
+    TEST_CHECK_EQUAL(a.offset, 4ULL);
+
+    // 2 回目は resolver を呼ばない
+    const SymbolInfo &b = cache.resolve(Addr(0x10000, 0x24));
+    TEST_CHECK(&a==&b);
+    TEST_CHECK_EQUAL(resolver.num_resolves, 1);
+    TEST_CHECK_EQUAL(cache.getStats().hits, (size_t)1);
+    TEST_CHECK_EQUAL(cache.getStats().resolves, (size_t)1);
+
+    // モジュール外のアドレスも、失敗した結果をキャッシュする
+    const SymbolInfo &c = cache.resolve(Addr(0x20000, 0));
+    TEST_CHECK_EQUAL(std::string(c.function), std::string(""));
+    cache.resolve(Addr(0x20000, 0));
+    TEST_CHECK_EQUAL(resolver.num_resolves, 2);
+}
+
+void TestResolveAddresses()
+{
+    StubResolver resolver(0x10000);
+    SymbolCache cache(&resolver);
+    cache.resolve(Addr(0x10000, 0x30));
+
+    void *addresses[] = {
+        Addr(0x10000, 0x10), Addr(0x10000, 0x20), Addr(0x10000, 0x10),
+        Addr(0x10000, 0x30), Addr(0x10000, 0x20), Addr(0x10000, 0x10),
+    };
+    const size_t num = sizeof(addresses)/sizeof(addresses[0]);
+    const SymbolInfo *symbols[num];
+    cache.resolveAddresses(addresses, num, symbols);
+    // 0x10 と 0x20 を 1 回ずつ。0x30 はキャッシュ済み
+    TEST_CHECK_EQUAL(resolver.num_resolves, 3);
+    TEST_CHECK_EQUAL(std::string(symbols[0]->function), std::string("func1"));
+    TEST_CHECK_EQUAL(std::string(symbols[1]->function), std::string("func2"));
+    TEST_CHECK_EQUAL(std::string(symbols[3]->function), std::string("func3"));
+    TEST_CHECK(symbols[0]==symbols[2]);
+    TEST_CHECK(symbols[0]==symbols[5]);
+    TEST_CHECK(symbols[1]==symbols[4]);
+    TEST_CHECK(symbols[3]==&cache.resolve(Addr(0x10000, 0x30)));
+
+    cache.resolveAddresses(addresses, num);
+    TEST_CHECK_EQUAL(resolver.num_resolves, 3);
+}
+
+// 同じモジュールが別のアドレスにロードされても、モジュール + オフセットで引ける
+void TestPersistentKey()
+{
+    StubResolver resolver(0x10000);
+    SymbolCache cache(&resolver);
+    cache.resolve(Addr(0x10000, 0x40));
+    TEST_CHECK_EQUAL(resolver.num_resolves, 1);
+
+    resolver.base = 0x50000;
+    const SymbolInfo &a = cache.resolve(Addr(0x50000, 0x40));
+    TEST_CHECK_EQUAL(resolver.num_resolves, 1);
+    TEST_CHECK_EQUAL(cache.getStats().persistent_hits, (size_t)1);
+    TEST_CHECK_EQUAL(std::string(a.function), std::string("func4"));
+
+    // timestamp が違えば別のバイナリ
+    resolver.key.timestamp = 3;
+    cache.resolve(Addr(0x50000, 0x50));
+    resolver.base = 0x10000;
+    cache.resolve(Addr(0x10000, 0x50));
+    TEST_CHECK_EQUAL(resolver.num_resolves, 2);
+    resolver.key.timestamp = 1;
+    cache.resolve(Addr(0x10000, 0x60));
+    TEST_CHECK_EQUAL(resolver.num_resolves, 3);
+}
+
+void TestSaveLoad()
+{
+    {
+        StubResolver resolver(0x10000);
+        SymbolCache cache(&resolver);
+        void *addresses[] = { Addr(0x10000, 0x10), Addr(0x10000, 0x24), Addr(0x10000, 0x38) };
+        cache.resolveAddresses(addresses, 3);
+        TEST_CHECK(cache.save(c_path));
+    }
+
+    // 同じバイナリなら、別のアドレスにロードされていても resolver を呼ばない
+    {
+        StubResolver resolver(0x30000);
+        SymbolCache cache(&resolver);
+        TEST_CHECK(cache.load(c_path));
+        const SymbolInfo &a = cache.resolve(Addr(0x30000, 0x24));
+        TEST_CHECK_EQUAL(resolver.num_resolves, 0);
+        TEST_CHECK_EQUAL(std::string(a.module), std::string("test.exe"));
+        TEST_CHECK_EQUAL(std::string(a.function), std::string("func2"));
+        TEST_CHECK_EQUAL(std::string(a.file), std::string("test.cpp"));
+        TEST_CHECK_EQUAL(a.line, 2u);
+        TEST_CHECK_EQUAL(a.offset, 4ULL);
+        cache.resolve(Addr(0x30000, 0x38));
+        TEST_CHECK_EQUAL(cache.getStats().persistent_hits, (size_t)2);
+        cache.resolve(Addr(0x30000, 0x48));
+        TEST_CHECK_EQUAL(resolver.num_resolves, 1);
+    }
+
+    // timestamp か checksum が違えば、読み込んだ記録は使わない
+    {
+        StubResolver resolver(0x10000, 5, 2);
+        SymbolCache cache(&resolver);
+        TEST_CHECK(cache.load(c_path));
+        cache.resolve(Addr(0x10000, 0x24));
+        TEST_CHECK_EQUAL(resolver.num_resolves, 1);
+        TEST_CHECK_EQUAL(cache.getStats().persistent_hits, (size_t)0);
+    }
+    {
+        StubResolver resolver(0x10000, 1, 6);
+        SymbolCache cache(&resolver);
+        TEST_CHECK(cache.load(c_path));
+        cache.resolve(Addr(0x10000, 0x24));
+        TEST_CHECK_EQUAL(resolver.num_resolves, 1);
+        TEST_CHECK_EQUAL(cache.getStats().persistent_hits, (size_t)0);
+    }
+    remove(c_path);
+}
+
+// 壊れたファイルを読んでも、それまでの記録は変わらない
+void TestLoadFailure()
+{
+    StubResolver resolver(0x10000);
+    std::string contents;
+    {
+        SymbolCache cache(&resolver);
+        void *addresses[] = { Addr(0x10000, 0x10), Addr(0x10000, 0x20) };
+        cache.resolveAddresses(addresses, 2);
+        TEST_CHECK(cache.save(c_path));
+        FILE *f = fopen(c_path, "rb");
+        char buf[256];
+        size_t n;
+        while((n=fread(buf, 1, sizeof(buf), f))>0) { contents.append(buf, n); }
+        fclose(f);
+    }
+
+    // 2 つ目のシンボルの途中で切れたファイル
+    FILE *f = fopen(c_path, "wb");
+    fwrite(contents.data(), 1, contents.size()-6, f);
+    fclose(f);
+
+    resolver.num_resolves = 0;
+    SymbolCache cache(&resolver);
+    TEST_CHECK(!cache.load(c_path));
+    cache.resolve(Addr(0x10000, 0x10));
+    TEST_CHECK_EQUAL(resolver.num_resolves, 1);
+    TEST_CHECK_EQUAL(cache.getStats().persistent_hits, (size_t)0);
+
+    // magic が違う
+    f = fopen(c_path, "wb");
+    fwrite("XXXX", 1, 4, f);
+    fclose(f);
+    TEST_CHECK(!cache.load(c_path));
+    TEST_CHECK(!cache.load("SymbolCacheTest.missing"));
+    remove(c_path);
+}
+
+} // namespace
+
+
+int main()
+{
+    TEST_RUN(TestCacheHit);
+    TEST_RUN(TestResolveAddresses);
+    TEST_RUN(TestPersistentKey);
+    TEST_RUN(TestSaveLoad);
+    TEST_RUN(TestLoadFailure);
+    return TestResult("SymbolCacheTest");
+}
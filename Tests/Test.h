@@ -0,0 +1,33 @@
+﻿#ifndef _ist_D3DHookInterface_Tests_Test_h_
+#define _ist_D3DHookInterface_Tests_Test_h_
+
+// Tests/ 以下のテストが使う最小限のチェック用マクロです。
+// 各テストは 1 つの .cpp で完結し、main() で TEST_RUN() を並べて最後に TestResult() を返します。
+// 失敗したチェックは stderr に出力し、終了コードを 1 にします。
+
+#include <stdio.h>
+
+namespace {
+
+int g_test_failures = 0;
+
+inline void TestFail(const char *file, int line, const char *expr)
+{
+    fprintf(stderr, "%s(%d): check failed: %s\n", file, line, expr);
+    ++g_test_failures;
+}
+
+inline int TestResult(const char *name)
+{
+    if(g_test_failures==0) { printf("%s: ok\n", name); return 0; }
+    printf("%s: %d failure(s)\n", name, g_test_failures);
+    return 1;
+}
+
+} // namespace
+
+#define TEST_CHECK(expr)        do { if(!(expr)) { TestFail(__FILE__, __LINE__, #expr); } } while(0)
+#define TEST_CHECK_EQUAL(a, b)  do { if(!((a)==(b))) { TestFail(__FILE__, __LINE__, #a " == " #b); } } while(0)
+#define TEST_RUN(f)             do { f(); } while(0)
+
+#endif // _ist_D3DHookInterface_Tests_Test_h_
@@ -0,0 +1,553 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Lock.h"
+#include "../Utilities/ResourceSize.h"
+#include "D3D11TexturePool.h"
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+
+enum VIEW_TYPE {
+    VIEW_SRV,
+    VIEW_RTV,
+    VIEW_UAV,
+    VIEW_DSV,
+};
+
+// pool が管理している view。pool 自身も参照を 1 つ保持しています
+struct PooledView
+{
+    IUnknown *view;
+    int type;           // VIEW_TYPE
+    std::string key;    // MakeViewKey() の結果
+    bool free;
+};
+
+typedef std::list<ID3D11Resource*> LRUList; // 先頭ほど最近解放された
+
+// pool が管理しているテクスチャ。pool 自身も参照を 1 つ保持しています
+struct PooledTexture
+{
+    D3D11_TEXTURE2D_DESC desc;
+    size_t bytes;
+    bool free;          // アプリからの参照が無い
+    bool available;     // free かつ全 view が free で、LRU に入っている
+    LRUList::iterator lru;
+    std::vector<PooledView> views;
+
+    PooledTexture() : bytes(0), free(false), available(false) {}
+};
+
+typedef std::unordered_map<ID3D11Resource*, PooledTexture> PooledTextures; // key はテクスチャ
+typedef std::unordered_map<IUnknown*, ID3D11Resource*> ViewOwners; // view -> テクスチャ
+
+namespace {
+
+Mutex g_mutex;
+PooledTextures g_textures;
+ViewOwners g_view_owners;
+LRUList g_lru;
+ID3D11Device *g_device = NULL;
+size_t g_budget = 0;
+
+size_t g_texture_hits = 0;
+size_t g_texture_misses = 0;
+size_t g_view_hits = 0;
+size_t g_view_misses = 0;
+size_t g_evictions = 0;
+size_t g_available_bytes = 0;
+
+} // namespace
+
+
+inline void AppendBytes(std::string &out, const void *data, size_t size)
+{
+    out.append((const char*)data, size);
+}
+
+// view desc の union のうち、ViewDimension で使われる部分だけを key にします (残りは未初期化の可能性があるため)。
+// desc が NULL の場合は種類だけの key になります。pool の対象外の ViewDimension なら false を返します。
+bool MakeViewKey(const D3D11_SHADER_RESOURCE_VIEW_DESC *desc, std::string &out)
+{
+    out.assign(1, (char)VIEW_SRV);
+    if(desc==NULL) { return true; }
+    size_t size = 0;
+    switch(desc->ViewDimension) {
+    case D3D11_SRV_DIMENSION_TEXTURE2D:         size = sizeof(desc->Texture2D); break;
+    case D3D11_SRV_DIMENSION_TEXTURE2DARRAY:    size = sizeof(desc->Texture2DArray); break;
+    case D3D11_SRV_DIMENSION_TEXTURE2DMS:       size = 0; break;
+    case D3D11_SRV_DIMENSION_TEXTURE2DMSARRAY:  size = sizeof(desc->Texture2DMSArray); break;
+    case D3D11_SRV_DIMENSION_TEXTURECUBE:       size = sizeof(desc->TextureCube); break;
+    case D3D11_SRV_DIMENSION_TEXTURECUBEARRAY:  size = sizeof(desc->TextureCubeArray); break;
+    default: return false;
+    }
+    AppendBytes(out, &desc->Format, sizeof(desc->Format));
+    AppendBytes(out, &desc->ViewDimension, sizeof(desc->ViewDimension));
+    AppendBytes(out, &desc->Texture2D, size);
+    return true;
+}
+
+bool MakeViewKey(const D3D11_RENDER_TARGET_VIEW_DESC *desc, std::string &out)
+{
+    out.assign(1, (char)VIEW_RTV);
+    if(desc==NULL) { return true; }
+    size_t size = 0;
+    switch(desc->ViewDimension) {
+    case D3D11_RTV_DIMENSION_TEXTURE2D:         size = sizeof(desc->Texture2D); break;
+    case D3D11_RTV_DIMENSION_TEXTURE2DARRAY:    size = sizeof(desc->Texture2DArray); break;
+    case D3D11_RTV_DIMENSION_TEXTURE2DMS:       size = 0; break;
+    case D3D11_RTV_DIMENSION_TEXTURE2DMSARRAY:  size = sizeof(desc->Texture2DMSArray); break;
+    default: return false;
+    }
+    AppendBytes(out, &desc->Format, sizeof(desc->Format));
+    AppendBytes(out, &desc->ViewDimension, sizeof(desc->ViewDimension));
+    AppendBytes(out, &desc->Texture2D, size);
+    return true;
+}
+
+bool MakeViewKey(const D3D11_UNORDERED_ACCESS_VIEW_DESC *desc, std::string &out)
+{
+    out.assign(1, (char)VIEW_UAV);
+    if(desc==NULL) { return true; }
+    size_t size = 0;
+    switch(desc->ViewDimension) {
+    case D3D11_UAV_DIMENSION_TEXTURE2D:         size = sizeof(desc->Texture2D); break;
+    case D3D11_UAV_DIMENSION_TEXTURE2DARRAY:    size = sizeof(desc->Texture2DArray); break;
+    default: return false;
+    }
+    AppendBytes(out, &desc->Format, sizeof(desc->Format));
+    AppendBytes(out, &desc->ViewDimension, sizeof(desc->ViewDimension));
+    AppendBytes(out, &desc->Texture2D, size);
+    return true;
+}
+
+bool MakeViewKey(const D3D11_DEPTH_STENCIL_VIEW_DESC *desc, std::string &out)
+{
+    out.assign(1, (char)VIEW_DSV);
+    if(desc==NULL) { return true; }
+    size_t size = 0;
+    switch(desc->ViewDimension) {
+    case D3D11_DSV_DIMENSION_TEXTURE2D:         size = sizeof(desc->Texture2D); break;
+    case D3D11_DSV_DIMENSION_TEXTURE2DARRAY:    size = sizeof(desc->Texture2DArray); break;
+    case D3D11_DSV_DIMENSION_TEXTURE2DMS:       size = 0; break;
+    case D3D11_DSV_DIMENSION_TEXTURE2DMSARRAY:  size = sizeof(desc->Texture2DMSArray); break;
+    default: return false;
+    }
+    AppendBytes(out, &desc->Format, sizeof(desc->Format));
+    AppendBytes(out, &desc->ViewDimension, sizeof(desc->ViewDimension));
+    AppendBytes(out, &desc->Flags, sizeof(desc->Flags));
+    AppendBytes(out, &desc->Texture2D, size);
+    return true;
+}
+
+bool IsPoolable(const D3D11_TEXTURE2D_DESC &desc, const D3D11_SUBRESOURCE_DATA *pInitialData)
+{
+    if(desc.Usage!=D3D11_USAGE_DEFAULT || pInitialData!=NULL) { return false; }
+    if((desc.MiscFlags & (D3D11_RESOURCE_MISC_SHARED|D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX|D3D11_RESOURCE_MISC_GDI_COMPATIBLE))!=0) { return false; }
+    return true;
+}
+
+bool IsSameDesc(const D3D11_TEXTURE2D_DESC &a, const D3D11_TEXTURE2D_DESC &b)
+{
+    return a.Width==b.Width && a.Height==b.Height && a.MipLevels==b.MipLevels && a.ArraySize==b.ArraySize &&
+        a.Format==b.Format && a.SampleDesc.Count==b.SampleDesc.Count && a.SampleDesc.Quality==b.SampleDesc.Quality &&
+        a.Usage==b.Usage && a.BindFlags==b.BindFlags && a.CPUAccessFlags==b.CPUAccessFlags && a.MiscFlags==b.MiscFlags;
+}
+
+
+// pool 以外からの参照が無いか。
+// OMGetRenderTargets() や GetResource() などで増えた参照は hook で捕捉できないので、free のものも実際の参照カウントで確認します。
+// (free のものに対して呼ぶので、Release() の hook は何もしません)
+inline bool IsOnlyPoolReferenced(IUnknown *v)
+{
+    v->AddRef();
+    return v->Release()==1;
+}
+
+// free フラグが立っているものが本当に未使用か確認し、使用中のものはフラグを戻します
+bool ValidateFree(ID3D11Resource *texture, PooledTexture &pt)
+{
+    bool ret = true;
+    if(pt.free && !IsOnlyPoolReferenced(texture)) {
+        pt.free = false;
+        ret = false;
+    }
+    for(size_t i=0; i<pt.views.size(); ++i) {
+        PooledView &pv = pt.views[i];
+        if(pv.free && !IsOnlyPoolReferenced(pv.view)) {
+            pv.free = false;
+            ret = false;
+        }
+    }
+    return ret && pt.free;
+}
+
+// テクスチャとその view が全てアプリから解放されていたら再利用可能にします。
+// Release() の hook から呼ばれるので、ここでは解放しません (解放中のオブジェクトの hook を外すことになるため)。
+// 予算の超過は次の CreateTexture2D() で解消します
+void UpdateAvailability(ID3D11Resource *texture, PooledTexture &pt)
+{
+    if(pt.available || !pt.free) { return; }
+    for(size_t i=0; i<pt.views.size(); ++i) {
+        if(!pt.views[i].free) { return; }
+    }
+    if(!ValidateFree(texture, pt)) { return; }
+    pt.available = true;
+    pt.lru = g_lru.insert(g_lru.begin(), texture);
+    g_available_bytes += pt.bytes;
+}
+
+void MakeUnavailable(PooledTexture &pt)
+{
+    if(!pt.available) { return; }
+    pt.available = false;
+    g_lru.erase(pt.lru);
+    g_available_bytes -= pt.bytes;
+}
+
+
+class Texture2DPoolHook : public D3D11Texture2DHook
+{
+typedef D3D11Texture2DHook super;
+public:
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        ScopedLock lock(g_mutex);
+        ULONG r = super::Release();
+        // pool の参照だけが残った
+        if(r==1) {
+            PooledTextures::iterator i = g_textures.find(this);
+            if(i!=g_textures.end() && !i->second.free) {
+                i->second.free = true;
+                UpdateAvailability(i->first, i->second);
+            }
+        }
+        return r;
+    }
+};
+
+template<class T>
+class TViewPoolHook : public T
+{
+typedef T super;
+public:
+    virtual ULONG STDMETHODCALLTYPE Release(void)
+    {
+        ScopedLock lock(g_mutex);
+        ULONG r = super::Release();
+        if(r==1) {
+            ViewOwners::iterator o = g_view_owners.find(this);
+            if(o!=g_view_owners.end()) {
+                PooledTextures::iterator i = g_textures.find(o->second);
+                PooledTexture &pt = i->second;
+                for(size_t vi=0; vi<pt.views.size(); ++vi) {
+                    PooledView &pv = pt.views[vi];
+                    if(pv.view==this && !pv.free) {
+                        pv.free = true;
+                        UpdateAvailability(i->first, pt);
+                        break;
+                    }
+                }
+            }
+        }
+        return r;
+    }
+};
+typedef TViewPoolHook<D3D11ShaderResourceViewHook>  ShaderResourceViewPoolHook;
+typedef TViewPoolHook<D3D11RenderTargetViewHook>    RenderTargetViewPoolHook;
+typedef TViewPoolHook<D3D11UnorderedAccessViewHook> UnorderedAccessViewPoolHook;
+typedef TViewPoolHook<D3D11DepthStencilViewHook>    DepthStencilViewPoolHook;
+
+
+// pool の参照を解放します。hook も外すので、アプリの参照が残っていればそのまま使い続けられます
+void ReleasePooledView(PooledView &pv)
+{
+    g_view_owners.erase(pv.view);
+    switch(pv.type) {
+    case VIEW_SRV: D3D11RemoveHook<ShaderResourceViewPoolHook>(pv.view); break;
+    case VIEW_RTV: D3D11RemoveHook<RenderTargetViewPoolHook>(pv.view); break;
+    case VIEW_UAV: D3D11RemoveHook<UnorderedAccessViewPoolHook>(pv.view); break;
+    case VIEW_DSV: D3D11RemoveHook<DepthStencilViewPoolHook>(pv.view); break;
+    }
+    pv.view->Release();
+}
+
+void ReleasePooledTexture(PooledTextures::iterator i)
+{
+    ID3D11Resource *texture = i->first;
+    PooledTexture &pt = i->second;
+    MakeUnavailable(pt);
+    for(size_t vi=0; vi<pt.views.size(); ++vi) {
+        ReleasePooledView(pt.views[vi]);
+    }
+    g_textures.erase(i);
+    D3D11RemoveHook<Texture2DPoolHook>(texture);
+    texture->Release();
+}
+
+// pool で追跡できない view が作られるテクスチャは pool から外します。
+// view はテクスチャを内部参照だけで保持しているので、テクスチャの Release() からは view の生存が分からず、
+// 再利用すると生きている view と別名になってしまうためです
+void DropPooledTexture(ID3D11Resource *pResource)
+{
+    ScopedLock lock(g_mutex);
+    PooledTextures::iterator i = g_textures.find(pResource);
+    if(i!=g_textures.end()) { ReleasePooledTexture(i); }
+}
+
+void EvictOverBudget()
+{
+    while(g_available_bytes>g_budget && !g_lru.empty()) {
+        ReleasePooledTexture(g_textures.find(g_lru.back()));
+        ++g_evictions;
+    }
+}
+
+// desc が一致する再利用可能なテクスチャのうち、最近解放されたものを取り出します
+ID3D11Texture2D* PopAvailableTexture(const D3D11_TEXTURE2D_DESC &desc)
+{
+    for(LRUList::iterator l=g_lru.begin(); l!=g_lru.end(); ) {
+        ID3D11Resource *texture = *l++;
+        PooledTexture &pt = g_textures[texture];
+        if(!IsSameDesc(pt.desc, desc)) { continue; }
+
+        MakeUnavailable(pt);
+        if(ValidateFree(texture, pt)) {
+            pt.free = false;
+            return static_cast<ID3D11Texture2D*>(texture);
+        }
+        // 知らないうちに参照が増えていた。解放されたら hook で再び free になります
+    }
+    return NULL;
+}
+
+// pool されているテクスチャに対する view の作成要求であれば、空きの view を探します。
+// 見つからなければ *out_pt を設定して false を返すので、作成後に AddPooledView() に渡します。
+template<class ViewType>
+bool FindPooledView(ID3D11Resource *pResource, const std::string &key, ViewType **ppView, PooledTexture **out_pt)
+{
+    *out_pt = NULL;
+    PooledTextures::iterator i = g_textures.find(pResource);
+    if(i==g_textures.end()) { return false; }
+
+    PooledTexture &pt = i->second;
+    for(size_t vi=0; vi<pt.views.size(); ++vi) {
+        PooledView &pv = pt.views[vi];
+        if(pv.free && pv.key==key) {
+            if(!IsOnlyPoolReferenced(pv.view)) {
+                // 知らないうちに参照が増えていた。解放されたら hook で再び free になります
+                pv.free = false;
+                continue;
+            }
+            pv.free = false;
+            pv.view->AddRef();
+            *ppView = static_cast<ViewType*>(pv.view);
+            ++g_view_hits;
+            return true;
+        }
+    }
+    *out_pt = &pt;
+    return false;
+}
+
+template<class HookType, class ViewType>
+void AddPooledView(ID3D11Resource *pResource, PooledTexture &pt, const std::string &key, int type, ViewType *view)
+{
+    ++g_view_misses;
+    PooledView pv;
+    pv.view = view;
+    pv.type = type;
+    pv.key = key;
+    pv.free = false;
+    pt.views.push_back(pv);
+    g_view_owners[view] = pResource;
+    view->AddRef();
+    D3D11SetHook<HookType>(view);
+}
+
+
+class DeviceTexturePool : public D3D11DeviceHook
+{
+typedef D3D11DeviceHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE CreateTexture2D(
+        const D3D11_TEXTURE2D_DESC *pDesc,
+        const D3D11_SUBRESOURCE_DATA *pInitialData,
+        ID3D11Texture2D **ppTexture2D)
+    {
+        if(pDesc==NULL || ppTexture2D==NULL || !IsPoolable(*pDesc, pInitialData)) {
+            return super::CreateTexture2D(pDesc, pInitialData, ppTexture2D);
+        }
+
+        ScopedLock lock(g_mutex);
+        ID3D11Texture2D *pooled = PopAvailableTexture(*pDesc);
+        EvictOverBudget();
+        if(pooled!=NULL) {
+            ++g_texture_hits;
+            pooled->AddRef();
+            *ppTexture2D = pooled;
+            return S_OK;
+        }
+
+        ++g_texture_misses;
+        HRESULT r = super::CreateTexture2D(pDesc, pInitialData, ppTexture2D);
+        if(r==S_OK) {
+            ID3D11Texture2D *texture = *ppTexture2D;
+            PooledTexture &pt = g_textures[texture];
+            pt.desc = *pDesc;
+            pt.bytes = EstimateResourceSize(*pDesc);
+            texture->AddRef();
+            D3D11SetHook<Texture2DPoolHook>(texture);
+        }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateShaderResourceView(
+        ID3D11Resource *pResource,
+        const D3D11_SHADER_RESOURCE_VIEW_DESC *pDesc,
+        ID3D11ShaderResourceView **ppSRView)
+    {
+        std::string key;
+        if(ppSRView==NULL) { return super::CreateShaderResourceView(pResource, pDesc, ppSRView); }
+        if(!MakeViewKey(pDesc, key)) {
+            HRESULT r = super::CreateShaderResourceView(pResource, pDesc, ppSRView);
+            if(r==S_OK) { DropPooledTexture(pResource); }
+            return r;
+        }
+
+        ScopedLock lock(g_mutex);
+        PooledTexture *pt;
+        if(FindPooledView(pResource, key, ppSRView, &pt)) { return S_OK; }
+        HRESULT r = super::CreateShaderResourceView(pResource, pDesc, ppSRView);
+        if(r==S_OK && pt!=NULL) { AddPooledView<ShaderResourceViewPoolHook>(pResource, *pt, key, VIEW_SRV, *ppSRView); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateUnorderedAccessView(
+        ID3D11Resource *pResource,
+        const D3D11_UNORDERED_ACCESS_VIEW_DESC *pDesc,
+        ID3D11UnorderedAccessView **ppUAView)
+    {
+        std::string key;
+        if(ppUAView==NULL) { return super::CreateUnorderedAccessView(pResource, pDesc, ppUAView); }
+        if(!MakeViewKey(pDesc, key)) {
+            HRESULT r = super::CreateUnorderedAccessView(pResource, pDesc, ppUAView);
+            if(r==S_OK) { DropPooledTexture(pResource); }
+            return r;
+        }
+
+        ScopedLock lock(g_mutex);
+        PooledTexture *pt;
+        if(FindPooledView(pResource, key, ppUAView, &pt)) { return S_OK; }
+        HRESULT r = super::CreateUnorderedAccessView(pResource, pDesc, ppUAView);
+        if(r==S_OK && pt!=NULL) { AddPooledView<UnorderedAccessViewPoolHook>(pResource, *pt, key, VIEW_UAV, *ppUAView); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateRenderTargetView(
+        ID3D11Resource *pResource,
+        const D3D11_RENDER_TARGET_VIEW_DESC *pDesc,
+        ID3D11RenderTargetView **ppRTView)
+    {
+        std::string key;
+        if(ppRTView==NULL) { return super::CreateRenderTargetView(pResource, pDesc, ppRTView); }
+        if(!MakeViewKey(pDesc, key)) {
+            HRESULT r = super::CreateRenderTargetView(pResource, pDesc, ppRTView);
+            if(r==S_OK) { DropPooledTexture(pResource); }
+            return r;
+        }
+
+        ScopedLock lock(g_mutex);
+        PooledTexture *pt;
+        if(FindPooledView(pResource, key, ppRTView, &pt)) { return S_OK; }
+        HRESULT r = super::CreateRenderTargetView(pResource, pDesc, ppRTView);
+        if(r==S_OK && pt!=NULL) { AddPooledView<RenderTargetViewPoolHook>(pResource, *pt, key, VIEW_RTV, *ppRTView); }
+        return r;
+    }
+
+    virtual HRESULT STDMETHODCALLTYPE CreateDepthStencilView(
+        ID3D11Resource *pResource,
+        const D3D11_DEPTH_STENCIL_VIEW_DESC *pDesc,
+        ID3D11DepthStencilView **ppDepthStencilView)
+    {
+        std::string key;
+        if(ppDepthStencilView==NULL) { return super::CreateDepthStencilView(pResource, pDesc, ppDepthStencilView); }
+        if(!MakeViewKey(pDesc, key)) {
+            HRESULT r = super::CreateDepthStencilView(pResource, pDesc, ppDepthStencilView);
+            if(r==S_OK) { DropPooledTexture(pResource); }
+            return r;
+        }
+
+        ScopedLock lock(g_mutex);
+        PooledTexture *pt;
+        if(FindPooledView(pResource, key, ppDepthStencilView, &pt)) { return S_OK; }
+        HRESULT r = super::CreateDepthStencilView(pResource, pDesc, ppDepthStencilView);
+        if(r==S_OK && pt!=NULL) { AddPooledView<DepthStencilViewPoolHook>(pResource, *pt, key, VIEW_DSV, *ppDepthStencilView); }
+        return r;
+    }
+};
+
+
+bool _D3D11TexturePoolInitialize(ID3D11Device *pDevice, size_t budget)
+{
+    if(g_device!=NULL) { return false; }
+
+    g_device = pDevice;
+    g_budget = budget;
+    D3D11SetHook<DeviceTexturePool>(pDevice);
+    return true;
+}
+
+void _D3D11TexturePoolFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    ScopedLock lock(g_mutex);
+    D3D11RemoveHook<DeviceTexturePool>(g_device);
+    // 使用中のものはアプリの参照が残っているので、pool の参照を外すだけになります
+    while(!g_textures.empty()) {
+        ReleasePooledTexture(g_textures.begin());
+    }
+    g_device = NULL;
+    g_texture_hits = g_texture_misses = 0;
+    g_view_hits = g_view_misses = 0;
+    g_evictions = 0;
+}
+
+void _D3D11TexturePoolSetBudget(size_t budget)
+{
+    ScopedLock lock(g_mutex);
+    g_budget = budget;
+    EvictOverBudget();
+}
+
+void _D3D11TexturePoolGetStats(D3D11TexturePoolStats &out)
+{
+    ScopedLock lock(g_mutex);
+    out.texture_hits    = g_texture_hits;
+    out.texture_misses  = g_texture_misses;
+    out.view_hits       = g_view_hits;
+    out.view_misses     = g_view_misses;
+    out.evictions       = g_evictions;
+    out.num_pooled      = g_textures.size();
+    out.num_available   = g_lru.size();
+    out.available_bytes = g_available_bytes;
+    out.budget          = g_budget;
+}
+
+void _D3D11TexturePoolPrintStats()
+{
+    D3D11TexturePoolStats stats;
+    _D3D11TexturePoolGetStats(stats);
+
+    char buf[512];
+    sprintf_s(buf,
+        "D3D11TexturePoolPrintStats(): TextureHits=%Iu TextureMisses=%Iu ViewHits=%Iu ViewMisses=%Iu Evictions=%Iu\n"
+        "  Pooled=%Iu Available=%Iu AvailableSize=%Iu Budget=%Iu\n",
+        stats.texture_hits, stats.texture_misses, stats.view_hits, stats.view_misses, stats.evictions,
+        stats.num_pooled, stats.num_available, stats.available_bytes, stats.budget);
+    OutputDebugStringA(buf);
+}
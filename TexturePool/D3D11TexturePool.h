@@ -0,0 +1,65 @@
+﻿#ifndef _ist_D3D11TexturePool_h_
+#define _ist_D3D11TexturePool_h_
+#include <D3D11.h>
+
+// ID3D11Device::CreateTexture2D() で作られたテクスチャと、それに対して作られた
+// ShaderResourceView / RenderTargetView / UnorderedAccessView / DepthStencilView を、アプリが解放した後も pool に保持しておき、
+// 同じ desc の作成要求が来たら再利用します。解像度変更時やエフェクトごとにポストプロセス用のテクスチャを
+// 作り直すようなコードの生成コストを無くせます。
+// テクスチャは、テクスチャ自身とその view が全てアプリから解放された時点で再利用可能になります。
+// 再利用可能なテクスチャのメモリ使用量の推定値が予算を超えたら、最後に解放されたのが古いものから本当に解放します (LRU)。
+// 解放はアプリの Release() の中では行わず、次の CreateTexture2D() か D3D11TexturePoolSetBudget() で行います。
+//
+// 対象は D3D11_USAGE_DEFAULT で初期データ無し、MiscFlags に D3D11_RESOURCE_MISC_SHARED 系を含まないテクスチャです。
+// pool が対応していない ViewDimension の view が作られたテクスチャは、その時点で pool から外れます
+// (view の生存を追跡できず、再利用すると生きている view と同じテクスチャを返してしまうため)。
+// 再利用されたテクスチャの内容は不定 (以前の内容が残っています) で、以前の SetPrivateData() の内容も残ります。
+//
+// 有効にするには、このファイルを include する前に D3D11TEXTUREPOOL_ENABLE を define しておく必要があります。
+// D3D11TEXTUREPOOL_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+#ifndef D3D11TEXTUREPOOL_DEFAULT_BUDGET
+#define D3D11TEXTUREPOOL_DEFAULT_BUDGET (256*1024*1024)
+#endif
+
+struct D3D11TexturePoolStats
+{
+    size_t texture_hits;
+    size_t texture_misses;
+    size_t view_hits;
+    size_t view_misses;
+    size_t evictions;       // 予算超過で解放したテクスチャの数
+    size_t num_pooled;      // pool が管理しているテクスチャの数 (使用中 + 再利用可能)
+    size_t num_available;   // 再利用可能なテクスチャの数
+    size_t available_bytes; // 再利用可能なテクスチャのメモリ使用量の推定値
+    size_t budget;
+};
+
+#ifdef D3D11TEXTUREPOOL_ENABLE
+
+// budget: 再利用可能なテクスチャを保持しておくメモリの上限 (byte)
+bool _D3D11TexturePoolInitialize(ID3D11Device *pDevice, size_t budget=D3D11TEXTUREPOOL_DEFAULT_BUDGET);
+void _D3D11TexturePoolFinalize();
+// 予算を変更します。超過分はすぐに解放されます
+void _D3D11TexturePoolSetBudget(size_t budget);
+void _D3D11TexturePoolGetStats(D3D11TexturePoolStats &out);
+void _D3D11TexturePoolPrintStats();
+
+#define D3D11TexturePoolInitialize(...) _D3D11TexturePoolInitialize(__VA_ARGS__)
+#define D3D11TexturePoolFinalize()      _D3D11TexturePoolFinalize()
+#define D3D11TexturePoolSetBudget(...)  _D3D11TexturePoolSetBudget(__VA_ARGS__)
+#define D3D11TexturePoolGetStats(...)   _D3D11TexturePoolGetStats(__VA_ARGS__)
+#define D3D11TexturePoolPrintStats()    _D3D11TexturePoolPrintStats()
+
+#else // D3D11TEXTUREPOOL_ENABLE
+
+#define D3D11TexturePoolInitialize(...)
+#define D3D11TexturePoolFinalize()
+#define D3D11TexturePoolSetBudget(...)
+#define D3D11TexturePoolGetStats(...)
+#define D3D11TexturePoolPrintStats()
+
+#endif // D3D11TEXTUREPOOL_ENABLE
+
+#endif // _ist_D3D11TexturePool_h_
@@ -0,0 +1,128 @@
+﻿// D3D11EventTraceInitialize() で記録したトレースを変換/集計するツールです。
+// Windows/D3D11 に依存しないので Linux などでもビルドできます。
+//   g++ -O2 -o EventTraceTool Tools/EventTraceTool.cpp EventTrace/D3D11EventTraceFile.cpp
+//
+// EventTraceTool chrome <trace> <output.json>  Chrome の trace event 形式に変換 (chrome://tracing, ui.perfetto.dev で開けます)
+// EventTraceTool summary <trace>               method ごとの呼び出し回数と時間を表示
+
+#include "../EventTrace/D3D11EventTraceFile.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct MethodStat
+{
+    uint64_t count;
+    double total;   // ミリ秒
+    double max;
+
+    MethodStat() : count(0), total(0.0), max(0.0) {}
+};
+typedef std::map<uint32_t, MethodStat> MethodTable;
+
+bool GreaterTotal(const MethodTable::value_type *a, const MethodTable::value_type *b)
+{
+    return a->second.total > b->second.total;
+}
+
+bool Load(const char *path, EventTrace &out)
+{
+    if(!ReadEventTrace(path, out)) {
+        fprintf(stderr, "failed to read %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+int Chrome(const char *trace_path, const char *out_path)
+{
+    EventTrace trace;
+    if(!Load(trace_path, trace)) { return 1; }
+    if(!ExportChromeTrace(trace, out_path)) {
+        fprintf(stderr, "failed to write %s\n", out_path);
+        return 1;
+    }
+    return 0;
+}
+
+int Summary(const char *trace_path)
+{
+    EventTrace trace;
+    if(!Load(trace_path, trace)) { return 1; }
+
+    // スレッドごとのイベントは時刻順に並んでいて、begin/end は入れ子になっている
+    typedef std::map<uint32_t, std::vector<const EventTraceEvent*> > Stacks;
+    Stacks stacks;
+    MethodTable table;
+    double to_ms = 1000.0/double(trace.frequency);
+    for(size_t i=0; i<trace.events.size(); ++i) {
+        const EventTraceEvent &e = trace.events[i];
+        std::vector<const EventTraceEvent*> &stack = stacks[e.thread];
+        if(e.phase==ETP_BEGIN) {
+            stack.push_back(&e);
+        }
+        else if(e.phase==ETP_END) {
+            // 溢れて捨てたイベントがあると対応が崩れるので、同じ method まで戻す
+            while(!stack.empty() && stack.back()->method!=e.method) { stack.pop_back(); }
+            if(stack.empty()) { continue; }
+            double t = double(e.time-stack.back()->time)*to_ms;
+            stack.pop_back();
+            MethodStat &st = table[e.method];
+            ++st.count;
+            st.total += t;
+            st.max = std::max<double>(st.max, t);
+        }
+        else {
+            ++table[e.method].count;
+        }
+    }
+
+    std::vector<const MethodTable::value_type*> sorted;
+    for(MethodTable::const_iterator i=table.begin(); i!=table.end(); ++i) {
+        sorted.push_back(&*i);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), GreaterTotal);
+
+    uint64_t dropped = 0;
+    for(EventTrace::Threads::const_iterator i=trace.threads.begin(); i!=trace.threads.end(); ++i) {
+        dropped += i->second.dropped;
+    }
+    printf("%llu events, %u threads, %llu dropped\n",
+        (unsigned long long)trace.events.size(), (unsigned)trace.threads.size(), (unsigned long long)dropped);
+    for(size_t i=0; i<sorted.size(); ++i) {
+        const MethodStat &st = sorted[i]->second;
+        EventTrace::Names::const_iterator n = trace.names.find(sorted[i]->first);
+        printf("  %10llu calls  total %10.3fms  avg %8.4fms  max %8.3fms  %s\n",
+            (unsigned long long)st.count, st.total, st.count>0 ? st.total/double(st.count) : 0.0, st.max,
+            n!=trace.names.end() ? n->second.c_str() : "(unknown)");
+    }
+    return 0;
+}
+
+void PrintUsage()
+{
+    fprintf(stderr,
+        "usage:\n"
+        "  EventTraceTool chrome <trace> <output.json>\n"
+        "  EventTraceTool summary <trace>\n");
+}
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+    if(argc==4 && strcmp(argv[1], "chrome")==0) {
+        return Chrome(argv[2], argv[3]);
+    }
+    else if(argc==3 && strcmp(argv[1], "summary")==0) {
+        return Summary(argv[2]);
+    }
+    PrintUsage();
+    return 1;
+}
@@ -0,0 +1,125 @@
+﻿// D3D11EvictionPriorityInitialize() で記録した使用状況のトレースを再生し、LRUEvictionPolicy の設定を評価するツールです。
+// Windows/D3D11 に依存しないので Linux などでもビルドできます。
+//   g++ -O2 -o EvictionSimTool Tools/EvictionSimTool.cpp Utilities/EvictionPolicy.cpp
+//
+// EvictionSimTool <trace> [options]
+//   --budget <bytes>      トレースに記録された budget の代わりに使う
+//   --max-changes <n>     1 回の見直しで変える priority の数の上限
+//   --pressure <ratio>    LRUEvictionPolicy::setPressureRatio()
+//   --cold <frames>       LRUEvictionPolicy::setColdFrames()
+//   --hot <frames>        LRUEvictionPolicy::setHotFrames()
+//
+// EVICTION_PRIORITY_MINIMUM にしていたリソースが次の見直しまでに使われたら、追い出された後に使われた (fault) とみなして数えます。
+
+#include "../Utilities/EvictionPolicy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+
+namespace {
+
+typedef std::map<uint64_t, uint32_t> PriorityTable;
+
+struct SimStats
+{
+    uint64_t changes;
+    uint64_t demotions;
+    uint64_t promotions;
+    uint64_t faults;
+    uint64_t fault_bytes;
+    uint64_t deferred;      // max_changes を超えて次に回した数
+
+    SimStats() : changes(0), demotions(0), promotions(0), faults(0), fault_bytes(0), deferred(0) {}
+};
+
+void PrintUsage()
+{
+    fprintf(stderr,
+        "usage:\n"
+        "  EvictionSimTool <trace> [--budget <bytes>] [--max-changes <n>] [--pressure <ratio>] [--cold <frames>] [--hot <frames>]\n");
+}
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+    if(argc<2) {
+        PrintUsage();
+        return 1;
+    }
+
+    LRUEvictionPolicy policy;
+    uint64_t budget = 0;
+    size_t max_changes = 64;
+    for(int i=2; i<argc; ++i) {
+        if(i+1>=argc) { PrintUsage(); return 1; }
+        const char *opt = argv[i];
+        const char *v = argv[++i];
+        if     (strcmp(opt, "--budget")==0)      { budget = strtoull(v, NULL, 10); }
+        else if(strcmp(opt, "--max-changes")==0) { max_changes = (size_t)strtoull(v, NULL, 10); }
+        else if(strcmp(opt, "--pressure")==0)    { policy.setPressureRatio(atof(v)); }
+        else if(strcmp(opt, "--cold")==0)        { policy.setColdFrames(strtoull(v, NULL, 10)); }
+        else if(strcmp(opt, "--hot")==0)         { policy.setHotFrames(strtoull(v, NULL, 10)); }
+        else { PrintUsage(); return 1; }
+    }
+
+    std::vector<EvictionSnapshot> snapshots;
+    if(!ReadEvictionTrace(argv[1], snapshots)) {
+        fprintf(stderr, "failed to read %s\n", argv[1]);
+        return 1;
+    }
+
+    PriorityTable priorities;
+    SimStats stats;
+    uint64_t prev_frame = 0;
+    std::vector<EvictionChange> changes;
+    for(size_t si=0; si<snapshots.size(); ++si) {
+        EvictionSnapshot &snap = snapshots[si];
+        if(budget!=0) { snap.state.budget = budget; }
+
+        PriorityTable next;
+        for(size_t i=0; i<snap.resources.size(); ++i) {
+            EvictionResource &r = snap.resources[i];
+            PriorityTable::const_iterator p = priorities.find(r.id);
+            r.priority = p!=priorities.end() ? p->second : EVICTION_PRIORITY_NORMAL;
+            if(si>0 && r.priority==EVICTION_PRIORITY_MINIMUM && r.use_count>0 && r.last_used_frame>prev_frame) {
+                ++stats.faults;
+                stats.fault_bytes += r.bytes;
+            }
+            next[r.id] = r.priority;
+        }
+
+        changes.clear();
+        size_t wanted = PlanEvictionPriorities(snap.resources, snap.state, policy, max_changes, changes);
+        stats.deferred += wanted-changes.size();
+        for(size_t i=0; i<changes.size(); ++i) {
+            uint32_t &cur = next[changes[i].id];
+            if(changes[i].priority<cur) { ++stats.demotions; }
+            else                        { ++stats.promotions; }
+            cur = changes[i].priority;
+            ++stats.changes;
+        }
+        priorities.swap(next); // 消えたリソースはここで落ちる
+        prev_frame = snap.state.frame;
+    }
+
+    uint64_t minimum_bytes = 0, total_bytes = 0;
+    if(!snapshots.empty()) {
+        const EvictionSnapshot &last = snapshots.back();
+        for(size_t i=0; i<last.resources.size(); ++i) {
+            total_bytes += last.resources[i].bytes;
+            if(priorities[last.resources[i].id]==EVICTION_PRIORITY_MINIMUM) { minimum_bytes += last.resources[i].bytes; }
+        }
+    }
+
+    printf("%u snapshots\n", (unsigned)snapshots.size());
+    printf("  changes    %llu (%llu demotions, %llu promotions, %llu deferred)\n",
+        (unsigned long long)stats.changes, (unsigned long long)stats.demotions,
+        (unsigned long long)stats.promotions, (unsigned long long)stats.deferred);
+    printf("  faults     %llu (%.2fMB)\n", (unsigned long long)stats.faults, double(stats.fault_bytes)/(1024.0*1024.0));
+    printf("  at minimum %.2fMB / %.2fMB at the end\n", double(minimum_bytes)/(1024.0*1024.0), double(total_bytes)/(1024.0*1024.0));
+    return 0;
+}
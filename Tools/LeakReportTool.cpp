@@ -0,0 +1,177 @@
+﻿// D3D11LeakCheckerExportLeakInfo(..., D3D11LC_REPORT_BINARY) で出力したレポートをマージ/比較するツールです。
+// Windows/D3D11 に依存しないので Linux などでもビルドできます。
+//   g++ -O2 -o LeakReportTool Tools/LeakReportTool.cpp LeakChecker/D3D11LeakReport.cpp
+//
+// LeakReportTool merge <report>...      複数のレポートのリークを生成場所ごとに集計して表示
+// LeakReportTool diff <base> <target>   base と target で生成場所ごとのリークの数とサイズの増減を表示
+//
+// 実行ごとにアドレスは変わるので、生成場所はシンボル名 (アドレス部分を除いたもの) のコールスタックで識別します。
+
+#include "../LeakChecker/D3D11LeakReport.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct CallsiteStat
+{
+    size_t runs;
+    size_t count;
+    uint64_t bytes;
+    int last_run;
+
+    CallsiteStat() : runs(0), count(0), bytes(0), last_run(-1) {}
+};
+typedef std::map<std::string, CallsiteStat> CallsiteTable;
+
+
+// "file(line): module!func + 0x10 [0x0000000140001010]" から末尾のアドレスを取り除きます。
+// 解決できずにアドレスだけ ("[0x0000000140001010]") のものは実行ごとに変わるので、"?" にします
+std::string NormalizeSymbol(const std::string &name)
+{
+    size_t pos = name.rfind("[0x");
+    size_t end = pos==std::string::npos ? name.size() : pos;
+    while(end>0 && (name[end-1]==' ' || name[end-1]=='\n' || name[end-1]=='\r')) { --end; }
+    return end==0 ? std::string("?") : name.substr(0, end);
+}
+
+std::string GetCallsiteKey(const LeakReport &report, uint32_t stack_id)
+{
+    std::string key;
+    LeakReport::Stacks::const_iterator s = report.stacks.find(stack_id);
+    if(s==report.stacks.end()) { return key; }
+
+    const std::vector<uint64_t> &frames = s->second;
+    for(size_t i=0; i<frames.size(); ++i) {
+        // シンボルのないフレームもアドレスは実行ごとに変わるので、"?" で識別する
+        LeakReport::Symbols::const_iterator sym = report.symbols.find(frames[i]);
+        key += sym!=report.symbols.end() ? NormalizeSymbol(sym->second) : std::string("?");
+        key += "\n";
+    }
+    return key;
+}
+
+void Accumulate(CallsiteTable &table, const LeakReport &report, int run)
+{
+    for(size_t i=0; i<report.entries.size(); ++i) {
+        const LeakReportEntry &e = report.entries[i];
+        CallsiteStat &st = table[GetCallsiteKey(report, e.stack)];
+        if(st.last_run!=run) {
+            st.last_run = run;
+            ++st.runs;
+        }
+        ++st.count;
+        st.bytes += e.bytes;
+    }
+}
+
+void PrintCallstack(const std::string &key)
+{
+    size_t begin = 0;
+    while(begin<key.size()) {
+        size_t end = key.find('\n', begin);
+        if(end==std::string::npos) { end = key.size(); }
+        printf("    %s\n", key.substr(begin, end-begin).c_str());
+        begin = end+1;
+    }
+}
+
+bool GreaterBytes(const CallsiteTable::value_type *a, const CallsiteTable::value_type *b)
+{
+    return a->second.bytes > b->second.bytes;
+}
+
+bool Load(const char *path, LeakReport &out)
+{
+    if(!ReadLeakReport(path, out)) {
+        fprintf(stderr, "failed to read %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+int Merge(int argc, char *argv[])
+{
+    CallsiteTable table;
+    for(int i=0; i<argc; ++i) {
+        LeakReport report;
+        if(!Load(argv[i], report)) { return 1; }
+        Accumulate(table, report, i);
+    }
+
+    std::vector<const CallsiteTable::value_type*> sorted;
+    for(CallsiteTable::const_iterator i=table.begin(); i!=table.end(); ++i) {
+        sorted.push_back(&*i);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), GreaterBytes);
+
+    for(size_t i=0; i<sorted.size(); ++i) {
+        const CallsiteStat &st = sorted[i]->second;
+        printf("%llu bytes in %u objects, leaked in %u/%d runs\n",
+            (unsigned long long)st.bytes, (unsigned)st.count, (unsigned)st.runs, argc);
+        PrintCallstack(sorted[i]->first);
+    }
+    return 0;
+}
+
+int Diff(const char *base_path, const char *target_path)
+{
+    LeakReport base, target;
+    if(!Load(base_path, base) || !Load(target_path, target)) { return 1; }
+
+    CallsiteTable base_table, target_table;
+    Accumulate(base_table, base, 0);
+    Accumulate(target_table, target, 0);
+
+    // 数かサイズが変わった生成場所を、'+' (target で増えた/新たに出た)、'-' (target で減った/消えた) の順に表示します。
+    // サイズの増減を優先し、サイズが同じなら数の増減で分けます
+    CallsiteTable keys = base_table;
+    keys.insert(target_table.begin(), target_table.end());
+    for(int pass=0; pass<2; ++pass) {
+        for(CallsiteTable::const_iterator i=keys.begin(); i!=keys.end(); ++i) {
+            CallsiteTable::const_iterator b = base_table.find(i->first);
+            CallsiteTable::const_iterator t = target_table.find(i->first);
+            size_t base_count = b!=base_table.end() ? b->second.count : 0;
+            uint64_t base_bytes = b!=base_table.end() ? b->second.bytes : 0;
+            size_t target_count = t!=target_table.end() ? t->second.count : 0;
+            uint64_t target_bytes = t!=target_table.end() ? t->second.bytes : 0;
+            if(base_count==target_count && base_bytes==target_bytes) { continue; }
+
+            bool grew = target_bytes!=base_bytes ? target_bytes>base_bytes : target_count>base_count;
+            if(grew!=(pass==0)) { continue; }
+            printf("%c %+lld objects, %+lld bytes (%u -> %u objects, %llu -> %llu bytes)\n", grew ? '+' : '-',
+                (long long)target_count-(long long)base_count, (long long)target_bytes-(long long)base_bytes,
+                (unsigned)base_count, (unsigned)target_count,
+                (unsigned long long)base_bytes, (unsigned long long)target_bytes);
+            PrintCallstack(i->first);
+        }
+    }
+    return 0;
+}
+
+void PrintUsage()
+{
+    fprintf(stderr,
+        "usage:\n"
+        "  LeakReportTool merge <report>...\n"
+        "  LeakReportTool diff <base> <target>\n");
+}
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+    if(argc>=3 && strcmp(argv[1], "merge")==0) {
+        return Merge(argc-2, argv+2);
+    }
+    else if(argc==4 && strcmp(argv[1], "diff")==0) {
+        return Diff(argv[2], argv[3]);
+    }
+    PrintUsage();
+    return 1;
+}
@@ -0,0 +1,394 @@
+﻿#include "../D3D11HookInterface.h"
+#include "../Utilities/Lock.h"
+#include "D3D11UpdateCoalescer.h"
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <unordered_map>
+
+
+typedef std::map<UINT, std::vector<char> > Spans; // key は範囲の先頭 (byte)。範囲同士は隣接も重複もしない
+
+// 転送待ちの更新。バッファの参照を 1 つ保持しています
+struct PendingUpdate
+{
+    Spans spans;
+};
+
+typedef std::unordered_map<ID3D11Buffer*, PendingUpdate> PendingUpdates;
+
+namespace {
+
+Mutex g_mutex;
+PendingUpdates g_pending;
+size_t g_pending_bytes = 0;
+bool g_flushing = false;
+IDXGISwapChain *g_swapchain = NULL;
+ID3D11Device *g_device = NULL;
+ID3D11DeviceContext *g_context = NULL;
+
+// アップロード用バッファ。先頭から詰めていき、足りなくなったら D3D11_MAP_WRITE_DISCARD で先頭に戻ります
+ID3D11Buffer *g_upload = NULL;
+size_t g_upload_size = 0;
+size_t g_upload_head = 0;
+
+size_t g_updates = 0;
+size_t g_copies = 0;
+size_t g_passthrough = 0;
+size_t g_flushes = 0;
+size_t g_bytes_submitted = 0;
+size_t g_bytes_uploaded = 0;
+
+} // namespace
+
+
+bool IsCoalescable(ID3D11Resource *res, UINT subresource, const void *data)
+{
+    if(res==NULL || subresource!=0 || data==NULL || g_flushing) { return false; }
+    D3D11_RESOURCE_DIMENSION dim;
+    res->GetType(&dim);
+    if(dim!=D3D11_RESOURCE_DIMENSION_BUFFER) { return false; }
+    D3D11_BUFFER_DESC desc;
+    static_cast<ID3D11Buffer*>(res)->GetDesc(&desc);
+    return desc.Usage==D3D11_USAGE_DEFAULT && (desc.BindFlags & D3D11_BIND_CONSTANT_BUFFER)==0;
+}
+
+// [begin, end) の範囲を追加し、隣接/重複する範囲と 1 つにまとめます。重複部分は新しい内容で上書きします
+void AddSpan(Spans &spans, UINT begin, UINT end, const char *src)
+{
+    Spans::iterator first = spans.upper_bound(begin);
+    if(first!=spans.begin()) {
+        Spans::iterator prev = first;
+        --prev;
+        if(prev->first+prev->second.size() >= begin) { first = prev; }
+    }
+
+    UINT merged_begin = begin;
+    UINT merged_end = end;
+    Spans::iterator last = first;
+    for(; last!=spans.end() && last->first<=end; ++last) {
+        merged_begin = std::min<UINT>(merged_begin, last->first);
+        merged_end = std::max<UINT>(merged_end, last->first+UINT(last->second.size()));
+    }
+
+    std::vector<char> merged(merged_end-merged_begin);
+    for(Spans::iterator i=first; i!=last; ++i) {
+        memcpy(&merged[i->first-merged_begin], &i->second[0], i->second.size());
+        g_pending_bytes -= i->second.size();
+    }
+    memcpy(&merged[begin-merged_begin], src, end-begin);
+    spans.erase(first, last);
+    g_pending_bytes += merged.size();
+    spans[merged_begin].swap(merged);
+}
+
+// 溜めている更新を全て転送します
+void FlushPendingUpdates(ID3D11DeviceContext *ctx)
+{
+    ScopedLock lock(g_mutex);
+    if(g_pending.empty()) { return; }
+
+    // 転送中に呼ぶ CopySubresourceRegion() などからもここに来るので、先に取り出しておく
+    PendingUpdates pending;
+    pending.swap(g_pending);
+    size_t bytes = g_pending_bytes;
+    g_pending_bytes = 0;
+    g_flushing = true;
+    ++g_flushes;
+
+    D3D11_MAP type = D3D11_MAP_WRITE_NO_OVERWRITE;
+    if(g_upload_head+bytes > g_upload_size) {
+        type = D3D11_MAP_WRITE_DISCARD;
+        g_upload_head = 0;
+    }
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    bool mapped_upload = SUCCEEDED(ctx->Map(g_upload, 0, type, 0, &mapped));
+
+    // アップロード用バッファに書き込んでから、まとめてコピー
+    std::vector<UINT> offsets;
+    if(mapped_upload) {
+        offsets.reserve(pending.size());
+        for(PendingUpdates::iterator p=pending.begin(); p!=pending.end(); ++p) {
+            for(Spans::iterator s=p->second.spans.begin(); s!=p->second.spans.end(); ++s) {
+                offsets.push_back(UINT(g_upload_head));
+                memcpy((char*)mapped.pData+g_upload_head, &s->second[0], s->second.size());
+                g_upload_head += s->second.size();
+            }
+        }
+        ctx->Unmap(g_upload, 0);
+    }
+
+    size_t n = 0;
+    for(PendingUpdates::iterator p=pending.begin(); p!=pending.end(); ++p) {
+        ID3D11Buffer *dst = p->first;
+        for(Spans::iterator s=p->second.spans.begin(); s!=p->second.spans.end(); ++s, ++n) {
+            UINT size = UINT(s->second.size());
+            if(mapped_upload) {
+                D3D11_BOX box = { offsets[n], 0, 0, offsets[n]+size, 1, 1 };
+                ctx->CopySubresourceRegion(dst, 0, s->first, 0, 0, g_upload, 0, &box);
+            }
+            else {
+                // Map できなかった場合はそのまま
+                D3D11_BOX box = { s->first, 0, 0, s->first+size, 1, 1 };
+                ctx->UpdateSubresource(dst, 0, &box, &s->second[0], 0, 0);
+            }
+            ++g_copies;
+            g_bytes_uploaded += size;
+        }
+        dst->Release();
+    }
+    g_flushing = false;
+}
+
+
+class DeviceContextUpdateCoalescer : public D3D11DeviceContextHook
+{
+typedef D3D11DeviceContextHook super;
+public:
+    virtual void STDMETHODCALLTYPE UpdateSubresource(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        const D3D11_BOX *pDstBox,
+        const void *pSrcData,
+        UINT SrcRowPitch,
+        UINT SrcDepthPitch)
+    {
+        ScopedLock lock(g_mutex);
+        if(!IsCoalescable(pDstResource, DstSubresource, pSrcData)) {
+            if(!g_flushing) { ++g_passthrough; }
+            super::UpdateSubresource(pDstResource, DstSubresource, pDstBox, pSrcData, SrcRowPitch, SrcDepthPitch);
+            return;
+        }
+
+        ID3D11Buffer *buffer = static_cast<ID3D11Buffer*>(pDstResource);
+        UINT begin = 0, end = 0;
+        if(pDstBox!=NULL) {
+            begin = pDstBox->left;
+            end = pDstBox->right;
+        }
+        else {
+            D3D11_BUFFER_DESC desc;
+            buffer->GetDesc(&desc);
+            end = desc.ByteWidth;
+        }
+        if(end<=begin) { return; } // 空の box は何もしない
+
+        size_t size = end-begin;
+        if(size > g_upload_size) {
+            // アップロード用バッファに収まらない。順序を保つため、溜めている分を先に転送する
+            FlushPendingUpdates(this);
+            ++g_passthrough;
+            super::UpdateSubresource(pDstResource, DstSubresource, pDstBox, pSrcData, SrcRowPitch, SrcDepthPitch);
+            return;
+        }
+        if(g_pending_bytes+size > g_upload_size) {
+            FlushPendingUpdates(this);
+        }
+
+        std::pair<PendingUpdates::iterator, bool> r = g_pending.insert(std::make_pair(buffer, PendingUpdate()));
+        if(r.second) { buffer->AddRef(); }
+        AddSpan(r.first->second.spans, begin, end, (const char*)pSrcData);
+        ++g_updates;
+        g_bytes_submitted += size;
+    }
+
+    virtual void STDMETHODCALLTYPE Draw(UINT VertexCount, UINT StartVertexLocation)
+    {
+        FlushPendingUpdates(this);
+        super::Draw(VertexCount, StartVertexLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawIndexed(UINT IndexCount, UINT StartIndexLocation, INT BaseVertexLocation)
+    {
+        FlushPendingUpdates(this);
+        super::DrawIndexed(IndexCount, StartIndexLocation, BaseVertexLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawInstanced(UINT VertexCountPerInstance, UINT InstanceCount, UINT StartVertexLocation, UINT StartInstanceLocation)
+    {
+        FlushPendingUpdates(this);
+        super::DrawInstanced(VertexCountPerInstance, InstanceCount, StartVertexLocation, StartInstanceLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation, INT BaseVertexLocation, UINT StartInstanceLocation)
+    {
+        FlushPendingUpdates(this);
+        super::DrawIndexedInstanced(IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation, StartInstanceLocation);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawAuto(void)
+    {
+        FlushPendingUpdates(this);
+        super::DrawAuto();
+    }
+
+    virtual void STDMETHODCALLTYPE DrawIndexedInstancedIndirect(ID3D11Buffer *pBufferForArgs, UINT AlignedByteOffsetForArgs)
+    {
+        FlushPendingUpdates(this);
+        super::DrawIndexedInstancedIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+    }
+
+    virtual void STDMETHODCALLTYPE DrawInstancedIndirect(ID3D11Buffer *pBufferForArgs, UINT AlignedByteOffsetForArgs)
+    {
+        FlushPendingUpdates(this);
+        super::DrawInstancedIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+    }
+
+    virtual void STDMETHODCALLTYPE Dispatch(UINT ThreadGroupCountX, UINT ThreadGroupCountY, UINT ThreadGroupCountZ)
+    {
+        FlushPendingUpdates(this);
+        super::Dispatch(ThreadGroupCountX, ThreadGroupCountY, ThreadGroupCountZ);
+    }
+
+    virtual void STDMETHODCALLTYPE DispatchIndirect(ID3D11Buffer *pBufferForArgs, UINT AlignedByteOffsetForArgs)
+    {
+        FlushPendingUpdates(this);
+        super::DispatchIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+    }
+
+    virtual void STDMETHODCALLTYPE CopySubresourceRegion(
+        ID3D11Resource *pDstResource,
+        UINT DstSubresource,
+        UINT DstX,
+        UINT DstY,
+        UINT DstZ,
+        ID3D11Resource *pSrcResource,
+        UINT SrcSubresource,
+        const D3D11_BOX *pSrcBox)
+    {
+        FlushPendingUpdates(this);
+        super::CopySubresourceRegion(pDstResource, DstSubresource, DstX, DstY, DstZ, pSrcResource, SrcSubresource, pSrcBox);
+    }
+
+    virtual void STDMETHODCALLTYPE CopyResource(ID3D11Resource *pDstResource, ID3D11Resource *pSrcResource)
+    {
+        FlushPendingUpdates(this);
+        super::CopyResource(pDstResource, pSrcResource);
+    }
+
+    virtual void STDMETHODCALLTYPE CopyStructureCount(ID3D11Buffer *pDstBuffer, UINT DstAlignedByteOffset, ID3D11UnorderedAccessView *pSrcView)
+    {
+        FlushPendingUpdates(this);
+        super::CopyStructureCount(pDstBuffer, DstAlignedByteOffset, pSrcView);
+    }
+
+    virtual void STDMETHODCALLTYPE ResolveSubresource(ID3D11Resource *pDstResource, UINT DstSubresource, ID3D11Resource *pSrcResource, UINT SrcSubresource, DXGI_FORMAT Format)
+    {
+        FlushPendingUpdates(this);
+        super::ResolveSubresource(pDstResource, DstSubresource, pSrcResource, SrcSubresource, Format);
+    }
+
+    virtual void STDMETHODCALLTYPE ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView *pUnorderedAccessView, const UINT Values[4])
+    {
+        FlushPendingUpdates(this);
+        super::ClearUnorderedAccessViewUint(pUnorderedAccessView, Values);
+    }
+
+    virtual void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat(ID3D11UnorderedAccessView *pUnorderedAccessView, const FLOAT Values[4])
+    {
+        FlushPendingUpdates(this);
+        super::ClearUnorderedAccessViewFloat(pUnorderedAccessView, Values);
+    }
+
+    virtual void STDMETHODCALLTYPE GenerateMips(ID3D11ShaderResourceView *pShaderResourceView)
+    {
+        FlushPendingUpdates(this);
+        super::GenerateMips(pShaderResourceView);
+    }
+
+    virtual void STDMETHODCALLTYPE ExecuteCommandList(ID3D11CommandList *pCommandList, BOOL RestoreContextState)
+    {
+        FlushPendingUpdates(this);
+        super::ExecuteCommandList(pCommandList, RestoreContextState);
+    }
+
+    virtual void STDMETHODCALLTYPE Flush(void)
+    {
+        FlushPendingUpdates(this);
+        super::Flush();
+    }
+};
+
+class SwapChainUpdateCoalescer : public DXGISwapChainHook
+{
+typedef DXGISwapChainHook super;
+public:
+    virtual HRESULT STDMETHODCALLTYPE Present(
+        UINT SyncInterval,
+        UINT Flags)
+    {
+        FlushPendingUpdates(g_context);
+        return super::Present(SyncInterval, Flags);
+    }
+};
+
+
+bool _D3D11UpdateCoalescerInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, size_t upload_size)
+{
+    if(g_device!=NULL) { return false; }
+
+    // 転送元にするだけなので bind flag は何でもよいが、D3D11.0 で D3D11_MAP_WRITE_NO_OVERWRITE できる vertex buffer にしておく
+    D3D11_BUFFER_DESC desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.ByteWidth = UINT(upload_size);
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    if(FAILED(pDevice->CreateBuffer(&desc, NULL, &g_upload))) {
+        return false;
+    }
+
+    g_swapchain = pSwapChain;
+    g_device = pDevice;
+    pDevice->GetImmediateContext(&g_context);
+    g_upload_size = upload_size;
+    g_upload_head = upload_size; // 最初の Map() は D3D11_MAP_WRITE_DISCARD にする
+    D3D11SetHook<SwapChainUpdateCoalescer>(pSwapChain);
+    D3D11SetHook<DeviceContextUpdateCoalescer>(g_context);
+    return true;
+}
+
+void _D3D11UpdateCoalescerFinalize()
+{
+    if(g_device==NULL) { return; }
+
+    FlushPendingUpdates(g_context);
+
+    ScopedLock lock(g_mutex);
+    D3D11RemoveHook<SwapChainUpdateCoalescer>(g_swapchain);
+    D3D11RemoveHook<DeviceContextUpdateCoalescer>(g_context);
+    g_upload->Release();
+    g_upload = NULL;
+    g_context->Release();
+    g_context = NULL;
+    g_swapchain = NULL;
+    g_device = NULL;
+
+    g_updates = g_copies = g_passthrough = g_flushes = 0;
+    g_bytes_submitted = g_bytes_uploaded = 0;
+}
+
+void _D3D11UpdateCoalescerGetStats(D3D11UpdateCoalescerStats &out)
+{
+    ScopedLock lock(g_mutex);
+    out.updates         = g_updates;
+    out.copies          = g_copies;
+    out.copies_saved    = g_updates>g_copies ? g_updates-g_copies : 0;
+    out.passthrough     = g_passthrough;
+    out.flushes         = g_flushes;
+    out.bytes_submitted = g_bytes_submitted;
+    out.bytes_uploaded  = g_bytes_uploaded;
+}
+
+void _D3D11UpdateCoalescerPrintStats()
+{
+    D3D11UpdateCoalescerStats stats;
+    _D3D11UpdateCoalescerGetStats(stats);
+
+    char buf[512];
+    sprintf_s(buf, "D3D11UpdateCoalescerPrintStats(): Updates=%Iu Copies=%Iu CopiesSaved=%Iu Passthrough=%Iu Flushes=%Iu Submitted=%Iu bytes Uploaded=%Iu bytes\n",
+        stats.updates, stats.copies, stats.copies_saved, stats.passthrough, stats.flushes, stats.bytes_submitted, stats.bytes_uploaded);
+    OutputDebugStringA(buf);
+}
@@ -0,0 +1,56 @@
+﻿#ifndef _ist_D3D11UpdateCoalescer_h_
+#define _ist_D3D11UpdateCoalescer_h_
+#include <D3D11.h>
+
+// immediate context の UpdateSubresource() を、描画や Dispatch などを挟まない間だけ溜めておき、
+// 同じバッファへの隣接/重複する範囲をまとめてからアップロードします。
+// まとめた範囲は常駐するアップロード用バッファ (D3D11_USAGE_DYNAMIC) に書き込み、CopySubresourceRegion() で転送します。
+// 重複した範囲は後から書かれた内容が優先されるので、結果は UpdateSubresource() を順に呼んだ場合と同じになります。
+//
+// 対象は D3D11_USAGE_DEFAULT のバッファ (constant buffer を除く) です。テクスチャなどはそのまま UpdateSubresource() します。
+// Draw*() / Dispatch*() / Copy*() / ResolveSubresource() / ClearUnorderedAccessView*() / GenerateMips() / ExecuteCommandList() /
+// Flush() / Present() の直前に、溜めていた更新を全て転送します。
+// D3D11UpdateCoalescerPrintStats() で、省けたコピーの数と転送したバイト数を表示できます。
+//
+// 有効にするには、このファイルを include する前に D3D11UPDATECOALESCER_ENABLE を define しておく必要があります。
+// D3D11UPDATECOALESCER_ENABLE を define しなかった場合、API は空の定義に置き換えられます。
+
+
+// アップロード用バッファのサイズ。溜めている更新がこれを超えたら、その時点で転送します
+#ifndef D3D11UPDATECOALESCER_DEFAULT_UPLOAD_SIZE
+#define D3D11UPDATECOALESCER_DEFAULT_UPLOAD_SIZE (4*1024*1024)
+#endif
+
+struct D3D11UpdateCoalescerStats
+{
+    size_t updates;         // 溜めた UpdateSubresource() の回数
+    size_t copies;          // 実際に行った CopySubresourceRegion() の回数
+    size_t copies_saved;    // updates - copies
+    size_t passthrough;     // 対象外でそのまま UpdateSubresource() した回数
+    size_t flushes;
+    size_t bytes_submitted; // アプリが UpdateSubresource() に渡したバイト数
+    size_t bytes_uploaded;  // 重複を除いて実際に転送したバイト数
+};
+
+#ifdef D3D11UPDATECOALESCER_ENABLE
+
+bool _D3D11UpdateCoalescerInitialize(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice, size_t upload_size=D3D11UPDATECOALESCER_DEFAULT_UPLOAD_SIZE);
+void _D3D11UpdateCoalescerFinalize();
+void _D3D11UpdateCoalescerGetStats(D3D11UpdateCoalescerStats &out);
+void _D3D11UpdateCoalescerPrintStats();
+
+#define D3D11UpdateCoalescerInitialize(...) _D3D11UpdateCoalescerInitialize(__VA_ARGS__)
+#define D3D11UpdateCoalescerFinalize()      _D3D11UpdateCoalescerFinalize()
+#define D3D11UpdateCoalescerGetStats(...)   _D3D11UpdateCoalescerGetStats(__VA_ARGS__)
+#define D3D11UpdateCoalescerPrintStats()    _D3D11UpdateCoalescerPrintStats()
+
+#else // D3D11UPDATECOALESCER_ENABLE
+
+#define D3D11UpdateCoalescerInitialize(...)
+#define D3D11UpdateCoalescerFinalize()
+#define D3D11UpdateCoalescerGetStats(...)
+#define D3D11UpdateCoalescerPrintStats()
+
+#endif // D3D11UPDATECOALESCER_ENABLE
+
+#endif // _ist_D3D11UpdateCoalescer_h_
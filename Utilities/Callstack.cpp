@@ -1,5 +1,8 @@
 ﻿#include "Callstack.h"
+#include "Hash.h"
+#include "Module.h"
 #include <windows.h>
+#include <intrin.h>
 #include <imagehlp.h>
 
 #pragma comment(lib, "imagehlp.lib")
@@ -21,12 +24,104 @@ void FinalizeSymbol()
 }
 
 
-int GetCallstack(void **callstack, int callstack_size, int skip_size)
+int GetCallstack(void **callstack, int callstack_size, int skip_size, uint64_t *out_hash)
 {
-    return CaptureStackBackTrace(skip_size, callstack_size, callstack, NULL);
+    int n = CaptureStackBackTrace(skip_size, callstack_size, callstack, NULL);
+    if(out_hash!=NULL) {
+        uint64_t hash = c_hash_seed;
+        for(int i=0; i<n; ++i) {
+            hash = HashCombine(hash, (size_t)callstack[i]);
+        }
+        *out_hash = hash;
+    }
+    return n;
 }
 
-std::string AddressToSymbolName(void *address)
+#pragma optimize("y", off) // この関数自体も frame pointer を持つ必要がある
+int GetCallstackFP(void **callstack, int callstack_size, int skip_size, uint64_t *out_hash)
+{
+#if defined(_M_IX86)
+    // [ebp] = 呼び出し元の ebp、[ebp+4] = return address
+    // GetCallstack() と揃えるため skip_size は GetCallstackFP() 自身のフレームを含めて数える。
+    // (自身のフレームは return address を持たないので、skip_size==0 でも出力されない)
+    NT_TIB *tib = (NT_TIB*)::NtCurrentTeb();
+    void **frame = (void**)_AddressOfReturnAddress() - 1;
+    uint64_t hash = c_hash_seed;
+    int n = 0;
+    if(skip_size>0) { --skip_size; }
+    if(skip_size>0) { --skip_size; }
+    else if(n<callstack_size) {
+        callstack[n++] = _ReturnAddress();
+        hash = HashCombine(hash, (size_t)callstack[0]);
+    }
+    while(n<callstack_size) {
+        void **next = (void**)frame[0];
+        // スタックの範囲外やアドレスが逆行していたら frame pointer が壊れている (省略されている) とみなして打ち切る
+        if(next<=frame || (void*)next<tib->StackLimit || (void*)(next+2)>tib->StackBase || ((size_t)next&3)!=0) {
+            break;
+        }
+        frame = next;
+        void *ret = frame[1];
+        if(ret==NULL) { break; }
+        if(skip_size>0) {
+            --skip_size;
+            continue;
+        }
+        callstack[n++] = ret;
+        hash = HashCombine(hash, (size_t)ret);
+    }
+    if(out_hash!=NULL) { *out_hash = hash; }
+    return n;
+#else
+    return GetCallstack(callstack, callstack_size, skip_size+1, out_hash);
+#endif
+}
+#pragma optimize("", on)
+
+int FilterCallstack(void **callstack, int callstack_size, uint64_t *io_hash)
+{
+    ModuleIndex &index = ModuleIndex::getInstance();
+    const ModuleRangeTable &table = index.getTable();
+    int n = 0;
+    index.lock();
+    for(int i=0; i<callstack_size; ++i) {
+        const ModuleRange *m = table.find(callstack[i]);
+        if(m==NULL || (m->flags & MODULE_FLAG_CALLSTACK_FILTERED)==0) {
+            callstack[n++] = callstack[i];
+        }
+    }
+    index.unlock();
+
+    if(io_hash!=NULL && n!=callstack_size) {
+        uint64_t hash = c_hash_seed;
+        for(int i=0; i<n; ++i) {
+            hash = HashCombine(hash, (size_t)callstack[i]);
+        }
+        *io_hash = hash;
+    }
+    return n;
+}
+
+bool DbgHelpSymbolResolver::findModule(void *address, SymbolModuleKey &out_key, size_t &out_base)
+{
+    // DbgHelp を使わず、モジュールの索引と PE ヘッダからモジュールを識別する情報を得る
+    ModuleRange module;
+    if(!ModuleIndex::getInstance().findModule(address, module)) {
+        return false;
+    }
+    IMAGE_DOS_HEADER *dos_header = (IMAGE_DOS_HEADER*)module.begin;
+    IMAGE_NT_HEADERS *nt_header = (IMAGE_NT_HEADERS*)(module.begin + dos_header->e_lfanew);
+    char name[MAX_PATH];
+    ::WideCharToMultiByte(CP_ACP, 0, module.name.c_str(), -1, name, _countof(name), NULL, NULL);
+
+    out_key.name = name;
+    out_key.timestamp = nt_header->FileHeader.TimeDateStamp;
+    out_key.checksum = nt_header->OptionalHeader.CheckSum;
+    out_base = module.begin;
+    return true;
+}
+
+bool DbgHelpSymbolResolver::resolve(void *address, ResolvedSymbol &out)
 {
 #ifdef _WIN64
     typedef DWORD64 DWORDX;
@@ -36,7 +131,6 @@ std::string AddressToSymbolName(void *address)
     typedef PDWORD PDWORDX;
 #endif
 
-    char buf[1024];
     HANDLE process = ::GetCurrentProcess();
     IMAGEHLP_MODULE imageModule = { sizeof(IMAGEHLP_MODULE) };
     IMAGEHLP_LINE line ={sizeof(IMAGEHLP_LINE)};
@@ -49,26 +143,79 @@ std::string AddressToSymbolName(void *address)
     imageSymbol->MaxNameLength = MAX_PATH;
 
     if(!::SymGetModuleInfo(process, (DWORDX)address, &imageModule)) {
+        return false;
+    }
+    out.module = imageModule.ModuleName;
+    if(!::SymGetSymFromAddr(process, (DWORDX)address, &dispSym, imageSymbol)) {
+        out.offset = (size_t)address-(size_t)imageModule.BaseOfImage;
+        return true;
+    }
+    out.function = imageSymbol->Name;
+    out.offset = (size_t)address-(size_t)imageSymbol->Address;
+    if(::SymGetLineFromAddr(process, (DWORDX)address, &dispLine, &line)) {
+        out.file = line.FileName;
+        out.line = line.LineNumber;
+    }
+    return true;
+}
+
+namespace {
+Mutex g_symbol_mutex;
+} // namespace
+
+Mutex& GetSymbolCacheMutex()
+{
+    return g_symbol_mutex;
+}
+
+SymbolCache& GetSymbolCache()
+{
+    static DbgHelpSymbolResolver s_resolver;
+    static SymbolCache s_cache(&s_resolver);
+    return s_cache;
+}
+
+void ResolveAddresses(void *const *addresses, size_t num)
+{
+    ScopedLock lock(g_symbol_mutex);
+    GetSymbolCache().resolveAddresses(addresses, num);
+}
+
+std::string SymbolToString(void *address, const SymbolInfo &sym)
+{
+    char buf[1024];
+    if(sym.module[0]=='\0') {
         sprintf_s(buf, "[0x%p]\n", address);
     }
-    else if(!::SymGetSymFromAddr(process, (DWORDX)address, &dispSym, imageSymbol)) {
-        sprintf_s(buf, "%s + 0x%x [0x%p]\n", imageModule.ModuleName, ((size_t)address-(size_t)imageModule.BaseOfImage), address);
+    else if(sym.function[0]=='\0') {
+        sprintf_s(buf, "%s + 0x%x [0x%p]\n", sym.module, (size_t)sym.offset, address);
     }
-    else if(!::SymGetLineFromAddr(process, (DWORDX)address, &dispLine, &line)) {
-        sprintf_s(buf, "%s!%s + 0x%x [0x%p]\n", imageModule.ModuleName, imageSymbol->Name, ((size_t)address-(size_t)imageSymbol->Address), address);
+    else if(sym.file[0]=='\0') {
+        sprintf_s(buf, "%s!%s + 0x%x [0x%p]\n", sym.module, sym.function, (size_t)sym.offset, address);
     }
     else {
-        sprintf_s(buf, "%s(%d): %s!%s + 0x%x [0x%p]\n", line.FileName, line.LineNumber,
-            imageModule.ModuleName, imageSymbol->Name, ((size_t)address-(size_t)imageSymbol->Address), address);
+        sprintf_s(buf, "%s(%d): %s!%s + 0x%x [0x%p]\n", sym.file, sym.line,
+            sym.module, sym.function, (size_t)sym.offset, address);
     }
     return buf;
 }
 
+std::string AddressToSymbolName(void *address)
+{
+    // 返される SymbolInfo の文字列はキャッシュ内のものなので、文字列にし終えるまでロックしておく
+    ScopedLock lock(g_symbol_mutex);
+    return SymbolToString(address, GetSymbolCache().resolve(address));
+}
+
 std::string CallstackToSymbolNames(void **callstack, int callstack_size, int clamp_head, int clamp_tail, const char *indent)
 {
+    ScopedLock lock(g_symbol_mutex);
     std::string tmp;
     int begin = std::max<int>(0, clamp_head);
     int end = std::max<int>(0, callstack_size-clamp_tail);
+    if(begin<end) {
+        ResolveAddresses(callstack+begin, end-begin);
+    }
     for(int i=begin; i<end; ++i) {
         tmp += indent;
         tmp += AddressToSymbolName(callstack[i]);
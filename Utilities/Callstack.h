@@ -2,11 +2,46 @@
 #define _ist_D3DHookInterface_Utilities_Callstack_
 
 #include <string>
+#include "Lock.h"
+#include "SymbolCache.h"
 
 bool InitializeSymbol();
 void FinalizeSymbol();
 
-int GetCallstack(void **callstack, int callstack_size, int skip_size);
+/// 現在のコールスタックを取得し、取得したフレーム数を返します。
+/// skip_size: 先頭 (呼び出し元に近い側) から捨てるフレーム数。0 なら GetCallstack() 自身のフレームから
+/// out_hash: 取得したフレームの hash を返します。同じコールスタックなら同じ値になります
+int GetCallstack(void **callstack, int callstack_size, int skip_size, uint64_t *out_hash=NULL);
+
+/// frame pointer をたどってコールスタックを取得します。引数は GetCallstack() と同じです。
+/// CaptureStackBackTrace() より大幅に軽いですが、x86 で frame pointer を省略しない (/Oy-) ビルドでのみ正しく動作します。
+/// それ以外の環境では GetCallstack() と同じ動作になります。
+int GetCallstackFP(void **callstack, int callstack_size, int skip_size, uint64_t *out_hash=NULL);
+
+/// D3D11 runtime やドライバなど、MODULE_FLAG_CALLSTACK_FILTERED が付いたモジュール (Module.h の ModuleIndex 参照) 内の
+/// フレームをコールスタックから取り除き、残ったフレーム数を返します。シンボル解決はせず、フレームあたり二分探索 1 回で済みます。
+/// io_hash: 取り除いたフレームがあった場合、残ったフレームの hash に更新されます
+int FilterCallstack(void **callstack, int callstack_size, uint64_t *io_hash=NULL);
+
+/// DbgHelp でシンボル解決する ISymbolResolver
+class DbgHelpSymbolResolver : public ISymbolResolver
+{
+public:
+    virtual bool findModule(void *address, SymbolModuleKey &out_key, size_t &out_base);
+    virtual bool resolve(void *address, ResolvedSymbol &out);
+};
+
+/// AddressToSymbolName() などが使う共有のシンボルキャッシュ。resolver は DbgHelpSymbolResolver
+/// 前回の実行で save() したものを load() しておけば、同じバイナリのシンボルは DbgHelp を使わずに解決できます。
+/// 複数の layer から使われるので、直接使うときは GetSymbolCacheMutex() をロックしてください。
+SymbolCache& GetSymbolCache();
+Mutex& GetSymbolCacheMutex();
+
+/// 複数のアドレスをまとめてシンボル解決し、キャッシュしておきます
+void ResolveAddresses(void *const *addresses, size_t num);
+
+/// "file(line): module!function + 0xoffset [0xaddress]" 形式の文字列にします (末尾に改行が付きます)
+std::string SymbolToString(void *address, const SymbolInfo &sym);
 std::string AddressToSymbolName(void *address);
 
 // utility
@@ -0,0 +1,242 @@
+﻿#include <string.h>
+#include <algorithm>
+#include "ConstantBufferRing.h"
+
+namespace {
+const uint64_t c_no_allocation = ~0ULL;
+} // namespace
+
+
+ConstantBufferRing::TrackedBuffer::TrackedBuffer()
+    : num_constants(0)
+    , offset(c_no_allocation)
+    , mapped(false)
+    , excluded(false)
+{
+    memset(bound_slots, 0, sizeof(bound_slots));
+}
+
+ConstantBufferRing::ConstantBufferRing(IConstantBufferRingContext *ctx, uint64_t ring_size, size_t frame_latency)
+    : m_ctx(ctx)
+    , m_frame_latency(frame_latency)
+    , m_ring_size(ring_size)
+    , m_head(0)
+    , m_tail(0)
+    , m_num_excluded(0)
+    , m_redirected(0)
+    , m_fallbacks(0)
+    , m_rebinds(0)
+    , m_frame_begin(0)
+    , m_frame_bytes(0)
+    , m_peak_frame_bytes(0)
+{
+    memset(m_bound, 0, sizeof(m_bound));
+}
+
+void ConstantBufferRing::addBuffer(void *buffer, size_t byte_width)
+{
+    if(m_buffers.find(buffer)!=m_buffers.end()) { return; }
+    TrackedBuffer &tb = m_buffers[buffer];
+    tb.num_constants = unsigned((byte_width/16+15) & ~size_t(15));
+    tb.data.resize(tb.num_constants*16);
+}
+
+void ConstantBufferRing::removeBuffer(void *buffer)
+{
+    TrackedBuffers::iterator i = m_buffers.find(buffer);
+    if(i==m_buffers.end()) { return; }
+    if(i->second.excluded) { --m_num_excluded; }
+    unbind(buffer, i->second);
+    m_buffers.erase(i);
+}
+
+bool ConstantBufferRing::isTracked(void *buffer) const
+{
+    return m_buffers.find(buffer)!=m_buffers.end();
+}
+
+void ConstantBufferRing::getTrackedBuffers(std::vector<void*> &out) const
+{
+    out.clear();
+    for(TrackedBuffers::const_iterator i=m_buffers.begin(); i!=m_buffers.end(); ++i) {
+        out.push_back(i->first);
+    }
+}
+
+// ring buffer から size byte 切り出し、offset を返します。frame_latency フレーム以内の領域とぶつかる場合は失敗します
+bool ConstantBufferRing::allocate(uint64_t size, uint64_t &out_offset)
+{
+    uint64_t pos = m_head % m_ring_size;
+    uint64_t pad = pos+size > m_ring_size ? m_ring_size-pos : 0; // 末尾をまたぐ場合は先頭から
+    if(m_head+pad+size-m_tail > m_ring_size) { return false; }
+    m_head += pad;
+    out_offset = m_head % m_ring_size;
+    m_head += size;
+    return true;
+}
+
+// ring buffer に置き換えていたバッファを本来のバッファに戻します。最新の内容はコピーにしか無いので書き戻します
+void ConstantBufferRing::writeBack(void *buffer, TrackedBuffer &tb)
+{
+    if(tb.offset==c_no_allocation) { return; }
+    m_ctx->writeBuffer(buffer, tb.data.data(), unsigned(tb.data.size()));
+    tb.offset = c_no_allocation;
+    rebind(buffer, tb);
+}
+
+// buffer がバインドされている全スロットを、現在の位置に合わせてバインドし直します
+void ConstantBufferRing::rebind(void *buffer, const TrackedBuffer &tb)
+{
+    for(int s=0; s<CBRING_STAGES; ++s) {
+        for(unsigned slot=0; tb.bound_slots[s]!=0 && slot<CBRING_SLOTS; ++slot) {
+            if((tb.bound_slots[s] & (1<<slot))==0) { continue; }
+            if(tb.offset!=c_no_allocation) {
+                m_ctx->bindRing(s, slot, tb.offset, tb.num_constants);
+                ++m_rebinds;
+            }
+            else {
+                m_ctx->bindBuffer(s, slot, buffer);
+            }
+        }
+    }
+}
+
+void ConstantBufferRing::unbind(void *buffer, TrackedBuffer &tb)
+{
+    for(int s=0; s<CBRING_STAGES; ++s) {
+        for(unsigned slot=0; tb.bound_slots[s]!=0 && slot<CBRING_SLOTS; ++slot) {
+            if((tb.bound_slots[s] & (1<<slot))!=0 && m_bound[s][slot]==buffer) {
+                m_bound[s][slot] = NULL;
+            }
+        }
+        tb.bound_slots[s] = 0;
+    }
+}
+
+CBRING_MAP_RESULT ConstantBufferRing::map(void *buffer, CBRING_MAP_TYPE type, char *&out_data, unsigned &out_pitch)
+{
+    TrackedBuffers::iterator i = m_buffers.find(buffer);
+    if(i==m_buffers.end() || i->second.excluded || i->second.mapped) { return CBRING_PASS_THROUGH; }
+    TrackedBuffer &tb = i->second;
+    // 本来のバッファを使っている間は、コピーに前回の内容が無い
+    if(type==CBRING_MAP_OTHER || (type==CBRING_MAP_WRITE_NO_OVERWRITE && tb.offset==c_no_allocation)) {
+        return CBRING_PASS_THROUGH;
+    }
+
+    uint64_t offset;
+    if(!allocate(tb.num_constants*16, offset)) {
+        // 空きが無いので本来のバッファで。NO_OVERWRITE なら前回の内容を書き戻しておく
+        ++m_fallbacks;
+        if(type==CBRING_MAP_WRITE_NO_OVERWRITE) {
+            writeBack(buffer, tb);
+        }
+        else if(tb.offset!=c_no_allocation) {
+            tb.offset = c_no_allocation;
+            rebind(buffer, tb);
+        }
+        return CBRING_PASS_THROUGH;
+    }
+    // 以前の領域は GPU が使っている可能性があるので、NO_OVERWRITE でも新しい領域に書く
+    tb.offset = offset;
+    tb.mapped = true;
+    out_data = &tb.data[0];
+    out_pitch = tb.num_constants*16;
+    ++m_redirected;
+    return CBRING_REDIRECTED;
+}
+
+bool ConstantBufferRing::unmap(void *buffer)
+{
+    TrackedBuffers::iterator i = m_buffers.find(buffer);
+    if(i==m_buffers.end() || !i->second.mapped) { return false; }
+    TrackedBuffer &tb = i->second;
+    tb.mapped = false;
+
+    char *ring = tb.excluded ? NULL : m_ctx->mapRing();
+    if(ring==NULL) {
+        // Map 中に置き換え対象から外されたか、ring buffer の Map に失敗した
+        writeBack(buffer, tb);
+        return true;
+    }
+    memcpy(ring+tb.offset, tb.data.data(), tb.data.size());
+    m_ctx->unmapRing();
+    rebind(buffer, tb);
+    return true;
+}
+
+void ConstantBufferRing::exclude(void *buffer)
+{
+    TrackedBuffers::iterator i = m_buffers.find(buffer);
+    if(i==m_buffers.end() || i->second.excluded) { return; }
+    TrackedBuffer &tb = i->second;
+    tb.excluded = true;
+    ++m_num_excluded;
+    // Map 中なら Unmap() で書き戻す
+    if(!tb.mapped) {
+        writeBack(buffer, tb);
+    }
+}
+
+void ConstantBufferRing::setConstantBuffers(int stage, unsigned start_slot, unsigned num_buffers, void *const *buffers)
+{
+    if(start_slot>=CBRING_SLOTS) { return; }
+    num_buffers = std::min<unsigned>(num_buffers, CBRING_SLOTS-start_slot);
+
+    for(unsigned i=0; i<num_buffers; ++i) {
+        unsigned slot = start_slot+i;
+        void *&bound = m_bound[stage][slot];
+        if(bound!=NULL) {
+            m_buffers[bound].bound_slots[stage] &= ~(1<<slot);
+            bound = NULL;
+        }
+
+        void *buffer = buffers!=NULL ? buffers[i] : NULL;
+        TrackedBuffers::iterator t = buffer!=NULL ? m_buffers.find(buffer) : m_buffers.end();
+        if(t==m_buffers.end()) { continue; }
+        TrackedBuffer &tb = t->second;
+        bound = buffer;
+        tb.bound_slots[stage] |= 1<<slot;
+        // Map 中のものは Unmap() でバインドする
+        if(tb.offset!=c_no_allocation && !tb.mapped) {
+            m_ctx->bindRing(stage, slot, tb.offset, tb.num_constants);
+            ++m_rebinds;
+        }
+    }
+}
+
+void* ConstantBufferRing::getBoundBuffer(int stage, unsigned slot) const
+{
+    return slot<CBRING_SLOTS ? m_bound[stage][slot] : NULL;
+}
+
+void ConstantBufferRing::clearBindings()
+{
+    for(TrackedBuffers::iterator i=m_buffers.begin(); i!=m_buffers.end(); ++i) {
+        memset(i->second.bound_slots, 0, sizeof(i->second.bound_slots));
+    }
+    memset(m_bound, 0, sizeof(m_bound));
+}
+
+void ConstantBufferRing::endFrame()
+{
+    m_frame_bytes = size_t(m_head-m_frame_begin);
+    m_peak_frame_bytes = std::max<size_t>(m_peak_frame_bytes, m_frame_bytes);
+    m_frame_begin = m_head;
+
+    m_fences.push_back(m_head);
+    while(m_fences.size()>m_frame_latency) {
+        m_tail = m_fences.front();
+        m_fences.pop_front();
+    }
+}
+
+void ConstantBufferRing::restore()
+{
+    // Map 中のものは、この後アプリが本来のバッファを Unmap() することになるので何もできません
+    for(TrackedBuffers::iterator i=m_buffers.begin(); i!=m_buffers.end(); ++i) {
+        if(!i->second.mapped) {
+            writeBack(i->first, i->second);
+        }
+    }
+    clearBindings();
+}
@@ -0,0 +1,129 @@
+﻿#ifndef _ist_D3DHookInterface_Utilities_ConstantBufferRing_h_
+#define _ist_D3DHookInterface_Utilities_ConstantBufferRing_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// D3D11ConstantBufferRing の、ring buffer からの切り出しと置き換え中の constant buffer の管理。
+// ring buffer の Map/Unmap とバインドは IConstantBufferRingContext 経由で行うので、D3D に依存せず、
+// 偽の context を渡せば任意の環境で動作を確かめられます。
+// 置き換えた Map() では、アプリはバッファごとの CPU 側のコピーに書き込み、Unmap() でそれを ring buffer に書き写します。
+// コピーには常に最新の内容があるので、置き換え対象から外す際に本来のバッファへ書き戻せます。
+
+
+#define CBRING_STAGES   6   // VS HS DS GS PS CS
+#define CBRING_SLOTS    14  // D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT
+
+enum CBRING_MAP_TYPE {
+    CBRING_MAP_WRITE_DISCARD,
+    CBRING_MAP_WRITE_NO_OVERWRITE,
+    CBRING_MAP_OTHER,
+};
+
+enum CBRING_MAP_RESULT {
+    // ring buffer に置き換えた。返したアドレスに書き込む
+    CBRING_REDIRECTED,
+    // 本来のバッファを Map する
+    CBRING_PASS_THROUGH,
+};
+
+class IConstantBufferRingContext
+{
+public:
+    virtual ~IConstantBufferRingContext() {}
+    /// ring buffer を D3D11_MAP_WRITE_NO_OVERWRITE で Map し、先頭のアドレスを返します。失敗したら NULL
+    virtual char* mapRing()=0;
+    virtual void unmapRing()=0;
+    /// 本来のバッファを D3D11_MAP_WRITE_DISCARD で Map し、data を書き込みます
+    virtual void writeBuffer(void *buffer, const char *data, unsigned size)=0;
+    /// stage の slot に、ring buffer の offset (byte) から num_constants 個 (16 byte 単位) をバインドします
+    virtual void bindRing(int stage, unsigned slot, uint64_t offset, unsigned num_constants)=0;
+    /// stage の slot に本来のバッファをバインドします
+    virtual void bindBuffer(int stage, unsigned slot, void *buffer)=0;
+};
+
+class ConstantBufferRing
+{
+public:
+    ConstantBufferRing(IConstantBufferRingContext *ctx, uint64_t ring_size, size_t frame_latency);
+
+    /// 置き換え対象にします。byte_width は *SetConstantBuffers1() の制約で 256 byte 単位に切り上げて扱います
+    void addBuffer(void *buffer, size_t byte_width);
+    /// 解放された
+    void removeBuffer(void *buffer);
+    bool isTracked(void *buffer) const;
+    void getTrackedBuffers(std::vector<void*> &out) const;
+
+    /// Map() の置き換え。CBRING_REDIRECTED なら out_data に書き込み先 (CPU 側のコピー)、out_pitch にサイズを返します。
+    /// D3D11_MAP_WRITE_NO_OVERWRITE も、コピーに前回の内容が残っているので新しい領域に切り出します
+    CBRING_MAP_RESULT map(void *buffer, CBRING_MAP_TYPE type, char *&out_data, unsigned &out_pitch);
+    /// Unmap() の置き換え。置き換えた Map() だったらコピーを ring buffer に書き写して true を返します。false なら本来のバッファを Unmap します
+    bool unmap(void *buffer);
+    /// 以後置き換え対象から外し、最新の内容を本来のバッファに書き戻して、バインドも本来のバッファに戻します。
+    /// 本来のバッファの内容が必要になる使い方 (コピー元や deferred context) を検出したときに呼びます
+    void exclude(void *buffer);
+
+    /// *SetConstantBuffers() の後に呼びます。本来のバッファは呼び出し側でバインド済みで、ring buffer に置き換え中のものだけ上書きします
+    void setConstantBuffers(int stage, unsigned start_slot, unsigned num_buffers, void *const *buffers);
+    /// アプリがバインドした置き換え対象のバッファ。無ければ NULL
+    void* getBoundBuffer(int stage, unsigned slot) const;
+    /// ClearState() などでバインドが外れた
+    void clearBindings();
+    /// Present() で呼びます。frame_latency フレーム前までに切り出した領域を再利用可能にします
+    void endFrame();
+    /// 全てのバッファの最新の内容を本来のバッファに書き戻し、置き換えていたスロットを本来のバッファに戻します
+    void restore();
+
+    size_t getNumTracked() const        { return m_buffers.size(); }
+    size_t getNumExcluded() const       { return m_num_excluded; }
+    size_t getRedirected() const        { return m_redirected; }
+    size_t getFallbacks() const         { return m_fallbacks; }
+    size_t getRebinds() const           { return m_rebinds; }
+    uint64_t getRingSize() const        { return m_ring_size; }
+    size_t getFrameBytes() const        { return m_frame_bytes; }
+    size_t getPeakFrameBytes() const    { return m_peak_frame_bytes; }
+
+private:
+    struct TrackedBuffer
+    {
+        unsigned num_constants; // 16 byte 単位
+        uint64_t offset;        // ring buffer 内の現在の位置 (byte)。c_no_allocation なら本来のバッファを使う
+        bool mapped;            // 置き換えた Map() の最中
+        bool excluded;
+        uint16_t bound_slots[CBRING_STAGES]; // バインドされているスロットの bit
+        std::string data;       // CPU 側のコピー。offset が有効な間は最新の内容
+
+        TrackedBuffer();
+    };
+    typedef std::map<void*, TrackedBuffer> TrackedBuffers;
+
+    bool allocate(uint64_t size, uint64_t &out_offset);
+    void writeBack(void *buffer, TrackedBuffer &tb);
+    void rebind(void *buffer, const TrackedBuffer &tb);
+    void unbind(void *buffer, TrackedBuffer &tb);
+
+    IConstantBufferRingContext *m_ctx;
+    TrackedBuffers m_buffers;
+    void *m_bound[CBRING_STAGES][CBRING_SLOTS];
+    size_t m_frame_latency;
+
+    // 位置は単調増加のカウンタで持ち、% m_ring_size で実際の offset にします
+    uint64_t m_ring_size;
+    uint64_t m_head;
+    uint64_t m_tail;
+    std::deque<uint64_t> m_fences;  // 各フレーム終了時の m_head
+
+    size_t m_num_excluded;
+    size_t m_redirected;
+    size_t m_fallbacks;
+    size_t m_rebinds;
+    uint64_t m_frame_begin;
+    size_t m_frame_bytes;
+    size_t m_peak_frame_bytes;
+};
+
+#endif // _ist_D3DHookInterface_Utilities_ConstantBufferRing_h_
@@ -0,0 +1,145 @@
+﻿#define _CRT_SECURE_NO_WARNINGS
+#include <string.h>
+#include <algorithm>
+#include "EvictionPolicy.h"
+
+namespace {
+
+struct PendingChange
+{
+    EvictionChange change;
+    uint64_t bytes;
+};
+
+bool GreaterBytes(const PendingChange &a, const PendingChange &b)
+{
+    return a.bytes > b.bytes;
+}
+
+} // namespace
+
+
+LRUEvictionPolicy::LRUEvictionPolicy()
+    : m_pressure(0.9)
+    , m_cold_frames(600)
+    , m_hot_frames(2)
+{
+}
+
+uint32_t LRUEvictionPolicy::getPriority(const EvictionResource &res, const EvictionState &state)
+{
+    if(double(state.usage) <= double(state.budget)*m_pressure) {
+        return EVICTION_PRIORITY_NORMAL;
+    }
+
+    uint64_t idle = GetIdleFrames(res, state.frame);
+    if(idle >= m_cold_frames)                   { return EVICTION_PRIORITY_MINIMUM; }
+    if(idle >= m_cold_frames/4)                 { return EVICTION_PRIORITY_LOW; }
+    if(res.use_count>0 && idle <= m_hot_frames) { return EVICTION_PRIORITY_HIGH; }
+    return EVICTION_PRIORITY_NORMAL;
+}
+
+uint64_t GetIdleFrames(const EvictionResource &res, uint64_t frame)
+{
+    uint64_t last = res.use_count>0 ? res.last_used_frame : res.create_frame;
+    return frame>last ? frame-last : 0;
+}
+
+size_t PlanEvictionPriorities(const std::vector<EvictionResource> &resources, const EvictionState &state,
+    IEvictionPolicy &policy, size_t max_changes, std::vector<EvictionChange> &out)
+{
+    std::vector<PendingChange> pending;
+    for(size_t i=0; i<resources.size(); ++i) {
+        const EvictionResource &res = resources[i];
+        uint32_t priority = policy.getPriority(res, state);
+        if(priority!=res.priority) {
+            PendingChange c = {{res.id, priority}, res.bytes};
+            pending.push_back(c);
+        }
+    }
+
+    // 影響の大きいものから変える。残りは次の見直しで
+    std::stable_sort(pending.begin(), pending.end(), GreaterBytes);
+    size_t n = std::min<size_t>(pending.size(), max_changes);
+    for(size_t i=0; i<n; ++i) {
+        out.push_back(pending[i].change);
+    }
+    return pending.size();
+}
+
+
+EvictionTraceWriter::EvictionTraceWriter()
+    : m_file(NULL)
+{
+}
+
+EvictionTraceWriter::~EvictionTraceWriter()
+{
+    close();
+}
+
+bool EvictionTraceWriter::open(const char *path)
+{
+    close();
+    m_file = fopen(path, "w");
+    if(m_file==NULL) { return false; }
+    setvbuf(m_file, NULL, _IOFBF, 1024*1024);
+    return true;
+}
+
+void EvictionTraceWriter::close()
+{
+    if(m_file!=NULL) {
+        fclose(m_file);
+        m_file = NULL;
+    }
+}
+
+void EvictionTraceWriter::write(const EvictionState &state, const std::vector<EvictionResource> &resources)
+{
+    if(m_file==NULL) { return; }
+
+    fprintf(m_file, "frame %llu %llu %llu\n",
+        (unsigned long long)state.frame, (unsigned long long)state.budget, (unsigned long long)state.usage);
+    for(size_t i=0; i<resources.size(); ++i) {
+        const EvictionResource &r = resources[i];
+        fprintf(m_file, "r %llu %llu %llu %llu %llu\n",
+            (unsigned long long)r.id, (unsigned long long)r.bytes, (unsigned long long)r.create_frame,
+            (unsigned long long)r.last_used_frame, (unsigned long long)r.use_count);
+    }
+}
+
+
+bool ReadEvictionTrace(const char *path, std::vector<EvictionSnapshot> &out)
+{
+    FILE *f = fopen(path, "r");
+    if(f==NULL) { return false; }
+
+    bool ok = true;
+    char line[256];
+    while(ok && fgets(line, sizeof(line), f)!=NULL) {
+        unsigned long long v[5];
+        if(strncmp(line, "frame ", 6)==0) {
+            ok = sscanf(line+6, "%llu %llu %llu", &v[0], &v[1], &v[2])==3;
+            if(ok) {
+                out.push_back(EvictionSnapshot());
+                EvictionState &s = out.back().state;
+                s.frame = v[0];
+                s.budget = v[1];
+                s.usage = v[2];
+            }
+        }
+        else if(strncmp(line, "r ", 2)==0) {
+            ok = !out.empty() && sscanf(line+2, "%llu %llu %llu %llu %llu", &v[0], &v[1], &v[2], &v[3], &v[4])==5;
+            if(ok) {
+                EvictionResource r = {v[0], v[1], v[2], v[3], v[4], EVICTION_PRIORITY_NORMAL};
+                out.back().resources.push_back(r);
+            }
+        }
+        else if(line[0]!='\n' && line[0]!='#') {
+            ok = false;
+        }
+    }
+    fclose(f);
+    return ok;
+}
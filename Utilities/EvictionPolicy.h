@@ -0,0 +1,111 @@
+﻿#ifndef _ist_D3DHookInterface_Utilities_EvictionPolicy_h_
+#define _ist_D3DHookInterface_Utilities_EvictionPolicy_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// リソースの使用状況から eviction priority (ID3D11Resource::SetEvictionPriority()) を決めるロジック。
+// 方針は IEvictionPolicy を継承して差し替えられます。
+// OS や D3D に依存しないので、記録した使用状況のトレース (EvictionTraceWriter) を
+// Tools/EvictionSimTool で再生して、任意の環境で方針を比較できます。
+
+
+// DXGI_RESOURCE_PRIORITY_* と同じ値。int に収まらないものがあるので enum にはしない
+const uint32_t EVICTION_PRIORITY_MINIMUM = 0x28000000;
+const uint32_t EVICTION_PRIORITY_LOW     = 0x50000000;
+const uint32_t EVICTION_PRIORITY_NORMAL  = 0x78000000;
+const uint32_t EVICTION_PRIORITY_HIGH    = 0xa0000000;
+const uint32_t EVICTION_PRIORITY_MAXIMUM = 0xc8000000;
+
+struct EvictionResource
+{
+    uint64_t id;
+    uint64_t bytes;
+    uint64_t create_frame;
+    uint64_t last_used_frame;   // use_count==0 なら意味を持たない
+    uint64_t use_count;         // 使われたフレーム数
+    uint32_t priority;          // 現在設定している priority
+};
+
+struct EvictionState
+{
+    uint64_t frame;
+    uint64_t budget;    // 使ってよいビデオメモリ量 (byte)
+    uint64_t usage;     // 記録しているリソースの合計サイズ (byte)
+};
+
+struct EvictionChange
+{
+    uint64_t id;
+    uint32_t priority;
+};
+
+class IEvictionPolicy
+{
+public:
+    virtual ~IEvictionPolicy() {}
+    virtual uint32_t getPriority(const EvictionResource &res, const EvictionState &state)=0;
+};
+
+// 最後に使われてからのフレーム数で決める方針。
+// 使用量が budget*pressure を超えている間だけ、長く使われていないものを下げ、直近使われたものを上げます。
+// 超えていなければ全て EVICTION_PRIORITY_NORMAL に戻します
+class LRUEvictionPolicy : public IEvictionPolicy
+{
+public:
+    LRUEvictionPolicy();
+
+    void setPressureRatio(double v)     { m_pressure = v; }
+    /// これ以上使われていなければ EVICTION_PRIORITY_MINIMUM、その 1/4 以上なら EVICTION_PRIORITY_LOW
+    void setColdFrames(uint64_t v)      { m_cold_frames = v; }
+    /// これ以内に使われていれば EVICTION_PRIORITY_HIGH
+    void setHotFrames(uint64_t v)       { m_hot_frames = v; }
+
+    virtual uint32_t getPriority(const EvictionResource &res, const EvictionState &state);
+
+private:
+    double m_pressure;
+    uint64_t m_cold_frames;
+    uint64_t m_hot_frames;
+};
+
+/// 最後に使われた (一度も使われていなければ作成された) フレームからの経過フレーム数
+uint64_t GetIdleFrames(const EvictionResource &res, uint64_t frame);
+
+/// priority を変えるべきリソースを、サイズの大きい順に最大 max_changes 個 out に格納します。戻り値は変えるべきリソースの総数です
+size_t PlanEvictionPriorities(const std::vector<EvictionResource> &resources, const EvictionState &state,
+    IEvictionPolicy &policy, size_t max_changes, std::vector<EvictionChange> &out);
+
+
+// 使用状況のトレース。テキストで、優先度を見直すたびに以下を出力します
+//   frame <frame> <budget> <usage>
+//   r <id> <bytes> <create_frame> <last_used_frame> <use_count>   (リソースの数だけ)
+struct EvictionSnapshot
+{
+    EvictionState state;
+    std::vector<EvictionResource> resources; // priority は EVICTION_PRIORITY_NORMAL
+};
+
+class EvictionTraceWriter
+{
+public:
+    EvictionTraceWriter();
+    ~EvictionTraceWriter();
+
+    bool open(const char *path);
+    void close();
+    bool isOpened() const { return m_file!=NULL; }
+    void write(const EvictionState &state, const std::vector<EvictionResource> &resources);
+
+private:
+    EvictionTraceWriter(const EvictionTraceWriter&);
+    EvictionTraceWriter& operator=(const EvictionTraceWriter&);
+
+    FILE *m_file;
+};
+
+bool ReadEvictionTrace(const char *path, std::vector<EvictionSnapshot> &out);
+
+#endif // _ist_D3DHookInterface_Utilities_EvictionPolicy_h_
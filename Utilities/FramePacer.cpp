@@ -0,0 +1,97 @@
+﻿#include <string.h>
+#include <algorithm>
+#include "FramePacer.h"
+
+
+FramePacer::FramePacer(IFrameClock *clock)
+    : m_clock(clock)
+    , m_mode(FRAME_PACER_PASS_THROUGH)
+    , m_target(0.0)
+    , m_spin_threshold(2.0)
+    , m_margin(1.0)
+    , m_frame_started(false)
+    , m_frame_start(0.0)
+    , m_has_deadline(false)
+    , m_deadline(0.0)
+    , m_num_costs(0)
+    , m_present_wait(0.0)
+    , m_start_wait(0.0)
+    , m_missed(0)
+{
+    memset(m_costs, 0, sizeof(m_costs));
+}
+
+void FramePacer::setMode(FRAME_PACER_MODE mode)
+{
+    m_mode = mode;
+    m_has_deadline = false;
+}
+
+void FramePacer::setTargetFrameTime(double ms)  { m_target = ms; m_has_deadline = false; }
+void FramePacer::setSpinThreshold(double ms)    { m_spin_threshold = ms; }
+void FramePacer::setSafetyMargin(double ms)     { m_margin = ms; }
+
+double FramePacer::getPredictedCost() const
+{
+    size_t n = std::min<size_t>(m_num_costs, FRAME_PACER_HISTORY);
+    double r = 0.0;
+    for(size_t i=0; i<n; ++i) { r = std::max<double>(r, m_costs[i]); }
+    return r;
+}
+
+// 残りが m_spin_threshold を超える間は sleep し、それ以下になったら spin します。待った時間を返します
+double FramePacer::waitUntil(double t)
+{
+    double begin = m_clock->now();
+    double now = begin;
+    while(now < t) {
+        double remain = t-now;
+        if(remain > m_spin_threshold) {
+            m_clock->sleep(remain-m_spin_threshold);
+        }
+        else {
+            m_clock->spin();
+        }
+        now = m_clock->now();
+    }
+    return now-begin;
+}
+
+void FramePacer::beforePresent()
+{
+    m_present_wait = 0.0;
+    double now = m_clock->now();
+    if(m_frame_started) {
+        m_costs[m_num_costs++ % FRAME_PACER_HISTORY] = now-m_frame_start;
+    }
+    if(m_mode==FRAME_PACER_PASS_THROUGH || m_target<=0.0) { return; }
+
+    if(!m_has_deadline) {
+        m_deadline = now;
+        m_has_deadline = true;
+    }
+    else if(now > m_deadline+m_target) {
+        // 1 フレーム以上遅れたら、取り戻そうとせず今から数え直す
+        ++m_missed;
+        m_deadline = now;
+    }
+    else {
+        if(now > m_deadline) { ++m_missed; }
+        m_present_wait = waitUntil(m_deadline);
+    }
+}
+
+void FramePacer::afterPresent()
+{
+    m_start_wait = 0.0;
+    if(m_mode!=FRAME_PACER_PASS_THROUGH && m_target>0.0 && m_has_deadline) {
+        m_deadline += m_target;
+        if(m_mode==FRAME_PACER_LOW_LATENCY && m_num_costs>0) {
+            // 次の Present() の予定時刻に、予測したコスト分だけ前倒しして間に合うように開始する
+            // (まだコストを測っていなければ待たない)
+            m_start_wait = waitUntil(m_deadline-getPredictedCost()-m_margin);
+        }
+    }
+    m_frame_start = m_clock->now();
+    m_frame_started = true;
+}
@@ -0,0 +1,86 @@
+﻿#ifndef _ist_D3DHookInterface_Utilities_FramePacer_h_
+#define _ist_D3DHookInterface_Utilities_FramePacer_h_
+
+#include <stddef.h>
+
+// Present() のタイミングを調整するロジック。時刻の取得と待機は IFrameClock 経由で行うので、
+// OS や D3D に依存せず、偽の clock を渡せば任意の環境で動作を確かめられます。
+
+
+#ifndef FRAME_PACER_HISTORY
+#define FRAME_PACER_HISTORY 8
+#endif
+
+/// 時刻はミリ秒
+class IFrameClock
+{
+public:
+    virtual ~IFrameClock() {}
+    virtual double now()=0;
+    /// 少なくとも ms ミリ秒スリープします。実際にはそれより長くなることがあります
+    virtual void sleep(double ms)=0;
+    /// spin wait の 1 回分。何もしなくてもよい
+    virtual void spin() {}
+};
+
+enum FRAME_PACER_MODE {
+    // 何もしない
+    FRAME_PACER_PASS_THROUGH,
+    // Present() を目標のフレーム時間ごとに呼ぶ
+    FRAME_PACER_FIXED_RATE,
+    // FRAME_PACER_FIXED_RATE に加え、Present() 後に直近のフレームの描画コマンド発行にかかった時間から逆算して、
+    // 次のフレームの開始をできるだけ遅らせる。入力から Present() までの遅延が減ります
+    FRAME_PACER_LOW_LATENCY,
+};
+
+class FramePacer
+{
+public:
+    explicit FramePacer(IFrameClock *clock);
+
+    void setMode(FRAME_PACER_MODE mode);
+    /// 目標のフレーム時間 (ミリ秒)。0 以下なら待機しません
+    void setTargetFrameTime(double ms);
+    /// 待ち時間の残りがこれ以下になったら sleep をやめて spin します
+    void setSpinThreshold(double ms);
+    /// FRAME_PACER_LOW_LATENCY で、予測したコストに足す余裕
+    void setSafetyMargin(double ms);
+
+    FRAME_PACER_MODE getMode() const    { return m_mode; }
+    double getTargetFrameTime() const   { return m_target; }
+
+    /// Present() の直前に呼びます
+    void beforePresent();
+    /// Present() の直後に呼びます
+    void afterPresent();
+
+    /// 直近 FRAME_PACER_HISTORY フレームの、フレーム開始から beforePresent() までの時間の最大値
+    double getPredictedCost() const;
+    double getLastCost() const          { return m_costs[(m_num_costs+FRAME_PACER_HISTORY-1) % FRAME_PACER_HISTORY]; }
+    /// 直前の beforePresent() / afterPresent() で待った時間
+    double getLastPresentWait() const   { return m_present_wait; }
+    double getLastStartWait() const     { return m_start_wait; }
+    /// Present() が予定に間に合わなかった回数
+    size_t getMissedDeadlines() const   { return m_missed; }
+
+private:
+    double waitUntil(double t);
+
+    IFrameClock *m_clock;
+    FRAME_PACER_MODE m_mode;
+    double m_target;
+    double m_spin_threshold;
+    double m_margin;
+
+    bool m_frame_started;   // afterPresent() を一度でも呼んだ
+    double m_frame_start;   // 前回の afterPresent() から戻った時刻
+    bool m_has_deadline;    // false なら次の beforePresent() で予定を決め直す
+    double m_deadline;      // 次に Present() する予定の時刻
+    double m_costs[FRAME_PACER_HISTORY];
+    size_t m_num_costs;
+    double m_present_wait;
+    double m_start_wait;
+    size_t m_missed;
+};
+
+#endif // _ist_D3DHookInterface_Utilities_FramePacer_h_
@@ -0,0 +1,253 @@
+﻿#include <algorithm>
+#include "GpuProfiler.h"
+
+
+GpuProfiler::GpuProfiler(IGpuQueryContext *ctx, size_t frame_latency, size_t initial_queries, size_t max_queries)
+    : m_ctx(ctx)
+    , m_max_queries(max_queries)
+    , m_frame(0)
+    , m_slots(std::max<size_t>(frame_latency, 1))
+    , m_current(0)
+    , m_num_queries(0)
+    , m_auto_pass(-1)
+    , m_last_frame(0)
+    , m_last_frame_time(0.0)
+    , m_skipped_frames(0)
+    , m_disjoint_frames(0)
+    , m_dropped_regions(0)
+{
+    for(size_t i=0; i<m_slots.size(); ++i) {
+        FrameSlot &slot = m_slots[i];
+        slot.disjoint = m_ctx->createDisjoint();
+        slot.frame_begin = slot.frame_end = NULL;
+        slot.frame = 0;
+        slot.active = slot.pending = false;
+    }
+    for(size_t i=0; i<initial_queries && m_num_queries<m_max_queries; ++i) {
+        GpuQuery q = m_ctx->createTimestamp();
+        if(q==NULL) { break; }
+        m_free_queries.push_back(q);
+        ++m_num_queries;
+    }
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    endFrame();
+    for(size_t i=0; i<m_slots.size(); ++i) {
+        FrameSlot &slot = m_slots[i];
+        releaseSlotQueries(slot);
+        if(slot.disjoint!=NULL) { m_ctx->releaseQuery(slot.disjoint); }
+    }
+    for(size_t i=0; i<m_free_queries.size(); ++i) {
+        m_ctx->releaseQuery(m_free_queries[i]);
+    }
+}
+
+// timestamp query をプールから取り出します。プールが空なら m_max_queries まで作ります
+GpuQuery GpuProfiler::acquireTimestamp()
+{
+    if(!m_free_queries.empty()) {
+        GpuQuery q = m_free_queries.back();
+        m_free_queries.pop_back();
+        return q;
+    }
+    if(m_num_queries>=m_max_queries) { return NULL; }
+    GpuQuery q = m_ctx->createTimestamp();
+    if(q!=NULL) { ++m_num_queries; }
+    return q;
+}
+
+void GpuProfiler::releaseTimestamp(GpuQuery q)
+{
+    if(q!=NULL) { m_free_queries.push_back(q); }
+}
+
+void GpuProfiler::releaseSlotQueries(FrameSlot &slot)
+{
+    for(size_t i=0; i<slot.regions.size(); ++i) {
+        releaseTimestamp(slot.regions[i].begin);
+        releaseTimestamp(slot.regions[i].end);
+    }
+    slot.regions.clear();
+    releaseTimestamp(slot.frame_begin);
+    releaseTimestamp(slot.frame_end);
+    slot.frame_begin = slot.frame_end = NULL;
+}
+
+// 区間を開き、regions の index を返します。query が足りなければ -1
+int GpuProfiler::openRegion(const char *name, int depth, bool user_region)
+{
+    FrameSlot &slot = m_slots[m_current];
+    if(!slot.active) { return -1; }
+    GpuQuery q = acquireTimestamp();
+    if(q==NULL) {
+        ++m_dropped_regions;
+        return -1;
+    }
+    m_ctx->end(q);
+
+    Region r;
+    r.name = name!=NULL ? name : "";
+    r.begin = q;
+    r.end = NULL;
+    r.depth = depth;
+    r.user_region = user_region;
+    slot.regions.push_back(r);
+    return int(slot.regions.size())-1;
+}
+
+void GpuProfiler::closeRegion(int index)
+{
+    FrameSlot &slot = m_slots[m_current];
+    if(!slot.active || index<0 || index>=int(slot.regions.size())) { return; }
+    Region &r = slot.regions[index];
+    if(r.end!=NULL) { return; }
+    r.end = acquireTimestamp();
+    if(r.end==NULL) {
+        ++m_dropped_regions;
+        return;
+    }
+    m_ctx->end(r.end);
+}
+
+void GpuProfiler::beginPass(const char *name)
+{
+    closeRegion(m_auto_pass);
+    m_auto_pass = openRegion(name, 0, false);
+}
+
+void GpuProfiler::beginRegion(const char *name)
+{
+    // query が足りず開けなかった区間も、endRegion() と対応を取るために積んでおく
+    m_open_regions.push_back(openRegion(name, int(m_open_regions.size())+1, true));
+}
+
+void GpuProfiler::endRegion()
+{
+    if(m_open_regions.empty()) { return; }
+    closeRegion(m_open_regions.back());
+    m_open_regions.pop_back();
+}
+
+void GpuProfiler::beginFrame()
+{
+    FrameSlot &slot = m_slots[m_current];
+    m_open_regions.clear();
+    m_auto_pass = -1;
+    slot.frame = m_frame;
+    slot.frame_begin = acquireTimestamp();
+    slot.frame_end = acquireTimestamp();
+    if(slot.disjoint==NULL || slot.frame_begin==NULL || slot.frame_end==NULL) {
+        releaseSlotQueries(slot);
+        ++m_skipped_frames;
+        return;
+    }
+    m_ctx->begin(slot.disjoint);
+    m_ctx->end(slot.frame_begin);
+    slot.active = true;
+}
+
+void GpuProfiler::endFrame()
+{
+    FrameSlot &slot = m_slots[m_current];
+    if(!slot.active) { return; }
+    closeRegion(m_auto_pass);
+    while(!m_open_regions.empty()) {
+        closeRegion(m_open_regions.back());
+        m_open_regions.pop_back();
+    }
+    m_ctx->end(slot.frame_end);
+    m_ctx->end(slot.disjoint);
+    slot.active = false;
+    slot.pending = true;
+}
+
+inline double TicksToMS(uint64_t begin, uint64_t end, uint64_t frequency)
+{
+    return end>begin && frequency>0 ? double(end-begin)*1000.0/double(frequency) : 0.0;
+}
+
+// 結果が揃っていれば回収してプールに query を戻します。まだなら false を返し、何もしません
+bool GpuProfiler::collectFrame(FrameSlot &slot)
+{
+    uint64_t frequency;
+    bool disjoint;
+    if(!m_ctx->getDisjoint(slot.disjoint, frequency, disjoint)) {
+        return false;
+    }
+
+    uint64_t frame_begin, frame_end;
+    if(!m_ctx->getTimestamp(slot.frame_begin, frame_begin) || !m_ctx->getTimestamp(slot.frame_end, frame_end)) {
+        return false;
+    }
+    std::vector<uint64_t> times(slot.regions.size()*2, 0);
+    for(size_t i=0; i<slot.regions.size(); ++i) {
+        const Region &r = slot.regions[i];
+        if(!m_ctx->getTimestamp(r.begin, times[i*2])) { return false; }
+        if(r.end!=NULL && !m_ctx->getTimestamp(r.end, times[i*2+1])) { return false; }
+    }
+
+    if(disjoint) {
+        ++m_disjoint_frames;
+    }
+    else {
+        m_last_frame = slot.frame;
+        m_last_frame_time = TicksToMS(frame_begin, frame_end, frequency);
+        m_last_results.clear();
+        for(size_t i=0; i<slot.regions.size(); ++i) {
+            const Region &r = slot.regions[i];
+            if(r.end==NULL) { continue; }
+            GpuProfilerResult result;
+            result.name = r.name;
+            result.time = TicksToMS(times[i*2], times[i*2+1], frequency);
+            result.depth = r.depth;
+            result.user_region = r.user_region;
+            m_last_results.push_back(result);
+
+            GpuProfilerRegionStats &rs = m_region_stats[r.name];
+            rs.total += result.time;
+            rs.max = std::max<double>(rs.max, result.time);
+            ++rs.count;
+        }
+    }
+
+    releaseSlotQueries(slot);
+    slot.pending = false;
+    return true;
+}
+
+// 回収待ちのフレームを古い順に回収します。m_current が次に使う (= 最も古い) slot です
+void GpuProfiler::collectFrames()
+{
+    for(size_t i=0; i<m_slots.size(); ++i) {
+        FrameSlot &slot = m_slots[(m_current+i) % m_slots.size()];
+        if(slot.pending && !collectFrame(slot)) { break; }
+    }
+}
+
+void GpuProfiler::start()
+{
+    beginFrame();
+}
+
+void GpuProfiler::beforePresent()
+{
+    endFrame();
+}
+
+void GpuProfiler::afterPresent()
+{
+    ++m_frame;
+    m_current = (m_current+1) % m_slots.size();
+    collectFrames();
+    // 回収が追いついていなければ、このフレームは計測しない
+    if(m_slots[m_current].pending) {
+        ++m_skipped_frames;
+        m_open_regions.clear();
+        m_auto_pass = -1;
+    }
+    else {
+        beginFrame();
+    }
+}
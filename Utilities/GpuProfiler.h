@@ -0,0 +1,137 @@
+﻿#ifndef _ist_D3DHookInterface_Utilities_GpuProfiler_h_
+#define _ist_D3DHookInterface_Utilities_GpuProfiler_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// D3D11GpuProfiler の、timestamp query のプールとフレームごとの slot、結果の回収を行うロジック。
+// query の作成・発行・結果の取得は IGpuQueryContext 経由で行うので、D3D に依存せず、
+// 結果を偽装した context を渡せば任意の環境で動作を確かめられます。
+
+
+typedef void* GpuQuery;
+
+class IGpuQueryContext
+{
+public:
+    virtual ~IGpuQueryContext() {}
+    /// 作れなければ NULL
+    virtual GpuQuery createTimestamp()=0;
+    virtual GpuQuery createDisjoint()=0;
+    virtual void releaseQuery(GpuQuery q)=0;
+    virtual void begin(GpuQuery q)=0;
+    virtual void end(GpuQuery q)=0;
+    /// 待たずに (D3D11_ASYNC_GETDATA_DONOTFLUSH) 結果を取得します。まだ出ていなければ false
+    virtual bool getTimestamp(GpuQuery q, uint64_t &out)=0;
+    virtual bool getDisjoint(GpuQuery q, uint64_t &out_frequency, bool &out_disjoint)=0;
+};
+
+struct GpuProfilerResult
+{
+    std::string name;
+    double time;        // GPU 時間 (ミリ秒)
+    int depth;          // beginRegion() の入れ子の深さ。自動のパスは 0
+    bool user_region;   // beginRegion() による区間なら true
+};
+
+struct GpuProfilerRegionStats
+{
+    double total;
+    double max;
+    size_t count;
+
+    GpuProfilerRegionStats() : total(0.0), max(0.0), count(0) {}
+};
+
+class GpuProfiler
+{
+public:
+    typedef std::map<std::string, GpuProfilerRegionStats> RegionStatsTable;
+
+    /// frame_latency 個の slot を順に使い、その間に結果を回収します。
+    /// timestamp query は initial_queries 個作っておき、足りなければ max_queries 個まで作り足します
+    GpuProfiler(IGpuQueryContext *ctx, size_t frame_latency, size_t initial_queries, size_t max_queries);
+    /// 計測中のフレームを閉じ、すべての query を解放します
+    ~GpuProfiler();
+
+    /// 最初のフレームの計測を始めます
+    void start();
+    /// 前の自動のパスを閉じ、新しいパスを開きます
+    void beginPass(const char *name);
+    void beginRegion(const char *name);
+    void endRegion();
+    /// Present() の直前に呼びます。計測中のフレームを閉じます
+    void beforePresent();
+    /// Present() の直後に呼びます。結果の出たフレームを回収し、次のフレームの計測を始めます。
+    /// 次に使う slot がまだ回収待ちなら、そのフレームは計測しません
+    void afterPresent();
+
+    /// 結果が出ている最新のフレーム
+    size_t getLastFrame() const                             { return m_last_frame; }
+    double getLastFrameTime() const                         { return m_last_frame_time; }
+    /// 結果が出ている最新のフレームの区間。発行順
+    const std::vector<GpuProfilerResult>& getLastResults() const { return m_last_results; }
+    /// 名前ごとの集計
+    const RegionStatsTable& getRegionStats() const          { return m_region_stats; }
+    size_t getNumQueries() const                            { return m_num_queries; }
+    size_t getSkippedFrames() const                         { return m_skipped_frames; }
+    size_t getDisjointFrames() const                        { return m_disjoint_frames; }
+    size_t getDroppedRegions() const                        { return m_dropped_regions; }
+
+private:
+    // 計測中の区間
+    struct Region
+    {
+        std::string name;
+        GpuQuery begin;
+        GpuQuery end;   // 区間が閉じられるまで NULL
+        int depth;
+        bool user_region;
+    };
+
+    // 1 フレーム分の query
+    struct FrameSlot
+    {
+        GpuQuery disjoint;
+        GpuQuery frame_begin;
+        GpuQuery frame_end;
+        std::vector<Region> regions;
+        size_t frame;
+        bool active;    // 計測中
+        bool pending;   // 計測を終え、結果の回収待ち
+    };
+
+    GpuQuery acquireTimestamp();
+    void releaseTimestamp(GpuQuery q);
+    void releaseSlotQueries(FrameSlot &slot);
+    int openRegion(const char *name, int depth, bool user_region);
+    void closeRegion(int index);
+    void beginFrame();
+    void endFrame();
+    bool collectFrame(FrameSlot &slot);
+    void collectFrames();
+
+    IGpuQueryContext *m_ctx;
+    size_t m_max_queries;
+    size_t m_frame;
+    std::vector<FrameSlot> m_slots;
+    size_t m_current;
+    std::vector<GpuQuery> m_free_queries;
+    size_t m_num_queries;
+    std::vector<int> m_open_regions;    // beginRegion() で開いている区間 (regions の index。開けなかったものは -1)
+    int m_auto_pass;                    // 開いている自動のパス (regions の index)
+
+    std::vector<GpuProfilerResult> m_last_results;
+    size_t m_last_frame;
+    double m_last_frame_time;
+    RegionStatsTable m_region_stats;
+
+    size_t m_skipped_frames;
+    size_t m_disjoint_frames;
+    size_t m_dropped_regions;
+};
+
+#endif // _ist_D3DHookInterface_Utilities_GpuProfiler_h_
@@ -0,0 +1,87 @@
+﻿#ifndef _ist_D3DHookInterface_Utilities_Hash_h_
+#define _ist_D3DHookInterface_Utilities_Hash_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2) || defined(__SSE2__)
+#define IST_HASH_SSE2
+#include <emmintrin.h>
+#endif
+
+const uint64_t c_hash_seed = 0xcbf29ce484222325ULL;
+
+/// 64bit 値を 1 つ混ぜ込みます
+inline uint64_t HashCombine(uint64_t h, uint64_t v)
+{
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h<<6) + (h>>2);
+    return h;
+}
+
+/// 64bit FNV-1a。小さい desc 構造体などのハッシュ用です
+inline uint64_t HashBytes(const void *data, size_t size, uint64_t h=c_hash_seed)
+{
+    const unsigned char *p = (const unsigned char*)data;
+    for(size_t i=0; i<size; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/// シェーダのバイトコードのような大きめのデータ用のハッシュ。
+/// 32 byte ずつ、64bit 単位の 4 レーンそれぞれで (v ^ secret) の上位 32bit と下位 32bit の積と v を足し込みます。
+/// 足し込む前に acc を回転し、secret もストライプごとに進めるので、ストライプを入れ替えると結果が変わります。
+/// SSE2 が使える場合は 2 レーンずつまとめて処理します。SSE2 の有無で結果は変わりません。
+inline uint64_t HashBytesFast(const void *data, size_t size, uint64_t h=c_hash_seed)
+{
+    static const uint64_t c_secret[4] = {
+        0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+    };
+    static const uint64_t c_step[2] = { 0x9e3779b97f4a7c15ULL, 0x9e3779b97f4a7c15ULL };
+    const unsigned char *p = (const unsigned char*)data;
+    size_t num_stripes = size/32;
+    uint64_t acc[4] = { h, ~h, h^c_secret[0], h^c_secret[1] };
+
+#ifdef IST_HASH_SSE2
+    __m128i acc0 = _mm_loadu_si128((const __m128i*)&acc[0]);
+    __m128i acc1 = _mm_loadu_si128((const __m128i*)&acc[2]);
+    __m128i secret0 = _mm_loadu_si128((const __m128i*)&c_secret[0]);
+    __m128i secret1 = _mm_loadu_si128((const __m128i*)&c_secret[2]);
+    const __m128i step = _mm_loadu_si128((const __m128i*)c_step);
+    for(size_t i=0; i<num_stripes; ++i, p+=32) {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)p);
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(p+16));
+        __m128i k0 = _mm_xor_si128(v0, secret0);
+        __m128i k1 = _mm_xor_si128(v1, secret1);
+        acc0 = _mm_or_si128(_mm_slli_epi64(acc0, 17), _mm_srli_epi64(acc0, 47));
+        acc1 = _mm_or_si128(_mm_slli_epi64(acc1, 17), _mm_srli_epi64(acc1, 47));
+        acc0 = _mm_add_epi64(acc0, _mm_add_epi64(_mm_mul_epu32(k0, _mm_srli_epi64(k0, 32)), v0));
+        acc1 = _mm_add_epi64(acc1, _mm_add_epi64(_mm_mul_epu32(k1, _mm_srli_epi64(k1, 32)), v1));
+        secret0 = _mm_add_epi64(secret0, step);
+        secret1 = _mm_add_epi64(secret1, step);
+    }
+    _mm_storeu_si128((__m128i*)&acc[0], acc0);
+    _mm_storeu_si128((__m128i*)&acc[2], acc1);
+#else
+    uint64_t secret[4] = { c_secret[0], c_secret[1], c_secret[2], c_secret[3] };
+    for(size_t i=0; i<num_stripes; ++i, p+=32) {
+        for(size_t l=0; l<4; ++l) {
+            uint64_t v;
+            memcpy(&v, p+l*8, sizeof(v));
+            uint64_t k = v ^ secret[l];
+            acc[l] = (acc[l]<<17) | (acc[l]>>47);
+            acc[l] += (k & 0xffffffffULL) * (k >> 32) + v;
+            secret[l] += c_step[0];
+        }
+    }
+#endif
+
+    for(size_t l=0; l<4; ++l) {
+        h = HashCombine(h, acc[l]);
+    }
+    h = HashBytes(p, size%32, h);
+    return HashCombine(h, size);
+}
+
+#endif // _ist_D3DHookInterface_Utilities_Hash_h_
@@ -0,0 +1,35 @@
+﻿#ifndef _ist_D3DHookInterface_Utilities_Lock_h_
+#define _ist_D3DHookInterface_Utilities_Lock_h_
+
+#include <windows.h>
+
+/// CRITICAL_SECTION の薄い wrapper。同じスレッドからの再入は可能です。
+class Mutex
+{
+public:
+    Mutex()         { ::InitializeCriticalSection(&m_cs); }
+    ~Mutex()        { ::DeleteCriticalSection(&m_cs); }
+    void lock()     { ::EnterCriticalSection(&m_cs); }
+    void unlock()   { ::LeaveCriticalSection(&m_cs); }
+
+private:
+    Mutex(const Mutex&);
+    Mutex& operator=(const Mutex&);
+
+    CRITICAL_SECTION m_cs;
+};
+
+class ScopedLock
+{
+public:
+    explicit ScopedLock(Mutex &m) : m_mutex(m) { m_mutex.lock(); }
+    ~ScopedLock() { m_mutex.unlock(); }
+
+private:
+    ScopedLock(const ScopedLock&);
+    ScopedLock& operator=(const ScopedLock&);
+
+    Mutex &m_mutex;
+};
+
+#endif // _ist_D3DHookInterface_Utilities_Lock_h_
@@ -1,4 +1,178 @@
 ﻿#include "Module.h"
+#include <winternl.h>
+
+namespace {
+
+// LdrRegisterDllNotification() 関連の定義は SDK のヘッダにないのでここで定義
+struct LdrDllNotificationData
+{
+    ULONG Flags;
+    const UNICODE_STRING *FullDllName;
+    const UNICODE_STRING *BaseDllName;
+    PVOID DllBase;
+    ULONG SizeOfImage;
+};
+const ULONG c_ldr_dll_notification_reason_loaded = 1;
+const ULONG c_ldr_dll_notification_reason_unloaded = 2;
+
+typedef VOID (CALLBACK *LdrDllNotificationFunction)(ULONG reason, const LdrDllNotificationData *data, PVOID context);
+typedef NTSTATUS (NTAPI *LdrRegisterDllNotificationT)(ULONG flags, LdrDllNotificationFunction func, PVOID context, PVOID *cookie);
+typedef NTSTATUS (NTAPI *LdrUnregisterDllNotificationT)(PVOID cookie);
+
+VOID CALLBACK OnDllNotification(ULONG reason, const LdrDllNotificationData *data, PVOID context)
+{
+    ModuleIndex *index = (ModuleIndex*)context;
+    if(reason==c_ldr_dll_notification_reason_loaded) {
+        std::wstring name(data->BaseDllName->Buffer, data->BaseDllName->Length/sizeof(WCHAR));
+        index->addModule(data->DllBase, data->SizeOfImage, name.c_str());
+    }
+    else if(reason==c_ldr_dll_notification_reason_unloaded) {
+        index->removeModule(data->DllBase);
+    }
+}
+
+// コールスタックから取り除くモジュール
+const wchar_t *g_default_callstack_filters[] = {
+    // D3D runtime
+    L"d3d11.dll",
+    L"d3d10warp.dll",
+    L"dxgi.dll",
+    // NVIDIA
+    L"nvwgf2um",
+    // AMD
+    L"aticfx",
+    L"atidxx",
+    L"amdxx",
+    // Intel
+    L"igd10",
+    L"igdumd",
+    // スレッドの開始部分 (BaseThreadInitThunk, RtlUserThreadStart)
+    L"kernel32.dll",
+    L"kernelbase.dll",
+    L"ntdll.dll",
+};
+
+} // namespace
+
+
+ModuleIndex& ModuleIndex::getInstance()
+{
+    static ModuleIndex s_instance;
+    return s_instance;
+}
+
+ModuleIndex::ModuleIndex()
+    : m_notification_cookie(NULL)
+{
+    ::InitializeCriticalSection(&m_cs);
+    m_callstack_filters.assign(g_default_callstack_filters, g_default_callstack_filters+_countof(g_default_callstack_filters));
+
+    // hook ライブラリ自体が dll になっている場合、そのモジュールも取り除く
+    // (exe に static link されている場合はアプリのコードと区別できないので対象外)
+    HMODULE self = NULL;
+    if(::GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS|GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, (LPCWSTR)&ModuleIndex::getInstance, &self) &&
+        self!=::GetModuleHandleW(NULL))
+    {
+        WCHAR path[MAX_PATH];
+        DWORD len = ::GetModuleFileNameW(self, path, _countof(path));
+        const WCHAR *name = path;
+        for(DWORD i=0; i<len; ++i) {
+            if(path[i]==L'\\' || path[i]==L'/') { name = path+i+1; }
+        }
+        m_callstack_filters.push_back(name);
+    }
+
+    refresh();
+
+    // Vista 以降でのみ使用可能。使えない場合は refresh() を呼ばない限り更新されない
+    HMODULE ntdll = ::GetModuleHandleA("ntdll.dll");
+    LdrRegisterDllNotificationT reg = (LdrRegisterDllNotificationT)::GetProcAddress(ntdll, "LdrRegisterDllNotification");
+    if(reg!=NULL) {
+        reg(0, &OnDllNotification, this, &m_notification_cookie);
+    }
+}
+
+ModuleIndex::~ModuleIndex()
+{
+    if(m_notification_cookie!=NULL) {
+        HMODULE ntdll = ::GetModuleHandleA("ntdll.dll");
+        LdrUnregisterDllNotificationT unreg = (LdrUnregisterDllNotificationT)::GetProcAddress(ntdll, "LdrUnregisterDllNotification");
+        if(unreg!=NULL) { unreg(m_notification_cookie); }
+    }
+    ::DeleteCriticalSection(&m_cs);
+}
+
+void ModuleIndex::lock()    { ::EnterCriticalSection(&m_cs); }
+void ModuleIndex::unlock()  { ::LeaveCriticalSection(&m_cs); }
+
+bool ModuleIndex::findModule(const void *address, ModuleRange &out)
+{
+    lock();
+    const ModuleRange *m = m_table.find(address);
+    if(m!=NULL) { out = *m; }
+    unlock();
+    return m!=NULL;
+}
+
+void ModuleIndex::refresh()
+{
+    std::vector<MODULEENTRY32W> modules;
+    GetAllModuleInfo(modules);
+
+    lock();
+    m_table.clear();
+    for(size_t i=0; i<modules.size(); ++i) {
+        ModuleRange m;
+        m.begin = (size_t)modules[i].modBaseAddr;
+        m.end = m.begin + modules[i].modBaseSize;
+        m.name = modules[i].szModule;
+        m.flags = classifyModule(m.name);
+        m_table.insert(m);
+    }
+    unlock();
+}
+
+void ModuleIndex::addModule(void *base, size_t size, const wchar_t *name)
+{
+    ModuleRange m;
+    m.begin = (size_t)base;
+    m.end = m.begin + size;
+    m.name = name;
+    lock();
+    m.flags = classifyModule(m.name);
+    m_table.insert(m);
+    unlock();
+}
+
+void ModuleIndex::addCallstackFilter(const wchar_t *name_prefix)
+{
+    lock();
+    m_callstack_filters.push_back(name_prefix);
+    for(size_t i=0; i<m_table.size(); ++i) {
+        m_table[i].flags = classifyModule(m_table[i].name);
+    }
+    unlock();
+}
+
+int ModuleIndex::classifyModule(const std::wstring &name) const
+{
+    int flags = 0;
+    for(size_t i=0; i<m_callstack_filters.size(); ++i) {
+        if(ModuleNameStartsWith(name.c_str(), m_callstack_filters[i].c_str())) {
+            flags |= MODULE_FLAG_CALLSTACK_FILTERED;
+            break;
+        }
+    }
+    return flags;
+}
+
+void ModuleIndex::removeModule(void *base)
+{
+    lock();
+    m_table.remove(base);
+    unlock();
+}
+
 
 bool GetModuleInfo(MODULEENTRY32W &out_info, WCHAR *lpModuleName, DWORD dwProcessId)
 {
@@ -44,24 +218,34 @@ size_t GetAllModuleInfo(std::vector<MODULEENTRY32W> &out_info, DWORD dwProcessId
 
 bool IsAddressInD3D11DLL(void *address, DWORD dwProcessId)
 {
-    static MODULEENTRY32W s_d3d11dll = {0};
-    if(s_d3d11dll.dwSize==0) {
-        GetModuleInfo(s_d3d11dll, L"d3d11.dll", dwProcessId);
+    if(dwProcessId!=0 && dwProcessId!=::GetCurrentProcessId()) {
+        MODULEENTRY32W d3d11dll = {0};
+        if(!GetModuleInfo(d3d11dll, L"d3d11.dll", dwProcessId)) { return false; }
+        void *range_begin = d3d11dll.modBaseAddr;
+        void *range_end = (char*)range_begin + d3d11dll.modBaseSize;
+        return address >= range_begin && address < range_end;
     }
 
-    void *range_begin = s_d3d11dll.modBaseAddr;
-    void *range_end = (char*)range_begin + s_d3d11dll.modBaseSize;
-    return address >= range_begin && address < range_end;
+    ModuleIndex &index = ModuleIndex::getInstance();
+    index.lock();
+    const ModuleRange *m = index.getTable().find(address);
+    bool r = m!=NULL && ModuleNameEquals(m->name.c_str(), L"d3d11.dll");
+    index.unlock();
+    return r;
 }
 
 bool DetectNvidiaNSight()
 {
-    std::vector<MODULEENTRY32W> modules;
-    GetAllModuleInfo(modules);
-    for(std::vector<MODULEENTRY32W>::iterator i=modules.begin(); i!=modules.end(); ++i) {
-        if(wcsstr(i->szModule, L"Nvda.Graphics.Interception")!=NULL) {
-            return true;
+    ModuleIndex &index = ModuleIndex::getInstance();
+    const ModuleRangeTable &table = index.getTable();
+    bool r = false;
+    index.lock();
+    for(size_t i=0; i<table.size(); ++i) {
+        if(wcsstr(table[i].name.c_str(), L"Nvda.Graphics.Interception")!=NULL) {
+            r = true;
+            break;
         }
     }
-    return false;
+    index.unlock();
+    return r;
 }
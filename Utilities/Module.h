@@ -5,6 +5,7 @@
 #include <TlHelp32.h>
 #include <vector>
 #include <intrin.h>
+#include "ModuleRangeTable.h"
 
 
 /// vtable の取得/設定
@@ -21,6 +22,53 @@ bool GetModuleInfo(MODULEENTRY32W &out_info, WCHAR *lpModuleName, DWORD dwProces
 size_t GetAllModuleInfo(std::vector<MODULEENTRY32W> &out_info, DWORD dwProcessId=0);
 
 
+enum MODULE_FLAG {
+    // FilterCallstack() でコールスタックから取り除くモジュール
+    MODULE_FLAG_CALLSTACK_FILTERED = 1,
+};
+
+/// current process 内のモジュールの索引。
+/// 初回の getInstance() で 1 度だけ全モジュールを列挙し、以降は DLL のロード/アンロード通知
+/// (LdrRegisterDllNotification) で差分だけ更新します。アドレス -> モジュールは二分探索で引けます。
+/// 通知は別スレッドから来るので、getTable() で索引を直接見る場合は lock()/unlock() で囲む必要があります。
+class ModuleIndex
+{
+public:
+    static ModuleIndex& getInstance();
+
+    void lock();
+    void unlock();
+    const ModuleRangeTable& getTable() const { return m_table; }
+
+    /// address を含むモジュールの情報をコピーして返します
+    bool findModule(const void *address, ModuleRange &out);
+    /// 全モジュールを列挙し直します
+    void refresh();
+
+    /// name_prefix で始まる名前のモジュールに MODULE_FLAG_CALLSTACK_FILTERED を付けます。
+    /// デフォルトで D3D11 runtime、主要な GPU ドライバ、スレッド開始部分 (kernel32/ntdll)、
+    /// および hook ライブラリが exe とは別モジュールの場合はそのモジュールが登録されています。
+    void addCallstackFilter(const wchar_t *name_prefix);
+
+    // DLL 通知から呼ばれます
+    void addModule(void *base, size_t size, const wchar_t *name);
+    void removeModule(void *base);
+
+private:
+    ModuleIndex();
+    ~ModuleIndex();
+    ModuleIndex(const ModuleIndex&);
+    ModuleIndex& operator=(const ModuleIndex&);
+
+    int classifyModule(const std::wstring &name) const;
+
+    CRITICAL_SECTION m_cs;
+    ModuleRangeTable m_table;
+    std::vector<std::wstring> m_callstack_filters;
+    void *m_notification_cookie;
+};
+
+
 /// 指定のアドレスが d3d11.dll モジュール内かを調べます
 bool IsAddressInD3D11DLL(void *address, DWORD dwProcessId=0);
 /// return address が d3d11.dll モジュール内なら true を返します
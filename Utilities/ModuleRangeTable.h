@@ -0,0 +1,99 @@
+﻿#ifndef _ist_D3DHookInterface_Utilities_ModuleRangeTable_h_
+#define _ist_D3DHookInterface_Utilities_ModuleRangeTable_h_
+
+#include <stddef.h>
+#include <wctype.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// モジュールのアドレス範囲 [begin, end) をソートした配列で保持し、アドレス -> モジュールを二分探索で引きます。
+// Windows には依存しません。モジュールの列挙や更新は ModuleIndex (Module.h) が行います。
+
+struct ModuleRange
+{
+    size_t begin;
+    size_t end;
+    std::wstring name;  // パスを含まないモジュール名
+    int flags;          // 利用側が自由に使えるフラグ
+
+    ModuleRange() : begin(0), end(0), flags(0) {}
+    bool contains(const void *address) const { return (size_t)address>=begin && (size_t)address<end; }
+};
+
+/// 大文字小文字を区別せずにモジュール名を比較します
+inline bool ModuleNameEquals(const wchar_t *a, const wchar_t *b)
+{
+    for(; *a!=L'\0' && *b!=L'\0'; ++a, ++b) {
+        if(towlower(*a)!=towlower(*b)) { return false; }
+    }
+    return *a==*b;
+}
+
+/// 大文字小文字を区別せずに name が prefix で始まっているかを調べます
+inline bool ModuleNameStartsWith(const wchar_t *name, const wchar_t *prefix)
+{
+    for(; *prefix!=L'\0'; ++name, ++prefix) {
+        if(*name==L'\0' || towlower(*name)!=towlower(*prefix)) { return false; }
+    }
+    return true;
+}
+
+class ModuleRangeTable
+{
+public:
+    const ModuleRange* find(const void *address) const
+    {
+        // begin が address より大きい最初の要素の 1 つ前が候補
+        Ranges::const_iterator i = std::upper_bound(m_ranges.begin(), m_ranges.end(), (size_t)address, LessBegin());
+        if(i==m_ranges.begin()) { return NULL; }
+        --i;
+        return i->contains(address) ? &*i : NULL;
+    }
+
+    const ModuleRange* findByName(const wchar_t *name) const
+    {
+        for(Ranges::const_iterator i=m_ranges.begin(); i!=m_ranges.end(); ++i) {
+            if(ModuleNameEquals(i->name.c_str(), name)) { return &*i; }
+        }
+        return NULL;
+    }
+
+    /// 範囲が重なっている古いモジュールは取り除かれます
+    void insert(const ModuleRange &m)
+    {
+        Ranges::iterator first = std::lower_bound(m_ranges.begin(), m_ranges.end(), m.begin, LessBegin());
+        if(first!=m_ranges.begin() && (first-1)->end > m.begin) { --first; }
+        Ranges::iterator last = first;
+        while(last!=m_ranges.end() && last->begin < m.end) { ++last; }
+        first = m_ranges.erase(first, last);
+        m_ranges.insert(first, m);
+    }
+
+    void remove(const void *base)
+    {
+        Ranges::iterator i = std::lower_bound(m_ranges.begin(), m_ranges.end(), (size_t)base, LessBegin());
+        if(i!=m_ranges.end() && i->begin==(size_t)base) {
+            m_ranges.erase(i);
+        }
+    }
+
+    void clear() { m_ranges.clear(); }
+    size_t size() const { return m_ranges.size(); }
+    const ModuleRange& operator[](size_t i) const { return m_ranges[i]; }
+    ModuleRange& operator[](size_t i) { return m_ranges[i]; }
+
+private:
+    typedef std::vector<ModuleRange> Ranges;
+
+    struct LessBegin
+    {
+        bool operator()(const ModuleRange &a, size_t b) const { return a.begin < b; }
+        bool operator()(size_t a, const ModuleRange &b) const { return a < b.begin; }
+        bool operator()(const ModuleRange &a, const ModuleRange &b) const { return a.begin < b.begin; }
+    };
+
+    Ranges m_ranges;
+};
+
+#endif // _ist_D3DHookInterface_Utilities_ModuleRangeTable_h_
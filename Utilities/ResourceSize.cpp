@@ -0,0 +1,227 @@
+﻿#include "ResourceSize.h"
+#include <algorithm>
+
+namespace {
+
+// 配置アライメントは D3D12 の規則 (通常 64KB、小さいテクスチャ 4KB、MSAA 4MB) を目安にしています。
+// D3D11 でもドライバの実装は概ねこれに近いと思われます。
+const size_t c_buffer_alignment         = 256;
+const size_t c_small_texture_alignment  = 4*1024;
+const size_t c_texture_alignment        = 64*1024;
+const size_t c_msaa_texture_alignment   = 4*1024*1024;
+
+inline size_t AlignTo(size_t v, size_t align) { return (v + align - 1) / align * align; }
+
+size_t GetSubresourceSize(DXGI_FORMAT format, UINT width, UINT height, UINT depth)
+{
+    size_t bpp = GetFormatBitsPerPixel(format);
+    if(IsBlockCompressedFormat(format)) {
+        // 4x4 block 単位
+        size_t bw = (std::max<UINT>(width, 1) + 3) / 4;
+        size_t bh = (std::max<UINT>(height, 1) + 3) / 4;
+        return bw * bh * depth * (bpp * 16 / 8);
+    }
+    return (size_t(width) * height * depth * bpp + 7) / 8;
+}
+
+size_t AlignTextureSize(size_t bytes, UINT bind_flags, D3D11_USAGE usage, UINT sample_count)
+{
+    if(usage==D3D11_USAGE_STAGING) {
+        // staging はシステムメモリ上に置かれるので VRAM を消費しないはずですが、ここではそのまま返します
+        return bytes;
+    }
+    if(sample_count>1) {
+        return AlignTo(bytes, c_msaa_texture_alignment);
+    }
+    if((bind_flags & (D3D11_BIND_RENDER_TARGET|D3D11_BIND_DEPTH_STENCIL))==0 && bytes<=c_texture_alignment) {
+        return AlignTo(bytes, c_small_texture_alignment);
+    }
+    return AlignTo(bytes, c_texture_alignment);
+}
+
+} // namespace
+
+
+UINT GetFormatBitsPerPixel(DXGI_FORMAT format)
+{
+    switch(format) {
+    case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+    case DXGI_FORMAT_R32G32B32A32_FLOAT:
+    case DXGI_FORMAT_R32G32B32A32_UINT:
+    case DXGI_FORMAT_R32G32B32A32_SINT:
+        return 128;
+
+    case DXGI_FORMAT_R32G32B32_TYPELESS:
+    case DXGI_FORMAT_R32G32B32_FLOAT:
+    case DXGI_FORMAT_R32G32B32_UINT:
+    case DXGI_FORMAT_R32G32B32_SINT:
+        return 96;
+
+    case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+    case DXGI_FORMAT_R16G16B16A16_FLOAT:
+    case DXGI_FORMAT_R16G16B16A16_UNORM:
+    case DXGI_FORMAT_R16G16B16A16_UINT:
+    case DXGI_FORMAT_R16G16B16A16_SNORM:
+    case DXGI_FORMAT_R16G16B16A16_SINT:
+    case DXGI_FORMAT_R32G32_TYPELESS:
+    case DXGI_FORMAT_R32G32_FLOAT:
+    case DXGI_FORMAT_R32G32_UINT:
+    case DXGI_FORMAT_R32G32_SINT:
+    case DXGI_FORMAT_R32G8X24_TYPELESS:
+    case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+    case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+    case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+        return 64;
+
+    case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+    case DXGI_FORMAT_R10G10B10A2_UNORM:
+    case DXGI_FORMAT_R10G10B10A2_UINT:
+    case DXGI_FORMAT_R11G11B10_FLOAT:
+    case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_R8G8B8A8_UINT:
+    case DXGI_FORMAT_R8G8B8A8_SNORM:
+    case DXGI_FORMAT_R8G8B8A8_SINT:
+    case DXGI_FORMAT_R16G16_TYPELESS:
+    case DXGI_FORMAT_R16G16_FLOAT:
+    case DXGI_FORMAT_R16G16_UNORM:
+    case DXGI_FORMAT_R16G16_UINT:
+    case DXGI_FORMAT_R16G16_SNORM:
+    case DXGI_FORMAT_R16G16_SINT:
+    case DXGI_FORMAT_R32_TYPELESS:
+    case DXGI_FORMAT_D32_FLOAT:
+    case DXGI_FORMAT_R32_FLOAT:
+    case DXGI_FORMAT_R32_UINT:
+    case DXGI_FORMAT_R32_SINT:
+    case DXGI_FORMAT_R24G8_TYPELESS:
+    case DXGI_FORMAT_D24_UNORM_S8_UINT:
+    case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+    case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+    case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+    case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+        return 32;
+
+    // 2 pixel で 32 bit
+    case DXGI_FORMAT_R8G8_B8G8_UNORM:
+    case DXGI_FORMAT_G8R8_G8B8_UNORM:
+        return 16;
+
+    case DXGI_FORMAT_R8G8_TYPELESS:
+    case DXGI_FORMAT_R8G8_UNORM:
+    case DXGI_FORMAT_R8G8_UINT:
+    case DXGI_FORMAT_R8G8_SNORM:
+    case DXGI_FORMAT_R8G8_SINT:
+    case DXGI_FORMAT_R16_TYPELESS:
+    case DXGI_FORMAT_R16_FLOAT:
+    case DXGI_FORMAT_D16_UNORM:
+    case DXGI_FORMAT_R16_UNORM:
+    case DXGI_FORMAT_R16_UINT:
+    case DXGI_FORMAT_R16_SNORM:
+    case DXGI_FORMAT_R16_SINT:
+    case DXGI_FORMAT_B5G6R5_UNORM:
+    case DXGI_FORMAT_B5G5R5A1_UNORM:
+        return 16;
+
+    case DXGI_FORMAT_R8_TYPELESS:
+    case DXGI_FORMAT_R8_UNORM:
+    case DXGI_FORMAT_R8_UINT:
+    case DXGI_FORMAT_R8_SNORM:
+    case DXGI_FORMAT_R8_SINT:
+    case DXGI_FORMAT_A8_UNORM:
+        return 8;
+
+    case DXGI_FORMAT_R1_UNORM:
+        return 1;
+
+    // block 圧縮: BC1/BC4 は 4x4 block が 64 bit、それ以外は 128 bit
+    case DXGI_FORMAT_BC1_TYPELESS:
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+    case DXGI_FORMAT_BC4_TYPELESS:
+    case DXGI_FORMAT_BC4_UNORM:
+    case DXGI_FORMAT_BC4_SNORM:
+        return 4;
+
+    case DXGI_FORMAT_BC2_TYPELESS:
+    case DXGI_FORMAT_BC2_UNORM:
+    case DXGI_FORMAT_BC2_UNORM_SRGB:
+    case DXGI_FORMAT_BC3_TYPELESS:
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+    case DXGI_FORMAT_BC5_TYPELESS:
+    case DXGI_FORMAT_BC5_UNORM:
+    case DXGI_FORMAT_BC5_SNORM:
+    case DXGI_FORMAT_BC6H_TYPELESS:
+    case DXGI_FORMAT_BC6H_UF16:
+    case DXGI_FORMAT_BC6H_SF16:
+    case DXGI_FORMAT_BC7_TYPELESS:
+    case DXGI_FORMAT_BC7_UNORM:
+    case DXGI_FORMAT_BC7_UNORM_SRGB:
+        return 8;
+
+    default:
+        return 0;
+    }
+}
+
+bool IsBlockCompressedFormat(DXGI_FORMAT format)
+{
+    return (format>=DXGI_FORMAT_BC1_TYPELESS && format<=DXGI_FORMAT_BC5_SNORM) ||
+           (format>=DXGI_FORMAT_BC6H_TYPELESS && format<=DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
+UINT GetMipLevelCount(UINT mip_levels, UINT width, UINT height, UINT depth)
+{
+    if(mip_levels!=0) { return mip_levels; }
+    UINT n = 1;
+    UINT d = std::max<UINT>(std::max<UINT>(width, height), depth);
+    while(d>1) { d/=2; ++n; }
+    return n;
+}
+
+
+size_t EstimateResourceSize(const D3D11_BUFFER_DESC &desc)
+{
+    if(desc.Usage==D3D11_USAGE_STAGING) { return desc.ByteWidth; }
+    return AlignTo(desc.ByteWidth, c_buffer_alignment);
+}
+
+size_t EstimateResourceSize(const D3D11_TEXTURE1D_DESC &desc)
+{
+    UINT mips = GetMipLevelCount(desc.MipLevels, desc.Width);
+    size_t total = 0;
+    for(UINT m=0; m<mips; ++m) {
+        total += GetSubresourceSize(desc.Format, std::max<UINT>(desc.Width>>m, 1), 1, 1);
+    }
+    total *= std::max<UINT>(desc.ArraySize, 1);
+    return AlignTextureSize(total, desc.BindFlags, desc.Usage, 1);
+}
+
+size_t EstimateResourceSize(const D3D11_TEXTURE2D_DESC &desc)
+{
+    UINT mips = GetMipLevelCount(desc.MipLevels, desc.Width, desc.Height);
+    UINT samples = std::max<UINT>(desc.SampleDesc.Count, 1);
+    size_t total = 0;
+    for(UINT m=0; m<mips; ++m) {
+        total += GetSubresourceSize(desc.Format, std::max<UINT>(desc.Width>>m, 1), std::max<UINT>(desc.Height>>m, 1), 1);
+    }
+    total *= std::max<UINT>(desc.ArraySize, 1) * samples;
+    return AlignTextureSize(total, desc.BindFlags, desc.Usage, samples);
+}
+
+size_t EstimateResourceSize(const D3D11_TEXTURE3D_DESC &desc)
+{
+    UINT mips = GetMipLevelCount(desc.MipLevels, desc.Width, desc.Height, desc.Depth);
+    size_t total = 0;
+    for(UINT m=0; m<mips; ++m) {
+        total += GetSubresourceSize(desc.Format, std::max<UINT>(desc.Width>>m, 1), std::max<UINT>(desc.Height>>m, 1), std::max<UINT>(desc.Depth>>m, 1));
+    }
+    return AlignTextureSize(total, desc.BindFlags, desc.Usage, 1);
+}
@@ -0,0 +1,28 @@
+﻿#ifndef _ist_D3DHookInterface_Utilities_ResourceSize_h_
+#define _ist_D3DHookInterface_Utilities_ResourceSize_h_
+
+#include <stddef.h>
+#include "D3D11DescTypes.h"
+
+
+/// DXGI_FORMAT の 1 pixel あたりの bit 数を返します。
+/// block 圧縮フォーマットは 1 block の bit 数を 16 pixel で割った値 (BC1 なら 4) を返します。
+/// 不明なフォーマットの場合 0 を返します。
+UINT GetFormatBitsPerPixel(DXGI_FORMAT format);
+
+/// BC1～BC7 なら true を返します
+bool IsBlockCompressedFormat(DXGI_FORMAT format);
+
+/// MipLevels==0 (full mip chain) を考慮した実際の mip 数を返します
+UINT GetMipLevelCount(UINT mip_levels, UINT width, UINT height=1, UINT depth=1);
+
+
+/// リソースが消費する GPU メモリ量の推定値 (byte) を返します。
+/// フォーマットの bit 数、mip 数、array 数、MSAA の sample 数、bind flag によるアライメントを考慮します。
+/// 実際の配置はドライバ次第なので、あくまで目安として扱ってください。
+size_t EstimateResourceSize(const D3D11_BUFFER_DESC &desc);
+size_t EstimateResourceSize(const D3D11_TEXTURE1D_DESC &desc);
+size_t EstimateResourceSize(const D3D11_TEXTURE2D_DESC &desc);
+size_t EstimateResourceSize(const D3D11_TEXTURE3D_DESC &desc);
+
+#endif // _ist_D3DHookInterface_Utilities_ResourceSize_h_
@@ -0,0 +1,192 @@
+﻿#define _CRT_SECURE_NO_WARNINGS
+#include "SymbolCache.h"
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+const uint32_t c_magic   = 0x43595344; // "DSYC"
+const uint32_t c_version = 1;
+
+inline void WriteU32(FILE *f, uint32_t v) { fwrite(&v, sizeof(v), 1, f); }
+inline void WriteU64(FILE *f, uint64_t v) { fwrite(&v, sizeof(v), 1, f); }
+inline void WriteString(FILE *f, const std::string &v)
+{
+    WriteU32(f, static_cast<uint32_t>(v.size()));
+    fwrite(v.c_str(), 1, v.size(), f);
+}
+
+inline bool ReadU32(FILE *f, uint32_t &v) { return fread(&v, sizeof(v), 1, f)==1; }
+inline bool ReadU64(FILE *f, uint64_t &v) { return fread(&v, sizeof(v), 1, f)==1; }
+inline bool ReadString(FILE *f, std::string &v)
+{
+    uint32_t len;
+    if(!ReadU32(f, len)) { return false; }
+    v.resize(len);
+    return len==0 || fread(&v[0], 1, len, f)==len;
+}
+
+} // namespace
+
+
+SymbolCache::SymbolCache(ISymbolResolver *resolver)
+    : m_resolver(resolver)
+{
+    m_strings.insert(std::string());
+}
+
+void SymbolCache::setResolver(ISymbolResolver *resolver)
+{
+    m_resolver = resolver;
+}
+
+const char* SymbolCache::intern(const std::string &v)
+{
+    return m_strings.insert(v).first->c_str();
+}
+
+SymbolInfo SymbolCache::resolveMiss(void *address)
+{
+    SymbolInfo sym;
+    if(m_resolver==NULL) { return sym; }
+
+    // モジュールが分かれば、モジュール + オフセットの記録から探す
+    SymbolModuleKey key;
+    size_t base = 0;
+    OffsetTable *offsets = NULL;
+    uint64_t rva = 0;
+    if(m_resolver->findModule(address, key, base)) {
+        offsets = &m_modules[key];
+        rva = (uint64_t)((size_t)address - base);
+        OffsetTable::iterator i = offsets->find(rva);
+        if(i!=offsets->end()) {
+            ++m_stats.persistent_hits;
+            return i->second;
+        }
+    }
+
+    ++m_stats.resolves;
+    ResolvedSymbol rs;
+    if(m_resolver->resolve(address, rs)) {
+        sym.module   = intern(rs.module);
+        sym.function = intern(rs.function);
+        sym.file     = intern(rs.file);
+        sym.line     = rs.line;
+        sym.offset   = rs.offset;
+        if(offsets!=NULL) {
+            (*offsets)[rva] = sym;
+        }
+    }
+    return sym;
+}
+
+const SymbolInfo& SymbolCache::resolve(void *address)
+{
+    AddressTable::iterator i = m_addresses.find(address);
+    if(i!=m_addresses.end()) {
+        ++m_stats.hits;
+        return i->second;
+    }
+    SymbolInfo &sym = m_addresses[address];
+    sym = resolveMiss(address);
+    return sym;
+}
+
+void SymbolCache::resolveAddresses(void *const *addresses, size_t num, const SymbolInfo **out_symbols)
+{
+    // キャッシュに無いものを重複なしで集めてから解決
+    std::vector<void*> misses;
+    for(size_t i=0; i<num; ++i) {
+        if(m_addresses.find(addresses[i])==m_addresses.end()) {
+            misses.push_back(addresses[i]);
+        }
+    }
+    std::sort(misses.begin(), misses.end());
+    misses.erase(std::unique(misses.begin(), misses.end()), misses.end());
+    for(size_t i=0; i<misses.size(); ++i) {
+        m_addresses[misses[i]] = resolveMiss(misses[i]);
+    }
+
+    if(out_symbols!=NULL) {
+        for(size_t i=0; i<num; ++i) {
+            out_symbols[i] = &m_addresses[addresses[i]];
+        }
+    }
+}
+
+bool SymbolCache::save(const char *path) const
+{
+    FILE *f = fopen(path, "wb");
+    if(f==NULL) { return false; }
+
+    WriteU32(f, c_magic);
+    WriteU32(f, c_version);
+    WriteU32(f, static_cast<uint32_t>(m_modules.size()));
+    for(ModuleTable::const_iterator m=m_modules.begin(); m!=m_modules.end(); ++m) {
+        WriteString(f, m->first.name);
+        WriteU32(f, m->first.timestamp);
+        WriteU32(f, m->first.checksum);
+        WriteU32(f, static_cast<uint32_t>(m->second.size()));
+        for(OffsetTable::const_iterator i=m->second.begin(); i!=m->second.end(); ++i) {
+            const SymbolInfo &sym = i->second;
+            WriteU64(f, i->first);
+            WriteString(f, sym.module);
+            WriteString(f, sym.function);
+            WriteString(f, sym.file);
+            WriteU32(f, sym.line);
+            WriteU64(f, sym.offset);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+bool SymbolCache::load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if(f==NULL) { return false; }
+
+    // 途中で失敗した場合に m_modules を中途半端にしないよう、全部読めてから反映する
+    ModuleTable modules;
+    uint32_t magic=0, version=0, num_modules=0;
+    bool ok = ReadU32(f, magic) && ReadU32(f, version) && magic==c_magic && version==c_version && ReadU32(f, num_modules);
+    std::string module, function, file;
+    for(uint32_t m=0; ok && m<num_modules; ++m) {
+        SymbolModuleKey key;
+        uint32_t num_symbols = 0;
+        ok = ReadString(f, key.name) && ReadU32(f, key.timestamp) && ReadU32(f, key.checksum) && ReadU32(f, num_symbols);
+        OffsetTable &offsets = modules[key];
+        for(uint32_t i=0; ok && i<num_symbols; ++i) {
+            uint64_t rva;
+            SymbolInfo sym;
+            ok = ReadU64(f, rva) && ReadString(f, module) && ReadString(f, function) && ReadString(f, file) &&
+                 ReadU32(f, sym.line) && ReadU64(f, sym.offset);
+            if(ok) {
+                sym.module   = intern(module);
+                sym.function = intern(function);
+                sym.file     = intern(file);
+                offsets[rva] = sym;
+            }
+        }
+    }
+    fclose(f);
+    if(!ok) { return false; }
+
+    for(ModuleTable::iterator m=modules.begin(); m!=modules.end(); ++m) {
+        OffsetTable &offsets = m_modules[m->first];
+        for(OffsetTable::iterator i=m->second.begin(); i!=m->second.end(); ++i) {
+            offsets[i->first] = i->second;
+        }
+    }
+    return true;
+}
+
+void SymbolCache::clear()
+{
+    m_addresses.clear();
+    m_modules.clear();
+    m_strings.clear();
+    m_strings.insert(std::string());
+    m_stats = Stats();
+}
@@ -0,0 +1,116 @@
+﻿#ifndef _ist_D3DHookInterface_Utilities_SymbolCache_h_
+#define _ist_D3DHookInterface_Utilities_SymbolCache_h_
+
+#include <stdint.h>
+#include <string>
+#include <set>
+#include <map>
+
+// アドレス -> シンボル情報 のキャッシュ。
+// 実際のシンボル解決は ISymbolResolver に任せ、キャッシュに無いアドレスについてのみ呼び出します。
+// Windows には依存しないので、resolver を差し替えればどこでも動作します。
+//
+// シンボル情報はモジュール (名前 + timestamp + checksum) とモジュール先頭からのオフセットでも記録しておき、
+// save()/load() でファイルに保存/復元できます。同じバイナリなら次回以降は resolver を呼ばずに済みます。
+
+
+/// シンボル情報。文字列はキャッシュ内に intern されているので、キャッシュが生きている間は有効です。
+/// 分からない項目は空文字列 / 0 になります。
+struct SymbolInfo
+{
+    const char *module;
+    const char *function;
+    const char *file;
+    uint32_t line;
+    uint64_t offset; // function が分かっていれば関数先頭から、そうでなければモジュール先頭からのオフセット
+
+    SymbolInfo() : module(""), function(""), file(""), line(0), offset(0) {}
+};
+
+struct SymbolModuleKey
+{
+    std::string name;
+    uint32_t timestamp;
+    uint32_t checksum;
+
+    SymbolModuleKey() : timestamp(0), checksum(0) {}
+    bool operator<(const SymbolModuleKey &v) const
+    {
+        if(timestamp!=v.timestamp) { return timestamp<v.timestamp; }
+        if(checksum!=v.checksum) { return checksum<v.checksum; }
+        return name<v.name;
+    }
+};
+
+struct ResolvedSymbol
+{
+    std::string module;
+    std::string function;
+    std::string file;
+    uint32_t line;
+    uint64_t offset;
+
+    ResolvedSymbol() : line(0), offset(0) {}
+};
+
+class ISymbolResolver
+{
+public:
+    virtual ~ISymbolResolver() {}
+
+    /// address を含むモジュールを調べます。不明なら false を返します。
+    virtual bool findModule(void *address, SymbolModuleKey &out_key, size_t &out_base) = 0;
+
+    /// address のシンボル情報を調べます。モジュールすら不明なら false を返します。
+    virtual bool resolve(void *address, ResolvedSymbol &out) = 0;
+};
+
+
+class SymbolCache
+{
+public:
+    struct Stats
+    {
+        size_t hits;            // アドレスのキャッシュにヒット
+        size_t persistent_hits; // モジュール + オフセットの記録 (load() したものを含む) にヒット
+        size_t resolves;        // resolver を呼んだ回数
+
+        Stats() : hits(0), persistent_hits(0), resolves(0) {}
+    };
+
+    explicit SymbolCache(ISymbolResolver *resolver);
+
+    void setResolver(ISymbolResolver *resolver);
+
+    const SymbolInfo& resolve(void *address);
+
+    /// まとめて解決します。重複は 1 回しか解決しません。
+    /// out_symbols を渡した場合、addresses と同じ並びで結果を格納します。
+    void resolveAddresses(void *const *addresses, size_t num, const SymbolInfo **out_symbols=NULL);
+
+    bool save(const char *path) const;
+    bool load(const char *path);
+    void clear();
+
+    const Stats& getStats() const { return m_stats; }
+
+private:
+    SymbolCache(const SymbolCache&);
+    SymbolCache& operator=(const SymbolCache&);
+
+    typedef std::map<void*, SymbolInfo> AddressTable;
+    typedef std::map<uint64_t, SymbolInfo> OffsetTable;
+    typedef std::map<SymbolModuleKey, OffsetTable> ModuleTable;
+    typedef std::set<std::string> StringTable;
+
+    const char* intern(const std::string &v);
+    SymbolInfo resolveMiss(void *address);
+
+    ISymbolResolver *m_resolver;
+    AddressTable m_addresses;
+    ModuleTable m_modules;
+    StringTable m_strings;
+    Stats m_stats;
+};
+
+#endif // _ist_D3DHookInterface_Utilities_SymbolCache_h_
@@ -0,0 +1,26 @@
+﻿#ifndef _ist_D3DHookInterface_Utilities_Timer_h_
+#define _ist_D3DHookInterface_Utilities_Timer_h_
+
+#include <windows.h>
+
+/// QueryPerformanceCounter() の値
+inline LONGLONG GetPerformanceCounter()
+{
+    LARGE_INTEGER v;
+    ::QueryPerformanceCounter(&v);
+    return v.QuadPart;
+}
+
+/// QueryPerformanceCounter() の差分をミリ秒に変換します
+inline double PerformanceCounterToMS(LONGLONG v)
+{
+    static LONGLONG s_freq = 0;
+    if(s_freq==0) {
+        LARGE_INTEGER f;
+        ::QueryPerformanceFrequency(&f);
+        s_freq = f.QuadPart;
+    }
+    return double(v)*1000.0/double(s_freq);
+}
+
+#endif // _ist_D3DHookInterface_Utilities_Timer_h_